@@ -139,6 +139,46 @@ static int valkeyAeAttachAdapter(valkeyAsyncContext *ac, void *loop) {
     return valkeyAeAttach((aeEventLoop *)loop, ac);
 }
 
+/* One-shot timer used by the cluster API. */
+typedef struct valkeyAeTimer {
+    long long id;
+    valkeyTimerCallback *fn;
+    void *privdata;
+} valkeyAeTimer;
+
+static int valkeyAeTimerEvent(aeEventLoop *el, long long id, void *privdata) {
+    ((void)el);
+    ((void)id);
+
+    valkeyAeTimer *t = (valkeyAeTimer *)privdata;
+    t->fn(t, t->privdata);
+    vk_free(t);
+    return AE_NOMORE;
+}
+
+static void *valkeyAeTimerAdapter(void *loop, struct timeval tv,
+                                  valkeyTimerCallback *fn, void *privdata) {
+    long long millisec = tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+    valkeyAeTimer *t = (valkeyAeTimer *)vk_malloc(sizeof(*t));
+    if (t == NULL)
+        return NULL;
+    t->fn = fn;
+    t->privdata = privdata;
+    t->id = aeCreateTimeEvent((aeEventLoop *)loop, millisec,
+                              valkeyAeTimerEvent, t, NULL);
+    if (t->id == AE_ERR) {
+        vk_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+static void valkeyAeTimerCancelAdapter(void *loop, void *timer) {
+    valkeyAeTimer *t = (valkeyAeTimer *)timer;
+    aeDeleteTimeEvent((aeEventLoop *)loop, t->id);
+    vk_free(t);
+}
+
 VALKEY_UNUSED
 static int valkeyClusterOptionsUseAe(valkeyClusterOptions *options,
                                      aeEventLoop *loop) {
@@ -148,6 +188,8 @@ static int valkeyClusterOptionsUseAe(valkeyClusterOptions *options,
 
     options->attach_fn = valkeyAeAttachAdapter;
     options->attach_data = loop;
+    options->timer_fn = valkeyAeTimerAdapter;
+    options->timer_cancel_fn = valkeyAeTimerCancelAdapter;
     return VALKEY_OK;
 }
 
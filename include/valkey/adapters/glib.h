@@ -152,6 +152,45 @@ static int valkeyGlibAttachAdapter(valkeyAsyncContext *ac, void *context) {
     return VALKEY_ERR;
 }
 
+/* One-shot timer used by the cluster API. */
+typedef struct
+{
+    GSource *source;
+    valkeyTimerCallback *fn;
+    void *privdata;
+} ValkeyTimer;
+
+static gboolean
+valkey_timer_dispatch(gpointer data) {
+    ValkeyTimer *timer = (ValkeyTimer *)data;
+    timer->fn(timer, timer->privdata);
+    g_source_unref(timer->source);
+    vk_free(timer);
+    return G_SOURCE_REMOVE;
+}
+
+/* Internal adapter function with correct function signature. */
+static void *valkeyGlibTimerAdapter(void *context, struct timeval tv,
+                                    valkeyTimerCallback *fn, void *privdata) {
+    ValkeyTimer *timer = (ValkeyTimer *)vk_malloc(sizeof(*timer));
+    if (timer == NULL)
+        return NULL;
+    timer->fn = fn;
+    timer->privdata = privdata;
+    timer->source = g_timeout_source_new(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+    g_source_set_callback(timer->source, valkey_timer_dispatch, timer, NULL);
+    g_source_attach(timer->source, (GMainContext *)context);
+    return timer;
+}
+
+static void valkeyGlibTimerCancelAdapter(void *context, void *data) {
+    (void)context;
+    ValkeyTimer *timer = (ValkeyTimer *)data;
+    g_source_destroy(timer->source);
+    g_source_unref(timer->source);
+    vk_free(timer);
+}
+
 VALKEY_UNUSED
 static int valkeyClusterOptionsUseGlib(valkeyClusterOptions *options,
                                        GMainContext *context) {
@@ -161,6 +200,8 @@ static int valkeyClusterOptionsUseGlib(valkeyClusterOptions *options,
 
     options->attach_fn = valkeyGlibAttachAdapter;
     options->attach_data = context;
+    options->timer_fn = valkeyGlibTimerAdapter;
+    options->timer_cancel_fn = valkeyGlibTimerCancelAdapter;
     return VALKEY_OK;
 }
 
@@ -192,6 +192,53 @@ static int valkeyLibevAttachAdapter(valkeyAsyncContext *ac, void *loop) {
     return valkeyLibevAttach((struct ev_loop *)loop, ac);
 }
 
+/* One-shot timer used by the cluster API. */
+typedef struct valkeyLibevTimer {
+    ev_timer timer;
+    valkeyTimerCallback *fn;
+    void *privdata;
+} valkeyLibevTimer;
+
+static void valkeyLibevTimerEvent(EV_P_ ev_timer *timer, int revents) {
+#if EV_MULTIPLICITY
+    ((void)EV_A);
+#endif
+    ((void)revents);
+    valkeyLibevTimer *t = (valkeyLibevTimer *)timer->data;
+    t->fn(t, t->privdata);
+    vk_free(t);
+}
+
+static void *valkeyLibevTimerAdapter(void *data, struct timeval tv,
+                                     valkeyTimerCallback *fn, void *privdata) {
+#if EV_MULTIPLICITY
+    struct ev_loop *loop = (struct ev_loop *)data;
+#else
+    ((void)data);
+#endif
+    valkeyLibevTimer *t = (valkeyLibevTimer *)vk_calloc(1, sizeof(*t));
+    if (t == NULL)
+        return NULL;
+    t->fn = fn;
+    t->privdata = privdata;
+    ev_timer_init(&t->timer, valkeyLibevTimerEvent,
+                  tv.tv_sec + tv.tv_usec / 1000000.00, 0.);
+    t->timer.data = t;
+    ev_timer_start(EV_A_ & t->timer);
+    return t;
+}
+
+static void valkeyLibevTimerCancelAdapter(void *data, void *timer) {
+#if EV_MULTIPLICITY
+    struct ev_loop *loop = (struct ev_loop *)data;
+#else
+    ((void)data);
+#endif
+    valkeyLibevTimer *t = (valkeyLibevTimer *)timer;
+    ev_timer_stop(EV_A_ & t->timer);
+    vk_free(t);
+}
+
 VALKEY_UNUSED
 static int valkeyClusterOptionsUseLibev(valkeyClusterOptions *options,
                                         struct ev_loop *loop) {
@@ -201,6 +248,8 @@ static int valkeyClusterOptionsUseLibev(valkeyClusterOptions *options,
 
     options->attach_fn = valkeyLibevAttachAdapter;
     options->attach_data = loop;
+    options->timer_fn = valkeyLibevTimerAdapter;
+    options->timer_cancel_fn = valkeyLibevTimerCancelAdapter;
     return VALKEY_OK;
 }
 
@@ -189,6 +189,46 @@ static int valkeyLibeventAttachAdapter(valkeyAsyncContext *ac, void *base) {
     return valkeyLibeventAttach(ac, (struct event_base *)base);
 }
 
+/* One-shot timer used by the cluster API. */
+typedef struct valkeyLibeventTimer {
+    struct event *ev;
+    valkeyTimerCallback *fn;
+    void *privdata;
+} valkeyLibeventTimer;
+
+static void valkeyLibeventTimerHandler(evutil_socket_t fd, short event, void *arg) {
+    (void)fd;
+    (void)event;
+    valkeyLibeventTimer *t = (valkeyLibeventTimer *)arg;
+    t->fn(t, t->privdata);
+    event_free(t->ev);
+    vk_free(t);
+}
+
+static void *valkeyLibeventTimerAdapter(void *base, struct timeval tv,
+                                        valkeyTimerCallback *fn, void *privdata) {
+    valkeyLibeventTimer *t = (valkeyLibeventTimer *)vk_calloc(1, sizeof(*t));
+    if (t == NULL)
+        return NULL;
+    t->fn = fn;
+    t->privdata = privdata;
+    t->ev = evtimer_new((struct event_base *)base, valkeyLibeventTimerHandler, t);
+    if (t->ev == NULL || evtimer_add(t->ev, &tv) != 0) {
+        if (t->ev)
+            event_free(t->ev);
+        vk_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+static void valkeyLibeventTimerCancelAdapter(void *base, void *timer) {
+    (void)base;
+    valkeyLibeventTimer *t = (valkeyLibeventTimer *)timer;
+    event_free(t->ev);
+    vk_free(t);
+}
+
 VALKEY_UNUSED
 static int valkeyClusterOptionsUseLibevent(valkeyClusterOptions *options,
                                            struct event_base *base) {
@@ -198,6 +238,8 @@ static int valkeyClusterOptionsUseLibevent(valkeyClusterOptions *options,
 
     options->attach_fn = valkeyLibeventAttachAdapter;
     options->attach_data = base;
+    options->timer_fn = valkeyLibeventTimerAdapter;
+    options->timer_cancel_fn = valkeyLibeventTimerCancelAdapter;
     return VALKEY_OK;
 }
 
@@ -0,0 +1,323 @@
+/* A multi-threaded cluster executor using libevent.
+ *
+ * The executor runs a number of event loop threads, each with its own
+ * valkeyClusterAsyncContext. The slot range is split evenly between the
+ * threads and a command is run by the thread owning the slot of its key, so a
+ * thread only connects to the nodes serving its part of the slots. Commands
+ * can be submitted from any thread; they are passed to the owning thread using
+ * a lock-free queue and a wakeup pipe. All threads share one slotmap.
+ *
+ * Reply callbacks are called from the loop thread that sent the command, with
+ * that thread's valkeyClusterAsyncContext. A callback that needs to continue
+ * in another thread has to pass the reply along itself.
+ *
+ * This adapter requires POSIX threads and GCC or Clang atomic builtins. */
+
+#ifndef VALKEY_ADAPTERS_LIBEVENT_EXECUTOR_H
+#define VALKEY_ADAPTERS_LIBEVENT_EXECUTOR_H
+#include "../cluster.h"
+#include "libevent.h"
+
+#include <event2/event.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#define VALKEY_EXECUTOR_SLOTS 16384
+
+typedef struct valkeyExecutorTask {
+    struct valkeyExecutorTask *next;
+    valkeyClusterCallbackFn *fn;
+    void *privdata;
+    char *cmd; /* Stored after the task. */
+    int len;
+} valkeyExecutorTask;
+
+typedef struct valkeyExecutorThread {
+    struct valkeyClusterExecutor *executor;
+    valkeyClusterAsyncContext *acc;
+    struct event_base *base;
+    struct event *wakeup;
+    int wakeup_fds[2];
+    int signaled; /* A wakeup byte is pending. */
+    pthread_t thread;
+    int started;
+    /* Intrusive MPSC queue. Producers swap `tail`, only the loop thread
+     * touches `head`. The stub keeps the queue non-empty. */
+    valkeyExecutorTask *head;
+    valkeyExecutorTask *tail;
+    valkeyExecutorTask stub;
+} valkeyExecutorThread;
+
+typedef struct valkeyClusterExecutor {
+    int num_threads;
+    int stopping;
+    valkeyClusterSharedSlotmap *slotmap; /* Owned unless given in options. */
+    int owns_slotmap;
+    valkeyExecutorThread *threads;
+} valkeyClusterExecutor;
+
+static void valkeyExecutorQueuePush(valkeyExecutorThread *t, valkeyExecutorTask *task) {
+    valkeyExecutorTask *prev;
+    __atomic_store_n(&task->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&t->tail, task, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, task, __ATOMIC_SEQ_CST);
+}
+
+/* Pop a task, or NULL when the queue is empty or a push is half done. A half
+ * done push is followed by a wakeup, so the loop will be back for it. */
+static valkeyExecutorTask *valkeyExecutorQueuePop(valkeyExecutorThread *t) {
+    valkeyExecutorTask *head = t->head;
+    valkeyExecutorTask *next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+    if (head == &t->stub) {
+        if (next == NULL)
+            return NULL;
+        t->head = next;
+        head = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next != NULL) {
+        t->head = next;
+        return head;
+    }
+    if (head != __atomic_load_n(&t->tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    valkeyExecutorQueuePush(t, &t->stub);
+    next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        t->head = next;
+        return head;
+    }
+    return NULL;
+}
+
+static void valkeyExecutorSignal(valkeyExecutorThread *t) {
+    char c = 0;
+    if (__atomic_exchange_n(&t->signaled, 1, __ATOMIC_SEQ_CST) == 0) {
+        /* A full pipe already holds a pending wakeup. */
+        if (write(t->wakeup_fds[1], &c, 1) < 0) {
+        }
+    }
+}
+
+static void valkeyExecutorRunTasks(valkeyExecutorThread *t) {
+    valkeyExecutorTask *task;
+    while ((task = valkeyExecutorQueuePop(t)) != NULL) {
+        if (valkeyClusterAsyncFormattedCommand(t->acc, task->fn, task->privdata,
+                                               task->cmd, task->len) != VALKEY_OK) {
+            /* Reason is found in acc->errstr. */
+            task->fn(t->acc, NULL, task->privdata);
+        }
+        vk_free(task);
+    }
+}
+
+static void valkeyExecutorWakeupHandler(evutil_socket_t fd, short event, void *arg) {
+    (void)event;
+    valkeyExecutorThread *t = (valkeyExecutorThread *)arg;
+    char buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0) {
+    }
+    __atomic_store_n(&t->signaled, 0, __ATOMIC_SEQ_CST);
+    valkeyExecutorRunTasks(t);
+
+    if (__atomic_load_n(&t->executor->stopping, __ATOMIC_SEQ_CST)) {
+        /* Let the loop end when the pending replies are received. */
+        event_del(t->wakeup);
+        valkeyClusterAsyncDisconnect(t->acc);
+    }
+}
+
+static void *valkeyExecutorThreadMain(void *arg) {
+    valkeyExecutorThread *t = (valkeyExecutorThread *)arg;
+    event_base_dispatch(t->base);
+    return NULL;
+}
+
+static void valkeyExecutorThreadCleanup(valkeyExecutorThread *t) {
+    valkeyExecutorTask *task;
+
+    if (t->executor == NULL)
+        return; /* Not initiated. */
+    if (t->started)
+        pthread_join(t->thread, NULL);
+    /* Fail commands that were submitted while stopping. */
+    while ((task = valkeyExecutorQueuePop(t)) != NULL) {
+        task->fn(t->acc, NULL, task->privdata);
+        vk_free(task);
+    }
+    valkeyClusterAsyncFree(t->acc);
+    if (t->wakeup != NULL)
+        event_free(t->wakeup);
+    if (t->base != NULL)
+        event_base_free(t->base);
+    for (int i = 0; i < 2; i++) {
+        if (t->wakeup_fds[i] >= 0)
+            close(t->wakeup_fds[i]);
+    }
+}
+
+static int valkeyExecutorThreadInit(valkeyClusterExecutor *ex, valkeyExecutorThread *t,
+                                    const valkeyClusterOptions *options) {
+    valkeyClusterOptions opts = *options;
+
+    t->executor = ex;
+    t->wakeup_fds[0] = t->wakeup_fds[1] = -1;
+    t->head = t->tail = &t->stub;
+
+    if (pipe(t->wakeup_fds) != 0)
+        return VALKEY_ERR;
+    for (int i = 0; i < 2; i++) {
+        int flags = fcntl(t->wakeup_fds[i], F_GETFL);
+        if (flags < 0 || fcntl(t->wakeup_fds[i], F_SETFL, flags | O_NONBLOCK) < 0)
+            return VALKEY_ERR;
+    }
+    if ((t->base = event_base_new()) == NULL)
+        return VALKEY_ERR;
+    t->wakeup = event_new(t->base, t->wakeup_fds[0], EV_READ | EV_PERSIST,
+                          valkeyExecutorWakeupHandler, t);
+    if (t->wakeup == NULL || event_add(t->wakeup, NULL) != 0)
+        return VALKEY_ERR;
+
+    valkeyClusterOptionsUseLibevent(&opts, t->base);
+    /* The first thread fetches the slotmap, the others adopt it. */
+    opts.options |= VALKEY_OPT_BLOCKING_INITIAL_UPDATE;
+    opts.shared_slotmap = ex->slotmap;
+    t->acc = valkeyClusterAsyncConnectWithOptions(&opts);
+    if (t->acc == NULL || t->acc->err)
+        return VALKEY_ERR;
+    return VALKEY_OK;
+}
+
+VALKEY_UNUSED
+static void valkeyClusterExecutorFree(valkeyClusterExecutor *ex) {
+    if (ex == NULL)
+        return;
+
+    __atomic_store_n(&ex->stopping, 1, __ATOMIC_SEQ_CST);
+    if (ex->threads != NULL) {
+        for (int i = 0; i < ex->num_threads; i++) {
+            if (ex->threads[i].started)
+                valkeyExecutorSignal(&ex->threads[i]);
+        }
+        for (int i = 0; i < ex->num_threads; i++)
+            valkeyExecutorThreadCleanup(&ex->threads[i]);
+        vk_free(ex->threads);
+    }
+    if (ex->owns_slotmap)
+        valkeyClusterSharedSlotmapFree(ex->slotmap);
+    vk_free(ex);
+}
+
+/* Create an executor running `num_threads` loop threads. The options are used
+ * for each thread's context; the event loop settings are set by the executor.
+ * Blocks until the initial slotmap is fetched. Returns NULL when a thread can't
+ * be set up. */
+VALKEY_UNUSED
+static valkeyClusterExecutor *valkeyClusterExecutorCreate(const valkeyClusterOptions *options,
+                                                          int num_threads) {
+    valkeyClusterExecutor *ex;
+
+    if (options == NULL || num_threads <= 0 || num_threads > VALKEY_EXECUTOR_SLOTS)
+        return NULL;
+
+    ex = (valkeyClusterExecutor *)vk_calloc(1, sizeof(*ex));
+    if (ex == NULL)
+        return NULL;
+    ex->slotmap = options->shared_slotmap;
+    if (ex->slotmap == NULL) {
+        if ((ex->slotmap = valkeyClusterSharedSlotmapCreate()) == NULL)
+            goto error;
+        ex->owns_slotmap = 1;
+    }
+    ex->threads = (valkeyExecutorThread *)vk_calloc(num_threads, sizeof(valkeyExecutorThread));
+    if (ex->threads == NULL)
+        goto error;
+    ex->num_threads = num_threads;
+
+    for (int i = 0; i < num_threads; i++) {
+        if (valkeyExecutorThreadInit(ex, &ex->threads[i], options) != VALKEY_OK)
+            goto error;
+    }
+    for (int i = 0; i < num_threads; i++) {
+        valkeyExecutorThread *t = &ex->threads[i];
+        if (pthread_create(&t->thread, NULL, valkeyExecutorThreadMain, t) != 0)
+            goto error;
+        t->started = 1;
+    }
+    return ex;
+
+error:
+    valkeyClusterExecutorFree(ex);
+    return NULL;
+}
+
+/* Submit a formatted command. Can be called from any thread. The command is
+ * copied and sent by the thread owning its slot. Commands without keys are
+ * passed to the first thread, which replies with an error. */
+VALKEY_UNUSED
+static int valkeyClusterExecutorFormattedCommand(valkeyClusterExecutor *ex,
+                                                 valkeyClusterCallbackFn *fn,
+                                                 void *privdata, const char *cmd,
+                                                 int len) {
+    valkeyExecutorTask *task;
+    valkeyExecutorThread *t;
+    int slot;
+
+    if (ex == NULL || fn == NULL || cmd == NULL || len <= 0)
+        return VALKEY_ERR;
+    if (__atomic_load_n(&ex->stopping, __ATOMIC_SEQ_CST))
+        return VALKEY_ERR;
+
+    slot = valkeyClusterGetSlotByCommand(cmd, (size_t)len);
+    t = &ex->threads[slot < 0 ? 0 : (slot * ex->num_threads) / VALKEY_EXECUTOR_SLOTS];
+
+    task = (valkeyExecutorTask *)vk_malloc(sizeof(*task) + len);
+    if (task == NULL)
+        return VALKEY_ERR;
+    task->fn = fn;
+    task->privdata = privdata;
+    task->cmd = (char *)(task + 1);
+    task->len = len;
+    memcpy(task->cmd, cmd, len);
+
+    valkeyExecutorQueuePush(t, task);
+    valkeyExecutorSignal(t);
+    return VALKEY_OK;
+}
+
+VALKEY_UNUSED
+static int valkeyClusterExecutorvCommand(valkeyClusterExecutor *ex,
+                                         valkeyClusterCallbackFn *fn,
+                                         void *privdata, const char *format,
+                                         va_list ap) {
+    char *cmd;
+    int len, status;
+
+    len = valkeyvFormatCommand(&cmd, format, ap);
+    if (len < 0)
+        return VALKEY_ERR;
+    status = valkeyClusterExecutorFormattedCommand(ex, fn, privdata, cmd, len);
+    valkeyFreeCommand(cmd);
+    return status;
+}
+
+VALKEY_UNUSED
+static int valkeyClusterExecutorCommand(valkeyClusterExecutor *ex,
+                                        valkeyClusterCallbackFn *fn,
+                                        void *privdata, const char *format, ...) {
+    va_list ap;
+    int status;
+
+    va_start(ap, format);
+    status = valkeyClusterExecutorvCommand(ex, fn, privdata, format, ap);
+    va_end(ap);
+    return status;
+}
+
+#endif /* VALKEY_ADAPTERS_LIBEVENT_EXECUTOR_H */
@@ -128,6 +128,49 @@ static int valkeyLibhvAttachAdapter(valkeyAsyncContext *ac, void *loop) {
     return valkeyLibhvAttach(ac, (hloop_t *)loop);
 }
 
+/* One-shot timer used by the cluster API. */
+typedef struct valkeyLibhvTimer {
+    htimer_t *timer;
+    valkeyTimerCallback *fn;
+    void *privdata;
+} valkeyLibhvTimer;
+
+static void valkeyLibhvTimerEvent(htimer_t *timer) {
+    valkeyLibhvTimer *t = (valkeyLibhvTimer *)hevent_userdata(timer);
+    t->fn(t, t->privdata);
+    vk_free(t); /* The timer is removed by libhv after its last repeat. */
+}
+
+static void *valkeyLibhvTimerAdapter(void *loop, struct timeval tv,
+                                     valkeyTimerCallback *fn, void *privdata) {
+    valkeyLibhvTimer *t;
+    uint32_t millis = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+    /* Libhv disallows zero'd timers */
+    if (millis == 0)
+        millis = 1;
+
+    t = (valkeyLibhvTimer *)vk_malloc(sizeof(*t));
+    if (t == NULL)
+        return NULL;
+    t->fn = fn;
+    t->privdata = privdata;
+    t->timer = htimer_add((hloop_t *)loop, valkeyLibhvTimerEvent, millis, 1);
+    if (t->timer == NULL) {
+        vk_free(t);
+        return NULL;
+    }
+    hevent_set_userdata(t->timer, t);
+    return t;
+}
+
+static void valkeyLibhvTimerCancelAdapter(void *loop, void *timer) {
+    (void)loop;
+    valkeyLibhvTimer *t = (valkeyLibhvTimer *)timer;
+    htimer_del(t->timer);
+    vk_free(t);
+}
+
 VALKEY_UNUSED
 static int valkeyClusterOptionsUseLibhv(valkeyClusterOptions *options,
                                         hloop_t *loop) {
@@ -137,6 +180,8 @@ static int valkeyClusterOptionsUseLibhv(valkeyClusterOptions *options,
 
     options->attach_fn = valkeyLibhvAttachAdapter;
     options->attach_data = loop;
+    options->timer_fn = valkeyLibhvTimerAdapter;
+    options->timer_cancel_fn = valkeyLibhvTimerCancelAdapter;
     return VALKEY_OK;
 }
 
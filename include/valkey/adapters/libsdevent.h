@@ -183,6 +183,45 @@ static int valkeyLibsdeventAttachAdapter(valkeyAsyncContext *ac, void *event) {
     return valkeyLibsdeventAttach(ac, (struct sd_event *)event);
 }
 
+/* One-shot timer used by the cluster API. */
+typedef struct valkeyLibsdeventTimer {
+    struct sd_event_source *source;
+    valkeyTimerCallback *fn;
+    void *privdata;
+} valkeyLibsdeventTimer;
+
+static int valkeyLibsdeventTimerHandler(sd_event_source *s, uint64_t usec, void *userdata) {
+    ((void)usec);
+    valkeyLibsdeventTimer *t = (valkeyLibsdeventTimer *)userdata;
+    t->fn(t, t->privdata);
+    sd_event_source_disable_unref(s);
+    vk_free(t);
+    return 0;
+}
+
+static void *valkeyLibsdeventTimerAdapter(void *event, struct timeval tv,
+                                          valkeyTimerCallback *fn, void *privdata) {
+    uint64_t usec = tv.tv_sec * 1000000 + tv.tv_usec;
+    valkeyLibsdeventTimer *t = (valkeyLibsdeventTimer *)vk_calloc(1, sizeof(*t));
+    if (t == NULL)
+        return NULL;
+    t->fn = fn;
+    t->privdata = privdata;
+    if (sd_event_add_time_relative((struct sd_event *)event, &t->source, CLOCK_MONOTONIC,
+                                   usec, 1, valkeyLibsdeventTimerHandler, t) < 0) {
+        vk_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+static void valkeyLibsdeventTimerCancelAdapter(void *event, void *timer) {
+    ((void)event);
+    valkeyLibsdeventTimer *t = (valkeyLibsdeventTimer *)timer;
+    sd_event_source_disable_unref(t->source);
+    vk_free(t);
+}
+
 VALKEY_UNUSED
 static int valkeyClusterOptionsUseLibsdevent(valkeyClusterOptions *options,
                                              struct sd_event *event) {
@@ -192,6 +231,8 @@ static int valkeyClusterOptionsUseLibsdevent(valkeyClusterOptions *options,
 
     options->attach_fn = valkeyLibsdeventAttachAdapter;
     options->attach_data = event;
+    options->timer_fn = valkeyLibsdeventTimerAdapter;
+    options->timer_cancel_fn = valkeyLibsdeventTimerCancelAdapter;
     return VALKEY_OK;
 }
 
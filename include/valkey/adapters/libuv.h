@@ -202,6 +202,52 @@ static int valkeyLibuvAttachAdapter(valkeyAsyncContext *ac, void *loop) {
     return valkeyLibuvAttach(ac, (uv_loop_t *)loop);
 }
 
+/* One-shot timer used by the cluster API. */
+typedef struct valkeyLibuvTimer {
+    uv_timer_t timer;
+    valkeyTimerCallback *fn;
+    void *privdata;
+} valkeyLibuvTimer;
+
+static void on_cluster_timer_close(uv_handle_t *handle) {
+    vk_free(handle->data);
+}
+
+#if (UV_VERSION_MAJOR == 0 && UV_VERSION_MINOR < 11) || \
+    (UV_VERSION_MAJOR == 0 && UV_VERSION_MINOR == 11 && UV_VERSION_PATCH < 23)
+static void valkeyLibuvTimerEvent(uv_timer_t *timer, int status) {
+    (void)status; // unused
+#else
+static void valkeyLibuvTimerEvent(uv_timer_t *timer) {
+#endif
+    valkeyLibuvTimer *t = (valkeyLibuvTimer *)timer->data;
+    t->fn(t, t->privdata);
+    uv_close((uv_handle_t *)&t->timer, on_cluster_timer_close);
+}
+
+static void *valkeyLibuvTimerAdapter(void *loop, struct timeval tv,
+                                     valkeyTimerCallback *fn, void *privdata) {
+    uint64_t millisec = tv.tv_sec * 1000 + tv.tv_usec / 1000.0;
+    valkeyLibuvTimer *t = (valkeyLibuvTimer *)vk_calloc(1, sizeof(*t));
+    if (t == NULL)
+        return NULL;
+    if (uv_timer_init((uv_loop_t *)loop, &t->timer) != 0) {
+        vk_free(t);
+        return NULL;
+    }
+    t->timer.data = t;
+    t->fn = fn;
+    t->privdata = privdata;
+    uv_timer_start(&t->timer, valkeyLibuvTimerEvent, millisec, 0);
+    return t;
+}
+
+static void valkeyLibuvTimerCancelAdapter(void *loop, void *timer) {
+    (void)loop;
+    valkeyLibuvTimer *t = (valkeyLibuvTimer *)timer;
+    uv_close((uv_handle_t *)&t->timer, on_cluster_timer_close);
+}
+
 VALKEY_UNUSED
 static int valkeyClusterOptionsUseLibuv(valkeyClusterOptions *options,
                                         uv_loop_t *loop) {
@@ -211,6 +257,8 @@ static int valkeyClusterOptionsUseLibuv(valkeyClusterOptions *options,
 
     options->attach_fn = valkeyLibuvAttachAdapter;
     options->attach_data = loop;
+    options->timer_fn = valkeyLibuvTimerAdapter;
+    options->timer_cancel_fn = valkeyLibuvTimerCancelAdapter;
     return VALKEY_OK;
 }
 
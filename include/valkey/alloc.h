@@ -51,6 +51,17 @@ typedef struct valkeyAllocFuncs {
 LIBVALKEY_API valkeyAllocFuncs valkeySetAllocators(valkeyAllocFuncs *fns);
 LIBVALKEY_API void valkeyResetAllocators(void);
 
+/* An allocator used by a single context instead of the global allocators for
+ * its reply objects and async callbacks, see the option `allocator`. The
+ * functions are called with `privdata`. The read and write buffers of the
+ * context still use the global allocators. */
+typedef struct valkeyAllocator {
+    void *(*mallocFn)(void *privdata, size_t size);
+    void *(*callocFn)(void *privdata, size_t nmemb, size_t size);
+    void (*freeFn)(void *privdata, void *ptr);
+    void *privdata;
+} valkeyAllocator;
+
 #ifndef _WIN32
 
 /* valkey' configured allocator function pointer struct */
@@ -31,6 +31,8 @@
 
 #ifndef VALKEY_ASYNC_H
 #define VALKEY_ASYNC_H
+#include "cache.h"
+#include "script.h"
 #include "valkey.h"
 #include "visibility.h"
 
@@ -119,6 +121,8 @@ typedef struct valkeyAsyncContext {
         struct dict *patterns;
         struct dict *schannels;
         int pending_unsubs;
+        /* Reused reply for messages, see VALKEY_OPT_REUSE_PUBSUB_REPLIES */
+        struct valkeyPubsubReply *reused_reply;
     } sub;
 
     /* Any configured RESP3 PUSH handler */
@@ -127,6 +131,18 @@ typedef struct valkeyAsyncContext {
     /* Replies received since command timeout timer was started, or
      * VALKEY_TIMEOUT_INACTIVE when no timer is scheduled. */
     int timeout_reply_count;
+
+    /* Client-side cache, see valkeyAsyncEnableCache() */
+    valkeyCache *cache;
+    int cache_db; /* Database selected for the cached replies. */
+    /* Replies to receive until no command that can modify keys is pending,
+     * during which the cache is bypassed. */
+    unsigned long cache_bypass;
+    unsigned long replies_pending; /* Callbacks in `replies`. */
+
+    /* Memory of the callbacks of pending commands, see
+     * valkeyAsyncGetMemoryUsage() */
+    size_t callbacks_size;
 } valkeyAsyncContext;
 
 LIBVALKEY_API valkeyAsyncContext *valkeyAsyncConnectWithOptions(const valkeyOptions *options);
@@ -140,6 +156,7 @@ LIBVALKEY_API int valkeyAsyncSetDisconnectCallback(valkeyAsyncContext *ac, valke
 
 LIBVALKEY_API valkeyAsyncPushFn *valkeyAsyncSetPushCallback(valkeyAsyncContext *ac, valkeyAsyncPushFn *fn);
 LIBVALKEY_API int valkeyAsyncSetTimeout(valkeyAsyncContext *ac, struct timeval tv);
+LIBVALKEY_API void valkeyAsyncGetMemoryUsage(valkeyAsyncContext *ac, valkeyMemoryUsage *usage);
 LIBVALKEY_API void valkeyAsyncDisconnect(valkeyAsyncContext *ac);
 LIBVALKEY_API void valkeyAsyncFree(valkeyAsyncContext *ac);
 
@@ -157,6 +174,21 @@ LIBVALKEY_API int valkeyAsyncCommand(valkeyAsyncContext *ac, valkeyCallbackFn *f
 LIBVALKEY_API int valkeyAsyncCommandArgv(valkeyAsyncContext *ac, valkeyCallbackFn *fn, void *privdata, int argc, const char **argv, const size_t *argvlen);
 LIBVALKEY_API int valkeyAsyncFormattedCommand(valkeyAsyncContext *ac, valkeyCallbackFn *fn, void *privdata, const char *cmd, size_t len);
 
+/* Use a client-side cache for the replies of cacheable commands. Switches the
+ * connection to RESP3 and enables key tracking, after which a cached reply is
+ * given to the callback directly from the command function. The cache is
+ * bypassed while a command that isn't cacheable is pending, and is flushed
+ * when the connection is closed, since invalidations may be lost. */
+LIBVALKEY_API int valkeyAsyncEnableCache(valkeyAsyncContext *ac, valkeyCache *cache);
+
+/* Call a registered script using EVALSHA, where the first `numkeys` of the
+ * arguments are keys. On a NOSCRIPT error the call is retried using EVAL,
+ * after the commands sent meanwhile. `argvlen` can be NULL when the arguments
+ * are null-terminated. */
+LIBVALKEY_API int valkeyAsyncScriptCall(valkeyAsyncContext *ac, valkeyCallbackFn *fn, void *privdata,
+                                        valkeyScript *script, int numkeys, int argc,
+                                        const char **argv, const size_t *argvlen);
+
 #ifdef __cplusplus
 }
 #endif
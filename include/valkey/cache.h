@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2026, the libvalkey contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VALKEY_CACHE_H
+#define VALKEY_CACHE_H
+#include "visibility.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Client-side cache
+ *
+ * Replies to read-only single-key commands, e.g. GET and HGET, are kept in a
+ * local store and given to later identical commands without contacting the
+ * server. The server tracks the keys read by each connection (CLIENT TRACKING
+ * using RESP3) and sends an invalidation message when a key is modified,
+ * which removes its replies from the cache. A cache is used by asynchronous
+ * contexts, see valkeyAsyncEnableCache() and the `cache` cluster option.
+ *
+ * A cache is not thread-safe and is to be used by contexts in the same thread.
+ * It must outlive the contexts using it. */
+typedef struct valkeyCache valkeyCache;
+
+/* Default upper limit of the memory used by a cache. */
+#define VALKEY_CACHE_DEFAULT_MAX_MEMORY (16 * 1024 * 1024)
+
+typedef struct valkeyCacheOptions {
+    /* Memory used by the cached replies, their commands and the bookkeeping,
+     * before the least recently used replies are evicted. Default 0, i.e.
+     * VALKEY_CACHE_DEFAULT_MAX_MEMORY. */
+    size_t max_memory;
+
+    /* Use the broadcasting mode of key tracking. The server sends
+     * invalidation messages for all modified keys matching `prefixes`, or all
+     * keys when no prefixes are given, instead of only the keys read by the
+     * connection. Only keys matching a prefix are cached. */
+    int bcast;
+    const char **prefixes;
+    int num_prefixes;
+} valkeyCacheOptions;
+
+typedef struct valkeyCacheStats {
+    uint64_t hits;          /* Commands replied from the cache. */
+    uint64_t misses;        /* Cacheable commands sent to the server. */
+    uint64_t invalidations; /* Replies removed by invalidation messages. */
+    uint64_t evictions;     /* Replies removed due to `max_memory`. */
+    size_t entries;         /* Cached replies. */
+    size_t used_memory;     /* Memory used by the cached replies. */
+} valkeyCacheStats;
+
+LIBVALKEY_API valkeyCache *valkeyCacheCreate(const valkeyCacheOptions *options);
+LIBVALKEY_API void valkeyCacheFree(valkeyCache *cache);
+
+/* Remove all cached replies, or the replies of a single key. */
+LIBVALKEY_API void valkeyCacheFlush(valkeyCache *cache);
+LIBVALKEY_API void valkeyCacheInvalidate(valkeyCache *cache, const char *key,
+                                         size_t len);
+
+LIBVALKEY_API void valkeyCacheGetStats(const valkeyCache *cache,
+                                       valkeyCacheStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VALKEY_CACHE_H */
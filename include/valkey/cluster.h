@@ -48,17 +48,43 @@
 #define VALKEYCLUSTER_EVENT_READY 2
 #define VALKEYCLUSTER_EVENT_FREE_CONTEXT 3
 
+/* Flags for the ..ToAllNodes() API. */
+#define VALKEYCLUSTER_INCLUDE_REPLICAS 0x1 /* Send to replicas as well. */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct cluster_conn;
 struct dict;
 struct hilist;
 struct valkeyClusterAsyncContext;
+struct valkeyClusterSharedSlotmap;
 struct valkeyTLSContext;
 
 typedef void(valkeyClusterCallbackFn)(struct valkeyClusterAsyncContext *,
                                       void *, void *);
+/* Combines the replies from multiple nodes into a single reply. The reducer
+ * takes ownership of the replies and returns NULL when out of memory. */
+typedef valkeyReply *(valkeyClusterReducerFn)(valkeyReply **replies,
+                                              size_t count);
+/* Number of latency buckets in valkeyClusterNodeStats. */
+#define VALKEY_NODE_STATS_BUCKETS 192
+
+/* Statistics of commands sent to a node, see valkeyClusterNodeGetStats().
+ * Latencies are measured in microseconds from sending a command to receiving
+ * its reply. The histogram buckets are log-linear, with 8 buckets per power
+ * of two, i.e. a relative precision of 12.5%. */
+typedef struct valkeyClusterNodeStats {
+    uint64_t replies;          /* Replies received, including error replies */
+    uint64_t errors;           /* Error replies and failed commands */
+    uint64_t redirects;        /* MOVED and ASK replies */
+    uint64_t in_flight;        /* Sent async commands awaiting a reply */
+    uint64_t latency_sum_usec; /* Sum of all measured latencies */
+    uint64_t latency_max_usec; /* Highest measured latency */
+    uint64_t latency[VALKEY_NODE_STATS_BUCKETS];
+} valkeyClusterNodeStats;
+
 typedef struct valkeyClusterNode {
     char *name;
     char *addr;
@@ -72,6 +98,11 @@ typedef struct valkeyClusterNode {
     int64_t lastConnectionAttempt; /* Timestamp */
     struct hilist *slots;
     struct hilist *replicas;
+    struct cluster_conn *pool; /* Connection pool, see connections_per_node */
+    int pool_size;
+    unsigned int pool_next; /* Round-robin position in the pool */
+    valkeyClusterNodeStats *stats; /* Allocated on first use */
+    struct cluster_conn *pubsub;   /* Sharded pub/sub connection, async only */
 } valkeyClusterNode;
 
 typedef struct cluster_slot {
@@ -91,19 +122,35 @@ typedef struct valkeyClusterContext {
     struct timeval *connect_timeout; /* TCP connect timeout */
     struct timeval *command_timeout; /* Receive and send timeout */
     int max_retry_count;             /* Allowed retry attempts */
+    int connections_per_node;        /* Size of the node connection pools */
     char *username;                  /* Authenticate using user */
     char *password;                  /* Authentication password */
     int select_db;
+    valkeyCache *cache; /* Client-side cache, async only */
+    const valkeyAllocator *allocator; /* Allocator of the node connections */
+    size_t max_obuf_size;             /* Output buffer limit per connection */
 
     struct dict *nodes;        /* Known valkeyClusterNode's */
     uint64_t route_version;    /* Increased when the node lookup table changes */
     valkeyClusterNode **table; /* valkeyClusterNode lookup table */
 
     struct hilist *requests; /* Outstanding commands (Pipelining) */
+    struct dict *checkouts;  /* Checked out pool connections */
 
     int retry_count;       /* Current number of failing attempts */
     int need_update_route; /* Indicator for valkeyClusterReset() (Pipel.) */
 
+    /* Incremental slotmap updates, see VALKEY_OPT_INCREMENTAL_SLOTMAP. */
+    int slotmap_deltas;                  /* MOVED applied since last update */
+    int max_slotmap_deltas;              /* Deltas allowed before an update */
+    int64_t slotmap_delta_start;         /* Timestamp of first applied delta */
+    int64_t slotmap_delta_interval_usec; /* Time allowed before an update */
+
+    /* Slotmap shared with other contexts, see `shared_slotmap`. */
+    struct valkeyClusterSharedSlotmap *shared_slotmap;
+    unsigned int shared_version; /* Last published or adopted version. */
+    char *slotmap_file;          /* See `slotmap_file`. */
+
     void *tls; /* Pointer to a valkeyTLSContext when using TLS. */
     int (*tls_init_fn)(struct valkeyContext *, struct valkeyTLSContext *);
 
@@ -130,6 +177,24 @@ typedef struct valkeyClusterAsyncContext {
     int (*attach_fn)(valkeyAsyncContext *ac, void *attach_data);
     void *attach_data;
 
+    /* Timer functions of the async library, used for delayed retries. */
+    void *(*timer_fn)(void *attach_data, struct timeval tv,
+                      valkeyTimerCallback *fn, void *privdata);
+    void (*timer_cancel_fn)(void *attach_data, void *timer);
+    int64_t retry_backoff_usec;     /* Delay before the first retry. */
+    int64_t retry_backoff_max_usec; /* Max delay between retries. */
+    struct hilist *retries;         /* Commands waiting for a delayed retry. */
+    int64_t topology_refresh_usec;  /* Interval of periodic slotmap updates. */
+    void *topology_refresh_timer;   /* Timer of the next periodic update. */
+    int topology_refresh_ongoing;   /* A periodic slotmap update is sent. */
+    struct dict *pipeline;          /* Commands held back per node address. */
+    void *pipeline_timer;           /* Timer that flushes the held commands. */
+    int pipeline_max_batch;         /* Max number of held back commands. */
+    int64_t pipeline_max_delay_usec; /* Max time a command is held back. */
+    struct dict *shard_channels;     /* Sharded pub/sub subscriptions. */
+    void *shard_timer;               /* Timer of the next resubscribe attempt. */
+    int cache_bypass;                /* Pending commands that aren't cacheable. */
+
     /* Called when either the connection is terminated due to an error or per
      * user request. The status is set accordingly (VALKEY_OK, VALKEY_ERR). */
     valkeyDisconnectCallback *onDisconnect;
@@ -144,6 +209,30 @@ typedef struct valkeyClusterAsyncContext {
 /* 72 bytes needed when using Valkey's dict. */
 typedef uint64_t valkeyClusterNodeIterator[9];
 
+/* Cluster-wide SCAN, see valkeyClusterScanCreate() and valkeyClusterAsyncScan(). */
+typedef struct valkeyClusterScan valkeyClusterScan;
+
+/* Called for each page of keys from an asynchronous cluster-wide SCAN. The
+ * keys are only valid during the callback. Return 0 to continue the scan, or
+ * any other value to stop it. When the scan is finished or stopped, the
+ * callback is called a final time with `keys` set to NULL, and with acc->err
+ * set if the scan failed. */
+typedef int(valkeyClusterScanCallbackFn)(struct valkeyClusterAsyncContext *acc,
+                                         const valkeyReply *keys, void *privdata);
+
+typedef struct {
+    const char *match;   /* MATCH pattern, or NULL to match all keys. */
+    long long count;     /* COUNT hint, or 0 to use the server default. */
+    const char *type;    /* TYPE filter, or NULL for all types. */
+    int max_concurrency; /* Nodes scanned concurrently, 0 means all nodes. */
+} valkeyClusterScanOptions;
+
+/* A slotmap shared by multiple cluster contexts, see `shared_slotmap`. */
+typedef struct valkeyClusterSharedSlotmap valkeyClusterSharedSlotmap;
+
+/* Commands for a MULTI/EXEC transaction, see valkeyClusterTransactionCreate(). */
+typedef struct valkeyClusterTransaction valkeyClusterTransaction;
+
 /* --- Configuration options --- */
 
 /* Enable slotmap updates using the command CLUSTER NODES.
@@ -154,6 +243,20 @@ typedef uint64_t valkeyClusterNodeIterator[9];
 #define VALKEY_OPT_USE_REPLICAS 0x2000
 /* Use a blocking slotmap update after an initial async connect. */
 #define VALKEY_OPT_BLOCKING_INITIAL_UPDATE 0x4000
+/* Apply the slot changes given by MOVED redirects directly to the slotmap
+ * instead of fetching a new slotmap for each redirect. A full slotmap update is
+ * still made when a redirect points to an unknown node, or when the limits
+ * given by `max_slotmap_deltas` and `slotmap_delta_interval` are reached. */
+#define VALKEY_OPT_INCREMENTAL_SLOTMAP 0x8000
+/* Send each command to the pooled connection with the fewest outstanding
+ * commands, instead of using round-robin. See `connections_per_node`. */
+#define VALKEY_OPT_POOL_LEAST_PENDING 0x10000
+/* Hold back commands sent using the asynchronous API and submit them to the
+ * node connections in batches. See `pipeline_max_batch`. */
+#define VALKEY_OPT_AUTO_PIPELINE 0x20000
+/* Start connecting to all primaries when the first slotmap is received, before
+ * the event VALKEYCLUSTER_EVENT_READY is sent. Asynchronous API only. */
+#define VALKEY_OPT_PRECONNECT 0x40000
 
 typedef struct {
     const char *initial_nodes;             /* Initial cluster node address(es). */
@@ -164,10 +267,88 @@ typedef struct {
     const char *password;                  /* Authentication password. */
     int max_retry;                         /* Allowed retry attempts. */
 
+    /* Limits when using VALKEY_OPT_INCREMENTAL_SLOTMAP. A full slotmap update
+     * is made when `max_slotmap_deltas` MOVED redirects have been applied since
+     * the last update (default 128), or when the first applied redirect is
+     * older than `slotmap_delta_interval` (default 10 seconds). */
+    int max_slotmap_deltas;
+    const struct timeval *slotmap_delta_interval;
+
+    /* Delay before retrying a command after a TRYAGAIN or CLUSTERDOWN error
+     * when using the asynchronous API. The delay is doubled for each retry up
+     * to `retry_backoff_max`, and a random jitter is applied. Requires an event
+     * library adapter with timer support, see `timer_fn`. Defaults are 50 ms
+     * and 2 seconds, and a zero `retry_backoff` retries without delay. */
+    const struct timeval *retry_backoff;
+    const struct timeval *retry_backoff_max;
+
+    /* Interval of periodic slotmap updates when using the asynchronous API,
+     * in addition to the updates triggered by redirects and connection errors.
+     * The received topology is compared with the current, and the slotmap and
+     * the event VALKEYCLUSTER_EVENT_SLOTMAP_UPDATED are only updated when the
+     * topology has changed. Requires an event library adapter with timer
+     * support, see `timer_fn`. Default is no periodic update. */
+    const struct timeval *topology_refresh_interval;
+
+    /* Limits of the auto-pipelining enabled by VALKEY_OPT_AUTO_PIPELINE.
+     * Commands are held back per node until `pipeline_max_batch` commands are
+     * waiting for the node (default 128), or until `pipeline_max_delay` has
+     * passed since the first was held back. The held back commands are then
+     * submitted together, which gives a single write per node connection.
+     * Commands are not held back without a delay (default 0), since commands
+     * given in the same event loop iteration are already written together.
+     * Requires an event library adapter with timer support, see `timer_fn`. */
+    int pipeline_max_batch;
+    const struct timeval *pipeline_max_delay;
+
+    /* Number of connections per node. In the asynchronous API the commands
+     * that are routed using the slotmap are spread over the connections, using
+     * round-robin or VALKEY_OPT_POOL_LEAST_PENDING. Commands sent to a specific
+     * node use a separate connection to keep their order. In the synchronous API
+     * the connections can be checked out using valkeyClusterCheckoutContext().
+     * Default is 1, i.e. a single connection per node. */
+    int connections_per_node;
+
+    /* A slotmap shared with other contexts, e.g. one context per thread,
+     * created using valkeyClusterSharedSlotmapCreate(). A slotmap fetched by
+     * any of the contexts is published as an immutable snapshot, which the
+     * other contexts use instead of fetching the slotmap themselves. The
+     * connections are still kept per context. The shared slotmap must outlive
+     * the contexts using it. Default NULL, i.e. not shared. */
+    valkeyClusterSharedSlotmap *shared_slotmap;
+
+    /* Path of a file where each fetched slotmap is saved. When connecting, a
+     * valid file is used instead of fetching the slotmap from a seed node.
+     * A stale slotmap is corrected by MOVED redirects and, in the
+     * asynchronous API, by `topology_refresh_interval`. The seed nodes are
+     * kept, so the slotmap can still be fetched when no saved node exists
+     * anymore. The file is written
+     * in host byte order and is replaced atomically on update.
+     * Default NULL, i.e. no file. */
+    const char *slotmap_file;
+
     /* Select a logical database after a successful connect.
      * Default 0, i.e. the SELECT command is not sent. */
     int select_db;
 
+    /* A client-side cache, created using valkeyCacheCreate(), for the replies
+     * of cacheable commands sent by the asynchronous API. Key tracking is
+     * enabled on each node connection, which uses RESP3. The cache can be
+     * shared by contexts in the same thread and must outlive them.
+     * Default NULL, i.e. no cache. */
+    valkeyCache *cache;
+
+    /* An allocator used by all node connections for their replies and
+     * callbacks, see `allocator` in valkeyOptions. It must outlive the
+     * context and its replies. Default NULL, i.e. the global allocators. */
+    const valkeyAllocator *allocator;
+
+    /* Max size of the output buffer of each node connection, see
+     * `max_obuf_size` in valkeyOptions. A command exceeding it fails with
+     * VALKEY_ERR_OUTPUT_LIMIT and the connection is kept. Default 0, i.e. no
+     * limit. */
+    size_t max_obuf_size;
+
     /* Common callbacks. */
 
     /* A hook to get notified when certain events occur. The `event` is set to
@@ -211,6 +392,14 @@ typedef struct {
     int (*attach_fn)(valkeyAsyncContext *ac, void *attach_data);
     void *attach_data;
 
+    /* Event engine timer functions, initiated by the same helper when the
+     * engine supports it. `timer_fn` schedules a single call to `fn` after
+     * `tv` and returns a timer handle, or NULL on failure. The handle is valid
+     * until the call is made or the timer is cancelled using `timer_cancel_fn`. */
+    void *(*timer_fn)(void *attach_data, struct timeval tv,
+                      valkeyTimerCallback *fn, void *privdata);
+    void (*timer_cancel_fn)(void *attach_data, void *timer);
+
     /* TLS context, initiated using valkeyCreateTLSContext. */
     void *tls;
     int (*tls_init_fn)(struct valkeyContext *, struct valkeyTLSContext *);
@@ -223,6 +412,12 @@ LIBVALKEY_API valkeyClusterContext *valkeyClusterConnect(const char *addrs);
 LIBVALKEY_API valkeyClusterContext *valkeyClusterConnectWithTimeout(const char *addrs, const struct timeval tv);
 LIBVALKEY_API void valkeyClusterFree(valkeyClusterContext *cc);
 
+/* A slotmap that can be shared by contexts in multiple threads. Use the option
+ * `shared_slotmap` to let a context use it, and free it after all contexts
+ * using it are freed. Returns NULL when out of memory. */
+LIBVALKEY_API valkeyClusterSharedSlotmap *valkeyClusterSharedSlotmapCreate(void);
+LIBVALKEY_API void valkeyClusterSharedSlotmapFree(valkeyClusterSharedSlotmap *ssm);
+
 /* Options configurable in runtime. */
 LIBVALKEY_API int valkeyClusterSetOptionTimeout(valkeyClusterContext *cc, const struct timeval tv);
 
@@ -249,6 +444,69 @@ LIBVALKEY_API void *valkeyClusterCommandArgv(valkeyClusterContext *cc, int argc,
 LIBVALKEY_API void *valkeyClusterFormattedCommand(valkeyClusterContext *cc, char *cmd,
                                                   int len);
 
+/* Send a command to all primaries, and optionally their replicas, and combine
+ * the replies using a reducer. The command is written to all nodes before the
+ * replies are read. Returns NULL if any node failed. */
+LIBVALKEY_API void *valkeyClusterCommandToAllNodes(valkeyClusterContext *cc, int flags,
+                                                   valkeyClusterReducerFn *reducer,
+                                                   const char *format, ...);
+LIBVALKEY_API void *valkeyClustervCommandToAllNodes(valkeyClusterContext *cc, int flags,
+                                                    valkeyClusterReducerFn *reducer,
+                                                    const char *format, va_list ap);
+
+/* Cluster-wide SCAN
+ * Iterates the keys on all primaries using a cursor per node. The scan is
+ * restarted on nodes that get new slots during the scan, so a key can be
+ * returned more than once, but a key that exists during the full scan is
+ * always returned. valkeyClusterScanNext() returns an array reply containing
+ * the next page of keys, or NULL when the scan is done or failed, in which
+ * case `cc->err` is set. The cluster context can be used for other commands
+ * between the calls, but not while a page is fetched. */
+LIBVALKEY_API valkeyClusterScan *valkeyClusterScanCreate(valkeyClusterContext *cc,
+                                                         const valkeyClusterScanOptions *options);
+LIBVALKEY_API valkeyReply *valkeyClusterScanNext(valkeyClusterScan *scan);
+LIBVALKEY_API void valkeyClusterScanFree(valkeyClusterScan *scan);
+
+/* Transactions
+ * Commands are collected in a transaction, which is sent as MULTI, the
+ * commands and EXEC in a single write to the node serving the slot of the
+ * keys. All keys must hash to the same slot, and an appended command with a
+ * key in another slot is rejected. Commands without keys are accepted, but
+ * the transaction needs at least one key to be routed. When a queued command
+ * is redirected using MOVED or ASK the whole transaction is retried on the
+ * node given by the redirect. An error while appending is set on the
+ * transaction and returned when it's executed. valkeyClusterTransactionExec()
+ * returns the reply of EXEC, or NULL with `cc->err` set. A transaction can be
+ * executed more than once. */
+LIBVALKEY_API valkeyClusterTransaction *valkeyClusterTransactionCreate(void);
+LIBVALKEY_API void valkeyClusterTransactionFree(valkeyClusterTransaction *tx);
+LIBVALKEY_API int valkeyClusterTransactionAppend(valkeyClusterTransaction *tx,
+                                                 const char *format, ...);
+LIBVALKEY_API int valkeyClusterTransactionvAppend(valkeyClusterTransaction *tx,
+                                                  const char *format, va_list ap);
+LIBVALKEY_API int valkeyClusterTransactionAppendArgv(valkeyClusterTransaction *tx,
+                                                     int argc, const char **argv,
+                                                     const size_t *argvlen);
+LIBVALKEY_API void *valkeyClusterTransactionExec(valkeyClusterContext *cc,
+                                                 valkeyClusterTransaction *tx);
+
+/* Connection pool
+ * Check out one of the `connections_per_node` connections to a node for
+ * exclusive use, e.g. for blocking commands, without affecting the commands
+ * sent using the other functions. Connects or reconnects if necessary.
+ * Returns NULL with `cc->err` set when all connections are checked out or
+ * when the connect fails. The connection is returned to the pool using
+ * valkeyClusterCheckinContext() and must not be freed by the caller.
+ *
+ * The node may be freed by any slotmap update, so it must not be used after
+ * the checkout, but the connection stays valid until checked in. When the
+ * node has been removed from the cluster, the connection is closed when
+ * checked in, or when the cluster context is freed. */
+LIBVALKEY_API valkeyContext *valkeyClusterCheckoutContext(valkeyClusterContext *cc,
+                                                          valkeyClusterNode *node);
+LIBVALKEY_API void valkeyClusterCheckinContext(valkeyClusterContext *cc,
+                                               valkeyContext *c);
+
 /* Pipelining
  * The following functions will write a command to the output buffer.
  * A call to `valkeyClusterGetReply()` will flush all commands in the output
@@ -319,12 +577,74 @@ LIBVALKEY_API int valkeyClusterAsyncCommandArgvToNode(valkeyClusterAsyncContext
 LIBVALKEY_API int valkeyClusterAsyncFormattedCommand(valkeyClusterAsyncContext *acc,
                                                      valkeyClusterCallbackFn *fn,
                                                      void *privdata, char *cmd, int len);
+/* Like valkeyClusterAsyncFormattedCommand() but takes the ownership of `cmd`,
+ * which is kept for retries instead of being copied. The buffer must be
+ * allocated by valkeyFormatCommand() or valkeyFormatCommandArgv(), and is
+ * freed by the library also when an error is returned. */
+LIBVALKEY_API int valkeyClusterAsyncFormattedCommandOwned(valkeyClusterAsyncContext *acc,
+                                                          valkeyClusterCallbackFn *fn,
+                                                          void *privdata, char *cmd, int len);
 LIBVALKEY_API int valkeyClusterAsyncFormattedCommandToNode(valkeyClusterAsyncContext *acc,
                                                            valkeyClusterNode *node,
                                                            valkeyClusterCallbackFn *fn,
                                                            void *privdata, char *cmd,
                                                            int len);
 
+/* Call a registered script using EVALSHA, routed by the first of the
+ * `numkeys` keys leading the arguments. On a NOSCRIPT error the script is
+ * loaded on that node by retrying the call using EVAL. */
+LIBVALKEY_API int valkeyClusterAsyncScriptCall(valkeyClusterAsyncContext *acc,
+                                               valkeyClusterCallbackFn *fn, void *privdata,
+                                               valkeyScript *script, int numkeys, int argc,
+                                               const char **argv, const size_t *argvlen);
+
+/* Execute a transaction, see valkeyClusterTransactionCreate(). The callback is
+ * called once with the reply of EXEC, or with NULL on errors. The transaction
+ * is copied and can be freed directly. */
+LIBVALKEY_API int valkeyClusterAsyncTransactionExec(valkeyClusterAsyncContext *acc,
+                                                    valkeyClusterTransaction *tx,
+                                                    valkeyClusterCallbackFn *fn,
+                                                    void *privdata);
+
+/* Send a command to all primaries, and optionally their replicas. The callback
+ * is called once with the replies combined by the reducer, or with NULL if any
+ * node failed. */
+LIBVALKEY_API int valkeyClusterAsyncCommandToAllNodes(valkeyClusterAsyncContext *acc,
+                                                      int flags,
+                                                      valkeyClusterReducerFn *reducer,
+                                                      valkeyClusterCallbackFn *fn,
+                                                      void *privdata,
+                                                      const char *format, ...);
+LIBVALKEY_API int valkeyClustervAsyncCommandToAllNodes(valkeyClusterAsyncContext *acc,
+                                                       int flags,
+                                                       valkeyClusterReducerFn *reducer,
+                                                       valkeyClusterCallbackFn *fn,
+                                                       void *privdata,
+                                                       const char *format, va_list ap);
+
+/* Cluster-wide SCAN
+ * Scans all primaries concurrently, and the next page from a node is requested
+ * before the callback handles the current page. See valkeyClusterScanCreate()
+ * for the guarantees. */
+LIBVALKEY_API int valkeyClusterAsyncScan(valkeyClusterAsyncContext *acc,
+                                         const valkeyClusterScanOptions *options,
+                                         valkeyClusterScanCallbackFn *fn, void *privdata);
+
+/* Sharded pub/sub
+ * Channels are subscribed to on a dedicated connection to the node serving
+ * their slot, and are resubscribed to when the slot moves or the connection is
+ * lost. The callback receives the first `ssubscribe` reply and each `smessage`,
+ * and a NULL reply when the client is disconnected. `channellen` can be NULL
+ * when the channel names are null-terminated. */
+LIBVALKEY_API int valkeyClusterAsyncSsubscribe(valkeyClusterAsyncContext *acc,
+                                               valkeyClusterCallbackFn *fn,
+                                               void *privdata, int count,
+                                               const char **channels,
+                                               const size_t *channellen);
+LIBVALKEY_API int valkeyClusterAsyncSunsubscribe(valkeyClusterAsyncContext *acc,
+                                                 int count, const char **channels,
+                                                 const size_t *channellen);
+
 /* Get the valkeyAsyncContext used for communication with a given node.
  * Connects or reconnects to the node if necessary. */
 LIBVALKEY_API valkeyAsyncContext *valkeyClusterGetValkeyAsyncContext(valkeyClusterAsyncContext *acc,
@@ -335,11 +655,38 @@ LIBVALKEY_API void valkeyClusterInitNodeIterator(valkeyClusterNodeIterator *iter
                                                  valkeyClusterContext *cc);
 LIBVALKEY_API valkeyClusterNode *valkeyClusterNodeNext(valkeyClusterNodeIterator *iter);
 
+/* Node statistics */
+LIBVALKEY_API void valkeyClusterNodeGetStats(const valkeyClusterNode *node,
+                                             valkeyClusterNodeStats *stats);
+LIBVALKEY_API void valkeyClusterNodeResetStats(valkeyClusterNode *node);
+LIBVALKEY_API uint64_t valkeyClusterNodeStatsPercentile(const valkeyClusterNodeStats *stats,
+                                                        double percentile);
+
+/* Memory usage of the node connections, see valkeyGetMemoryUsage() */
+LIBVALKEY_API void valkeyClusterNodeGetMemoryUsage(const valkeyClusterNode *node,
+                                                   valkeyMemoryUsage *usage);
+LIBVALKEY_API void valkeyClusterGetMemoryUsage(valkeyClusterContext *cc,
+                                               valkeyMemoryUsage *usage);
+LIBVALKEY_API void valkeyClusterAsyncGetMemoryUsage(valkeyClusterAsyncContext *acc,
+                                                    valkeyMemoryUsage *usage);
+
 /* Helper functions */
 LIBVALKEY_API unsigned int valkeyClusterGetSlotByKey(char *key);
+LIBVALKEY_API void valkeyClusterGetSlotsByKeys(const char **keys, const size_t *keylens,
+                                               size_t count, unsigned int *slots);
+LIBVALKEY_API int valkeyClusterGetSlotByCommand(const char *cmd, size_t len);
 LIBVALKEY_API valkeyClusterNode *valkeyClusterGetNodeByKey(valkeyClusterContext *cc,
                                                            char *key);
 
+/* Reducers for the ..ToAllNodes() API. */
+
+/* Sum of integer replies. The first error is returned if any. */
+LIBVALKEY_API valkeyReply *valkeyClusterReduceSum(valkeyReply **replies, size_t count);
+/* An array reply containing the replies in node order. */
+LIBVALKEY_API valkeyReply *valkeyClusterReduceConcat(valkeyReply **replies, size_t count);
+/* The first error reply, or the first reply when no node replied an error. */
+LIBVALKEY_API valkeyReply *valkeyClusterReduceFirstError(valkeyReply **replies, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,6 +31,7 @@
 
 #ifndef VALKEY_READ_H
 #define VALKEY_READ_H
+#include "alloc.h"
 #include "visibility.h"
 
 #include <stdio.h> /* for size_t */
@@ -47,6 +48,10 @@
 #define VALKEY_ERR_PROTOCOL 4 /* Protocol error */
 #define VALKEY_ERR_OOM 5      /* Out of memory */
 #define VALKEY_ERR_TIMEOUT 6  /* Timed out */
+/* A command was rejected by the output buffer limit. Unlike the other errors
+ * the context can still be used, and the error is cleared by the next call
+ * appending a command, or reading or writing the connection. */
+#define VALKEY_ERR_OUTPUT_LIMIT 7
 #define VALKEY_ERR_OTHER 2    /* Everything else... */
 
 #define VALKEY_REPLY_STRING 1
@@ -81,6 +86,7 @@ typedef struct valkeyReadTask {
     void *obj;                     /* holds user-generated value for a read task */
     struct valkeyReadTask *parent; /* parent task */
     void *privdata;                /* user-settable arbitrary field */
+    const valkeyAllocator *allocator; /* allocator of the reader, or NULL */
 } valkeyReadTask;
 
 typedef struct valkeyReplyObjectFunctions {
@@ -111,6 +117,9 @@ typedef struct valkeyReader {
 
     valkeyReplyObjectFunctions *fn;
     void *privdata;
+
+    /* Allocator for reply objects, or NULL to use the global allocators. */
+    const valkeyAllocator *allocator;
 } valkeyReader;
 
 /* Public API for the protocol parser. */
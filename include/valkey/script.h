@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2026, the libvalkey contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VALKEY_SCRIPT_H
+#define VALKEY_SCRIPT_H
+#include "visibility.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Script registry
+ *
+ * A Lua script is registered once and then called by its handle, which sends
+ * EVALSHA with the SHA1 digest instead of the script body. When a server
+ * replies NOSCRIPT, e.g. after a restart or a SCRIPT FLUSH, the call is
+ * retried using EVAL, which also loads the script on that server. See
+ * valkeyAsyncScriptCall() and valkeyClusterAsyncScriptCall().
+ *
+ * A script is used by contexts in the same thread. It can be freed while calls
+ * are in progress, which keep it until their replies are received. */
+typedef struct valkeyScript valkeyScript;
+
+/* Register a script. The digest is calculated locally. */
+LIBVALKEY_API valkeyScript *valkeyScriptCreate(const char *body, size_t len);
+LIBVALKEY_API void valkeyScriptFree(valkeyScript *script);
+
+/* The SHA1 digest of the script, as 40 lowercase hex characters. */
+LIBVALKEY_API const char *valkeyScriptGetSha(const valkeyScript *script);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VALKEY_SCRIPT_H */
@@ -84,8 +84,21 @@ typedef struct {
     const char *private_key_filename;
     const char *server_name;
     int verify_mode;
+    /* Hand the record encryption to the kernel after the handshake (kTLS),
+     * when supported by OpenSSL, the kernel and the negotiated cipher.
+     * Otherwise the connection falls back to encryption in user space. */
+    int enable_ktls;
+    /* Number of server endpoints to cache a session for, which is resumed
+     * when connecting to the same endpoint again, instead of doing a full
+     * handshake. The cache is shared by all connections using the context,
+     * also in multiple threads. Default 0, i.e. no session cache. */
+    int session_cache_size;
 } valkeyTLSOptions;
 
+/* Directions offloaded to kernel TLS, see valkeyTLSGetKTLS(). */
+#define VALKEY_TLS_KTLS_SEND 0x01
+#define VALKEY_TLS_KTLS_RECV 0x02
+
 /**
  * Return the error message corresponding with the specified error code.
  */
@@ -155,6 +168,21 @@ LIBVALKEY_API int valkeyInitiateTLSWithContext(struct valkeyContext *c, valkeyTL
  */
 LIBVALKEY_API int valkeyInitiateTLS(struct valkeyContext *c, struct ssl_st *ssl);
 
+/**
+ * Return 1 if the handshake of a TLS connection resumed a cached session,
+ * see `session_cache_size`, or 0 if a full handshake was done.
+ */
+LIBVALKEY_API int valkeyTLSIsSessionReused(struct valkeyContext *c);
+
+/**
+ * Get the directions of a TLS connection that are offloaded to kernel TLS,
+ * as a combination of VALKEY_TLS_KTLS_SEND and VALKEY_TLS_KTLS_RECV.
+ *
+ * Returns 0 when kTLS is not used, e.g. before the handshake has completed,
+ * when it wasn't enabled using `enable_ktls` or when it isn't supported.
+ */
+LIBVALKEY_API int valkeyTLSGetKTLS(struct valkeyContext *c);
+
 #ifdef __cplusplus
 }
 #endif
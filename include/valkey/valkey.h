@@ -103,6 +103,13 @@ typedef SSIZE_T ssize_t;
 /* Flag specific to use Multipath TCP (MPTCP) */
 #define VALKEY_MPTCP 0x2000
 
+/* Flag that is set when key tracking is enabled for a client-side cache. */
+#define VALKEY_TRACKING 0x4000
+
+/* Flag that is set while commands are queued in a transaction, which bypass
+ * the client-side cache. */
+#define VALKEY_IN_MULTI 0x8000
+
 #define VALKEY_KEEPALIVE_INTERVAL 15 /* seconds */
 
 /* number of times we retry to connect in the case of EADDRNOTAVAIL and
@@ -132,9 +139,10 @@ typedef struct valkeyReply {
                                    * VALKEY_REPLY_VERB,
                                    * VALKEY_REPLY_DOUBLE (in additional to dval),
                                    * and VALKEY_REPLY_BIGNUM. */
-    char vtype[4];                /* Used for VALKEY_REPLY_VERB, contains the null
-                                   * terminated 3 character content type,
-                                   * such as "txt". */
+    char vtype[4];                /* Only meaningful for VALKEY_REPLY_VERB,
+                                   * contains the null terminated 3 character
+                                   * content type, such as "txt". Used
+                                   * internally for other types. */
     size_t elements;              /* number of elements, for VALKEY_REPLY_ARRAY */
     struct valkeyReply **element; /* elements vector for VALKEY_REPLY_ARRAY */
 } valkeyReply;
@@ -144,6 +152,15 @@ LIBVALKEY_API valkeyReader *valkeyReaderCreate(void);
 /* Function to free the reply objects hivalkey returns by default. */
 LIBVALKEY_API void freeReplyObject(void *reply);
 
+/* Keep up to `bytes` of small reply allocations per thread in free lists,
+ * reused by replies read using the global allocators. 0 disables them. Can
+ * be called from any thread. Lowering the limit only trims the free lists of
+ * the calling thread, other threads keep their memory until they trim their
+ * lists, see valkeyTrimReplyFreelist(), or exit. */
+LIBVALKEY_API void valkeySetReplyFreelistLimit(size_t bytes);
+/* Free the memory kept in the free lists of the calling thread. */
+LIBVALKEY_API void valkeyTrimReplyFreelist(void);
+
 /* Functions to format a command according to the protocol. */
 LIBVALKEY_API int valkeyvFormatCommand(char **target, const char *format, va_list ap);
 LIBVALKEY_API int valkeyFormatCommand(char **target, const char *format, ...);
@@ -173,7 +190,9 @@ enum valkeyConnectionType {
 #define VALKEY_OPT_PREFER_IPV6 0x40       /* Prefer IPv6 in DNS lookups. */
 #define VALKEY_OPT_PREFER_IP_UNSPEC (VALKEY_OPT_PREFER_IPV4 | VALKEY_OPT_PREFER_IPV6)
 #define VALKEY_OPT_MPTCP 0x80
-#define VALKEY_OPT_LAST_SA_OPTION 0x80 /* Last defined standalone option. */
+#define VALKEY_OPT_REUSE_PUBSUB_REPLIES 0x100 /* Reuse a reply for pub/sub
+                                               * messages in async contexts. */
+#define VALKEY_OPT_LAST_SA_OPTION 0x100 /* Last defined standalone option. */
 
 /* In Unix systems a file descriptor is a regular signed int, with -1
  * representing an invalid descriptor. In Windows it is a SOCKET
@@ -226,6 +245,19 @@ typedef struct {
     /* A user defined PUSH message callback */
     valkeyPushFn *push_cb;
     valkeyAsyncPushFn *async_push_cb;
+
+    /* An allocator for the reply objects and the async callbacks of this
+     * context, instead of the global allocators. The read and write buffers,
+     * verbatim strings and the context itself still use the global
+     * allocators. It must outlive the context and its replies. */
+    const valkeyAllocator *allocator;
+
+    /* Max size of the output buffer. New commands are rejected with the
+     * error VALKEY_ERR_OUTPUT_LIMIT, which doesn't prevent using the context,
+     * when the commands waiting to be written would exceed it. The
+     * asynchronous API rejects them without setting an error. Default 0, no
+     * limit. */
+    size_t max_obuf_size;
 } valkeyOptions;
 
 /**
@@ -320,8 +352,22 @@ typedef struct valkeyContext {
 
     /* An optional RESP3 PUSH handler */
     valkeyPushFn *push_cb;
+
+    /* Allocator given by the option `allocator`, or NULL. */
+    const valkeyAllocator *allocator;
+
+    size_t max_obuf_size; /* Given by the option `max_obuf_size`, or 0. */
 } valkeyContext;
 
+/* Memory held by a connection, in bytes, see valkeyGetMemoryUsage(). */
+typedef struct valkeyMemoryUsage {
+    size_t obuf;          /* Commands not yet written */
+    size_t reader;        /* Read buffer and reader state */
+    size_t callbacks;     /* Callbacks of commands awaiting a reply (async) */
+    size_t subscriptions; /* Subscribed channels and patterns (async) */
+    size_t total;         /* Sum of the above */
+} valkeyMemoryUsage;
+
 LIBVALKEY_API valkeyContext *valkeyConnectWithOptions(const valkeyOptions *options);
 LIBVALKEY_API valkeyContext *valkeyConnect(const char *ip, int port);
 LIBVALKEY_API valkeyContext *valkeyConnectWithTimeout(const char *ip, int port, const struct timeval tv);
@@ -360,6 +406,9 @@ LIBVALKEY_API valkeyFD valkeyFreeKeepFd(valkeyContext *c);
 LIBVALKEY_API int valkeyBufferRead(valkeyContext *c);
 LIBVALKEY_API int valkeyBufferWrite(valkeyContext *c, int *done);
 
+/* Get the memory held by the buffers of a context. */
+LIBVALKEY_API void valkeyGetMemoryUsage(const valkeyContext *c, valkeyMemoryUsage *usage);
+
 /* In a blocking context, this function first checks if there are unconsumed
  * replies to return and returns one if so. Otherwise, it flushes the output
  * buffer to the socket and reads until it has a reply. In a non-blocking
@@ -44,8 +44,10 @@
 
 #include "async.h"
 #include "async_private.h"
+#include "cache_private.h"
 #include "dict.h"
 #include "net.h"
+#include "script_private.h"
 #include "valkey_private.h"
 #include "vkutil.h"
 
@@ -67,6 +69,29 @@ typedef struct {
     void *user_priv_data;
 } ssubscribeCallbackData;
 
+/* A script call, kept to be retried using EVAL. */
+typedef struct {
+    valkeyScript *script;
+    sds command; /* EVALSHA, or NULL when retried. */
+    valkeyCallbackFn *user_callback;
+    void *user_priv_data;
+} scriptCallbackData;
+
+/* A command whose reply is stored in the client-side cache. */
+typedef struct {
+    sds command;
+    int db;
+    valkeyCallbackFn *user_callback;
+    void *user_priv_data;
+} cacheFillCallbackData;
+
+/* A SELECT command, which changes the database of the cached replies. */
+typedef struct {
+    int db;
+    valkeyCallbackFn *user_callback;
+    void *user_priv_data;
+} cacheSelectCallbackData;
+
 /* Forward declarations of valkey.c functions */
 int valkeyAppendCmdLen(valkeyContext *c, const char *cmd, size_t len);
 
@@ -100,6 +125,273 @@ static dictType callbackDict = {
     .keyDestructor = callbackKeyDestructor,
     .valDestructor = callbackValDestructor};
 
+typedef struct {
+    const char *str;
+    size_t len;
+} callbackName;
+
+static int callbackNameMatch(const void *key, const void *privdata) {
+    const callbackName *name = privdata;
+    return sdslen((const sds)key) == name->len &&
+           memcmp(key, name->str, name->len) == 0;
+}
+
+/* Find the callback of a channel or pattern without creating an sds key. */
+static dictEntry *callbackFind(dict *callbacks, const char *str, size_t len) {
+    callbackName name = {str, len};
+    uint64_t hash = dictGenHashFunction((const unsigned char *)str, (int)len);
+    return dictFindByHash(callbacks, hash, callbackNameMatch, &name);
+}
+
+/* Types of pub/sub replies, see valkeyPubsubType(). */
+#define PUBSUB_OTHER 0
+#define PUBSUB_MESSAGE 1
+#define PUBSUB_SUBSCRIBE 2
+#define PUBSUB_UNSUBSCRIBE 3
+#define PUBSUB_KIND_MASK 0x3
+#define PUBSUB_PATTERN 0x4 /* The p-prefixed variant, e.g. "pmessage". */
+#define PUBSUB_SHARDED 0x8 /* The s-prefixed variant, e.g. "smessage". */
+
+/* Classify the type of a pub/sub reply, e.g. "message" or "punsubscribe".
+ * The length and the first character select the only possible match, so at
+ * most one string comparison is needed. */
+static int valkeyPubsubType(const char *str, size_t len) {
+    const char *name;
+    int type;
+
+    switch (len) {
+    case 8:
+    case 10:
+    case 12:
+        if (tolower((unsigned char)str[0]) == 'p')
+            type = PUBSUB_PATTERN;
+        else if (tolower((unsigned char)str[0]) == 's')
+            type = PUBSUB_SHARDED;
+        else
+            return PUBSUB_OTHER;
+        str++;
+        len--;
+        break;
+    default:
+        type = 0;
+    }
+
+    switch (len) {
+    case 7:
+        name = "message";
+        type |= PUBSUB_MESSAGE;
+        break;
+    case 9:
+        name = "subscribe";
+        type |= PUBSUB_SUBSCRIBE;
+        break;
+    case 11:
+        name = "unsubscribe";
+        type |= PUBSUB_UNSUBSCRIBE;
+        break;
+    default:
+        return PUBSUB_OTHER;
+    }
+
+    if (tolower((unsigned char)str[0]) != name[0] ||
+        strncasecmp(str + 1, name + 1, len - 1) != 0)
+        return PUBSUB_OTHER;
+    return type;
+}
+
+/* A reply that is reused for each pub/sub message received, see
+ * VALKEY_OPT_REUSE_PUBSUB_REPLIES. The reader builds the message in it,
+ * with the strings copied into a buffer that is kept between messages.
+ * Replies that turn out not to be messages are built by the reader's
+ * regular functions instead. */
+typedef struct valkeyPubsubReply {
+    valkeyReply reply; /* Must be first. */
+    valkeyReply elements[4];
+    valkeyReply *element[4];
+    size_t offset[4]; /* Offset of string elements in `buf`. */
+    char *buf;
+    size_t buflen;
+    size_t bufcap;
+    int in_use;
+    valkeyContext *c;
+    valkeyReplyObjectFunctions *fn; /* Functions for other replies. */
+} valkeyPubsubReply;
+
+/* Returns the reused reply when the task is one of its elements. */
+static valkeyPubsubReply *pubsubReplyOf(const valkeyReadTask *task) {
+    valkeyPubsubReply *pr = task->privdata;
+    if (task->parent != NULL && task->parent->obj == &pr->reply)
+        return pr;
+    return NULL;
+}
+
+/* Replace the reused reply with a regular one, when the first element shows
+ * that the reply isn't a message. */
+static int pubsubReplyAbandon(valkeyPubsubReply *pr, const valkeyReadTask *task) {
+    void *obj = pr->fn->createArray(task->parent, pr->reply.elements);
+    if (obj == NULL)
+        return VALKEY_ERR;
+    task->parent->obj = obj;
+    pr->c->reader->reply = obj;
+    pr->in_use = 0;
+    return VALKEY_OK;
+}
+
+static void *pubsubCreateString(const valkeyReadTask *task, char *str, size_t len) {
+    valkeyPubsubReply *pr = pubsubReplyOf(task);
+    valkeyReply *e;
+
+    if (pr == NULL)
+        return ((valkeyPubsubReply *)task->privdata)->fn->createString(task, str, len);
+
+    if (task->idx == 0 && (task->type != VALKEY_REPLY_STRING ||
+                           (valkeyPubsubType(str, len) & PUBSUB_KIND_MASK) != PUBSUB_MESSAGE)) {
+        if (pubsubReplyAbandon(pr, task) != VALKEY_OK)
+            return NULL;
+        return pr->fn->createString(task, str, len);
+    }
+    if (task->type != VALKEY_REPLY_STRING)
+        return pr->fn->createString(task, str, len);
+
+    if (pr->buflen + len + 1 > pr->bufcap) {
+        size_t cap = pr->bufcap ? pr->bufcap : 256;
+        while (cap < pr->buflen + len + 1)
+            cap *= 2;
+        char *buf = vk_realloc(pr->buf, cap);
+        if (buf == NULL)
+            return NULL;
+        pr->buf = buf;
+        pr->bufcap = cap;
+        for (int i = 0; i < task->idx; i++) {
+            if (pr->element[i] == &pr->elements[i] &&
+                pr->elements[i].type == VALKEY_REPLY_STRING)
+                pr->elements[i].str = pr->buf + pr->offset[i];
+        }
+    }
+
+    e = &pr->elements[task->idx];
+    memset(e, 0, sizeof(*e));
+    e->type = VALKEY_REPLY_STRING;
+    e->str = pr->buf + pr->buflen;
+    e->len = len;
+    memcpy(e->str, str, len);
+    e->str[len] = '\0';
+    pr->offset[task->idx] = pr->buflen;
+    pr->buflen += len + 1;
+    pr->element[task->idx] = e;
+    return e;
+}
+
+static void *pubsubCreateArray(const valkeyReadTask *task, size_t elements) {
+    valkeyPubsubReply *pr = task->privdata;
+
+    if (task->parent == NULL && !pr->in_use && elements >= 3 && elements <= 4 &&
+        (task->type == VALKEY_REPLY_ARRAY || task->type == VALKEY_REPLY_PUSH) &&
+        (pr->c->flags & VALKEY_SUBSCRIBED) &&
+        !(pr->c->flags & VALKEY_NO_AUTO_FREE_REPLIES)) {
+        memset(&pr->reply, 0, sizeof(pr->reply));
+        pr->reply.type = task->type;
+        pr->reply.elements = elements;
+        pr->reply.element = pr->element;
+        valkeyReplySetOwner(&pr->reply, VALKEY_REPLY_OWNER_REUSED);
+        memset(pr->element, 0, sizeof(pr->element));
+        pr->buflen = 0;
+        pr->in_use = 1;
+        return &pr->reply;
+    }
+
+    if (pubsubReplyOf(task) && task->idx == 0 &&
+        pubsubReplyAbandon(pr, task) != VALKEY_OK)
+        return NULL;
+    return pr->fn->createArray(task, elements);
+}
+
+static void *pubsubCreateInteger(const valkeyReadTask *task, long long value) {
+    valkeyPubsubReply *pr = task->privdata;
+    if (pubsubReplyOf(task) && task->idx == 0 &&
+        pubsubReplyAbandon(pr, task) != VALKEY_OK)
+        return NULL;
+    return pr->fn->createInteger(task, value);
+}
+
+static void *pubsubCreateDouble(const valkeyReadTask *task, double value,
+                                char *str, size_t len) {
+    valkeyPubsubReply *pr = task->privdata;
+    if (pubsubReplyOf(task) && task->idx == 0 &&
+        pubsubReplyAbandon(pr, task) != VALKEY_OK)
+        return NULL;
+    return pr->fn->createDouble(task, value, str, len);
+}
+
+static void *pubsubCreateNil(const valkeyReadTask *task) {
+    valkeyPubsubReply *pr = task->privdata;
+    if (pubsubReplyOf(task) && task->idx == 0 &&
+        pubsubReplyAbandon(pr, task) != VALKEY_OK)
+        return NULL;
+    return pr->fn->createNil(task);
+}
+
+static void *pubsubCreateBool(const valkeyReadTask *task, int bval) {
+    valkeyPubsubReply *pr = task->privdata;
+    if (pubsubReplyOf(task) && task->idx == 0 &&
+        pubsubReplyAbandon(pr, task) != VALKEY_OK)
+        return NULL;
+    return pr->fn->createBool(task, bval);
+}
+
+/* Releases the reused reply, or frees any other reply. Elements of the reused
+ * reply that were not strings are regular replies. */
+static void pubsubFreeObject(void *obj) {
+    valkeyReply *r = obj;
+
+    if (r == NULL || valkeyReplyGetOwner(r) != VALKEY_REPLY_OWNER_REUSED) {
+        freeReplyObject(obj);
+        return;
+    }
+
+    valkeyPubsubReply *pr = (valkeyPubsubReply *)r;
+    for (size_t i = 0; i < r->elements; i++) {
+        if (pr->element[i] != NULL && pr->element[i] != &pr->elements[i])
+            pr->fn->freeObject(pr->element[i]);
+    }
+    pr->in_use = 0;
+}
+
+static valkeyReplyObjectFunctions pubsubReplyFunctions = {
+    pubsubCreateString,
+    pubsubCreateArray,
+    pubsubCreateInteger,
+    pubsubCreateDouble,
+    pubsubCreateNil,
+    pubsubCreateBool,
+    pubsubFreeObject};
+
+/* Let the reader of the context reuse a reply for pub/sub messages. */
+static int valkeyAsyncReusePubsubReplies(valkeyAsyncContext *ac) {
+    valkeyContext *c = &ac->c;
+    valkeyPubsubReply *pr;
+
+    if (c->reader == NULL)
+        return VALKEY_OK;
+
+    pr = vk_calloc(1, sizeof(*pr));
+    if (pr == NULL)
+        return VALKEY_ERR;
+    pr->c = c;
+    pr->fn = c->reader->fn;
+    c->reader->fn = &pubsubReplyFunctions;
+    c->reader->privdata = pr;
+    ac->sub.reused_reply = pr;
+    return VALKEY_OK;
+}
+
+static void valkeyPubsubReplyFree(valkeyPubsubReply *pr) {
+    if (pr == NULL)
+        return;
+    vk_free(pr->buf);
+    vk_free(pr);
+}
+
 static valkeyAsyncContext *valkeyAsyncInitialize(valkeyContext *c) {
     valkeyAsyncContext *ac;
     dict *channels = NULL, *patterns = NULL, *schannels = NULL;
@@ -151,8 +443,14 @@ static valkeyAsyncContext *valkeyAsyncInitialize(valkeyContext *c) {
     ac->sub.patterns = patterns;
     ac->sub.schannels = schannels;
     ac->sub.pending_unsubs = 0;
+    ac->sub.reused_reply = NULL;
 
     ac->timeout_reply_count = VALKEY_TIMEOUT_INACTIVE;
+    ac->cache = NULL;
+    ac->cache_db = 0;
+    ac->cache_bypass = 0;
+    ac->replies_pending = 0;
+    ac->callbacks_size = 0;
 
     return ac;
 oom:
@@ -198,6 +496,12 @@ valkeyAsyncContext *valkeyAsyncConnectWithOptions(const valkeyOptions *options)
     /* Set any configured async push handler */
     valkeyAsyncSetPushCallback(ac, myOptions.async_push_cb);
 
+    if ((options->options & VALKEY_OPT_REUSE_PUBSUB_REPLIES) &&
+        valkeyAsyncReusePubsubReplies(ac) != VALKEY_OK) {
+        valkeyAsyncFree(ac);
+        return NULL;
+    }
+
     valkeyAsyncCopyError(ac);
     return ac;
 }
@@ -255,11 +559,11 @@ int valkeyAsyncSetDisconnectCallback(valkeyAsyncContext *ac, valkeyDisconnectCal
 }
 
 /* Helper functions to push/shift callbacks */
-static int valkeyPushCallback(valkeyCallbackList *list, valkeyCallback *source) {
+static int valkeyPushCallback(valkeyAsyncContext *ac, valkeyCallbackList *list, valkeyCallback *source) {
     valkeyCallback *cb;
 
     /* Copy callback from stack to heap */
-    cb = vk_malloc(sizeof(*cb));
+    cb = vk_ctx_malloc(ac->c.allocator, sizeof(*cb));
     if (cb == NULL)
         return VALKEY_ERR_OOM;
 
@@ -270,6 +574,10 @@ static int valkeyPushCallback(valkeyCallbackList *list, valkeyCallback *source)
         cb->next = NULL;
     }
 
+    ac->callbacks_size += sizeof(*cb);
+    if (list == &ac->replies)
+        ac->replies_pending++;
+
     /* Store callback in list */
     if (list->head == NULL)
         list->head = cb;
@@ -279,7 +587,7 @@ static int valkeyPushCallback(valkeyCallbackList *list, valkeyCallback *source)
     return VALKEY_OK;
 }
 
-static int valkeyShiftCallback(valkeyCallbackList *list, valkeyCallback *target) {
+static int valkeyShiftCallback(valkeyAsyncContext *ac, valkeyCallbackList *list, valkeyCallback *target) {
     valkeyCallback *cb = list->head;
     if (cb != NULL) {
         list->head = cb->next;
@@ -289,7 +597,13 @@ static int valkeyShiftCallback(valkeyCallbackList *list, valkeyCallback *target)
         /* Copy callback from heap to stack */
         if (target != NULL)
             memcpy(target, cb, sizeof(*cb));
-        vk_free(cb);
+        vk_ctx_free(ac->c.allocator, cb);
+        ac->callbacks_size -= sizeof(*cb);
+        if (list == &ac->replies) {
+            ac->replies_pending--;
+            if (ac->cache_bypass > 0)
+                ac->cache_bypass--;
+        }
         return VALKEY_OK;
     }
     return VALKEY_ERR;
@@ -347,9 +661,9 @@ static void valkeyAsyncFreeInternal(valkeyAsyncContext *ac) {
     dictEntry *de;
 
     /* Execute pending callbacks with NULL reply. */
-    while (valkeyShiftCallback(&ac->replies, &cb) == VALKEY_OK)
+    while (valkeyShiftCallback(ac, &ac->replies, &cb) == VALKEY_OK)
         valkeyRunCallback(ac, &cb, NULL);
-    while (valkeyShiftCallback(&ac->sub.replies, &cb) == VALKEY_OK)
+    while (valkeyShiftCallback(ac, &ac->sub.replies, &cb) == VALKEY_OK)
         valkeyRunCallback(ac, &cb, NULL);
 
     /* Run subscription callbacks with NULL reply */
@@ -377,6 +691,10 @@ static void valkeyAsyncFreeInternal(valkeyAsyncContext *ac) {
         dictRelease(ac->sub.schannels);
     }
 
+    /* Invalidations for the cached replies can't be received anymore. */
+    if (ac->cache != NULL && (c->flags & VALKEY_TRACKING))
+        valkeyCacheFlush(ac->cache);
+
     /* Signal event lib to clean up */
     _EL_CLEANUP(ac);
 
@@ -393,8 +711,10 @@ static void valkeyAsyncFreeInternal(valkeyAsyncContext *ac) {
         ac->dataCleanup(ac->data);
     }
 
-    /* Cleanup self */
+    /* Cleanup self. The reader may still use the reused reply. */
+    valkeyPubsubReply *reused_reply = ac->sub.reused_reply;
     valkeyFree(c);
+    valkeyPubsubReplyFree(reused_reply);
 }
 
 /* Free the async context. When this function is called from a callback,
@@ -421,7 +741,7 @@ void valkeyAsyncDisconnectInternal(valkeyAsyncContext *ac) {
 
     if (ac->err == 0) {
         /* For clean disconnects, there should be no pending callbacks. */
-        int ret = valkeyShiftCallback(&ac->replies, NULL);
+        int ret = valkeyShiftCallback(ac, &ac->replies, NULL);
         assert(ret == VALKEY_ERR);
     } else {
         /* Disconnection is caused by an error, make sure that pending
@@ -466,10 +786,8 @@ static int valkeyGetSubscribeCallback(valkeyAsyncContext *ac, valkeyReply *reply
     valkeyContext *c = &(ac->c);
     dict *callbacks;
     valkeyCallback *cb = NULL;
-    dictEntry *de;
-    int pvariant, svariant;
-    char *stype;
-    sds sname = NULL;
+    dictEntry *de = NULL;
+    int type;
 
     /* Match reply with the expected format of a pushed message.
      * The type and number of elements (3 to 4) are specified at:
@@ -477,36 +795,31 @@ static int valkeyGetSubscribeCallback(valkeyAsyncContext *ac, valkeyReply *reply
     if ((reply->type == VALKEY_REPLY_ARRAY && !(c->flags & VALKEY_SUPPORTS_PUSH) && reply->elements >= 3) ||
         reply->type == VALKEY_REPLY_PUSH) {
         assert(reply->element[0]->type == VALKEY_REPLY_STRING);
-        stype = reply->element[0]->str;
-        pvariant = (tolower(stype[0]) == 'p') ? 1 : 0;
-        svariant = valkeyIsShardedVariant(stype);
+        type = valkeyPubsubType(reply->element[0]->str, reply->element[0]->len);
 
-        callbacks = pvariant ? ac->sub.patterns :
-                    svariant ? ac->sub.schannels :
-                               ac->sub.channels;
+        callbacks = (type & PUBSUB_PATTERN) ? ac->sub.patterns :
+                    (type & PUBSUB_SHARDED) ? ac->sub.schannels :
+                                              ac->sub.channels;
 
         /* Locate the right callback */
         if (reply->element[1]->type == VALKEY_REPLY_STRING) {
-            sname = sdsnewlen(reply->element[1]->str, reply->element[1]->len);
-            if (sname == NULL)
-                goto oom;
-
-            if ((de = dictFind(callbacks, sname)) != NULL) {
+            de = callbackFind(callbacks, reply->element[1]->str, reply->element[1]->len);
+            if (de != NULL) {
                 cb = dictGetVal(de);
                 memcpy(dstcb, cb, sizeof(*dstcb));
             }
         }
 
         /* If this is a subscribe reply decrease pending counter. */
-        if (strcasecmp(stype + pvariant + svariant, "subscribe") == 0) {
+        if ((type & PUBSUB_KIND_MASK) == PUBSUB_SUBSCRIBE) {
             assert(cb != NULL);
             cb->pending_subs -= 1;
             cb->subscribed = 1;
-        } else if (strcasecmp(stype + pvariant + svariant, "unsubscribe") == 0) {
+        } else if ((type & PUBSUB_KIND_MASK) == PUBSUB_UNSUBSCRIBE) {
             if (cb == NULL)
                 ac->sub.pending_unsubs -= 1;
             else if (cb->pending_subs == 0)
-                dictDelete(callbacks, sname);
+                dictDelete(callbacks, dictGetKey(de));
 
             /* If this was the last unsubscribe message, revert to
              * non-subscribe mode. */
@@ -523,44 +836,27 @@ static int valkeyGetSubscribeCallback(valkeyAsyncContext *ac, valkeyReply *reply
 
                 /* Move ongoing regular command callbacks. */
                 valkeyCallback reply_cb;
-                while (valkeyShiftCallback(&ac->sub.replies, &reply_cb) == VALKEY_OK) {
-                    valkeyPushCallback(&ac->replies, &reply_cb);
+                while (valkeyShiftCallback(ac, &ac->sub.replies, &reply_cb) == VALKEY_OK) {
+                    valkeyPushCallback(ac, &ac->replies, &reply_cb);
                 }
             }
         }
-        sdsfree(sname);
     } else {
         /* Shift callback for pending command in subscribed context. */
-        valkeyShiftCallback(&ac->sub.replies, dstcb);
+        valkeyShiftCallback(ac, &ac->sub.replies, dstcb);
     }
     return VALKEY_OK;
-oom:
-    valkeySetError(&(ac->c), VALKEY_ERR_OOM, "Out of memory");
-    valkeyAsyncCopyError(ac);
-    return VALKEY_ERR;
 }
 
 #define valkeyIsSpontaneousPushReply(r) \
     (valkeyIsPushReply(r) && !valkeyIsSubscribeReply(r))
 
 static int valkeyIsSubscribeReply(valkeyReply *reply) {
-    char *str;
-    size_t len, off;
-
     /* We will always have at least one string with the subscribe/message type */
-    if (reply->elements < 1 || reply->element[0]->type != VALKEY_REPLY_STRING ||
-        reply->element[0]->len < sizeof("message") - 1) {
+    if (reply->elements < 1 || reply->element[0]->type != VALKEY_REPLY_STRING)
         return 0;
-    }
-
-    /* Get the string/len moving past 'p' if needed */
-    off = tolower(reply->element[0]->str[0]) == 'p' || valkeyIsShardedVariant(reply->element[0]->str);
-    str = reply->element[0]->str + off;
-    len = reply->element[0]->len - off;
 
-    return !strncasecmp(str, "subscribe", len) ||
-           !strncasecmp(str, "message", len) ||
-           !strncasecmp(str, "unsubscribe", len);
+    return valkeyPubsubType(reply->element[0]->str, reply->element[0]->len) != PUBSUB_OTHER;
 }
 
 void valkeyProcessCallbacks(valkeyAsyncContext *ac) {
@@ -594,6 +890,8 @@ void valkeyProcessCallbacks(valkeyAsyncContext *ac) {
          * This allows existing code to be backward compatible and work in
          * either RESP2 or RESP3 mode. */
         if (valkeyIsSpontaneousPushReply(reply)) {
+            if (ac->cache != NULL)
+                valkeyCacheHandlePush(ac->cache, reply);
             valkeyRunPushCallback(ac, reply);
             c->reader->fn->freeObject(reply);
             continue;
@@ -602,7 +900,7 @@ void valkeyProcessCallbacks(valkeyAsyncContext *ac) {
         /* Even if the context is subscribed, pending regular
          * callbacks will get a reply before pub/sub messages arrive. */
         valkeyCallback cb = {NULL, NULL, 0, 0, NULL};
-        if (valkeyShiftCallback(&ac->replies, &cb) != VALKEY_OK) {
+        if (valkeyShiftCallback(ac, &ac->replies, &cb) != VALKEY_OK) {
             /*
              * A spontaneous reply in a not-subscribed context can be the error
              * reply that is sent when a new connection exceeds the maximum
@@ -624,7 +922,7 @@ void valkeyProcessCallbacks(valkeyAsyncContext *ac) {
                 if (c->flags & VALKEY_SUBSCRIBED)
                     valkeyGetSubscribeCallback(ac, reply, &cb);
             } else if (
-                (c->flags & VALKEY_SUBSCRIBED) && (((valkeyReply *)reply)->type == VALKEY_REPLY_ERROR) && (strncmp(((valkeyReply *)reply)->str, "MOVED", 5) == 0 || strncmp(((valkeyReply *)reply)->str, "CROSSSLOT", 9) == 0) && valkeyShiftCallback(&ac->sub.replies, &cb) == VALKEY_OK) {
+                (c->flags & VALKEY_SUBSCRIBED) && (((valkeyReply *)reply)->type == VALKEY_REPLY_ERROR) && (strncmp(((valkeyReply *)reply)->str, "MOVED", 5) == 0 || strncmp(((valkeyReply *)reply)->str, "CROSSSLOT", 9) == 0) && valkeyShiftCallback(ac, &ac->sub.replies, &cb) == VALKEY_OK) {
                 /* Ssubscribe error */
             } else {
                 c->err = VALKEY_ERR_OTHER;
@@ -656,7 +954,7 @@ void valkeyProcessCallbacks(valkeyAsyncContext *ac) {
 
         /* If in monitor mode, repush the callback */
         if (c->flags & VALKEY_MONITORING) {
-            valkeyPushCallback(&ac->replies, &cb);
+            valkeyPushCallback(ac, &ac->replies, &cb);
         }
     }
 
@@ -814,7 +1112,7 @@ void valkeyAsyncHandleTimeout(valkeyAsyncContext *ac) {
         valkeyRunConnectCallback(ac, VALKEY_ERR);
     }
 
-    while (valkeyShiftCallback(&ac->replies, &cb) == VALKEY_OK) {
+    while (valkeyShiftCallback(ac, &ac->replies, &cb) == VALKEY_OK) {
         valkeyRunCallback(ac, &cb, NULL);
     }
 
@@ -917,7 +1215,13 @@ void valkeySsubscribeCallback(struct valkeyAsyncContext *ac, void *reply, void *
 
     assert(data != NULL);
     assert(data->command != NULL);
-    assert(r != NULL);
+    if (r == NULL) {
+        /* The context is freed before the subscription was replied. */
+        data->user_callback(ac, reply, data->user_priv_data);
+        vk_free(data->command);
+        vk_free(privdata);
+        return;
+    }
     if (r->type == VALKEY_REPLY_ERROR) {
         /*/ On CROSSSLOT, MOVED and other errors */
         p = nextArgument(data->command, data->len, &cstr, &clen);
@@ -995,6 +1299,11 @@ static int valkeyAsyncAppendCmdLen(valkeyAsyncContext *ac, valkeyCallbackFn *fn,
     if (c->flags & (VALKEY_DISCONNECTING | VALKEY_FREEING))
         return VALKEY_ERR;
 
+    /* Don't accept new commands exceeding the output buffer limit, but keep
+     * the connection. */
+    if (valkeyOutputLimitReached(c, len))
+        return VALKEY_ERR;
+
     /* Get the first string in the command, and don't accept empty commands. */
     p = nextArgument(cmd, len, &cstr, &clen);
     if (cstr == NULL)
@@ -1068,10 +1377,10 @@ static int valkeyAsyncAppendCmdLen(valkeyAsyncContext *ac, valkeyCallbackFn *fn,
             cb.unsubscribe_sent = 0;
             cb.subscribed = 1;
             if (was_subscribed) {
-                if (valkeyPushCallback(&ac->sub.replies, &cb) != VALKEY_OK)
+                if (valkeyPushCallback(ac, &ac->sub.replies, &cb) != VALKEY_OK)
                     goto oom;
             } else {
-                if (valkeyPushCallback(&ac->replies, &cb) != VALKEY_OK)
+                if (valkeyPushCallback(ac, &ac->replies, &cb) != VALKEY_OK)
                     goto oom;
             }
         }
@@ -1131,14 +1440,14 @@ static int valkeyAsyncAppendCmdLen(valkeyAsyncContext *ac, valkeyCallbackFn *fn,
     } else if (strncasecmp(cstr, "monitor\r\n", 9) == 0) {
         /* Set monitor flag and push callback */
         c->flags |= VALKEY_MONITORING;
-        if (valkeyPushCallback(&ac->replies, &cb) != VALKEY_OK)
+        if (valkeyPushCallback(ac, &ac->replies, &cb) != VALKEY_OK)
             goto oom;
     } else {
         if (c->flags & VALKEY_SUBSCRIBED) {
-            if (valkeyPushCallback(&ac->sub.replies, &cb) != VALKEY_OK)
+            if (valkeyPushCallback(ac, &ac->sub.replies, &cb) != VALKEY_OK)
                 goto oom;
         } else {
-            if (valkeyPushCallback(&ac->replies, &cb) != VALKEY_OK)
+            if (valkeyPushCallback(ac, &ac->replies, &cb) != VALKEY_OK)
                 goto oom;
         }
     }
@@ -1159,6 +1468,167 @@ oom:
     return VALKEY_ERR;
 }
 
+static void valkeyCacheFillCallback(valkeyAsyncContext *ac, void *reply, void *privdata) {
+    cacheFillCallbackData *data = privdata;
+
+    if (reply != NULL && ac->cache != NULL && (ac->c.flags & VALKEY_TRACKING))
+        valkeyCacheStore(ac->cache, data->db, data->command, sdslen(data->command), reply);
+    if (data->user_callback != NULL)
+        data->user_callback(ac, reply, data->user_priv_data);
+    sdsfree(data->command);
+    vk_free(data);
+}
+
+static void valkeyCacheSelectCallback(valkeyAsyncContext *ac, void *reply, void *privdata) {
+    cacheSelectCallbackData *data = privdata;
+    valkeyReply *r = reply;
+
+    if (r != NULL && r->type == VALKEY_REPLY_STATUS)
+        ac->cache_db = data->db;
+    if (data->user_callback != NULL)
+        data->user_callback(ac, reply, data->user_priv_data);
+    vk_free(data);
+}
+
+/* Give a cached reply to the callback. Freeing or disconnecting the context
+ * from the callback is deferred until the callback returns, like for replies
+ * read from the connection. */
+static void valkeyRunCachedReply(valkeyAsyncContext *ac, valkeyCallbackFn *fn,
+                                 void *privdata, valkeyCacheEntry *entry) {
+    valkeyContext *c = &(ac->c);
+    int in_callback = c->flags & VALKEY_IN_CALLBACK;
+
+    if (fn != NULL) {
+        c->flags |= VALKEY_IN_CALLBACK;
+        fn(ac, valkeyCacheEntryReply(entry), privdata);
+        if (!in_callback)
+            c->flags &= ~VALKEY_IN_CALLBACK;
+    }
+    valkeyCacheEntryRelease(entry);
+
+    if (in_callback)
+        return;
+    if (c->flags & VALKEY_FREEING)
+        valkeyAsyncFreeInternal(ac);
+    else if ((c->flags & VALKEY_DISCONNECTING) && ac->replies.head == NULL)
+        valkeyAsyncDisconnectInternal(ac);
+}
+
+/* Keep track of a transaction being queued, since the queued commands are
+ * replied to with QUEUED and can neither be given from nor stored in the
+ * client-side cache. */
+static void valkeyAsyncTrackMulti(valkeyAsyncContext *ac, const char *cmd, size_t len) {
+    const char *cstr;
+    size_t clen;
+
+    nextArgument(cmd, len, &cstr, &clen);
+    if (cstr == NULL)
+        return;
+    if (clen == 5 && strncasecmp(cstr, "multi", 5) == 0)
+        ac->c.flags |= VALKEY_IN_MULTI;
+    else if ((clen == 4 && strncasecmp(cstr, "exec", 4) == 0) ||
+             (clen == 7 && strncasecmp(cstr, "discard", 7) == 0))
+        ac->c.flags &= ~VALKEY_IN_MULTI;
+}
+
+/* Send a command that isn't cacheable. The cache is bypassed until it's
+ * replied to, since it may modify a cached key. A SELECT command changes the
+ * database of the cached replies when successful. */
+static int valkeyAsyncSubmitUncached(valkeyAsyncContext *ac, valkeyCallbackFn *fn,
+                                     void *privdata, const char *cmd, size_t len) {
+    cacheSelectCallbackData *data = NULL;
+    const char *cstr, *p;
+    size_t clen;
+
+    p = nextArgument(cmd, len, &cstr, &clen);
+    if (cstr != NULL && clen == 6 && strncasecmp(cstr, "select", 6) == 0) {
+        nextArgument(p, len - (p - cmd), &cstr, &clen);
+        if (cstr != NULL) {
+            data = vk_malloc(sizeof(*data));
+            if (data == NULL) {
+                valkeySetError(&ac->c, VALKEY_ERR_OOM, "Out of memory");
+                valkeyAsyncCopyError(ac);
+                return VALKEY_ERR;
+            }
+            data->db = vk_atoi(cstr, clen);
+            data->user_callback = fn;
+            data->user_priv_data = privdata;
+            fn = valkeyCacheSelectCallback;
+            privdata = data;
+        }
+    }
+
+    if (valkeyAsyncAppendCmdLen(ac, fn, privdata, cmd, len) != VALKEY_OK) {
+        vk_free(data);
+        return VALKEY_ERR;
+    }
+    ac->cache_bypass = ac->replies_pending;
+    valkeyAsyncTrackMulti(ac, cmd, len);
+    return VALKEY_OK;
+}
+
+/* Send a command, or reply to it from the client-side cache when `lookup` is
+ * set and the reply is cached. A sent cacheable command stores its reply. */
+static int valkeyAsyncSubmit(valkeyAsyncContext *ac, valkeyCallbackFn *fn, void *privdata,
+                             const char *cmd, size_t len, int lookup) {
+    valkeyContext *c = &(ac->c);
+    cacheFillCallbackData *data;
+    valkeyCacheEntry *entry;
+
+    /* Replies owned by the callback can't be given from the cache. */
+    if (ac->cache == NULL ||
+        (c->flags & (VALKEY_NO_AUTO_FREE_REPLIES | VALKEY_MONITORING)))
+        return valkeyAsyncAppendCmdLen(ac, fn, privdata, cmd, len);
+
+    if ((c->flags & VALKEY_IN_MULTI) || !valkeyCacheIsCacheable(ac->cache, cmd, len))
+        return valkeyAsyncSubmitUncached(ac, fn, privdata, cmd, len);
+
+    if (c->flags & (VALKEY_DISCONNECTING | VALKEY_FREEING))
+        return VALKEY_ERR;
+
+    /* Neither replied from nor stored in the cache while a command that can
+     * modify the key is pending, or the database is being changed. */
+    if (ac->cache_bypass > 0)
+        return valkeyAsyncAppendCmdLen(ac, fn, privdata, cmd, len);
+
+    if (lookup && (c->flags & VALKEY_TRACKING)) {
+        entry = valkeyCacheLookup(ac->cache, ac->cache_db, cmd, len);
+        if (entry != NULL) {
+            valkeyRunCachedReply(ac, fn, privdata, entry);
+            return VALKEY_OK;
+        }
+    }
+
+    data = vk_malloc(sizeof(*data));
+    if (data == NULL)
+        goto oom;
+    data->command = sdsnewlen(cmd, len);
+    if (data->command == NULL) {
+        vk_free(data);
+        goto oom;
+    }
+    data->db = ac->cache_db;
+    data->user_callback = fn;
+    data->user_priv_data = privdata;
+
+    if (valkeyAsyncAppendCmdLen(ac, valkeyCacheFillCallback, data, cmd, len) != VALKEY_OK) {
+        sdsfree(data->command);
+        vk_free(data);
+        return VALKEY_ERR;
+    }
+    return VALKEY_OK;
+
+oom:
+    valkeySetError(c, VALKEY_ERR_OOM, "Out of memory");
+    valkeyAsyncCopyError(ac);
+    return VALKEY_ERR;
+}
+
+int valkeyAsyncFormattedCommandNoCache(valkeyAsyncContext *ac, valkeyCallbackFn *fn,
+                                       void *privdata, const char *cmd, size_t len) {
+    return valkeyAsyncSubmit(ac, fn, privdata, cmd, len, 0);
+}
+
 int valkeyvAsyncCommand(valkeyAsyncContext *ac, valkeyCallbackFn *fn, void *privdata, const char *format, va_list ap) {
     char *cmd;
     int len;
@@ -1169,7 +1639,7 @@ int valkeyvAsyncCommand(valkeyAsyncContext *ac, valkeyCallbackFn *fn, void *priv
     if (len < 0)
         return VALKEY_ERR;
 
-    status = valkeyAsyncAppendCmdLen(ac, fn, privdata, cmd, len);
+    status = valkeyAsyncSubmit(ac, fn, privdata, cmd, len, 1);
     vk_free(cmd);
     return status;
 }
@@ -1190,13 +1660,13 @@ int valkeyAsyncCommandArgv(valkeyAsyncContext *ac, valkeyCallbackFn *fn, void *p
     len = valkeyFormatSdsCommandArgv(&cmd, argc, argv, argvlen);
     if (len < 0)
         return VALKEY_ERR;
-    status = valkeyAsyncAppendCmdLen(ac, fn, privdata, cmd, len);
+    status = valkeyAsyncSubmit(ac, fn, privdata, cmd, len, 1);
     sdsfree(cmd);
     return status;
 }
 
 int valkeyAsyncFormattedCommand(valkeyAsyncContext *ac, valkeyCallbackFn *fn, void *privdata, const char *cmd, size_t len) {
-    int status = valkeyAsyncAppendCmdLen(ac, fn, privdata, cmd, len);
+    int status = valkeyAsyncSubmit(ac, fn, privdata, cmd, len, 1);
     return status;
 }
 
@@ -1223,3 +1693,138 @@ int valkeyAsyncSetTimeout(valkeyAsyncContext *ac, struct timeval tv) {
 
     return VALKEY_OK;
 }
+
+/* Memory of a subscription dict, including its keys and callbacks. */
+static size_t subscriptionsMemoryUsage(dict *d) {
+    dictIterator it;
+    dictEntry *de;
+    size_t size;
+
+    if (d == NULL)
+        return 0;
+    size = dictMemUsage(d);
+    dictInitIterator(&it, d);
+    while ((de = dictNext(&it)) != NULL)
+        size += sdsAllocSize(dictGetKey(de)) + sizeof(valkeyCallback);
+    return size;
+}
+
+void valkeyAsyncGetMemoryUsage(valkeyAsyncContext *ac, valkeyMemoryUsage *usage) {
+    valkeyPubsubReply *pr = ac->sub.reused_reply;
+
+    valkeyGetMemoryUsage(&ac->c, usage);
+    if (pr != NULL)
+        usage->reader += sizeof(*pr) + pr->bufcap;
+    usage->callbacks = ac->callbacks_size;
+    usage->subscriptions = subscriptionsMemoryUsage(ac->sub.channels) +
+                           subscriptionsMemoryUsage(ac->sub.patterns) +
+                           subscriptionsMemoryUsage(ac->sub.schannels);
+    usage->total = usage->obuf + usage->reader + usage->callbacks +
+                   usage->subscriptions;
+}
+
+/* The cache is not used when the connection can't be switched to RESP3 or
+ * tracking is refused, e.g. by an older server. */
+static void valkeyCacheHelloCallback(valkeyAsyncContext *ac, void *r, void *privdata) {
+    valkeyReply *reply = r;
+    (void)privdata;
+
+    if (reply == NULL || reply->type == VALKEY_REPLY_ERROR)
+        ac->cache = NULL;
+}
+
+static void valkeyCacheTrackingCallback(valkeyAsyncContext *ac, void *r, void *privdata) {
+    valkeyReply *reply = r;
+    (void)privdata;
+
+    if (reply == NULL || reply->type == VALKEY_REPLY_ERROR)
+        ac->cache = NULL;
+    else if (ac->cache != NULL)
+        ac->c.flags |= VALKEY_TRACKING;
+}
+
+int valkeyAsyncEnableCache(valkeyAsyncContext *ac, valkeyCache *cache) {
+    char *cmd;
+    long long len;
+    int status;
+
+    if (cache == NULL || ac->cache != NULL)
+        return VALKEY_ERR;
+
+    if (valkeyAsyncCommand(ac, valkeyCacheHelloCallback, NULL, "HELLO 3") != VALKEY_OK)
+        return VALKEY_ERR;
+
+    len = valkeyCacheFormatTracking(cache, &cmd);
+    if (len < 0) {
+        valkeySetError(&ac->c, VALKEY_ERR_OOM, "Out of memory");
+        valkeyAsyncCopyError(ac);
+        return VALKEY_ERR;
+    }
+    status = valkeyAsyncAppendCmdLen(ac, valkeyCacheTrackingCallback, NULL, cmd, len);
+    vk_free(cmd);
+    if (status != VALKEY_OK)
+        return VALKEY_ERR;
+
+    ac->cache = cache;
+    return VALKEY_OK;
+}
+
+static void valkeyScriptCallback(valkeyAsyncContext *ac, void *reply, void *privdata) {
+    scriptCallbackData *data = privdata;
+
+    if (reply != NULL && data->command != NULL && valkeyScriptIsNoscript(reply)) {
+        /* The script is not loaded, e.g. after a restart. EVAL loads it. */
+        sds eval = valkeyScriptFormatEval(data->script, data->command,
+                                          sdslen(data->command));
+        sdsfree(data->command);
+        data->command = NULL;
+        if (eval != NULL &&
+            valkeyAsyncSubmitUncached(ac, valkeyScriptCallback, data, eval, sdslen(eval)) == VALKEY_OK) {
+            sdsfree(eval);
+            return;
+        }
+        sdsfree(eval); /* Give the NOSCRIPT error to the callback. */
+    }
+
+    if (data->user_callback != NULL)
+        data->user_callback(ac, reply, data->user_priv_data);
+    valkeyScriptFree(data->script);
+    sdsfree(data->command);
+    vk_free(data);
+}
+
+int valkeyAsyncScriptCall(valkeyAsyncContext *ac, valkeyCallbackFn *fn, void *privdata,
+                          valkeyScript *script, int numkeys, int argc,
+                          const char **argv, const size_t *argvlen) {
+    scriptCallbackData *data;
+
+    if (script == NULL || numkeys < 0 || argc < numkeys)
+        return VALKEY_ERR;
+
+    data = vk_calloc(1, sizeof(*data));
+    if (data == NULL)
+        goto oom;
+    data->command = valkeyScriptFormatCall(script, numkeys, argc, argv, argvlen);
+    if (data->command == NULL) {
+        vk_free(data);
+        goto oom;
+    }
+    data->script = script;
+    data->user_callback = fn;
+    data->user_priv_data = privdata;
+
+    /* Sent uncached, since the script may modify the keys. */
+    if (valkeyAsyncSubmitUncached(ac, valkeyScriptCallback, data, data->command,
+                                  sdslen(data->command)) != VALKEY_OK) {
+        sdsfree(data->command);
+        vk_free(data);
+        return VALKEY_ERR;
+    }
+    valkeyScriptRetain(script);
+    return VALKEY_OK;
+
+oom:
+    valkeySetError(&ac->c, VALKEY_ERR_OOM, "Out of memory");
+    valkeyAsyncCopyError(ac);
+    return VALKEY_ERR;
+}
@@ -86,4 +86,9 @@ static inline void refreshTimeout(valkeyAsyncContext *ctx) {
 LIBVALKEY_API void valkeyAsyncDisconnectInternal(valkeyAsyncContext *ac);
 LIBVALKEY_API void valkeyProcessCallbacks(valkeyAsyncContext *ac);
 
+/* Send a command that fills the client-side cache, without replying to it
+ * from the cache. Used by the cluster client which does its own lookups. */
+int valkeyAsyncFormattedCommandNoCache(valkeyAsyncContext *ac, valkeyCallbackFn *fn,
+                                       void *privdata, const char *cmd, size_t len);
+
 #endif /* VALKEY_ASYNC_PRIVATE_H */
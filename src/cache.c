@@ -0,0 +1,556 @@
+/*
+ * Copyright (c) 2026, the libvalkey contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "fmacros.h"
+#include "win32.h"
+
+#include "cache_private.h"
+
+#include "alloc.h"
+#include "dict.h"
+#include "sds.h"
+
+#include <string.h>
+#ifndef _MSC_VER
+#include <strings.h>
+#endif
+
+/* Read-only commands taking a single key as the first argument, whose replies
+ * are cached. */
+static const char *cacheableCommands[] = {
+    "GET", "GETRANGE", "STRLEN", "TYPE",
+    "HGET", "HMGET", "HGETALL", "HEXISTS", "HLEN", "HKEYS", "HVALS", "HSTRLEN",
+    "LINDEX", "LLEN", "LRANGE",
+    "SCARD", "SISMEMBER", "SMISMEMBER", "SMEMBERS",
+    "ZCARD", "ZSCORE", "ZMSCORE", "ZRANGE", "ZRANK", "ZCOUNT"};
+
+typedef struct cacheKey {
+    sds name;
+    struct valkeyCacheEntry *entries; /* Replies of commands on this key. */
+} cacheKey;
+
+struct valkeyCacheEntry {
+    int db;  /* The database the command was sent to. */
+    sds cmd; /* The formatted command. */
+    valkeyReply *reply;
+    size_t size;  /* Accounted memory. */
+    int refcount; /* One for the cache and one per lookup. */
+    cacheKey *key;
+    struct valkeyCacheEntry *key_prev, *key_next;
+    struct valkeyCacheEntry *lru_prev, *lru_next;
+};
+
+struct valkeyCache {
+    size_t max_memory;
+    size_t used_memory;
+    int bcast;
+    sds *prefixes;
+    int num_prefixes;
+
+    dict *entries; /* Database and formatted command -> valkeyCacheEntry. */
+    dict *keys;    /* Key name -> cacheKey. */
+    /* Recency order, the head is the most recently used. */
+    valkeyCacheEntry *lru_head, *lru_tail;
+
+    valkeyCacheStats stats;
+};
+
+typedef struct cacheString {
+    const char *str;
+    size_t len;
+} cacheString;
+
+typedef struct cacheCommand {
+    int db;
+    cacheString cmd;
+} cacheCommand;
+
+static uint64_t cacheSdsHash(const void *key) {
+    return dictGenHashFunction((const unsigned char *)key, sdslen((const sds)key));
+}
+
+static int cacheSdsCompare(const void *key1, const void *key2) {
+    size_t l1 = sdslen((const sds)key1);
+    size_t l2 = sdslen((const sds)key2);
+    return l1 == l2 && memcmp(key1, key2, l1) == 0;
+}
+
+static int cacheSdsMatch(const void *key, const void *privdata) {
+    const cacheString *s = privdata;
+    return sdslen((const sds)key) == s->len && memcmp(key, s->str, s->len) == 0;
+}
+
+static uint64_t cacheCommandHash(int db, const char *cmd, size_t len) {
+    return dictGenHashFunction((const unsigned char *)cmd, len) + (uint64_t)db;
+}
+
+static uint64_t cacheEntryHash(const void *key) {
+    const valkeyCacheEntry *e = key;
+    return cacheCommandHash(e->db, e->cmd, sdslen(e->cmd));
+}
+
+static int cacheEntryCompare(const void *key1, const void *key2) {
+    const valkeyCacheEntry *e1 = key1, *e2 = key2;
+    return e1->db == e2->db && cacheSdsCompare(e1->cmd, e2->cmd);
+}
+
+static int cacheEntryMatch(const void *key, const void *privdata) {
+    const valkeyCacheEntry *e = key;
+    const cacheCommand *c = privdata;
+    return e->db == c->db && cacheSdsMatch(e->cmd, &c->cmd);
+}
+
+/* The entries are keyed by themselves. */
+static dictType cacheEntryDictType = {
+    cacheEntryHash,    /* hash function */
+    NULL,              /* key dup */
+    cacheEntryCompare, /* key compare */
+    NULL,              /* key destructor */
+    NULL               /* val destructor */
+};
+
+/* The keys are owned by the entries. */
+static dictType cacheDictType = {
+    cacheSdsHash,    /* hash function */
+    NULL,            /* key dup */
+    cacheSdsCompare, /* key compare */
+    NULL,            /* key destructor */
+    NULL             /* val destructor */
+};
+
+static void *cacheFind(dict *d, const char *str, size_t len) {
+    cacheString s = {str, len};
+    dictEntry *de = dictFindByHash(d, dictGenHashFunction((const unsigned char *)str, len),
+                                   cacheSdsMatch, &s);
+    return de ? dictGetVal(de) : NULL;
+}
+
+static valkeyCacheEntry *cacheFindEntry(dict *d, int db, const char *cmd, size_t len) {
+    cacheCommand c = {db, {cmd, len}};
+    dictEntry *de = dictFindByHash(d, cacheCommandHash(db, cmd, len),
+                                   cacheEntryMatch, &c);
+    return de ? dictGetVal(de) : NULL;
+}
+
+/* Parse a bulk string in a formatted command, returning the position after it
+ * or NULL on a malformed command. */
+static const char *cacheParseArg(const char *p, const char *end,
+                                 const char **arg, size_t *arglen) {
+    size_t len = 0;
+
+    if (p >= end || *p != '$')
+        return NULL;
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+        len = len * 10 + (size_t)(*p - '0');
+    if (end - p < 4 || (size_t)(end - p - 4) < len || p[0] != '\r')
+        return NULL;
+    *arg = p + 2;
+    *arglen = len;
+    return p + 2 + len + 2;
+}
+
+/* Get the command name and the first argument of a formatted command. */
+static int cacheParseCommand(const char *cmd, size_t len, cacheString *name,
+                             cacheString *key) {
+    const char *p = cmd, *end = cmd + len;
+    size_t argc = 0;
+
+    if (len == 0 || *p != '*')
+        return VALKEY_ERR;
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+        argc = argc * 10 + (size_t)(*p - '0');
+    if (argc < 2 || end - p < 2)
+        return VALKEY_ERR;
+    p = cacheParseArg(p + 2, end, &name->str, &name->len);
+    if (p == NULL)
+        return VALKEY_ERR;
+    if (cacheParseArg(p, end, &key->str, &key->len) == NULL)
+        return VALKEY_ERR;
+    return VALKEY_OK;
+}
+
+static int cacheIsCacheableCommand(const cacheString *name) {
+    size_t i;
+
+    for (i = 0; i < sizeof(cacheableCommands) / sizeof(cacheableCommands[0]); i++) {
+        if (strlen(cacheableCommands[i]) == name->len &&
+            strncasecmp(cacheableCommands[i], name->str, name->len) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static int cacheIsCacheableKey(const valkeyCache *cache, const cacheString *key) {
+    int i;
+
+    if (!cache->bcast || cache->num_prefixes == 0)
+        return 1;
+    for (i = 0; i < cache->num_prefixes; i++) {
+        size_t plen = sdslen(cache->prefixes[i]);
+        if (key->len >= plen && memcmp(key->str, cache->prefixes[i], plen) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+int valkeyCacheIsCacheable(const valkeyCache *cache, const char *cmd,
+                           size_t len) {
+    cacheString name, key;
+
+    if (cacheParseCommand(cmd, len, &name, &key) != VALKEY_OK)
+        return 0;
+    return cacheIsCacheableCommand(&name) && cacheIsCacheableKey(cache, &key);
+}
+
+/* Deep copy of a reply, adding the memory it uses to `size`. */
+static valkeyReply *cacheReplyDup(const valkeyReply *reply, size_t *size) {
+    valkeyReply *r = vk_calloc(1, sizeof(*r));
+    if (r == NULL)
+        return NULL;
+    *size += sizeof(*r);
+
+    r->type = reply->type;
+    r->integer = reply->integer;
+    r->dval = reply->dval;
+    if (reply->type == VALKEY_REPLY_VERB)
+        memcpy(r->vtype, reply->vtype, sizeof(r->vtype));
+
+    switch (reply->type) {
+    case VALKEY_REPLY_ERROR:
+    case VALKEY_REPLY_STATUS:
+    case VALKEY_REPLY_STRING:
+    case VALKEY_REPLY_DOUBLE:
+    case VALKEY_REPLY_VERB:
+    case VALKEY_REPLY_BIGNUM:
+        r->str = vk_malloc(reply->len + 1);
+        if (r->str == NULL)
+            goto oom;
+        memcpy(r->str, reply->str, reply->len);
+        r->str[reply->len] = '\0';
+        r->len = reply->len;
+        *size += reply->len + 1;
+        break;
+    case VALKEY_REPLY_ARRAY:
+    case VALKEY_REPLY_MAP:
+    case VALKEY_REPLY_ATTR:
+    case VALKEY_REPLY_SET:
+    case VALKEY_REPLY_PUSH:
+        if (reply->elements == 0)
+            break;
+        r->element = vk_calloc(reply->elements, sizeof(valkeyReply *));
+        if (r->element == NULL)
+            goto oom;
+        r->elements = reply->elements;
+        *size += reply->elements * sizeof(valkeyReply *);
+        for (size_t i = 0; i < reply->elements; i++) {
+            r->element[i] = cacheReplyDup(reply->element[i], size);
+            if (r->element[i] == NULL)
+                goto oom;
+        }
+        break;
+    default:
+        break;
+    }
+    return r;
+
+oom:
+    freeReplyObject(r);
+    return NULL;
+}
+
+static void cacheLruUnlink(valkeyCache *cache, valkeyCacheEntry *e) {
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        cache->lru_head = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        cache->lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void cacheLruPush(valkeyCache *cache, valkeyCacheEntry *e) {
+    e->lru_prev = NULL;
+    e->lru_next = cache->lru_head;
+    if (cache->lru_head)
+        cache->lru_head->lru_prev = e;
+    else
+        cache->lru_tail = e;
+    cache->lru_head = e;
+}
+
+static void cacheEntryFree(valkeyCacheEntry *e) {
+    freeReplyObject(e->reply);
+    sdsfree(e->cmd);
+    vk_free(e);
+}
+
+void valkeyCacheEntryRelease(valkeyCacheEntry *entry) {
+    if (--entry->refcount == 0)
+        cacheEntryFree(entry);
+}
+
+valkeyReply *valkeyCacheEntryReply(const valkeyCacheEntry *entry) {
+    return entry->reply;
+}
+
+/* Remove an entry from the cache, and its key when it was the last entry. */
+static void cacheRemove(valkeyCache *cache, valkeyCacheEntry *e) {
+    cacheKey *key = e->key;
+
+    dictDelete(cache->entries, e);
+    cacheLruUnlink(cache, e);
+
+    if (e->key_prev)
+        e->key_prev->key_next = e->key_next;
+    else
+        key->entries = e->key_next;
+    if (e->key_next)
+        e->key_next->key_prev = e->key_prev;
+    if (key->entries == NULL) {
+        dictDelete(cache->keys, key->name);
+        cache->used_memory -= sizeof(*key) + sdslen(key->name);
+        sdsfree(key->name);
+        vk_free(key);
+    }
+
+    cache->used_memory -= e->size;
+    e->key = NULL;
+    valkeyCacheEntryRelease(e);
+}
+
+valkeyCacheEntry *valkeyCacheLookup(valkeyCache *cache, int db, const char *cmd,
+                                    size_t len) {
+    valkeyCacheEntry *e = cacheFindEntry(cache->entries, db, cmd, len);
+    if (e == NULL) {
+        cache->stats.misses++;
+        return NULL;
+    }
+    cache->stats.hits++;
+    if (cache->lru_head != e) {
+        cacheLruUnlink(cache, e);
+        cacheLruPush(cache, e);
+    }
+    e->refcount++;
+    return e;
+}
+
+int valkeyCacheStore(valkeyCache *cache, int db, const char *cmd, size_t len,
+                     const valkeyReply *reply) {
+    cacheString name, keyname;
+    valkeyCacheEntry *e;
+    cacheKey *key;
+
+    if (reply == NULL || reply->type == VALKEY_REPLY_ERROR)
+        return VALKEY_ERR;
+    if (cacheParseCommand(cmd, len, &name, &keyname) != VALKEY_OK ||
+        !cacheIsCacheableCommand(&name) || !cacheIsCacheableKey(cache, &keyname))
+        return VALKEY_ERR;
+
+    /* Replace a reply cached meanwhile by an identical command. */
+    e = cacheFindEntry(cache->entries, db, cmd, len);
+    if (e != NULL)
+        cacheRemove(cache, e);
+
+    e = vk_calloc(1, sizeof(*e));
+    if (e == NULL)
+        return VALKEY_ERR;
+    e->db = db;
+    e->size = sizeof(*e) + len;
+    e->reply = cacheReplyDup(reply, &e->size);
+    e->cmd = sdsnewlen(cmd, len);
+    if (e->reply == NULL || e->cmd == NULL ||
+        e->size + sizeof(*key) + keyname.len > cache->max_memory)
+        goto error;
+
+    key = cacheFind(cache->keys, keyname.str, keyname.len);
+    if (key == NULL) {
+        key = vk_calloc(1, sizeof(*key));
+        if (key == NULL)
+            goto error;
+        key->name = sdsnewlen(keyname.str, keyname.len);
+        if (key->name == NULL || dictAdd(cache->keys, key->name, key) != DICT_OK) {
+            sdsfree(key->name);
+            vk_free(key);
+            goto error;
+        }
+        cache->used_memory += sizeof(*key) + keyname.len;
+    }
+    if (dictAdd(cache->entries, e, e) != DICT_OK) {
+        if (key->entries == NULL) {
+            dictDelete(cache->keys, key->name);
+            cache->used_memory -= sizeof(*key) + keyname.len;
+            sdsfree(key->name);
+            vk_free(key);
+        }
+        goto error;
+    }
+
+    e->refcount = 1;
+    e->key = key;
+    e->key_next = key->entries;
+    if (key->entries)
+        key->entries->key_prev = e;
+    key->entries = e;
+    cacheLruPush(cache, e);
+    cache->used_memory += e->size;
+
+    while (cache->used_memory > cache->max_memory && cache->lru_tail != e) {
+        cache->stats.evictions++;
+        cacheRemove(cache, cache->lru_tail);
+    }
+    return VALKEY_OK;
+
+error:
+    cacheEntryFree(e);
+    return VALKEY_ERR;
+}
+
+void valkeyCacheInvalidate(valkeyCache *cache, const char *key, size_t len) {
+    valkeyCacheEntry *e, *next;
+    cacheKey *k = cacheFind(cache->keys, key, len);
+    if (k == NULL)
+        return;
+
+    /* The key is freed with its last entry. */
+    for (e = k->entries; e != NULL; e = next) {
+        next = e->key_next;
+        cache->stats.invalidations++;
+        cacheRemove(cache, e);
+    }
+}
+
+void valkeyCacheFlush(valkeyCache *cache) {
+    while (cache->lru_head != NULL)
+        cacheRemove(cache, cache->lru_head);
+}
+
+int valkeyCacheHandlePush(valkeyCache *cache, const valkeyReply *reply) {
+    const valkeyReply *keys;
+
+    if (reply->type != VALKEY_REPLY_PUSH || reply->elements != 2 ||
+        reply->element[0]->type != VALKEY_REPLY_STRING ||
+        reply->element[0]->len != 10 ||
+        strncasecmp(reply->element[0]->str, "invalidate", 10) != 0)
+        return 0;
+
+    keys = reply->element[1];
+    if (keys->type == VALKEY_REPLY_NIL) {
+        /* Sent on FLUSHALL and FLUSHDB. */
+        cache->stats.invalidations += dictSize(cache->entries);
+        valkeyCacheFlush(cache);
+    } else if (keys->type == VALKEY_REPLY_ARRAY) {
+        for (size_t i = 0; i < keys->elements; i++) {
+            if (keys->element[i]->type == VALKEY_REPLY_STRING)
+                valkeyCacheInvalidate(cache, keys->element[i]->str,
+                                      keys->element[i]->len);
+        }
+    }
+    return 1;
+}
+
+long long valkeyCacheFormatTracking(const valkeyCache *cache, char **target) {
+    const char **argv;
+    long long len;
+    int argc = 0;
+
+    argv = vk_malloc((4 + 2 * (size_t)cache->num_prefixes) * sizeof(char *));
+    if (argv == NULL)
+        return -1;
+    argv[argc++] = "CLIENT";
+    argv[argc++] = "TRACKING";
+    argv[argc++] = "ON";
+    if (cache->bcast) {
+        argv[argc++] = "BCAST";
+        for (int i = 0; i < cache->num_prefixes; i++) {
+            argv[argc++] = "PREFIX";
+            argv[argc++] = cache->prefixes[i];
+        }
+    }
+    len = valkeyFormatCommandArgv(target, argc, argv, NULL);
+    vk_free(argv);
+    return len;
+}
+
+valkeyCache *valkeyCacheCreate(const valkeyCacheOptions *options) {
+    valkeyCache *cache = vk_calloc(1, sizeof(*cache));
+    if (cache == NULL)
+        return NULL;
+
+    cache->max_memory = VALKEY_CACHE_DEFAULT_MAX_MEMORY;
+    if (options != NULL && options->max_memory > 0)
+        cache->max_memory = options->max_memory;
+
+    cache->entries = dictCreate(&cacheEntryDictType);
+    cache->keys = dictCreate(&cacheDictType);
+    if (cache->entries == NULL || cache->keys == NULL)
+        goto oom;
+
+    if (options != NULL && options->bcast) {
+        cache->bcast = 1;
+        if (options->num_prefixes > 0) {
+            cache->prefixes = vk_calloc(options->num_prefixes, sizeof(sds));
+            if (cache->prefixes == NULL)
+                goto oom;
+            for (int i = 0; i < options->num_prefixes; i++) {
+                cache->prefixes[i] = sdsnew(options->prefixes[i]);
+                if (cache->prefixes[i] == NULL)
+                    goto oom;
+                cache->num_prefixes++;
+            }
+        }
+    }
+    return cache;
+
+oom:
+    valkeyCacheFree(cache);
+    return NULL;
+}
+
+void valkeyCacheFree(valkeyCache *cache) {
+    if (cache == NULL)
+        return;
+    if (cache->entries != NULL && cache->keys != NULL)
+        valkeyCacheFlush(cache);
+    if (cache->entries != NULL)
+        dictRelease(cache->entries);
+    if (cache->keys != NULL)
+        dictRelease(cache->keys);
+    for (int i = 0; i < cache->num_prefixes; i++)
+        sdsfree(cache->prefixes[i]);
+    vk_free(cache->prefixes);
+    vk_free(cache);
+}
+
+void valkeyCacheGetStats(const valkeyCache *cache, valkeyCacheStats *stats) {
+    *stats = cache->stats;
+    stats->entries = dictSize(cache->entries);
+    stats->used_memory = cache->used_memory;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026, the libvalkey contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VALKEY_CACHE_PRIVATE_H
+#define VALKEY_CACHE_PRIVATE_H
+
+#include "cache.h"
+#include "valkey.h"
+
+#include <stddef.h>
+
+/* A cached reply. The entry is pinned by valkeyCacheLookup() and stays valid
+ * until released, even if it's removed from the cache meanwhile. */
+typedef struct valkeyCacheEntry valkeyCacheEntry;
+
+/* Returns 1 if the formatted command can be replied from the cache. */
+int valkeyCacheIsCacheable(const valkeyCache *cache, const char *cmd,
+                           size_t len);
+
+/* Find the reply of a cacheable command sent to a database, counting a hit
+ * or a miss. */
+valkeyCacheEntry *valkeyCacheLookup(valkeyCache *cache, int db, const char *cmd,
+                                    size_t len);
+valkeyReply *valkeyCacheEntryReply(const valkeyCacheEntry *entry);
+void valkeyCacheEntryRelease(valkeyCacheEntry *entry);
+
+/* Cache a copy of the reply to a cacheable command. Error replies are not
+ * cached. Returns VALKEY_ERR when not cached. */
+int valkeyCacheStore(valkeyCache *cache, int db, const char *cmd, size_t len,
+                     const valkeyReply *reply);
+
+/* Handle a push message, removing the invalidated keys. Returns 1 if it was
+ * an invalidation message. */
+int valkeyCacheHandlePush(valkeyCache *cache, const valkeyReply *reply);
+
+/* Format the CLIENT TRACKING command that enables tracking for the cache. */
+long long valkeyCacheFormatTracking(const valkeyCache *cache, char **target);
+
+#endif /* VALKEY_CACHE_PRIVATE_H */
@@ -37,8 +37,13 @@
 
 #include "adlist.h"
 #include "alloc.h"
+#include "async_private.h"
+#include "cache_private.h"
 #include "command.h"
 #include "dict.h"
+#include "script_private.h"
+#include "sockcompat.h"
+#include "valkey_private.h"
 #include "vkutil.h"
 
 #include <sds.h>
@@ -49,6 +54,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef _MSC_VER
+#include <strings.h>
+#endif
 
 /* Make sure standalone and cluster options don't overlap. */
 vk_static_assert(VALKEY_OPT_USE_CLUSTER_NODES > VALKEY_OPT_LAST_SA_OPTION);
@@ -58,6 +66,20 @@ vk_static_assert(VALKEY_OPT_USE_CLUSTER_NODES > VALKEY_OPT_LAST_SA_OPTION);
 #define VALKEY_FLAG_PARSE_REPLICAS 0x2
 #define VALKEY_FLAG_DISCONNECTING 0x4
 #define VALKEY_FLAG_BLOCKING_INITIAL_UPDATE 0x8
+#define VALKEY_FLAG_INCREMENTAL_SLOTMAP 0x10
+#define VALKEY_FLAG_POOL_LEAST_PENDING 0x20
+/* Flag to enable auto-pipelining in the async API. */
+#define VALKEY_FLAG_AUTO_PIPELINE 0x40
+/* Flag set while a slotmap from the shared slotmap or a file is applied. */
+#define VALKEY_FLAG_ADOPTING_SLOTMAP 0x80
+/* Flag to connect to all primaries before the READY event in async. */
+#define VALKEY_FLAG_PRECONNECT 0x100
+/* Flag set when sharded pub/sub channels are subscribed to in async. */
+#define VALKEY_FLAG_SHARDED_PUBSUB 0x200
+/* Async user callbacks are being called, which defers valkeyClusterAsyncFree(). */
+#define VALKEY_FLAG_IN_CALLBACK 0x400
+/* valkeyClusterAsyncFree() was called from a callback. */
+#define VALKEY_FLAG_FREEING 0x800
 
 // Cluster errors are offset by 100 to be sufficiently out of range of
 // standard Valkey errors
@@ -68,19 +90,68 @@ vk_static_assert(VALKEY_OPT_USE_CLUSTER_NODES > VALKEY_OPT_LAST_SA_OPTION);
 #define VALKEY_COMMAND_ASKING "ASKING"
 
 #define CLUSTER_DEFAULT_MAX_RETRY_COUNT 5
+#define CLUSTER_DEFAULT_RETRY_BACKOFF_USEC 50000
+#define CLUSTER_DEFAULT_RETRY_BACKOFF_MAX_USEC 2000000
+#define CLUSTER_DEFAULT_PIPELINE_MAX_BATCH 128
 #define NO_RETRY -1
 
 #define SLOTMAP_UPDATE_THROTTLE_USEC 1000000
 #define SLOTMAP_UPDATE_ONGOING INT64_MAX
 
+#define SLOTMAP_DEFAULT_MAX_DELTAS 128
+#define SLOTMAP_DEFAULT_DELTA_INTERVAL_USEC 10000000
+
+/* A connection in the connection pool of a node. */
+typedef struct cluster_conn {
+    valkeyClusterNode *node; /* The node this pool entry belongs to. */
+    valkeyContext *con;
+    valkeyAsyncContext *acon;
+    int pending; /* Outstanding async commands. */
+    struct cluster_checkout *checkout; /* Set while `con` is checked out. */
+} cluster_conn;
+
+/* A checked out pool connection, kept in cc->checkouts by its context. The
+ * pool entry keeps its address when the pool is moved to the node object of
+ * a new slotmap. When the node is removed the entry is freed, and the
+ * context is kept until checked in. */
+typedef struct cluster_checkout {
+    valkeyContext *con;
+    cluster_conn *conn; /* The pool entry, or NULL when the node is removed. */
+} cluster_checkout;
+
 typedef struct cluster_async_data {
     valkeyClusterAsyncContext *acc;
     struct cmd *command;
     valkeyClusterCallbackFn *callback;
     int retry_count;
     void *privdata;
+    listNode *retry_node; /* Entry in acc->retries during a delayed retry. */
+    void *timer;
+    int64_t sent_usec; /* When the command was sent, for node statistics. */
+    int cache_bypass;  /* Counted in acc->cache_bypass until freed. */
 } cluster_async_data;
 
+/* State of a command sent to all nodes using the async ..ToAllNodes() API. */
+typedef struct cluster_gather_data cluster_gather_data;
+
+typedef struct cluster_gather_entry {
+    cluster_gather_data *gd;
+    size_t index; /* Index of the node's reply */
+} cluster_gather_entry;
+
+struct cluster_gather_data {
+    valkeyClusterAsyncContext *acc;
+    valkeyClusterReducerFn *reducer;
+    valkeyClusterCallbackFn *callback;
+    void *privdata;
+    size_t count;   /* Number of nodes */
+    size_t pending; /* Outstanding replies */
+    int err;        /* First error, 0 when all nodes replied */
+    char errstr[128];
+    valkeyReply **replies;
+    cluster_gather_entry *entries;
+};
+
 typedef enum {
     CLUSTER_NO_ERROR = 0,
     CLUSTER_ERR_MOVED,
@@ -93,6 +164,8 @@ typedef enum {
 static void freeValkeyClusterNode(valkeyClusterNode *node);
 static void cluster_slot_destroy(cluster_slot *slot);
 static int updateNodesAndSlotmap(valkeyClusterContext *cc, dict *nodes);
+static int updateTopology(valkeyClusterContext *cc, dict *nodes,
+                          int skip_unchanged);
 static int updateSlotMapAsync(valkeyClusterAsyncContext *acc,
                               valkeyAsyncContext *ac);
 static int valkeyClusterSetOptionAddNodes(valkeyClusterContext *cc, const char *addrs);
@@ -100,6 +173,11 @@ static int valkeyClusterSetOptionConnectTimeout(valkeyClusterContext *cc, const
 static int valkeyClusterSetOptionPassword(valkeyClusterContext *cc, const char *password);
 static int valkeyClusterSetOptionUsername(valkeyClusterContext *cc, const char *username);
 static int valkeyClusterAsyncConnect(valkeyClusterAsyncContext *acc);
+static void clusterAsyncScheduleRefresh(valkeyClusterAsyncContext *acc);
+static void clusterAsyncPreconnect(valkeyClusterAsyncContext *acc);
+static void clusterShardResubscribe(valkeyClusterAsyncContext *acc);
+static void clusterAsyncFree(valkeyClusterAsyncContext *acc);
+static valkeyReply *clusterReplyDup(const valkeyReply *r);
 
 void listClusterNodeDestructor(void *val) { freeValkeyClusterNode(val); }
 
@@ -127,11 +205,6 @@ static void dictClusterNodeDestructor(void *val) {
     freeValkeyClusterNode(val);
 }
 
-/* Destructor function for clusterNodeListDictType. */
-static void dictClusterNodeListDestructor(void *val) {
-    listRelease(val);
-}
-
 /* Cluster node hash table
  * maps node address (1.2.3.4:6379) to a valkeyClusterNode
  * Has ownership of valkeyClusterNode memory
@@ -142,12 +215,46 @@ dictType clusterNodesDictType = {
     .keyDestructor = dictSdsDestructor,
     .valDestructor = dictClusterNodeDestructor};
 
-/* Hash table dictType to map node address to a list of valkeyClusterNodes. */
-dictType clusterNodeListDictType = {
+static void dictListDestructor(void *val) {
+    if (val != NULL)
+        listRelease(val);
+}
+
+/* Auto-pipelining hash table
+ * maps node address (1.2.3.4:6379) to the list of commands held back for it
+ */
+static dictType clusterPipelineDictType = {
     .hashFunction = dictSdsHash,
     .keyCompare = dictSdsKeyCompare,
     .keyDestructor = dictSdsDestructor,
-    .valDestructor = dictClusterNodeListDestructor};
+    .valDestructor = dictListDestructor};
+
+static uint64_t dictPtrHash(const void *key) {
+    return dictGenHashFunction((const unsigned char *)&key, sizeof(key));
+}
+
+static int dictPtrKeyCompare(const void *key1, const void *key2) {
+    return key1 == key2;
+}
+
+/* Return a checked out connection to its pool entry, or close it when its
+ * node has been removed. */
+static void dictCheckoutDestructor(void *val) {
+    cluster_checkout *checkout = val;
+    if (checkout->conn != NULL)
+        checkout->conn->checkout = NULL;
+    else
+        valkeyFree(checkout->con);
+    vk_free(checkout);
+}
+
+/* Checked out connections hash table
+ * maps a valkeyContext to its cluster_checkout
+ */
+static dictType clusterCheckoutsDictType = {
+    .hashFunction = dictPtrHash,
+    .keyCompare = dictPtrKeyCompare,
+    .valDestructor = dictCheckoutDestructor};
 
 void listCommandFree(void *command) {
     struct cmd *cmd = command;
@@ -164,29 +271,24 @@ void listCommandFree(void *command) {
  * However if the key contains the {...} pattern, only the part between
  * { and } is hashed. This may be useful in the future to force certain
  * keys to be in the same node (assuming no resharding is in progress). */
-static unsigned int keyHashSlot(char *key, int keylen) {
-    int s, e; /* start-end indexes of { and } */
-
-    for (s = 0; s < keylen; s++)
-        if (key[s] == '{')
-            break;
+static unsigned int keyHashSlot(const char *key, int keylen) {
+    const char *s, *e; /* Positions of { and } */
 
     /* No '{' ? Hash the whole key. This is the base case. */
-    if (s == keylen)
+    if (keylen <= 0 || (s = memchr(key, '{', keylen)) == NULL)
         return crc16(key, keylen) & 0x3FFF;
 
     /* '{' found? Check if we have the corresponding '}'. */
-    for (e = s + 1; e < keylen; e++)
-        if (key[e] == '}')
-            break;
+    s++;
+    e = memchr(s, '}', keylen - (s - key));
 
     /* No '}' or nothing between {} ? Hash the whole key. */
-    if (e == keylen || e == s + 1)
+    if (e == NULL || e == s)
         return crc16(key, keylen) & 0x3FFF;
 
     /* If we are here there is both a { and a } on its right. Hash
      * what is in the middle between { and }. */
-    return crc16(key + s + 1, e - s - 1) & 0x3FFF;
+    return crc16(s, e - s) & 0x3FFF;
 }
 
 static void valkeyClusterSetError(valkeyClusterContext *cc, int type,
@@ -202,6 +304,15 @@ static void valkeyClusterSetError(valkeyClusterContext *cc, int type,
     }
 }
 
+/* Set the error of a command that couldn't be appended to a node connection.
+ * The error of a command rejected by the output buffer limit is moved from
+ * the connection, which is kept rather than reconnected. */
+static void clusterSetAppendError(valkeyClusterContext *cc, valkeyContext *c) {
+    valkeyClusterSetError(cc, c->err, c->errstr);
+    if (c->err == VALKEY_ERR_OUTPUT_LIMIT)
+        valkeyClearError(c);
+}
+
 static inline void valkeyClusterClearError(valkeyClusterContext *cc) {
     cc->err = 0;
     cc->errstr[0] = '\0';
@@ -223,6 +334,70 @@ static replyErrorType getReplyErrorType(valkeyReply *reply) {
     return CLUSTER_ERR_OTHER;
 }
 
+/* Index of the latency histogram bucket for a value. Values below 8 have a
+ * bucket each, larger values use 8 buckets per power of two. */
+static unsigned int latencyBucket(uint64_t usec) {
+    unsigned int exp = 0, idx;
+
+    if (usec < 8)
+        return (unsigned int)usec;
+    for (uint64_t v = usec; v > 1; v >>= 1)
+        exp++;
+    idx = (exp - 2) * 8 + (unsigned int)((usec >> (exp - 3)) & 7);
+    return idx < VALKEY_NODE_STATS_BUCKETS ? idx : VALKEY_NODE_STATS_BUCKETS - 1;
+}
+
+/* Highest value counted in a latency histogram bucket. */
+static uint64_t latencyBucketMax(unsigned int idx) {
+    unsigned int exp;
+
+    if (idx < 8)
+        return idx;
+    exp = idx / 8 + 2;
+    return ((uint64_t)(8 + idx % 8) << (exp - 3)) + ((uint64_t)1 << (exp - 3)) - 1;
+}
+
+/* Statistics of a node, allocated on first use. Returns NULL when out of
+ * memory, in which case nothing is recorded. */
+static valkeyClusterNodeStats *clusterNodeStats(valkeyClusterNode *node) {
+    if (node->stats == NULL)
+        node->stats = vk_calloc(1, sizeof(*node->stats));
+    return node->stats;
+}
+
+/* Record the outcome of a command sent to a node. A NULL reply means that the
+ * command failed without a reply, so there is no latency to record. */
+static void clusterNodeRecordReply(valkeyClusterNode *node, valkeyReply *reply,
+                                   int64_t latency_usec) {
+    valkeyClusterNodeStats *stats = clusterNodeStats(node);
+    if (stats == NULL)
+        return;
+
+    if (reply == NULL) {
+        stats->errors++;
+        return;
+    }
+
+    uint64_t usec = latency_usec > 0 ? (uint64_t)latency_usec : 0;
+    stats->replies++;
+    stats->latency_sum_usec += usec;
+    if (usec > stats->latency_max_usec)
+        stats->latency_max_usec = usec;
+    stats->latency[latencyBucket(usec)]++;
+
+    switch (getReplyErrorType(reply)) {
+    case CLUSTER_NO_ERROR:
+        break;
+    case CLUSTER_ERR_MOVED:
+    case CLUSTER_ERR_ASK:
+        stats->redirects++;
+        break;
+    default:
+        stats->errors++;
+        break;
+    }
+}
+
 /* Create and initiate the cluster node structure */
 static valkeyClusterNode *createValkeyClusterNode(void) {
     /* use calloc to guarantee all fields are zeroed */
@@ -247,6 +422,25 @@ static void freeValkeyClusterNode(valkeyClusterNode *node) {
         node->acon->data = NULL;
         valkeyAsyncFree(node->acon);
     }
+    for (int i = 0; i < node->pool_size; i++) {
+        if (node->pool[i].checkout != NULL)
+            node->pool[i].checkout->conn = NULL; /* Freed when checked in. */
+        else
+            valkeyFree(node->pool[i].con);
+        if (node->pool[i].acon != NULL) {
+            node->pool[i].acon->data = NULL;
+            valkeyAsyncFree(node->pool[i].acon);
+        }
+    }
+    vk_free(node->pool);
+    if (node->pubsub != NULL) {
+        if (node->pubsub->acon != NULL) {
+            node->pubsub->acon->data = NULL;
+            valkeyAsyncFree(node->pubsub->acon);
+        }
+        vk_free(node->pubsub);
+    }
+    vk_free(node->stats);
     listRelease(node->slots);
     listRelease(node->replicas);
     vk_free(node);
@@ -465,6 +659,35 @@ static void cluster_nodes_swap_ctx(dict *nodes_f, dict *nodes_t) {
             if (node_f->acon)
                 node_f->acon->data = node_f;
         }
+
+        if (node_f->pool != NULL) {
+            /* The pooled connections refer to their pool entry, which is
+             * moved as a whole. */
+            cluster_conn *pool = node_f->pool;
+            int pool_size = node_f->pool_size;
+            node_f->pool = node_t->pool;
+            node_f->pool_size = node_t->pool_size;
+            node_t->pool = pool;
+            node_t->pool_size = pool_size;
+            for (int i = 0; i < node_t->pool_size; i++)
+                node_t->pool[i].node = node_t;
+            for (int i = 0; i < node_f->pool_size; i++)
+                node_f->pool[i].node = node_f;
+        }
+
+        if (node_f->pubsub != NULL) {
+            cluster_conn *pubsub = node_f->pubsub;
+            node_f->pubsub = node_t->pubsub;
+            node_t->pubsub = pubsub;
+            node_t->pubsub->node = node_t;
+            if (node_f->pubsub)
+                node_f->pubsub->node = node_f;
+        }
+
+        /* The statistics follow the connections. */
+        valkeyClusterNodeStats *stats = node_f->stats;
+        node_f->stats = node_t->stats;
+        node_t->stats = stats;
     }
 }
 
@@ -640,64 +863,91 @@ error:
     return NULL;
 }
 
-/* Keep lists of parsed replica nodes in a dict using the primary_id as key. */
-static int retain_replica_node(dict *replicas, char *primary_id, valkeyClusterNode *node) {
-    sds key = sdsnew(primary_id);
-    if (key == NULL)
-        return VALKEY_ERR;
+/* A field in a CLUSTER NODES line, pointing into the reply buffer. */
+typedef struct {
+    char *str;
+    size_t len;
+} nodes_field;
 
-    struct hilist *replicaList;
+/* A parsed replica node, kept until all primary nodes are parsed. */
+typedef struct {
+    valkeyClusterNode *node;
+    nodes_field primary_id;
+} parsed_replica;
 
-    dictEntry *de = dictFind(replicas, key);
-    if (de == NULL) {
-        /* Create list to hold replicas for a primary. */
-        replicaList = listCreate();
-        if (replicaList == NULL) {
-            sdsfree(key);
-            return VALKEY_ERR;
-        }
-        replicaList->free = listClusterNodeDestructor;
-        if (dictAdd(replicas, key, replicaList) != DICT_OK) {
-            sdsfree(key);
-            listRelease(replicaList);
-            return VALKEY_ERR;
-        }
-    } else {
-        sdsfree(key);
-        replicaList = dictGetVal(de);
-    }
+#define fieldIs(_str, _len, _literal) \
+    ((_len) == sizeof(_literal) - 1 && memcmp(_str, _literal, (_len)) == 0)
 
-    if (listAddNodeTail(replicaList, node) == NULL)
-        return VALKEY_ERR;
+static int nodeNameCompare(const void *a, const void *b) {
+    const valkeyClusterNode *na = *(valkeyClusterNode *const *)a;
+    const valkeyClusterNode *nb = *(valkeyClusterNode *const *)b;
+    return sdscmp(na->name, nb->name);
+}
 
-    return VALKEY_OK;
+/* Compare a primary_id field with the name of a node, ordered as sdscmp(). */
+static int nodeNameFieldCompare(const void *key, const void *elem) {
+    const nodes_field *id = key;
+    const valkeyClusterNode *node = *(valkeyClusterNode *const *)elem;
+    size_t namelen = sdslen(node->name);
+    int cmp = memcmp(id->str, node->name, id->len < namelen ? id->len : namelen);
+    if (cmp != 0)
+        return cmp;
+    return id->len < namelen ? -1 : (id->len > namelen ? 1 : 0);
 }
 
-/* Store parsed replica nodes in the primary nodes, which holds a list of replica
- * nodes. The `replicas` dict shall contain lists of nodes with primary_id as key. */
-static int store_replica_nodes(dict *nodes, dict *replicas) {
-    if (replicas == NULL)
+/* Store parsed replica nodes in the list of replicas of their primary node.
+ * The primaries are sorted by name so each replica is found using a binary
+ * search. Replicas without a known primary are freed. */
+static int store_replica_nodes(dict *nodes, parsed_replica *replicas,
+                               size_t num_replicas) {
+    valkeyClusterNode **primaries;
+    size_t num_primaries = 0;
+
+    if (num_replicas == 0)
         return VALKEY_OK;
 
+    primaries = vk_malloc(dictSize(nodes) * sizeof(*primaries));
+    if (primaries == NULL)
+        return VALKEY_ERR;
+
     dictIterator di;
     dictInitIterator(&di, nodes);
     dictEntry *de;
-    while ((de = dictNext(&di))) {
-        valkeyClusterNode *primary = dictGetVal(de);
+    while ((de = dictNext(&di)) != NULL) {
+        primaries[num_primaries++] = dictGetVal(de);
+    }
+    qsort(primaries, num_primaries, sizeof(*primaries), nodeNameCompare);
 
-        /* Move replica nodes related to this primary. */
-        dictEntry *der = dictFind(replicas, primary->name);
-        if (der != NULL) {
-            assert(primary->replicas == NULL);
-            /* Move replica list from replicas dict to nodes dict. */
-            primary->replicas = dictGetVal(der);
-            dictSetVal(replicas, der, NULL);
+    for (size_t i = 0; i < num_replicas; i++) {
+        valkeyClusterNode **found, *primary;
+        found = bsearch(&replicas[i].primary_id, primaries, num_primaries,
+                        sizeof(*primaries), nodeNameFieldCompare);
+        if (found == NULL) {
+            freeValkeyClusterNode(replicas[i].node);
+            replicas[i].node = NULL;
+            continue;
+        }
+        primary = *found;
+        if (primary->replicas == NULL) {
+            if ((primary->replicas = listCreate()) == NULL)
+                goto oom;
+            primary->replicas->free = listClusterNodeDestructor;
         }
+        if (listAddNodeTail(primary->replicas, replicas[i].node) == NULL)
+            goto oom;
+        replicas[i].node = NULL; /* Owned by the primary. */
     }
+    vk_free(primaries);
     return VALKEY_OK;
+
+oom:
+    vk_free(primaries);
+    return VALKEY_ERR;
 }
 
-/* Parse a node from a single CLUSTER NODES line.
+/* Parse a node from a single CLUSTER NODES line, given by `line` and the
+ * position of its line break in `end`. The line is parsed in place without
+ * modifying the buffer.
  * Returns VALKEY_OK and an allocated valkeyClusterNode as a pointer in
  * `parsed_node`, or VALKEY_ERR when the parsing fails.
  * Only parse primary nodes if the `parsed_primary_id` argument is NULL,
@@ -706,52 +956,45 @@ static int store_replica_nodes(dict *nodes, dict *replicas) {
  * The valkeyContext used when sending the CLUSTER NODES command should be
  * provided in `c` since its destination IP address is used when no IP address
  * is found in the parsed string. */
-static int parse_cluster_nodes_line(valkeyClusterContext *cc, valkeyContext *c, char *line,
-                                    valkeyClusterNode **parsed_node, char **parsed_primary_id) {
-    char *p, *id = NULL, *addr = NULL, *flags = NULL, *primary_id = NULL,
-             *link_state = NULL, *slots = NULL;
-    /* Find required fields and keep a pointer to each field:
+static int parse_cluster_nodes_line(valkeyClusterContext *cc, valkeyContext *c,
+                                    char *line, char *end,
+                                    valkeyClusterNode **parsed_node,
+                                    nodes_field *parsed_primary_id) {
+    /* Find required fields:
      * <id> <addr> <flags> <primary_id> <ping-sent> <pong-recv> <config-epoch> <link-state> [<slot> ...]
      */
-    // clang-format off
-    int i = 0;
-    while ((p = strchr(line, ' ')) != NULL) {
-        *p = '\0';
-        switch (i++) {
-            case 0: id = line; break;
-            case 1: addr = line; break;
-            case 2: flags = line; break;
-            case 3: primary_id = line; break;
-            case 7: link_state = line; break;
-        }
-        line = p + 1; /* Start of next field. */
-        if (i == 8) { slots = line; break; }
+    nodes_field fields[8];
+    char *p = line, *sp;
+    int i;
+    for (i = 0; i < 8 && p <= end; i++) {
+        sp = memchr(p, ' ', end - p);
+        fields[i].str = p;
+        fields[i].len = (sp != NULL ? sp : end) - p;
+        p = (sp != NULL ? sp : end) + 1; /* Start of next field. */
     }
-    if (i == 7 && line[0] != '\0') link_state = line;
-    // clang-format on
-
-    if (link_state == NULL) {
+    if (i < 8 || fields[7].len == 0) {
         valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Mandatory fields missing");
         return VALKEY_ERR;
     }
+    char *slots = p; /* Slots follow when p is before end. */
 
     /* Parse flags, a comma separated list of following flags:
      * myself, master, slave, fail?, fail, handshake, noaddr, nofailover, noflags. */
     uint8_t role = VALKEY_ROLE_UNKNOWN;
-    while (*flags != '\0') {
-        if ((p = strchr(flags, ',')) != NULL)
-            *p = '\0';
-        if (memcmp(flags, "master", 6) == 0)
+    char *flag = fields[2].str;
+    char *flags_end = flag + fields[2].len;
+    while (flag < flags_end) {
+        char *comma = memchr(flag, ',', flags_end - flag);
+        size_t len = (comma != NULL ? comma : flags_end) - flag;
+        if (fieldIs(flag, len, "master"))
             role = VALKEY_ROLE_PRIMARY;
-        else if (memcmp(flags, "slave", 5) == 0)
+        else if (fieldIs(flag, len, "slave"))
             role = VALKEY_ROLE_REPLICA;
-        else if (memcmp(flags, "noaddr", 6) == 0) {
+        else if (fieldIs(flag, len, "noaddr")) {
             *parsed_node = NULL;
             return VALKEY_OK; /* Skip nodes with 'noaddr'. */
         }
-        if (p == NULL) /* No more flags. */
-            break;
-        flags = p + 1; /* Start of next flag. */
+        flag += len + 1; /* Start of next flag. */
     }
     if (role == VALKEY_ROLE_UNKNOWN) {
         valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Unknown role");
@@ -764,47 +1007,47 @@ static int parse_cluster_nodes_line(valkeyClusterContext *cc, valkeyContext *c,
         return VALKEY_OK;
     }
 
-    valkeyClusterNode *node = createValkeyClusterNode();
-    if (node == NULL) {
-        goto oom;
-    }
-    node->role = role;
-    node->name = sdsnew(id);
-    if (node->name == NULL)
-        goto oom;
-
     /* Parse the address field: <ip:port@cport[,hostname]>
-     * Remove @cport.. to get <ip>:<port> which is our dict key. */
-    if ((p = strchr(addr, '@')) != NULL) {
-        *p = '\0';
-    }
+     * Skip @cport.. to get <ip>:<port> which is our dict key. */
+    char *addr = fields[1].str;
+    char *addr_end = memchr(addr, '@', fields[1].len);
+    if (addr_end == NULL)
+        addr_end = addr + fields[1].len;
 
     /* Find the required port separator. */
-    if ((p = strrchr(addr, ':')) == NULL) {
+    for (p = addr_end; p > addr && *(p - 1) != ':'; p--)
+        ;
+    if (p == addr) {
         valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid node address");
-        freeValkeyClusterNode(node);
         return VALKEY_ERR;
     }
 
-    /* Get the port (skip the found port separator). */
-    int port = vk_atoi(p + 1, strlen(p + 1));
+    /* Get the port, which follows the found port separator. */
+    int port = vk_atoi(p, (addr_end - p));
     if (port < 1 || port > UINT16_MAX) {
         valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid port");
-        freeValkeyClusterNode(node);
         return VALKEY_ERR;
     }
+    size_t hostlen = p - 1 - addr;
+
+    valkeyClusterNode *node = createValkeyClusterNode();
+    if (node == NULL) {
+        goto oom;
+    }
+    node->role = role;
     node->port = port;
+    node->name = sdsnewlen(fields[0].str, fields[0].len);
+    if (node->name == NULL)
+        goto oom;
 
     /* Check that we received an ip/host address, i.e. the field
      * does not start with the port separator. */
-    if (p != addr) {
-        node->addr = sdsnew(addr);
+    if (hostlen > 0) {
+        node->addr = sdsnewlen(addr, addr_end - addr);
         if (node->addr == NULL)
             goto oom;
 
-        *p = '\0'; /* Cut port separator. */
-
-        node->host = sdsnew(addr);
+        node->host = sdsnewlen(addr, hostlen);
         if (node->host == NULL)
             goto oom;
 
@@ -828,7 +1071,7 @@ static int parse_cluster_nodes_line(valkeyClusterContext *cc, valkeyContext *c,
 
     /* No slot parsing needed for replicas, but return primary id. */
     if (node->role == VALKEY_ROLE_REPLICA) {
-        *parsed_primary_id = primary_id;
+        *parsed_primary_id = fields[3];
         *parsed_node = node;
         return VALKEY_OK;
     }
@@ -838,29 +1081,22 @@ static int parse_cluster_nodes_line(valkeyClusterContext *cc, valkeyContext *c,
         goto oom;
     node->slots->free = listClusterSlotDestructor;
 
-    /* Parse slots when available. */
-    if (slots == NULL) {
-        *parsed_node = node;
-        return VALKEY_OK;
-    }
-    /* Parse each slot element. */
-    while (*slots != '\0') {
-        if ((p = strchr(slots, ' ')) != NULL)
-            *p = '\0';
-        char *entry = slots;
-        if (entry[0] == '[')
+    /* Parse each slot element, i.e. <slot> or <start>-<end>. */
+    while (slots < end) {
+        char *entry_end = memchr(slots, ' ', end - slots);
+        if (entry_end == NULL)
+            entry_end = end;
+        if (slots[0] == '[')
             break; /* Skip importing/migrating slots at string end. */
 
         int slot_start, slot_end;
-        char *sp = strchr(entry, '-');
-        if (sp == NULL) {
-            slot_start = vk_atoi(entry, strlen(entry));
+        char *dash = memchr(slots, '-', entry_end - slots);
+        if (dash == NULL) {
+            slot_start = vk_atoi(slots, (entry_end - slots));
             slot_end = slot_start;
         } else {
-            *sp = '\0';
-            slot_start = vk_atoi(entry, strlen(entry));
-            entry = sp + 1; // Skip '-'
-            slot_end = vk_atoi(entry, strlen(entry));
+            slot_start = vk_atoi(slots, (dash - slots));
+            slot_end = vk_atoi(dash + 1, (entry_end - dash - 1));
         }
 
         /* Create a slot entry owned by the node. */
@@ -870,9 +1106,7 @@ static int parse_cluster_nodes_line(valkeyClusterContext *cc, valkeyContext *c,
         slot->start = (uint32_t)slot_start;
         slot->end = (uint32_t)slot_end;
 
-        if (p == NULL) /* Check if this was the last entry. */
-            break;
-        slots = p + 1; /* Start of next entry. */
+        slots = entry_end + 1; /* Start of next entry. */
     }
     *parsed_node = node;
     return VALKEY_OK;
@@ -885,12 +1119,15 @@ oom:
 
 /**
  * Parse the "cluster nodes" command reply to nodes dict.
+ * The reply is parsed in a single pass without modifying it. Replica nodes are
+ * kept in an array until all primaries are known.
  */
 static dict *parse_cluster_nodes(valkeyClusterContext *cc, valkeyContext *c, valkeyReply *reply) {
     dict *nodes = NULL;
     int slot_ranges_found = 0;
     int add_replicas = cc->flags & VALKEY_FLAG_PARSE_REPLICAS;
-    dict *replicas = NULL;
+    parsed_replica *replicas = NULL;
+    size_t num_replicas = 0, replicas_size = 0;
 
     if (reply->type != VALKEY_REPLY_STRING && reply->type != VALKEY_REPLY_VERB) {
         valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Unexpected reply type");
@@ -902,52 +1139,52 @@ static dict *parse_cluster_nodes(valkeyClusterContext *cc, valkeyContext *c, val
         goto oom;
     }
 
-    char *lines = reply->str; /* NULL terminated string. */
-    char *p, *line;
-    while ((p = strchr(lines, '\n')) != NULL) {
-        *p = '\0';
-        line = lines;
-        lines = p + 1; /* Start of next line. */
-
-        char *primary_id;
+    char *line = reply->str;
+    char *end = reply->str + reply->len;
+    char *nl;
+    while ((nl = memchr(line, '\n', end - line)) != NULL) {
+        nodes_field primary_id;
         valkeyClusterNode *node;
-        if (parse_cluster_nodes_line(cc, c, line, &node, add_replicas ? &primary_id : NULL) != VALKEY_OK)
+        if (parse_cluster_nodes_line(cc, c, line, nl, &node,
+                                     add_replicas ? &primary_id : NULL) != VALKEY_OK)
             goto error;
+        line = nl + 1; /* Start of next line. */
         if (node == NULL)
             continue; /* Line skipped. */
         if (node->role == VALKEY_ROLE_PRIMARY) {
-            sds key = sdsnew(node->addr);
+            sds key = sdsdup(node->addr);
             if (key == NULL) {
                 freeValkeyClusterNode(node);
                 goto oom;
             }
-            if (dictFind(nodes, key) != NULL) {
-                valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
-                                      "Duplicate addresses in cluster nodes response");
-                sdsfree(key);
-                freeValkeyClusterNode(node);
-                goto error;
-            }
             if (dictAdd(nodes, key, node) != DICT_OK) {
+                int duplicate = dictFind(nodes, key) != NULL;
                 sdsfree(key);
                 freeValkeyClusterNode(node);
-                goto oom;
+                if (!duplicate)
+                    goto oom;
+                valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                                      "Duplicate addresses in cluster nodes response");
+                goto error;
             }
             slot_ranges_found += listLength(node->slots);
 
         } else {
             assert(node->role == VALKEY_ROLE_REPLICA);
-            if (replicas == NULL) {
-                if ((replicas = dictCreate(&clusterNodeListDictType)) == NULL) {
+            /* Retain parsed replica nodes until all primaries are parsed. */
+            if (num_replicas == replicas_size) {
+                size_t size = replicas_size ? replicas_size * 2 : 16;
+                parsed_replica *r = vk_realloc(replicas, size * sizeof(*r));
+                if (r == NULL) {
                     freeValkeyClusterNode(node);
                     goto oom;
                 }
+                replicas = r;
+                replicas_size = size;
             }
-            /* Retain parsed replica nodes until all primaries are parsed. */
-            if (retain_replica_node(replicas, primary_id, node) != VALKEY_OK) {
-                freeValkeyClusterNode(node);
-                goto oom;
-            }
+            replicas[num_replicas].node = node;
+            replicas[num_replicas].primary_id = primary_id;
+            num_replicas++;
         }
     }
 
@@ -957,10 +1194,10 @@ static dict *parse_cluster_nodes(valkeyClusterContext *cc, valkeyContext *c, val
     }
 
     /* Store the retained replica nodes in primary nodes. */
-    if (store_replica_nodes(nodes, replicas) != VALKEY_OK) {
+    if (store_replica_nodes(nodes, replicas, num_replicas) != VALKEY_OK) {
         goto oom;
     }
-    dictRelease(replicas);
+    vk_free(replicas);
 
     return nodes;
 
@@ -969,7 +1206,9 @@ oom:
     // passthrough
 
 error:
-    dictRelease(replicas);
+    for (size_t i = 0; i < num_replicas; i++)
+        freeValkeyClusterNode(replicas[i].node);
+    vk_free(replicas);
     dictRelease(nodes);
     return NULL;
 }
@@ -1018,2287 +1257,5820 @@ static int clusterUpdateRouteHandleReply(valkeyClusterContext *cc,
     return updateNodesAndSlotmap(cc, nodes);
 }
 
-/* Update known cluster nodes with a new collection of valkeyClusterNodes.
- * Will also update the slot-to-node lookup table for the new nodes. */
-static int updateNodesAndSlotmap(valkeyClusterContext *cc, dict *nodes) {
-    if (nodes == NULL) {
-        return VALKEY_ERR;
-    }
+/* A shared slotmap holds the latest published snapshot. The version is read
+ * without locking by the contexts to detect a new snapshot, while the snapshot
+ * itself is referenced and released under the lock. A snapshot is immutable
+ * and freed when the last reference is released. */
+typedef struct slotmap_snapshot {
+    int refcount;
+    unsigned int version;
+    dict *nodes; /* Nodes and slots, without connections. */
+} slotmap_snapshot;
+
+#ifdef VALKEY_USE_THREADS
+#ifdef _WIN32
+typedef CRITICAL_SECTION sharedLockType;
+#define sharedLockInit(l) InitializeCriticalSection(l)
+#define sharedLockDestroy(l) DeleteCriticalSection(l)
+#define sharedLockAcquire(l) EnterCriticalSection(l)
+#define sharedLockRelease(l) LeaveCriticalSection(l)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t sharedLockType;
+#define sharedLockInit(l) pthread_mutex_init(l, NULL)
+#define sharedLockDestroy(l) pthread_mutex_destroy(l)
+#define sharedLockAcquire(l) pthread_mutex_lock(l)
+#define sharedLockRelease(l) pthread_mutex_unlock(l)
+#endif
+#else
+typedef int sharedLockType;
+#define sharedLockInit(l) ((void)(l))
+#define sharedLockDestroy(l) ((void)(l))
+#define sharedLockAcquire(l) ((void)(l))
+#define sharedLockRelease(l) ((void)(l))
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define sharedVersionGet(ssm) __atomic_load_n(&(ssm)->version, __ATOMIC_ACQUIRE)
+#define sharedVersionSet(ssm, v) __atomic_store_n(&(ssm)->version, (v), __ATOMIC_RELEASE)
+#else
+/* Aligned 32-bit volatile accesses have acquire/release semantics on MSVC. */
+#define sharedVersionGet(ssm) (*(volatile unsigned int *)&(ssm)->version)
+#define sharedVersionSet(ssm, v) (*(volatile unsigned int *)&(ssm)->version = (v))
+#endif
+
+struct valkeyClusterSharedSlotmap {
+    unsigned int version;      /* Version of `current`, 0 before the first. */
+    slotmap_snapshot *current; /* Protected by `lock`. */
+    sharedLockType lock;
+};
 
-    /* Create a slot to valkeyClusterNode lookup table */
-    valkeyClusterNode **table;
-    table = vk_calloc(VALKEYCLUSTER_SLOTS, sizeof(valkeyClusterNode *));
-    if (table == NULL) {
-        goto oom;
+valkeyClusterSharedSlotmap *valkeyClusterSharedSlotmapCreate(void) {
+    valkeyClusterSharedSlotmap *ssm = vk_calloc(1, sizeof(*ssm));
+    if (ssm == NULL)
+        return NULL;
+    sharedLockInit(&ssm->lock);
+    return ssm;
+}
+
+static void slotmapSnapshotRelease(valkeyClusterSharedSlotmap *ssm,
+                                   slotmap_snapshot *snap) {
+    int refcount;
+
+    if (snap == NULL)
+        return;
+    sharedLockAcquire(&ssm->lock);
+    refcount = --snap->refcount;
+    sharedLockRelease(&ssm->lock);
+    if (refcount == 0) {
+        dictRelease(snap->nodes);
+        vk_free(snap);
     }
+}
 
-    dictIterator di;
-    dictInitIterator(&di, nodes);
+void valkeyClusterSharedSlotmapFree(valkeyClusterSharedSlotmap *ssm) {
+    if (ssm == NULL)
+        return;
+    slotmapSnapshotRelease(ssm, ssm->current);
+    sharedLockDestroy(&ssm->lock);
+    vk_free(ssm);
+}
 
-    dictEntry *de;
-    while ((de = dictNext(&di))) {
-        valkeyClusterNode *node = dictGetVal(de);
-        if (node->role != VALKEY_ROLE_PRIMARY) {
-            valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
-                                  "Node role must be primary");
-            goto error;
-        }
+/* Copy the address, name, role and slots of a node, and its replicas. */
+static valkeyClusterNode *clusterNodeCopy(valkeyClusterNode *src) {
+    valkeyClusterNode *node = createValkeyClusterNode();
+    if (node == NULL)
+        return NULL;
 
-        if (node->slots == NULL) {
-            continue;
-        }
+    node->role = src->role;
+    node->port = src->port;
+    if ((src->name && (node->name = sdsdup(src->name)) == NULL) ||
+        (node->addr = sdsdup(src->addr)) == NULL ||
+        (node->host = sdsdup(src->host)) == NULL)
+        goto oom;
 
+    if (src->slots != NULL) {
         listIter li;
-        listRewind(node->slots, &li);
-
         listNode *ln;
-        while ((ln = listNext(&li))) {
-            cluster_slot *slot = listNodeValue(ln);
-            if (slot->start > slot->end || slot->end >= VALKEYCLUSTER_SLOTS) {
-                valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
-                                      "Slot region for node is invalid");
-                goto error;
-            }
-            for (uint32_t i = slot->start; i <= slot->end; i++) {
-                if (table[i] != NULL) {
-                    valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
-                                          "Different node holds same slot");
-                    goto error;
-                }
-                table[i] = node;
-            }
+        listRewind(src->slots, &li);
+        while ((ln = listNext(&li)) != NULL) {
+            cluster_slot *src_slot = listNodeValue(ln);
+            cluster_slot *slot = cluster_slot_create(node);
+            if (slot == NULL)
+                goto oom;
+            slot->start = src_slot->start;
+            slot->end = src_slot->end;
         }
     }
 
-    /* Update slot-to-node table before changing cc->nodes since
-     * removal of nodes might trigger user callbacks which may
-     * send commands, which depend on the slot-to-node table. */
-    if (cc->table != NULL) {
-        vk_free(cc->table);
-    }
-    cc->table = table;
+    if (src->replicas != NULL) {
+        if ((node->replicas = listCreate()) == NULL)
+            goto oom;
+        node->replicas->free = listClusterNodeDestructor;
 
-    cc->route_version++;
+        listIter li;
+        listNode *ln;
+        listRewind(src->replicas, &li);
+        while ((ln = listNext(&li)) != NULL) {
+            valkeyClusterNode *replica = clusterNodeCopy(listNodeValue(ln));
+            if (replica == NULL)
+                goto oom;
+            if (listAddNodeTail(node->replicas, replica) == NULL) {
+                freeValkeyClusterNode(replica);
+                goto oom;
+            }
+        }
+    }
+    return node;
 
-    // Move all libvalkey contexts in cc->nodes to nodes
-    cluster_nodes_swap_ctx(cc->nodes, nodes);
+oom:
+    freeValkeyClusterNode(node);
+    return NULL;
+}
 
-    /* Replace cc->nodes before releasing the old dict since
-     * the release procedure might access cc->nodes. */
-    dict *oldnodes = cc->nodes;
-    cc->nodes = nodes;
-    dictRelease(oldnodes);
+static dict *clusterNodesCopy(dict *src) {
+    dict *nodes = dictCreate(&clusterNodesDictType);
+    if (nodes == NULL)
+        return NULL;
 
-    if (cc->event_callback != NULL) {
-        cc->event_callback(cc, VALKEYCLUSTER_EVENT_SLOTMAP_UPDATED,
-                           cc->event_privdata);
-        if (cc->route_version == 1) {
-            /* Special event the first time the slotmap was updated. */
-            cc->event_callback(cc, VALKEYCLUSTER_EVENT_READY,
-                               cc->event_privdata);
+    dictIterator di;
+    dictInitIterator(&di, src);
+    dictEntry *de;
+    while ((de = dictNext(&di)) != NULL) {
+        valkeyClusterNode *node = clusterNodeCopy(dictGetVal(de));
+        if (node == NULL)
+            goto oom;
+        sds key = sdsdup(node->addr);
+        if (key == NULL) {
+            freeValkeyClusterNode(node);
+            goto oom;
+        }
+        if (dictAdd(nodes, key, node) != DICT_OK) {
+            sdsfree(key);
+            freeValkeyClusterNode(node);
+            goto oom;
         }
     }
-    cc->need_update_route = 0;
-    return VALKEY_OK;
+    return nodes;
 
 oom:
-    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-    // passthrough
-error:
-    vk_free(table);
     dictRelease(nodes);
-    return VALKEY_ERR;
+    return NULL;
 }
 
-int valkeyClusterUpdateSlotmap(valkeyClusterContext *cc) {
-    if (cc == NULL) {
-        return VALKEY_ERR;
+/* Publish the current nodes of a context as a new snapshot in its shared
+ * slotmap. A failed publish is not an error for the context itself. */
+static void clusterPublishSlotmap(valkeyClusterContext *cc) {
+    valkeyClusterSharedSlotmap *ssm = cc->shared_slotmap;
+    slotmap_snapshot *snap, *old;
+    unsigned int version;
+
+    snap = vk_calloc(1, sizeof(*snap));
+    if (snap == NULL)
+        return;
+    snap->refcount = 1; /* Referenced by the shared slotmap. */
+    if ((snap->nodes = clusterNodesCopy(cc->nodes)) == NULL) {
+        vk_free(snap);
+        return;
     }
 
-    valkeyClusterNode *node;
-    dictEntry *de;
+    sharedLockAcquire(&ssm->lock);
+    old = ssm->current;
+    version = ssm->version + 1;
+    if (version == 0)
+        version = 1; /* Zero means that nothing is published. */
+    snap->version = version;
+    ssm->current = snap;
+    sharedVersionSet(ssm, version);
+    sharedLockRelease(&ssm->lock);
 
-    dictIterator di;
-    dictInitIterator(&di, cc->nodes);
+    /* The snapshot may be replaced and released by others from now on. */
+    cc->shared_version = version;
+    slotmapSnapshotRelease(ssm, old);
+}
 
-    while ((de = dictNext(&di)) != NULL) {
-        node = dictGetVal(de);
+/* Use the snapshot in the shared slotmap when another context has published
+ * a snapshot since the last one seen by this context. The check is lock-free,
+ * and a lock is only taken to reference a new snapshot.
+ * Returns 1 when a snapshot was applied, otherwise 0. */
+static int clusterAdoptSharedSlotmap(valkeyClusterContext *cc) {
+    valkeyClusterSharedSlotmap *ssm = cc->shared_slotmap;
+    slotmap_snapshot *snap;
+    int status;
 
-        /* Use existing connection or (re)connect to the node. */
-        valkeyContext *c = valkeyClusterGetValkeyContext(cc, node);
-        if (c == NULL)
-            continue;
-        if (clusterUpdateRouteSendCommand(cc, c) != VALKEY_OK ||
-            clusterUpdateRouteHandleReply(cc, c) != VALKEY_OK) {
-            valkeyFree(node->con);
-            node->con = NULL;
-            continue;
-        }
-        valkeyClusterClearError(cc);
-        return VALKEY_OK;
-    }
+    if (ssm == NULL || sharedVersionGet(ssm) == cc->shared_version)
+        return 0;
 
-    return VALKEY_ERR;
-}
+    sharedLockAcquire(&ssm->lock);
+    snap = ssm->current;
+    if (snap != NULL)
+        snap->refcount++;
+    sharedLockRelease(&ssm->lock);
+    if (snap == NULL)
+        return 0;
 
-static int valkeyClusterContextInit(valkeyClusterContext *cc,
-                                    const valkeyClusterOptions *options) {
-    cc->nodes = dictCreate(&clusterNodesDictType);
-    if (cc->nodes == NULL) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-        return VALKEY_ERR;
-    }
-    cc->requests = listCreate();
-    if (cc->requests == NULL) {
+    /* The connections are kept per context, so the nodes are copied and the
+     * existing connections are moved to them by the update. */
+    dict *nodes = clusterNodesCopy(snap->nodes);
+    cc->shared_version = snap->version;
+    slotmapSnapshotRelease(ssm, snap);
+    if (nodes == NULL) {
         valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-        return VALKEY_ERR;
+        return 0;
     }
-    cc->requests->free = listCommandFree;
 
-    int supported_options = (VALKEY_OPT_USE_CLUSTER_NODES | VALKEY_OPT_USE_REPLICAS |
-                             VALKEY_OPT_BLOCKING_INITIAL_UPDATE | VALKEY_OPT_REUSEADDR |
-                             VALKEY_OPT_PREFER_IPV4 | VALKEY_OPT_PREFER_IPV6 |
-                             VALKEY_OPT_PREFER_IP_UNSPEC | VALKEY_OPT_MPTCP);
-    if (options->options & ~supported_options) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Unsupported options");
-        return VALKEY_ERR;
-    }
-    cc->options = options->options;
+    cc->flags |= VALKEY_FLAG_ADOPTING_SLOTMAP;
+    status = updateTopology(cc, nodes, 1);
+    cc->flags &= ~VALKEY_FLAG_ADOPTING_SLOTMAP;
+    return status == VALKEY_OK;
+}
 
-    if (options->options & VALKEY_OPT_USE_CLUSTER_NODES) {
-        cc->flags |= VALKEY_FLAG_USE_CLUSTER_NODES;
-    }
-    if (options->options & VALKEY_OPT_USE_REPLICAS) {
-        cc->flags |= VALKEY_FLAG_PARSE_REPLICAS;
-    }
-    if (options->options & VALKEY_OPT_BLOCKING_INITIAL_UPDATE) {
-        cc->flags |= VALKEY_FLAG_BLOCKING_INITIAL_UPDATE;
-    }
-    if (options->max_retry > 0) {
-        cc->max_retry_count = options->max_retry;
-    } else {
-        cc->max_retry_count = CLUSTER_DEFAULT_MAX_RETRY_COUNT;
-    }
-    if (options->select_db > 0) {
-        cc->select_db = options->select_db;
-    }
-    if (options->initial_nodes != NULL &&
-        valkeyClusterSetOptionAddNodes(cc, options->initial_nodes) != VALKEY_OK) {
-        return VALKEY_ERR; /* err and errstr already set. */
-    }
-    if (options->connect_timeout != NULL &&
-        valkeyClusterSetOptionConnectTimeout(cc, *options->connect_timeout) != VALKEY_OK) {
-        return VALKEY_ERR; /* err and errstr already set. */
-    }
-    if (options->command_timeout != NULL &&
-        valkeyClusterSetOptionTimeout(cc, *options->command_timeout) != VALKEY_OK) {
-        return VALKEY_ERR; /* err and errstr already set. */
-    }
-    if (options->username != NULL &&
-        valkeyClusterSetOptionUsername(cc, options->username) != VALKEY_OK) {
-        return VALKEY_ERR; /* err and errstr already set. */
-    }
-    if (options->password != NULL &&
-        valkeyClusterSetOptionPassword(cc, options->password) != VALKEY_OK) {
-        return VALKEY_ERR; /* err and errstr already set. */
-    }
-    if (options->connect_callback) {
-        cc->on_connect = options->connect_callback;
-    }
-    if (options->event_callback) {
-        cc->event_callback = options->event_callback;
-        cc->event_privdata = options->event_privdata;
-    }
-    if (options->tls) {
-        cc->tls = options->tls;
-        cc->tls_init_fn = options->tls_init_fn;
-    }
+/* Slotmap file, see `slotmap_file` in valkeyClusterOptions.
+ *
+ * The file consists of a header followed by fixed size node and slot range
+ * records, all in host byte order and naturally aligned, so the file can be
+ * read or mapped as is. The checksum covers the records. */
+#define SLOTMAP_FILE_MAGIC "VKSLOTMP"
+#define SLOTMAP_FILE_VERSION 1
+#define SLOTMAP_FILE_NAME_LEN 40
+#define SLOTMAP_FILE_HOST_LEN 256
+#define SLOTMAP_FILE_MAX_SIZE (64 * 1024 * 1024)
+
+typedef struct slotmap_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t checksum;
+    uint32_t node_count;
+    uint32_t range_count;
+} slotmap_file_header;
+
+typedef struct slotmap_file_node {
+    uint16_t port;
+    uint8_t role;
+    uint8_t name_len;
+    uint16_t host_len;
+    uint16_t pad;
+    uint32_t primary; /* Index of the primary of a replica. */
+    char name[SLOTMAP_FILE_NAME_LEN];
+    char host[SLOTMAP_FILE_HOST_LEN];
+} slotmap_file_node;
+
+typedef struct slotmap_file_range {
+    uint16_t start;
+    uint16_t end;
+    uint32_t node; /* Index of the owning primary. */
+} slotmap_file_range;
+
+/* FNV-1a */
+static uint32_t slotmapFileChecksum(const unsigned char *p, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
 
-    return VALKEY_OK;
+static void slotmapFileNodeSet(slotmap_file_node *rec, valkeyClusterNode *node,
+                               uint32_t primary) {
+    size_t len;
+    memset(rec, 0, sizeof(*rec));
+    rec->port = node->port;
+    rec->role = node->role;
+    rec->primary = primary;
+    len = node->name ? sdslen(node->name) : 0;
+    if (len > 0 && len <= SLOTMAP_FILE_NAME_LEN) {
+        rec->name_len = len;
+        memcpy(rec->name, node->name, len);
+    }
+    len = sdslen(node->host);
+    rec->host_len = len;
+    memcpy(rec->host, node->host, len);
 }
 
-void valkeyClusterFree(valkeyClusterContext *cc) {
-    if (cc == NULL)
-        return;
+/* Save the current nodes and slots to the slotmap file. The file is written to
+ * a temporary file which then replaces the slotmap file, so readers never see
+ * a partial file. Failures are ignored since the file is only an optimization. */
+static void clusterSaveSlotmapFile(valkeyClusterContext *cc) {
+    slotmap_file_header *hdr;
+    slotmap_file_node *nodes;
+    slotmap_file_range *ranges;
+    uint32_t node_count = 0, range_count = 0;
+    unsigned char *buf = NULL;
+    sds tmpfile = NULL;
+    FILE *fp = NULL;
+    dictIterator di;
+    dictEntry *de;
+    listIter li;
+    listNode *ln;
 
-    if (cc->event_callback) {
-        cc->event_callback(cc, VALKEYCLUSTER_EVENT_FREE_CONTEXT,
-                           cc->event_privdata);
+    dictInitIterator(&di, cc->nodes);
+    while ((de = dictNext(&di)) != NULL) {
+        valkeyClusterNode *node = dictGetVal(de);
+        if (node->host == NULL || sdslen(node->host) > SLOTMAP_FILE_HOST_LEN)
+            return;
+        node_count++;
+        if (node->slots)
+            range_count += listLength(node->slots);
+        if (node->replicas) {
+            listRewind(node->replicas, &li);
+            while ((ln = listNext(&li)) != NULL) {
+                valkeyClusterNode *replica = listNodeValue(ln);
+                if (replica->host == NULL || sdslen(replica->host) > SLOTMAP_FILE_HOST_LEN)
+                    return;
+                node_count++;
+            }
+        }
     }
 
-    vk_free(cc->connect_timeout);
-    vk_free(cc->command_timeout);
-    vk_free(cc->username);
-    vk_free(cc->password);
-    vk_free(cc->table);
-    dictRelease(cc->nodes);
-    listRelease(cc->requests);
-
-    memset(cc, 0xff, sizeof(*cc));
-    vk_free(cc);
-}
+    size_t size = sizeof(*hdr) + node_count * sizeof(*nodes) +
+                  range_count * sizeof(*ranges);
+    if ((buf = vk_calloc(1, size)) == NULL)
+        return;
+    hdr = (slotmap_file_header *)buf;
+    nodes = (slotmap_file_node *)(hdr + 1);
+    ranges = (slotmap_file_range *)(nodes + node_count);
 
-valkeyClusterContext *valkeyClusterConnectWithOptions(const valkeyClusterOptions *options) {
-    valkeyClusterContext *cc;
+    uint32_t n = 0, r = 0;
+    dictInitIterator(&di, cc->nodes);
+    while ((de = dictNext(&di)) != NULL) {
+        valkeyClusterNode *node = dictGetVal(de);
+        uint32_t primary = n;
+        slotmapFileNodeSet(&nodes[n++], node, primary);
+        if (node->slots) {
+            listRewind(node->slots, &li);
+            while ((ln = listNext(&li)) != NULL) {
+                cluster_slot *slot = listNodeValue(ln);
+                ranges[r].start = slot->start;
+                ranges[r].end = slot->end;
+                ranges[r].node = primary;
+                r++;
+            }
+        }
+        if (node->replicas) {
+            listRewind(node->replicas, &li);
+            while ((ln = listNext(&li)) != NULL)
+                slotmapFileNodeSet(&nodes[n++], listNodeValue(ln), primary);
+        }
+    }
 
-    cc = vk_calloc(1, sizeof(valkeyClusterContext));
-    if (cc == NULL)
-        return NULL;
+    memcpy(hdr->magic, SLOTMAP_FILE_MAGIC, sizeof(hdr->magic));
+    hdr->version = SLOTMAP_FILE_VERSION;
+    hdr->node_count = node_count;
+    hdr->range_count = range_count;
+    hdr->checksum = slotmapFileChecksum((unsigned char *)nodes, size - sizeof(*hdr));
 
-    if (valkeyClusterContextInit(cc, options) == VALKEY_OK) {
-        /* Only connect if options are ok. */
-        valkeyClusterUpdateSlotmap(cc);
+    /* Unique per process and context to not collide with other writers. */
+    tmpfile = sdscatprintf(sdsempty(), "%s.%lld.%p.tmp", cc->slotmap_file,
+                           (long long)vk_usec_now(), (void *)cc);
+    if (tmpfile == NULL || (fp = fopen(tmpfile, "wb")) == NULL)
+        goto done;
+    if (fwrite(buf, size, 1, fp) != 1) {
+        fclose(fp);
+        remove(tmpfile);
+        goto done;
     }
-    return cc;
-}
-
-valkeyClusterContext *valkeyClusterConnect(const char *addrs) {
-    valkeyClusterOptions options = {0};
-    options.initial_nodes = addrs;
+    if (fclose(fp) != 0 || rename(tmpfile, cc->slotmap_file) != 0)
+        remove(tmpfile);
 
-    return valkeyClusterConnectWithOptions(&options);
+done:
+    sdsfree(tmpfile);
+    vk_free(buf);
 }
 
-valkeyClusterContext *valkeyClusterConnectWithTimeout(const char *addrs,
-                                                      const struct timeval tv) {
-    valkeyClusterOptions options = {0};
-    options.initial_nodes = addrs;
-    options.connect_timeout = &tv;
-
-    return valkeyClusterConnectWithOptions(&options);
+static valkeyClusterNode *slotmapFileNodeCreate(const slotmap_file_node *rec) {
+    valkeyClusterNode *node = createValkeyClusterNode();
+    if (node == NULL)
+        return NULL;
+    node->role = rec->role;
+    node->port = rec->port;
+    if ((rec->name_len > 0 &&
+         (node->name = sdsnewlen(rec->name, rec->name_len)) == NULL) ||
+        (node->host = sdsnewlen(rec->host, rec->host_len)) == NULL ||
+        (node->addr = sdsdup(node->host)) == NULL ||
+        (node->addr = sdscatfmt(node->addr, ":%i", (int)rec->port)) == NULL) {
+        freeValkeyClusterNode(node);
+        return NULL;
+    }
+    return node;
 }
 
-static int valkeyClusterSetOptionAddNode(valkeyClusterContext *cc, const char *addr) {
-    dictEntry *node_entry;
-    valkeyClusterNode *node = NULL;
-    int port, ret;
-    sds ip = NULL;
+/* Read and verify the slotmap file. Returns the nodes described by the file,
+ * or NULL if the file is missing, invalid or when out of memory. */
+static dict *clusterReadSlotmapFile(const char *path) {
+    const slotmap_file_header *hdr;
+    const slotmap_file_node *recs;
+    const slotmap_file_range *ranges;
+    valkeyClusterNode **created = NULL;
+    unsigned char *buf = NULL;
+    dict *nodes = NULL;
+    FILE *fp;
+    long size;
 
-    if (cc == NULL) {
-        return VALKEY_ERR;
+    if ((fp = fopen(path, "rb")) == NULL)
+        return NULL;
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < (long)sizeof(*hdr) ||
+        size > SLOTMAP_FILE_MAX_SIZE || fseek(fp, 0, SEEK_SET) != 0 ||
+        (buf = vk_malloc(size)) == NULL || fread(buf, size, 1, fp) != 1) {
+        fclose(fp);
+        vk_free(buf);
+        return NULL;
     }
+    fclose(fp);
+
+    hdr = (const slotmap_file_header *)buf;
+    recs = (const slotmap_file_node *)(hdr + 1);
+    if (memcmp(hdr->magic, SLOTMAP_FILE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != SLOTMAP_FILE_VERSION || hdr->node_count == 0 ||
+        hdr->node_count > (uint32_t)size / sizeof(*recs) ||
+        hdr->range_count > VALKEYCLUSTER_SLOTS ||
+        (size_t)size != sizeof(*hdr) + hdr->node_count * sizeof(*recs) +
+                            hdr->range_count * sizeof(*ranges) ||
+        hdr->checksum != slotmapFileChecksum((const unsigned char *)recs,
+                                             size - sizeof(*hdr)))
+        goto error;
+    ranges = (const slotmap_file_range *)(recs + hdr->node_count);
 
-    sds addr_sds = sdsnew(addr);
-    if (addr_sds == NULL) {
-        goto oom;
-    }
-    node_entry = dictFind(cc->nodes, addr_sds);
-    sdsfree(addr_sds);
-    if (node_entry == NULL) {
-        char *p;
+    if ((created = vk_calloc(hdr->node_count, sizeof(*created))) == NULL ||
+        (nodes = dictCreate(&clusterNodesDictType)) == NULL)
+        goto error;
 
-        /* Find the last occurrence of the port separator since
-         * IPv6 addresses can contain ':' */
-        if ((p = strrchr(addr, ':')) == NULL) {
-            valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
-                                  "server address is incorrect, port separator missing.");
-            return VALKEY_ERR;
-        }
-        // p includes separator
+    /* Primaries are stored before their replicas. */
+    for (uint32_t i = 0; i < hdr->node_count; i++) {
+        const slotmap_file_node *rec = &recs[i];
+        valkeyClusterNode *node, *primary;
 
-        if (p - addr <= 0) { /* length until separator */
-            valkeyClusterSetError(
-                cc, VALKEY_ERR_OTHER,
-                "server address is incorrect, address part missing.");
-            return VALKEY_ERR;
-        }
+        if (rec->host_len > SLOTMAP_FILE_HOST_LEN ||
+            rec->name_len > SLOTMAP_FILE_NAME_LEN || rec->primary > i)
+            goto error;
+        if ((rec->role == VALKEY_ROLE_PRIMARY && rec->primary != i) ||
+            (rec->role == VALKEY_ROLE_REPLICA && rec->primary == i) ||
+            (rec->role != VALKEY_ROLE_PRIMARY && rec->role != VALKEY_ROLE_REPLICA))
+            goto error;
+        if ((node = slotmapFileNodeCreate(rec)) == NULL)
+            goto error;
 
-        ip = sdsnewlen(addr, p - addr);
-        if (ip == NULL) {
-            goto oom;
+        if (rec->role == VALKEY_ROLE_PRIMARY) {
+            sds key = sdsdup(node->addr);
+            if (key == NULL || dictAdd(nodes, key, node) != DICT_OK) {
+                sdsfree(key);
+                freeValkeyClusterNode(node);
+                goto error;
+            }
+            created[i] = node;
+            continue;
         }
-        p++; // remove separator character
 
-        if (strlen(p) <= 0) {
-            valkeyClusterSetError(
-                cc, VALKEY_ERR_OTHER,
-                "server address is incorrect, port part missing.");
+        primary = created[rec->primary];
+        if (primary == NULL) {
+            freeValkeyClusterNode(node);
             goto error;
         }
-
-        port = vk_atoi(p, strlen(p));
-        if (port <= 0) {
-            valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
-                                  "server port is incorrect");
+        if (primary->replicas == NULL) {
+            if ((primary->replicas = listCreate()) == NULL) {
+                freeValkeyClusterNode(node);
+                goto error;
+            }
+            primary->replicas->free = listClusterNodeDestructor;
+        }
+        if (listAddNodeTail(primary->replicas, node) == NULL) {
+            freeValkeyClusterNode(node);
             goto error;
         }
+    }
 
-        node = createValkeyClusterNode();
-        if (node == NULL) {
-            goto oom;
-        }
+    for (uint32_t i = 0; i < hdr->range_count; i++) {
+        cluster_slot *slot;
+        if (ranges[i].node >= hdr->node_count || created[ranges[i].node] == NULL ||
+            (slot = cluster_slot_create(created[ranges[i].node])) == NULL)
+            goto error;
+        slot->start = ranges[i].start;
+        slot->end = ranges[i].end;
+    }
 
-        node->addr = sdsnew(addr);
-        if (node->addr == NULL) {
-            goto oom;
-        }
+    vk_free(created);
+    vk_free(buf);
+    return nodes;
 
-        node->host = ip;
-        node->port = port;
+error:
+    if (nodes)
+        dictRelease(nodes);
+    vk_free(created);
+    vk_free(buf);
+    return NULL;
+}
 
-        sds key = sdsnewlen(node->addr, sdslen(node->addr));
-        if (key == NULL) {
-            goto oom;
-        }
-        ret = dictAdd(cc->nodes, key, node);
-        if (ret != DICT_OK) {
+/* Add the seed nodes missing in nodes read from a slotmap file, as nodes
+ * without slots. A stale file can then be replaced by fetching the slotmap
+ * from a seed node, even when none of the saved nodes exist anymore. */
+static int clusterMergeSeedNodes(valkeyClusterContext *cc, dict *nodes) {
+    dictIterator di;
+    dictInitIterator(&di, cc->nodes);
+    dictEntry *de;
+    while ((de = dictNext(&di)) != NULL) {
+        if (dictFind(nodes, dictGetKey(de)) != NULL)
+            continue;
+        valkeyClusterNode *node = clusterNodeCopy(dictGetVal(de));
+        if (node == NULL)
+            return VALKEY_ERR;
+        node->role = VALKEY_ROLE_PRIMARY;
+        sds key = sdsdup(node->addr);
+        if (key == NULL || dictAdd(nodes, key, node) != DICT_OK) {
             sdsfree(key);
-            goto oom;
+            freeValkeyClusterNode(node);
+            return VALKEY_ERR;
         }
     }
-
     return VALKEY_OK;
+}
 
-oom:
-    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-    // passthrough
+/* Use the slotmap file instead of fetching the slotmap, when it is valid.
+ * Returns VALKEY_OK when the slotmap was loaded. */
+static int clusterLoadSlotmapFile(valkeyClusterContext *cc) {
+    dict *nodes;
+    int status;
 
-error:
-    sdsfree(ip);
-    if (node != NULL) {
-        sdsfree(node->addr);
-        vk_free(node);
-    }
-    return VALKEY_ERR;
+    if (cc->slotmap_file == NULL)
+        return VALKEY_ERR;
+    if ((nodes = clusterReadSlotmapFile(cc->slotmap_file)) == NULL)
+        return VALKEY_ERR;
+    if (clusterMergeSeedNodes(cc, nodes) != VALKEY_OK) {
+        dictRelease(nodes);
+        return VALKEY_ERR; /* Fetch it instead. */
+    }
+
+    /* Not saved again nor published, since it wasn't fetched. */
+    cc->flags |= VALKEY_FLAG_ADOPTING_SLOTMAP;
+    status = updateTopology(cc, nodes, 0);
+    cc->flags &= ~VALKEY_FLAG_ADOPTING_SLOTMAP;
+    if (status != VALKEY_OK)
+        valkeyClusterClearError(cc); /* Fetch it instead. */
+    return status;
 }
 
-static int valkeyClusterSetOptionAddNodes(valkeyClusterContext *cc,
-                                          const char *addrs) {
-    int ret;
-    sds *address = NULL;
-    int address_count = 0;
-    int i;
+static int sdsEqual(const sds a, const sds b) {
+    if (a == NULL || b == NULL)
+        return a == b;
+    return sdscmp(a, b) == 0;
+}
 
-    if (cc == NULL) {
-        return VALKEY_ERR;
-    }
+/* Check if two nodes have the same address, name and replicas. */
+static int clusterNodeEqual(valkeyClusterNode *a, valkeyClusterNode *b) {
+    if (!sdsEqual(a->addr, b->addr) || !sdsEqual(a->name, b->name))
+        return 0;
 
-    /* Split into individual addresses. */
-    address = sdssplitlen(addrs, strlen(addrs), ",", strlen(","), &address_count);
-    if (address == NULL) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-        return VALKEY_ERR;
-    }
+    unsigned long na = a->replicas ? listLength(a->replicas) : 0;
+    unsigned long nb = b->replicas ? listLength(b->replicas) : 0;
+    if (na != nb)
+        return 0;
+    if (na == 0)
+        return 1;
+
+    listNode *la = listFirst(a->replicas);
+    listNode *lb = listFirst(b->replicas);
+    for (; la != NULL && lb != NULL; la = listNextNode(la), lb = listNextNode(lb)) {
+        valkeyClusterNode *ra = listNodeValue(la);
+        valkeyClusterNode *rb = listNodeValue(lb);
+        if (!sdsEqual(ra->addr, rb->addr))
+            return 0;
+    }
+    return 1;
+}
 
-    if (address_count <= 0) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
-                              "invalid server addresses (example format: "
-                              "127.0.0.1:1234,127.0.0.2:5678)");
-        sdsfreesplitres(address, address_count);
-        return VALKEY_ERR;
+/* Check if a new collection of nodes and its slot-to-node table describe the
+ * same topology as the one currently used. */
+static int clusterTopologyEqual(valkeyClusterContext *cc, dict *nodes,
+                                valkeyClusterNode **table) {
+    if (cc->table == NULL || cc->nodes == NULL ||
+        dictSize(cc->nodes) != dictSize(nodes))
+        return 0;
+
+    dictIterator di;
+    dictInitIterator(&di, nodes);
+    dictEntry *de;
+    while ((de = dictNext(&di)) != NULL) {
+        valkeyClusterNode *node = dictGetVal(de);
+        dictEntry *de_cur = dictFind(cc->nodes, node->addr);
+        if (de_cur == NULL || !clusterNodeEqual(dictGetVal(de_cur), node))
+            return 0;
     }
 
-    for (i = 0; i < address_count; i++) {
-        ret = valkeyClusterSetOptionAddNode(cc, address[i]);
-        if (ret != VALKEY_OK) {
-            sdsfreesplitres(address, address_count);
-            return VALKEY_ERR;
+    for (uint32_t i = 0; i < VALKEYCLUSTER_SLOTS; i++) {
+        if (table[i] == NULL || cc->table[i] == NULL) {
+            if (table[i] != cc->table[i])
+                return 0;
+        } else if (sdscmp(table[i]->addr, cc->table[i]->addr) != 0) {
+            return 0;
         }
     }
+    return 1;
+}
 
-    sdsfreesplitres(address, address_count);
+/* Set the owner of the slot regions of a node. */
+static void clusterNodeOwnSlots(valkeyClusterNode *node) {
+    listIter li;
+    listNode *ln;
 
-    return VALKEY_OK;
+    if (node->slots == NULL)
+        return;
+    listRewind(node->slots, &li);
+    while ((ln = listNext(&li)) != NULL)
+        ((cluster_slot *)listNodeValue(ln))->node = node;
 }
 
-/**
- * Configure a username used during authentication, see
- * the Valkey AUTH command.
- * Disabled by default. Can be disabled again by providing an
- * empty string or a null pointer.
- */
-static int valkeyClusterSetOptionUsername(valkeyClusterContext *cc,
-                                          const char *username) {
-    if (cc == NULL) {
-        return VALKEY_ERR;
-    }
+/* Apply a changed topology to the current one, touching only what changed.
+ * Nodes that remain are kept, including their connections and statistics,
+ * and get the slots, name and replicas of their new counterpart. The new
+ * `nodes` is updated to hold the kept nodes while the counterparts are moved
+ * to cc->nodes, to be released with it. Only the changed entries of the
+ * current slot-to-node table are written, using `table` which maps the slots
+ * to the new nodes. */
+static void clusterApplyTopologyDiff(valkeyClusterContext *cc, dict *nodes,
+                                     valkeyClusterNode **table) {
+    dictIterator di;
+    dictEntry *de;
 
-    // Disabling option
-    if (username == NULL || username[0] == '\0') {
-        vk_free(cc->username);
-        cc->username = NULL;
-        return VALKEY_OK;
+    dictInitIterator(&di, nodes);
+    while ((de = dictNext(&di)) != NULL) {
+        valkeyClusterNode *node = dictGetVal(de);
+        dictEntry *de_cur = dictFind(cc->nodes, node->addr);
+        if (de_cur == NULL)
+            continue; /* An added node. */
+
+        valkeyClusterNode *cur = dictGetVal(de_cur);
+        struct hilist *slots = cur->slots;
+        cur->slots = node->slots;
+        node->slots = slots;
+        clusterNodeOwnSlots(cur);
+        clusterNodeOwnSlots(node);
+        if (!clusterNodeEqual(cur, node)) {
+            struct hilist *replicas = cur->replicas;
+            cur->replicas = node->replicas;
+            node->replicas = replicas;
+            char *name = cur->name;
+            cur->name = node->name;
+            node->name = name;
+        }
+        dictSetVal(nodes, de, cur);
+        dictSetVal(cc->nodes, de_cur, node);
     }
 
-    vk_free(cc->username);
-    cc->username = vk_strdup(username);
-    if (cc->username == NULL) {
-        return VALKEY_ERR;
-    }
+    /* Point the owned slots of `table` to the kept nodes instead of their
+     * counterparts. Slots not owned in the new topology are already NULL. */
+    dictInitIterator(&di, nodes);
+    while ((de = dictNext(&di)) != NULL) {
+        valkeyClusterNode *node = dictGetVal(de);
+        listIter li;
+        listNode *ln;
 
-    return VALKEY_OK;
+        if (node->slots == NULL)
+            continue;
+        listRewind(node->slots, &li);
+        while ((ln = listNext(&li)) != NULL) {
+            cluster_slot *slot = listNodeValue(ln);
+            for (uint32_t i = slot->start; i <= slot->end; i++)
+                table[i] = node;
+        }
+    }
+    for (uint32_t i = 0; i < VALKEYCLUSTER_SLOTS; i++) {
+        if (cc->table[i] != table[i])
+            cc->table[i] = table[i];
+    }
 }
 
-/**
- * Configure a password used when connecting to password-protected
- * Valkey instances. (See Valkey AUTH command)
- */
-static int valkeyClusterSetOptionPassword(valkeyClusterContext *cc,
-                                          const char *password) {
+/* Update known cluster nodes with a new collection of valkeyClusterNodes.
+ * Will also update the slot-to-node lookup table for the new nodes. */
+static int updateNodesAndSlotmap(valkeyClusterContext *cc, dict *nodes) {
+    return updateTopology(cc, nodes, 0);
+}
 
-    if (cc == NULL) {
+/* Update the nodes and slotmap as updateNodesAndSlotmap(). When skip_unchanged
+ * is set and the new nodes describe the current topology they are discarded,
+ * keeping the current nodes and their connections, and no event is sent.
+ * A changed topology is then applied as a diff to the current one. */
+static int updateTopology(valkeyClusterContext *cc, dict *nodes,
+                          int skip_unchanged) {
+    if (nodes == NULL) {
         return VALKEY_ERR;
     }
 
-    // Disabling use of password
-    if (password == NULL || password[0] == '\0') {
-        vk_free(cc->password);
-        cc->password = NULL;
-        return VALKEY_OK;
+    /* Create a slot to valkeyClusterNode lookup table */
+    valkeyClusterNode **table;
+    table = vk_calloc(VALKEYCLUSTER_SLOTS, sizeof(valkeyClusterNode *));
+    if (table == NULL) {
+        goto oom;
     }
 
-    vk_free(cc->password);
-    cc->password = vk_strdup(password);
-    if (cc->password == NULL) {
-        return VALKEY_ERR;
-    }
+    dictIterator di;
+    dictInitIterator(&di, nodes);
 
-    return VALKEY_OK;
-}
+    dictEntry *de;
+    while ((de = dictNext(&di))) {
+        valkeyClusterNode *node = dictGetVal(de);
+        if (node->role != VALKEY_ROLE_PRIMARY) {
+            valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                                  "Node role must be primary");
+            goto error;
+        }
 
-static int valkeyClusterSetOptionConnectTimeout(valkeyClusterContext *cc,
-                                                const struct timeval tv) {
+        if (node->slots == NULL) {
+            continue;
+        }
 
-    if (cc == NULL) {
-        return VALKEY_ERR;
-    }
+        listIter li;
+        listRewind(node->slots, &li);
 
-    if (cc->connect_timeout == NULL) {
-        cc->connect_timeout = vk_malloc(sizeof(struct timeval));
-        if (cc->connect_timeout == NULL) {
-            valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-            return VALKEY_ERR;
+        listNode *ln;
+        while ((ln = listNext(&li))) {
+            cluster_slot *slot = listNodeValue(ln);
+            if (slot->start > slot->end || slot->end >= VALKEYCLUSTER_SLOTS) {
+                valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                                      "Slot region for node is invalid");
+                goto error;
+            }
+            for (uint32_t i = slot->start; i <= slot->end; i++) {
+                if (table[i] != NULL) {
+                    valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                                          "Different node holds same slot");
+                    goto error;
+                }
+                table[i] = node;
+            }
         }
     }
 
-    memcpy(cc->connect_timeout, &tv, sizeof(struct timeval));
-
-    return VALKEY_OK;
-}
-
-int valkeyClusterSetOptionTimeout(valkeyClusterContext *cc,
-                                  const struct timeval tv) {
-    if (cc == NULL) {
-        return VALKEY_ERR;
+    if (skip_unchanged && clusterTopologyEqual(cc, nodes, table)) {
+        vk_free(table);
+        dictRelease(nodes);
+        cc->need_update_route = 0;
+        cc->slotmap_deltas = 0;
+        return VALKEY_OK;
     }
 
-    if (cc->command_timeout == NULL ||
-        cc->command_timeout->tv_sec != tv.tv_sec ||
-        cc->command_timeout->tv_usec != tv.tv_usec) {
-
-        if (cc->command_timeout == NULL) {
-            cc->command_timeout = vk_malloc(sizeof(struct timeval));
-            if (cc->command_timeout == NULL) {
-                valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-                return VALKEY_ERR;
-            }
+    /* Update slot-to-node table before changing cc->nodes since
+     * removal of nodes might trigger user callbacks which may
+     * send commands, which depend on the slot-to-node table. */
+    if (skip_unchanged && cc->table != NULL && cc->nodes != NULL) {
+        clusterApplyTopologyDiff(cc, nodes, table);
+        vk_free(table);
+    } else {
+        if (cc->table != NULL) {
+            vk_free(cc->table);
         }
+        cc->table = table;
 
-        memcpy(cc->command_timeout, &tv, sizeof(struct timeval));
-
-        /* Set timeout on already connected nodes */
-        if (dictSize(cc->nodes) > 0) {
-            dictEntry *de;
-            valkeyClusterNode *node;
+        // Move all libvalkey contexts in cc->nodes to nodes
+        cluster_nodes_swap_ctx(cc->nodes, nodes);
+    }
 
-            dictIterator di;
-            dictInitIterator(&di, cc->nodes);
+    cc->route_version++;
 
-            while ((de = dictNext(&di)) != NULL) {
-                node = dictGetVal(de);
-                if (node->acon) {
-                    valkeyAsyncSetTimeout(node->acon, tv);
-                }
-                if (node->con && node->con->err == 0) {
-                    valkeySetTimeout(node->con, tv);
-                }
+    /* Replace cc->nodes before releasing the old dict since
+     * the release procedure might access cc->nodes. */
+    dict *oldnodes = cc->nodes;
+    cc->nodes = nodes;
+    dictRelease(oldnodes);
 
-                if (node->replicas && listLength(node->replicas) > 0) {
-                    valkeyClusterNode *replica;
-                    listNode *ln;
+    if (!(cc->flags & VALKEY_FLAG_ADOPTING_SLOTMAP)) {
+        if (cc->shared_slotmap != NULL)
+            clusterPublishSlotmap(cc);
+        if (cc->slotmap_file != NULL)
+            clusterSaveSlotmapFile(cc);
+    }
 
-                    listIter li;
-                    listRewind(node->replicas, &li);
+    /* Only set for async contexts, which extend the cluster context. */
+    if (cc->route_version == 1 && (cc->flags & VALKEY_FLAG_PRECONNECT))
+        clusterAsyncPreconnect((valkeyClusterAsyncContext *)cc);
+    /* Subscribe to sharded channels whose subscription was lost. */
+    if (cc->flags & VALKEY_FLAG_SHARDED_PUBSUB)
+        clusterShardResubscribe((valkeyClusterAsyncContext *)cc);
 
-                    while ((ln = listNext(&li)) != NULL) {
-                        replica = listNodeValue(ln);
-                        if (replica->acon) {
-                            valkeyAsyncSetTimeout(replica->acon, tv);
-                        }
-                        if (replica->con && replica->con->err == 0) {
-                            valkeySetTimeout(replica->con, tv);
-                        }
-                    }
-                }
-            }
+    if (cc->event_callback != NULL) {
+        cc->event_callback(cc, VALKEYCLUSTER_EVENT_SLOTMAP_UPDATED,
+                           cc->event_privdata);
+        if (cc->route_version == 1) {
+            /* Special event the first time the slotmap was updated. */
+            cc->event_callback(cc, VALKEYCLUSTER_EVENT_READY,
+                               cc->event_privdata);
         }
     }
-
+    cc->need_update_route = 0;
+    cc->slotmap_deltas = 0;
     return VALKEY_OK;
+
+oom:
+    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+    // passthrough
+error:
+    vk_free(table);
+    dictRelease(nodes);
+    return VALKEY_ERR;
 }
 
-valkeyContext *valkeyClusterGetValkeyContext(valkeyClusterContext *cc,
-                                             valkeyClusterNode *node) {
-    valkeyContext *c = NULL;
-    if (node == NULL) {
-        return NULL;
-    }
+typedef struct seed_probe {
+    valkeyContext *c;
+    int write_done;
+    int pending_auth; /* An AUTH reply is expected before the slotmap. */
+} seed_probe;
+
+/* Fetch the initial slotmap by sending the slotmap command to all seed nodes
+ * concurrently using non-blocking connections, and use the first successful
+ * reply. A dead seed then costs at most a single timeout in total. */
+static int clusterProbeSeeds(valkeyClusterContext *cc) {
+    unsigned long count = dictSize(cc->nodes), active = 0;
+    seed_probe *probes = NULL;
+    struct pollfd *pfds = NULL;
+    dict *nodes = NULL;
+    int64_t deadline = -1;
+    int status = VALKEY_ERR;
+    dictIterator di;
+    dictEntry *de;
 
-    c = node->con;
-    if (c != NULL) {
-        if (c->err) {
-            valkeyReconnect(c);
+    probes = vk_calloc(count, sizeof(*probes));
+    pfds = vk_calloc(count, sizeof(*pfds));
+    if (probes == NULL || pfds == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+        goto done;
+    }
 
-            if (cc->on_connect) {
-                cc->on_connect(c, c->err ? VALKEY_ERR : VALKEY_OK);
-            }
+    const char *cmd = (cc->flags & VALKEY_FLAG_USE_CLUSTER_NODES ?
+                           VALKEY_COMMAND_CLUSTER_NODES :
+                           VALKEY_COMMAND_CLUSTER_SLOTS);
+    dictInitIterator(&di, cc->nodes);
+    while ((de = dictNext(&di)) != NULL) {
+        valkeyClusterNode *node = dictGetVal(de);
+        valkeyOptions options = {0};
+        valkeyContext *c;
 
-            if (cc->tls && cc->tls_init_fn(c, cc->tls) != VALKEY_OK) {
-                valkeyClusterSetError(cc, c->err, c->errstr);
-            }
-            /* Authenticate and select a logical database when configured.
-             * cc->err and cc->errstr are set when failing. */
-            authenticate(cc, c);
-            select_db(cc, c);
+        if (node->host == NULL || node->port <= 0)
+            continue;
+        VALKEY_OPTIONS_SET_TCP(&options, node->host, node->port);
+        options.options = cc->options | VALKEY_OPT_NONBLOCK;
+        options.allocator = cc->allocator;
+        options.max_obuf_size = cc->max_obuf_size;
+        c = valkeyConnectWithOptions(&options);
+        if (c == NULL) {
+            valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+            continue;
         }
-
-        return c;
+        seed_probe *p = &probes[active];
+        if (cc->password != NULL) {
+            if (cc->username != NULL)
+                valkeyAppendCommand(c, "AUTH %s %s", cc->username, cc->password);
+            else
+                valkeyAppendCommand(c, "AUTH %s", cc->password);
+            p->pending_auth = 1;
+        }
+        if (c->err == 0)
+            valkeyAppendCommand(c, cmd);
+        if (c->err) {
+            valkeyClusterSetError(cc, c->err, c->errstr);
+            valkeyFree(c);
+            continue;
+        }
+        p->c = c;
+        active++;
     }
 
-    if (node->host == NULL || node->port <= 0) {
-        return NULL;
+    if (cc->connect_timeout != NULL || cc->command_timeout != NULL) {
+        deadline = vk_msec_now();
+        if (cc->connect_timeout != NULL)
+            deadline += cc->connect_timeout->tv_sec * 1000 + cc->connect_timeout->tv_usec / 1000;
+        if (cc->command_timeout != NULL)
+            deadline += cc->command_timeout->tv_sec * 1000 + cc->command_timeout->tv_usec / 1000;
     }
 
-    valkeyOptions options = {0};
-    VALKEY_OPTIONS_SET_TCP(&options, node->host, node->port);
-    options.connect_timeout = cc->connect_timeout;
-    options.command_timeout = cc->command_timeout;
-    options.options = cc->options;
-
-    c = valkeyConnectWithOptions(&options);
-    if (c == NULL) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-        return NULL;
-    }
+    while (nodes == NULL) {
+        unsigned long n = 0;
+        int timeout = -1;
 
-    if (cc->on_connect) {
-        cc->on_connect(c, c->err ? VALKEY_ERR : VALKEY_OK);
-    }
+        for (unsigned long i = 0; i < active; i++) {
+            if (probes[i].c == NULL)
+                continue;
+            pfds[n].fd = probes[i].c->fd;
+            pfds[n].events = POLLIN | (probes[i].write_done ? 0 : POLLOUT);
+            pfds[n].revents = 0;
+            n++;
+        }
+        if (n == 0)
+            break; /* All failed, error already set. */
+        if (deadline >= 0) {
+            int64_t left = deadline - vk_msec_now();
+            if (left <= 0) {
+                valkeyClusterSetError(cc, VALKEY_ERR_TIMEOUT, "Timeout probing seed nodes");
+                break;
+            }
+            timeout = (int)left;
+        }
+        int res = poll(pfds, n, timeout);
+        if (res < 0 && errno != EINTR) {
+            valkeyClusterSetError(cc, VALKEY_ERR_IO, strerror(errno));
+            break;
+        }
+        if (res <= 0)
+            continue;
 
-    if (c->err) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
-        valkeyFree(c);
-        return NULL;
-    }
+        n = 0;
+        for (unsigned long i = 0; i < active && nodes == NULL; i++) {
+            seed_probe *p = &probes[i];
+            valkeyContext *c = p->c;
+            valkeyReply *reply = NULL;
+            int drop = 0;
+            short revents;
+
+            if (c == NULL)
+                continue;
+            revents = pfds[n++].revents;
+            if (revents == 0)
+                continue;
+
+            if (!p->write_done && (revents & (POLLOUT | POLLERR | POLLHUP)) &&
+                valkeyBufferWrite(c, &p->write_done) != VALKEY_OK)
+                goto failed;
+            if ((revents & (POLLIN | POLLERR | POLLHUP)) &&
+                valkeyBufferRead(c) != VALKEY_OK)
+                goto failed;
+            while (nodes == NULL && !drop) {
+                if (valkeyGetReplyFromReader(c, (void **)&reply) != VALKEY_OK)
+                    goto failed;
+                if (reply == NULL)
+                    break; /* Wait for more data. */
+                if (reply->type == VALKEY_REPLY_ERROR) {
+                    valkeyClusterSetError(cc, VALKEY_ERR_OTHER, reply->str);
+                    drop = 1;
+                } else if (p->pending_auth) {
+                    p->pending_auth = 0;
+                } else if (cc->flags & VALKEY_FLAG_USE_CLUSTER_NODES) {
+                    nodes = parse_cluster_nodes(cc, c, reply);
+                    drop = (nodes == NULL);
+                } else {
+                    nodes = parse_cluster_slots(cc, c, reply);
+                    drop = (nodes == NULL);
+                }
+                freeReplyObject(reply);
+            }
+            if (drop) {
+                valkeyFree(c);
+                p->c = NULL;
+            }
+            continue;
 
-    if (cc->tls && cc->tls_init_fn(c, cc->tls) != VALKEY_OK) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
-        valkeyFree(c);
-        return NULL;
+        failed:
+            valkeyClusterSetError(cc, c->err, c->errstr);
+            valkeyFree(c);
+            p->c = NULL;
+        }
     }
 
-    if (authenticate(cc, c) != VALKEY_OK) {
-        valkeyFree(c);
-        return NULL;
-    }
-    if (select_db(cc, c) != VALKEY_OK) {
-        valkeyFree(c);
-        return NULL;
+    if (nodes != NULL) {
+        valkeyClusterClearError(cc);
+        status = updateNodesAndSlotmap(cc, nodes);
     }
 
-    node->con = c;
-
-    return c;
+done:
+    for (unsigned long i = 0; i < active; i++)
+        valkeyFree(probes[i].c);
+    vk_free(probes);
+    vk_free(pfds);
+    return status;
 }
 
-static valkeyClusterNode *node_get_by_table(valkeyClusterContext *cc,
-                                            uint32_t slot_num) {
-    if (cc == NULL) {
-        return NULL;
+/* Update the slotmap. A newer slotmap fetched by another context is used
+ * instead of fetching one, unless the update is caused by a redirect. The
+ * redirect can be newer than the shared slotmap, and adopting it would free
+ * nodes that the caller still holds. */
+static int clusterUpdateSlotmap(valkeyClusterContext *cc, int redirected) {
+    if (!redirected && clusterAdoptSharedSlotmap(cc)) {
+        return VALKEY_OK;
     }
 
-    if (slot_num >= VALKEYCLUSTER_SLOTS) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "invalid slot");
-        return NULL;
+    /* Probe the seed nodes concurrently for the first slotmap. TLS connections
+     * are set up in blocking mode, so they are tried one by one. */
+    if (cc->route_version == 0 && cc->tls == NULL && dictSize(cc->nodes) > 1) {
+        return clusterProbeSeeds(cc);
     }
 
-    if (cc->table == NULL) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "slotmap not available");
-        return NULL;
-    }
+    valkeyClusterNode *node;
+    dictEntry *de;
 
-    if (cc->table[slot_num] == NULL) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
-                              "slot not served by any node");
-        return NULL;
-    }
+    dictIterator di;
+    dictInitIterator(&di, cc->nodes);
 
-    return cc->table[slot_num];
-}
+    while ((de = dictNext(&di)) != NULL) {
+        node = dictGetVal(de);
 
-/* Helper function for the valkeyClusterAppendCommand* family of functions.
- *
- * Write a formatted command to the output buffer. When this family
- * is used, you need to call valkeyGetReply yourself to retrieve
- * the reply (or replies in pub/sub).
- */
-static int valkeyClusterAppendCommandInternal(valkeyClusterContext *cc,
-                                              struct cmd *command) {
+        /* Use existing connection or (re)connect to the node. */
+        valkeyContext *c = valkeyClusterGetValkeyContext(cc, node);
+        if (c == NULL)
+            continue;
+        if (clusterUpdateRouteSendCommand(cc, c) != VALKEY_OK ||
+            clusterUpdateRouteHandleReply(cc, c) != VALKEY_OK) {
+            valkeyFree(node->con);
+            node->con = NULL;
+            continue;
+        }
+        valkeyClusterClearError(cc);
+        return VALKEY_OK;
+    }
 
-    valkeyClusterNode *node;
-    valkeyContext *c = NULL;
+    return VALKEY_ERR;
+}
 
-    if (cc == NULL || command == NULL) {
+int valkeyClusterUpdateSlotmap(valkeyClusterContext *cc) {
+    if (cc == NULL) {
         return VALKEY_ERR;
     }
+    return clusterUpdateSlotmap(cc, 0);
+}
 
-    node = node_get_by_table(cc, (uint32_t)command->slot_num);
-    if (node == NULL) {
+static int valkeyClusterContextInit(valkeyClusterContext *cc,
+                                    const valkeyClusterOptions *options) {
+    cc->nodes = dictCreate(&clusterNodesDictType);
+    if (cc->nodes == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
         return VALKEY_ERR;
     }
-
-    c = valkeyClusterGetValkeyContext(cc, node);
-    if (c == NULL) {
+    cc->requests = listCreate();
+    if (cc->requests == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
         return VALKEY_ERR;
-    } else if (c->err) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
+    }
+    cc->requests->free = listCommandFree;
+
+    int supported_options = (VALKEY_OPT_USE_CLUSTER_NODES | VALKEY_OPT_USE_REPLICAS |
+                             VALKEY_OPT_BLOCKING_INITIAL_UPDATE |
+                             VALKEY_OPT_INCREMENTAL_SLOTMAP | VALKEY_OPT_POOL_LEAST_PENDING |
+                             VALKEY_OPT_AUTO_PIPELINE | VALKEY_OPT_PRECONNECT |
+                             VALKEY_OPT_REUSEADDR |
+                             VALKEY_OPT_PREFER_IPV4 | VALKEY_OPT_PREFER_IPV6 |
+                             VALKEY_OPT_PREFER_IP_UNSPEC | VALKEY_OPT_MPTCP |
+                             VALKEY_OPT_REUSE_PUBSUB_REPLIES);
+    if (options->options & ~supported_options) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Unsupported options");
         return VALKEY_ERR;
     }
+    cc->options = options->options;
 
-    if (valkeyAppendFormattedCommand(c, command->cmd, command->clen) !=
-        VALKEY_OK) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
+    if (options->options & VALKEY_OPT_USE_CLUSTER_NODES) {
+        cc->flags |= VALKEY_FLAG_USE_CLUSTER_NODES;
+    }
+    if (options->options & VALKEY_OPT_USE_REPLICAS) {
+        cc->flags |= VALKEY_FLAG_PARSE_REPLICAS;
+    }
+    if (options->options & VALKEY_OPT_BLOCKING_INITIAL_UPDATE) {
+        cc->flags |= VALKEY_FLAG_BLOCKING_INITIAL_UPDATE;
+    }
+    if (options->options & VALKEY_OPT_INCREMENTAL_SLOTMAP) {
+        cc->flags |= VALKEY_FLAG_INCREMENTAL_SLOTMAP;
+    }
+    if (options->options & VALKEY_OPT_POOL_LEAST_PENDING) {
+        cc->flags |= VALKEY_FLAG_POOL_LEAST_PENDING;
+    }
+    if (options->options & VALKEY_OPT_AUTO_PIPELINE) {
+        cc->flags |= VALKEY_FLAG_AUTO_PIPELINE;
+    }
+    cc->connections_per_node = options->connections_per_node > 1 ? options->connections_per_node : 1;
+    cc->shared_slotmap = options->shared_slotmap;
+    if (options->slotmap_file != NULL &&
+        (cc->slotmap_file = vk_strdup(options->slotmap_file)) == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
         return VALKEY_ERR;
     }
+    if (options->max_slotmap_deltas > 0) {
+        cc->max_slotmap_deltas = options->max_slotmap_deltas;
+    } else {
+        cc->max_slotmap_deltas = SLOTMAP_DEFAULT_MAX_DELTAS;
+    }
+    if (options->slotmap_delta_interval != NULL) {
+        cc->slotmap_delta_interval_usec =
+            options->slotmap_delta_interval->tv_sec * 1000000LL +
+            options->slotmap_delta_interval->tv_usec;
+    } else {
+        cc->slotmap_delta_interval_usec = SLOTMAP_DEFAULT_DELTA_INTERVAL_USEC;
+    }
+    if (options->max_retry > 0) {
+        cc->max_retry_count = options->max_retry;
+    } else {
+        cc->max_retry_count = CLUSTER_DEFAULT_MAX_RETRY_COUNT;
+    }
+    if (options->select_db > 0) {
+        cc->select_db = options->select_db;
+    }
+    cc->cache = options->cache;
+    cc->allocator = options->allocator;
+    cc->max_obuf_size = options->max_obuf_size;
+    if (options->initial_nodes != NULL &&
+        valkeyClusterSetOptionAddNodes(cc, options->initial_nodes) != VALKEY_OK) {
+        return VALKEY_ERR; /* err and errstr already set. */
+    }
+    if (options->connect_timeout != NULL &&
+        valkeyClusterSetOptionConnectTimeout(cc, *options->connect_timeout) != VALKEY_OK) {
+        return VALKEY_ERR; /* err and errstr already set. */
+    }
+    if (options->command_timeout != NULL &&
+        valkeyClusterSetOptionTimeout(cc, *options->command_timeout) != VALKEY_OK) {
+        return VALKEY_ERR; /* err and errstr already set. */
+    }
+    if (options->username != NULL &&
+        valkeyClusterSetOptionUsername(cc, options->username) != VALKEY_OK) {
+        return VALKEY_ERR; /* err and errstr already set. */
+    }
+    if (options->password != NULL &&
+        valkeyClusterSetOptionPassword(cc, options->password) != VALKEY_OK) {
+        return VALKEY_ERR; /* err and errstr already set. */
+    }
+    if (options->connect_callback) {
+        cc->on_connect = options->connect_callback;
+    }
+    if (options->event_callback) {
+        cc->event_callback = options->event_callback;
+        cc->event_privdata = options->event_privdata;
+    }
+    if (options->tls) {
+        cc->tls = options->tls;
+        cc->tls_init_fn = options->tls_init_fn;
+    }
 
     return VALKEY_OK;
 }
 
-/* Helper functions for the valkeyClusterGetReply* family of functions.
- */
-static int valkeyClusterGetReplyFromNode(valkeyClusterContext *cc,
-                                         valkeyClusterNode *node,
-                                         void **reply) {
-    valkeyContext *c;
-
-    if (cc == NULL || node == NULL || reply == NULL)
-        return VALKEY_ERR;
-
-    c = node->con;
-    if (c == NULL) {
-        return VALKEY_ERR;
-    } else if (c->err) {
-        if (cc->need_update_route == 0) {
-            cc->retry_count++;
-            if (cc->retry_count > cc->max_retry_count) {
-                cc->need_update_route = 1;
-                cc->retry_count = 0;
-            }
-        }
-        valkeyClusterSetError(cc, c->err, c->errstr);
-        return VALKEY_ERR;
-    }
+void valkeyClusterFree(valkeyClusterContext *cc) {
+    if (cc == NULL)
+        return;
 
-    if (valkeyGetReply(c, reply) != VALKEY_OK) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
-        return VALKEY_ERR;
+    if (cc->event_callback) {
+        cc->event_callback(cc, VALKEYCLUSTER_EVENT_FREE_CONTEXT,
+                           cc->event_privdata);
     }
 
-    if (getReplyErrorType(*reply) == CLUSTER_ERR_MOVED)
-        cc->need_update_route = 1;
+    vk_free(cc->connect_timeout);
+    vk_free(cc->command_timeout);
+    vk_free(cc->username);
+    vk_free(cc->password);
+    vk_free(cc->slotmap_file);
+    vk_free(cc->table);
+    dictRelease(cc->nodes);
+    /* Closes the checked out connections, after their nodes are freed. */
+    if (cc->checkouts != NULL)
+        dictRelease(cc->checkouts);
+    listRelease(cc->requests);
 
-    return VALKEY_OK;
+    memset(cc, 0xff, sizeof(*cc));
+    vk_free(cc);
 }
 
-/* Parses a MOVED or ASK error reply and returns the destination node. The slot
- * is returned by pointer, if provided. When the parsed endpoint/IP is an empty
- * string the address from which the reply was sent from is used instead, as
- * described in the Valkey Cluster Specification. This address is provided via
- * the valkeyContext given in 'c'. */
-static valkeyClusterNode *getNodeFromRedirectReply(valkeyClusterContext *cc,
-                                                   valkeyContext *c,
-                                                   valkeyReply *reply,
-                                                   int *slotptr) {
-    valkeyClusterNode *node = NULL;
-    sds key = NULL;
-    sds endpoint = NULL;
-    char *str = reply->str;
-
-    /* Expecting ["ASK" | "MOVED", "<slot>", "<endpoint>:<port>"] */
-    char *p, *slot = NULL, *addr = NULL;
-    int field = 0;
-    while (*str != '\0') {
-        // clang-format off
-        switch (field++) {
-            // Skip field 0, i.e. ASK/MOVED
-            case 1: slot = str; break;
-            case 2: addr = str; break;
-        }
-        // clang-format on
-        if ((p = strchr(str, ' ')) == NULL)
-            break; /* No more fields. */
-        *p = '\0';
-        str = p + 1; /* Start of next field. */
-    }
+valkeyClusterContext *valkeyClusterConnectWithOptions(const valkeyClusterOptions *options) {
+    valkeyClusterContext *cc;
 
-    /* Make sure all expected fields are found. */
-    if (addr == NULL) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Failed to parse redirect");
+    cc = vk_calloc(1, sizeof(valkeyClusterContext));
+    if (cc == NULL)
         return NULL;
+
+    if (valkeyClusterContextInit(cc, options) == VALKEY_OK) {
+        /* Only connect if options are ok. */
+        if (clusterLoadSlotmapFile(cc) != VALKEY_OK)
+            valkeyClusterUpdateSlotmap(cc);
     }
-    /* Find the last occurrence of the port separator since
-     * IPv6 addresses can contain ':' */
-    if ((p = strrchr(addr, ':')) == NULL) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid address in redirect");
-        return NULL;
+    return cc;
+}
+
+valkeyClusterContext *valkeyClusterConnect(const char *addrs) {
+    valkeyClusterOptions options = {0};
+    options.initial_nodes = addrs;
+
+    return valkeyClusterConnectWithOptions(&options);
+}
+
+valkeyClusterContext *valkeyClusterConnectWithTimeout(const char *addrs,
+                                                      const struct timeval tv) {
+    valkeyClusterOptions options = {0};
+    options.initial_nodes = addrs;
+    options.connect_timeout = &tv;
+
+    return valkeyClusterConnectWithOptions(&options);
+}
+
+static int valkeyClusterSetOptionAddNode(valkeyClusterContext *cc, const char *addr) {
+    dictEntry *node_entry;
+    valkeyClusterNode *node = NULL;
+    int port, ret;
+    sds ip = NULL;
+
+    if (cc == NULL) {
+        return VALKEY_ERR;
     }
-    /* Get the port (skip the found port separator). */
-    int port = vk_atoi(p + 1, strlen(p + 1));
-    if (port < 1 || port > UINT16_MAX) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid port in redirect");
-        return NULL;
+
+    sds addr_sds = sdsnew(addr);
+    if (addr_sds == NULL) {
+        goto oom;
     }
+    node_entry = dictFind(cc->nodes, addr_sds);
+    sdsfree(addr_sds);
+    if (node_entry == NULL) {
+        char *p;
 
-    /* Check that we received an ip/host address, i.e. the field
-     * does not start with the port separator. */
-    if (p != addr) {
-        key = sdsnew(addr);
-        if (key == NULL) {
+        /* Find the last occurrence of the port separator since
+         * IPv6 addresses can contain ':' */
+        if ((p = strrchr(addr, ':')) == NULL) {
+            valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                                  "server address is incorrect, port separator missing.");
+            return VALKEY_ERR;
+        }
+        // p includes separator
+
+        if (p - addr <= 0) { /* length until separator */
+            valkeyClusterSetError(
+                cc, VALKEY_ERR_OTHER,
+                "server address is incorrect, address part missing.");
+            return VALKEY_ERR;
+        }
+
+        ip = sdsnewlen(addr, p - addr);
+        if (ip == NULL) {
             goto oom;
         }
-        *p = '\0'; /* Cut port separator and port. */
+        p++; // remove separator character
 
-        endpoint = sdsnew(addr);
-        if (endpoint == NULL) {
+        if (strlen(p) <= 0) {
+            valkeyClusterSetError(
+                cc, VALKEY_ERR_OTHER,
+                "server address is incorrect, port part missing.");
+            goto error;
+        }
+
+        port = vk_atoi(p, strlen(p));
+        if (port <= 0) {
+            valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                                  "server port is incorrect");
+            goto error;
+        }
+
+        node = createValkeyClusterNode();
+        if (node == NULL) {
             goto oom;
         }
-    } else {
-        /* We received an ip/host that is an empty string. According to the docs
-         * we can treat this as it means the same address we received the reply from. */
-        endpoint = sdsnew(c->tcp.host);
-        if (endpoint == NULL) {
+
+        node->addr = sdsnew(addr);
+        if (node->addr == NULL) {
             goto oom;
         }
 
-        key = sdsdup(endpoint);
+        node->host = ip;
+        node->port = port;
+
+        sds key = sdsnewlen(node->addr, sdslen(node->addr));
         if (key == NULL) {
             goto oom;
         }
-        key = sdscatfmt(key, ":%i", port);
-        if (key == NULL) {
+        ret = dictAdd(cc->nodes, key, node);
+        if (ret != DICT_OK) {
+            sdsfree(key);
             goto oom;
         }
     }
 
-    /* Parse slot if requested. */
-    if (slotptr != NULL) {
-        *slotptr = vk_atoi(slot, strlen(slot));
+    return VALKEY_OK;
+
+oom:
+    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+    // passthrough
+
+error:
+    sdsfree(ip);
+    if (node != NULL) {
+        sdsfree(node->addr);
+        vk_free(node);
     }
+    return VALKEY_ERR;
+}
 
-    /* Get the node if already known. */
-    dictEntry *de = dictFind(cc->nodes, key);
-    if (de != NULL) {
-        sdsfree(key);
-        sdsfree(endpoint);
-        return dictGetVal(de);
+static int valkeyClusterSetOptionAddNodes(valkeyClusterContext *cc,
+                                          const char *addrs) {
+    int ret;
+    sds *address = NULL;
+    int address_count = 0;
+    int i;
+
+    if (cc == NULL) {
+        return VALKEY_ERR;
     }
 
-    /* Add this node since it was unknown */
-    node = createValkeyClusterNode();
-    if (node == NULL) {
-        goto oom;
+    /* Split into individual addresses. */
+    address = sdssplitlen(addrs, strlen(addrs), ",", strlen(","), &address_count);
+    if (address == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+        return VALKEY_ERR;
     }
-    node->role = VALKEY_ROLE_PRIMARY;
-    node->host = endpoint;
-    node->port = port;
-    node->addr = sdsdup(key);
-    if (node->addr == NULL) {
+
+    if (address_count <= 0) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                              "invalid server addresses (example format: "
+                              "127.0.0.1:1234,127.0.0.2:5678)");
+        sdsfreesplitres(address, address_count);
+        return VALKEY_ERR;
+    }
+
+    for (i = 0; i < address_count; i++) {
+        ret = valkeyClusterSetOptionAddNode(cc, address[i]);
+        if (ret != VALKEY_OK) {
+            sdsfreesplitres(address, address_count);
+            return VALKEY_ERR;
+        }
+    }
+
+    sdsfreesplitres(address, address_count);
+
+    return VALKEY_OK;
+}
+
+/**
+ * Configure a username used during authentication, see
+ * the Valkey AUTH command.
+ * Disabled by default. Can be disabled again by providing an
+ * empty string or a null pointer.
+ */
+static int valkeyClusterSetOptionUsername(valkeyClusterContext *cc,
+                                          const char *username) {
+    if (cc == NULL) {
+        return VALKEY_ERR;
+    }
+
+    // Disabling option
+    if (username == NULL || username[0] == '\0') {
+        vk_free(cc->username);
+        cc->username = NULL;
+        return VALKEY_OK;
+    }
+
+    vk_free(cc->username);
+    cc->username = vk_strdup(username);
+    if (cc->username == NULL) {
+        return VALKEY_ERR;
+    }
+
+    return VALKEY_OK;
+}
+
+/**
+ * Configure a password used when connecting to password-protected
+ * Valkey instances. (See Valkey AUTH command)
+ */
+static int valkeyClusterSetOptionPassword(valkeyClusterContext *cc,
+                                          const char *password) {
+
+    if (cc == NULL) {
+        return VALKEY_ERR;
+    }
+
+    // Disabling use of password
+    if (password == NULL || password[0] == '\0') {
+        vk_free(cc->password);
+        cc->password = NULL;
+        return VALKEY_OK;
+    }
+
+    vk_free(cc->password);
+    cc->password = vk_strdup(password);
+    if (cc->password == NULL) {
+        return VALKEY_ERR;
+    }
+
+    return VALKEY_OK;
+}
+
+static int valkeyClusterSetOptionConnectTimeout(valkeyClusterContext *cc,
+                                                const struct timeval tv) {
+
+    if (cc == NULL) {
+        return VALKEY_ERR;
+    }
+
+    if (cc->connect_timeout == NULL) {
+        cc->connect_timeout = vk_malloc(sizeof(struct timeval));
+        if (cc->connect_timeout == NULL) {
+            valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+            return VALKEY_ERR;
+        }
+    }
+
+    memcpy(cc->connect_timeout, &tv, sizeof(struct timeval));
+
+    return VALKEY_OK;
+}
+
+/* Set the command timeout on all connections to a node. */
+static void nodeSetTimeout(valkeyClusterNode *node, const struct timeval tv) {
+    if (node->acon) {
+        valkeyAsyncSetTimeout(node->acon, tv);
+    }
+    if (node->con && node->con->err == 0) {
+        valkeySetTimeout(node->con, tv);
+    }
+    for (int i = 0; i < node->pool_size; i++) {
+        if (node->pool[i].acon) {
+            valkeyAsyncSetTimeout(node->pool[i].acon, tv);
+        }
+        if (node->pool[i].con && node->pool[i].con->err == 0) {
+            valkeySetTimeout(node->pool[i].con, tv);
+        }
+    }
+}
+
+int valkeyClusterSetOptionTimeout(valkeyClusterContext *cc,
+                                  const struct timeval tv) {
+    if (cc == NULL) {
+        return VALKEY_ERR;
+    }
+
+    if (cc->command_timeout == NULL ||
+        cc->command_timeout->tv_sec != tv.tv_sec ||
+        cc->command_timeout->tv_usec != tv.tv_usec) {
+
+        if (cc->command_timeout == NULL) {
+            cc->command_timeout = vk_malloc(sizeof(struct timeval));
+            if (cc->command_timeout == NULL) {
+                valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+                return VALKEY_ERR;
+            }
+        }
+
+        memcpy(cc->command_timeout, &tv, sizeof(struct timeval));
+
+        /* Set timeout on already connected nodes */
+        if (dictSize(cc->nodes) > 0) {
+            dictEntry *de;
+            valkeyClusterNode *node;
+
+            dictIterator di;
+            dictInitIterator(&di, cc->nodes);
+
+            while ((de = dictNext(&di)) != NULL) {
+                node = dictGetVal(de);
+                nodeSetTimeout(node, tv);
+
+                if (node->replicas && listLength(node->replicas) > 0) {
+                    valkeyClusterNode *replica;
+                    listNode *ln;
+
+                    listIter li;
+                    listRewind(node->replicas, &li);
+
+                    while ((ln = listNext(&li)) != NULL) {
+                        replica = listNodeValue(ln);
+                        nodeSetTimeout(replica, tv);
+                    }
+                }
+            }
+        }
+    }
+
+    return VALKEY_OK;
+}
+
+/* Get the connection kept in `conp`, or connect to the node and keep the new
+ * connection in `conp`. A connection with errors is reconnected. */
+static valkeyContext *clusterGetContext(valkeyClusterContext *cc,
+                                        valkeyClusterNode *node,
+                                        valkeyContext **conp) {
+    valkeyContext *c = *conp;
+    if (c != NULL) {
+        if (c->err) {
+            valkeyReconnect(c);
+
+            if (cc->on_connect) {
+                cc->on_connect(c, c->err ? VALKEY_ERR : VALKEY_OK);
+            }
+
+            if (cc->tls && cc->tls_init_fn(c, cc->tls) != VALKEY_OK) {
+                valkeyClusterSetError(cc, c->err, c->errstr);
+            }
+            /* Authenticate and select a logical database when configured.
+             * cc->err and cc->errstr are set when failing. */
+            authenticate(cc, c);
+            select_db(cc, c);
+        }
+
+        return c;
+    }
+
+    if (node->host == NULL || node->port <= 0) {
+        return NULL;
+    }
+
+    valkeyOptions options = {0};
+    VALKEY_OPTIONS_SET_TCP(&options, node->host, node->port);
+    options.connect_timeout = cc->connect_timeout;
+    options.command_timeout = cc->command_timeout;
+    options.options = cc->options;
+    options.allocator = cc->allocator;
+    options.max_obuf_size = cc->max_obuf_size;
+
+    c = valkeyConnectWithOptions(&options);
+    if (c == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+        return NULL;
+    }
+
+    if (cc->on_connect) {
+        cc->on_connect(c, c->err ? VALKEY_ERR : VALKEY_OK);
+    }
+
+    if (c->err) {
+        valkeyClusterSetError(cc, c->err, c->errstr);
+        valkeyFree(c);
+        return NULL;
+    }
+
+    if (cc->tls && cc->tls_init_fn(c, cc->tls) != VALKEY_OK) {
+        valkeyClusterSetError(cc, c->err, c->errstr);
+        valkeyFree(c);
+        return NULL;
+    }
+
+    if (authenticate(cc, c) != VALKEY_OK) {
+        valkeyFree(c);
+        return NULL;
+    }
+    if (select_db(cc, c) != VALKEY_OK) {
+        valkeyFree(c);
+        return NULL;
+    }
+
+    *conp = c;
+
+    return c;
+}
+
+valkeyContext *valkeyClusterGetValkeyContext(valkeyClusterContext *cc,
+                                             valkeyClusterNode *node) {
+    if (node == NULL) {
+        return NULL;
+    }
+
+    return clusterGetContext(cc, node, &node->con);
+}
+
+/* Create the connection pool of a node when needed. */
+static int clusterNodeInitPool(valkeyClusterContext *cc,
+                               valkeyClusterNode *node) {
+    if (node->pool != NULL)
+        return VALKEY_OK;
+
+    node->pool = vk_calloc(cc->connections_per_node, sizeof(cluster_conn));
+    if (node->pool == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+        return VALKEY_ERR;
+    }
+    node->pool_size = cc->connections_per_node;
+    for (int i = 0; i < node->pool_size; i++)
+        node->pool[i].node = node;
+    return VALKEY_OK;
+}
+
+valkeyContext *valkeyClusterCheckoutContext(valkeyClusterContext *cc,
+                                            valkeyClusterNode *node) {
+    cluster_checkout *checkout;
+    cluster_conn *conn = NULL;
+    valkeyContext *c;
+
+    if (cc == NULL || node == NULL) {
+        return NULL;
+    }
+    valkeyClusterClearError(cc);
+
+    if (clusterNodeInitPool(cc, node) != VALKEY_OK) {
+        return NULL;
+    }
+
+    /* Prefer an idle connection that is already connected. */
+    for (int i = 0; i < node->pool_size; i++) {
+        if (node->pool[i].checkout != NULL)
+            continue;
+        if (conn == NULL || (conn->con == NULL && node->pool[i].con != NULL))
+            conn = &node->pool[i];
+    }
+    if (conn == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                              "All connections to the node are checked out");
+        return NULL;
+    }
+
+    c = clusterGetContext(cc, node, &conn->con);
+    if (c == NULL || c->err) {
+        if (c != NULL)
+            valkeyClusterSetError(cc, c->err, c->errstr);
+        else if (cc->err == 0)
+            valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "node host or port is error");
+        return NULL;
+    }
+
+    if (cc->checkouts == NULL) {
+        cc->checkouts = dictCreate(&clusterCheckoutsDictType);
+        if (cc->checkouts == NULL)
+            goto oom;
+    }
+    checkout = vk_malloc(sizeof(*checkout));
+    if (checkout == NULL)
+        goto oom;
+    checkout->con = c;
+    checkout->conn = conn;
+    if (dictAdd(cc->checkouts, c, checkout) != DICT_OK) {
+        vk_free(checkout);
+        goto oom;
+    }
+    conn->checkout = checkout;
+    return c;
+
+oom:
+    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+    return NULL;
+}
+
+/* The connection is found by itself, since its node may have been freed. */
+void valkeyClusterCheckinContext(valkeyClusterContext *cc, valkeyContext *c) {
+    if (cc == NULL || c == NULL || cc->checkouts == NULL) {
+        return;
+    }
+
+    dictDelete(cc->checkouts, c);
+}
+
+static valkeyClusterNode *node_get_by_table(valkeyClusterContext *cc,
+                                            uint32_t slot_num) {
+    if (cc == NULL) {
+        return NULL;
+    }
+
+    if (slot_num >= VALKEYCLUSTER_SLOTS) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "invalid slot");
+        return NULL;
+    }
+
+    if (cc->table == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "slotmap not available");
+        return NULL;
+    }
+
+    if (cc->table[slot_num] == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                              "slot not served by any node");
+        return NULL;
+    }
+
+    return cc->table[slot_num];
+}
+
+/* Helper function for the valkeyClusterAppendCommand* family of functions.
+ *
+ * Write a formatted command to the output buffer. When this family
+ * is used, you need to call valkeyGetReply yourself to retrieve
+ * the reply (or replies in pub/sub).
+ */
+static int valkeyClusterAppendCommandInternal(valkeyClusterContext *cc,
+                                              struct cmd *command) {
+
+    valkeyClusterNode *node;
+    valkeyContext *c = NULL;
+
+    if (cc == NULL || command == NULL) {
+        return VALKEY_ERR;
+    }
+
+    node = node_get_by_table(cc, (uint32_t)command->slot_num);
+    if (node == NULL) {
+        return VALKEY_ERR;
+    }
+
+    c = valkeyClusterGetValkeyContext(cc, node);
+    if (c == NULL) {
+        return VALKEY_ERR;
+    } else if (c->err) {
+        valkeyClusterSetError(cc, c->err, c->errstr);
+        return VALKEY_ERR;
+    }
+
+    if (valkeyAppendFormattedCommand(c, command->cmd, command->clen) !=
+        VALKEY_OK) {
+        clusterSetAppendError(cc, c);
+        return VALKEY_ERR;
+    }
+
+    return VALKEY_OK;
+}
+
+/* Helper functions for the valkeyClusterGetReply* family of functions.
+ */
+static int valkeyClusterGetReplyFromNode(valkeyClusterContext *cc,
+                                         valkeyClusterNode *node,
+                                         void **reply) {
+    valkeyContext *c;
+
+    if (cc == NULL || node == NULL || reply == NULL)
+        return VALKEY_ERR;
+
+    c = node->con;
+    if (c == NULL) {
+        return VALKEY_ERR;
+    } else if (c->err) {
+        if (cc->need_update_route == 0) {
+            cc->retry_count++;
+            if (cc->retry_count > cc->max_retry_count) {
+                cc->need_update_route = 1;
+                cc->retry_count = 0;
+            }
+        }
+        valkeyClusterSetError(cc, c->err, c->errstr);
+        return VALKEY_ERR;
+    }
+
+    if (valkeyGetReply(c, reply) != VALKEY_OK) {
+        valkeyClusterSetError(cc, c->err, c->errstr);
+        return VALKEY_ERR;
+    }
+
+    if (getReplyErrorType(*reply) == CLUSTER_ERR_MOVED)
+        cc->need_update_route = 1;
+
+    return VALKEY_OK;
+}
+
+/* Parses a MOVED or ASK error reply and returns the destination node. The slot
+ * is returned by pointer, if provided. An unknown destination node is added to
+ * the known nodes, which is indicated via `createdptr` if provided. When the
+ * parsed endpoint/IP is an empty
+ * string the address from which the reply was sent from is used instead, as
+ * described in the Valkey Cluster Specification. This address is provided via
+ * the valkeyContext given in 'c'. */
+static valkeyClusterNode *getNodeFromRedirectReply(valkeyClusterContext *cc,
+                                                   valkeyContext *c,
+                                                   valkeyReply *reply,
+                                                   int *slotptr,
+                                                   int *createdptr) {
+    valkeyClusterNode *node = NULL;
+    sds key = NULL;
+    sds endpoint = NULL;
+    char *str = reply->str;
+
+    /* Expecting ["ASK" | "MOVED", "<slot>", "<endpoint>:<port>"] */
+    char *p, *slot = NULL, *addr = NULL;
+    int field = 0;
+    while (*str != '\0') {
+        // clang-format off
+        switch (field++) {
+            // Skip field 0, i.e. ASK/MOVED
+            case 1: slot = str; break;
+            case 2: addr = str; break;
+        }
+        // clang-format on
+        if ((p = strchr(str, ' ')) == NULL)
+            break; /* No more fields. */
+        *p = '\0';
+        str = p + 1; /* Start of next field. */
+    }
+
+    /* Make sure all expected fields are found. */
+    if (addr == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Failed to parse redirect");
+        return NULL;
+    }
+    /* Find the last occurrence of the port separator since
+     * IPv6 addresses can contain ':' */
+    if ((p = strrchr(addr, ':')) == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid address in redirect");
+        return NULL;
+    }
+    /* Get the port (skip the found port separator). */
+    int port = vk_atoi(p + 1, strlen(p + 1));
+    if (port < 1 || port > UINT16_MAX) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid port in redirect");
+        return NULL;
+    }
+
+    /* Check that we received an ip/host address, i.e. the field
+     * does not start with the port separator. */
+    if (p != addr) {
+        key = sdsnew(addr);
+        if (key == NULL) {
+            goto oom;
+        }
+        *p = '\0'; /* Cut port separator and port. */
+
+        endpoint = sdsnew(addr);
+        if (endpoint == NULL) {
+            goto oom;
+        }
+    } else {
+        /* We received an ip/host that is an empty string. According to the docs
+         * we can treat this as it means the same address we received the reply from. */
+        endpoint = sdsnew(c->tcp.host);
+        if (endpoint == NULL) {
+            goto oom;
+        }
+
+        key = sdsdup(endpoint);
+        if (key == NULL) {
+            goto oom;
+        }
+        key = sdscatfmt(key, ":%i", port);
+        if (key == NULL) {
+            goto oom;
+        }
+    }
+
+    /* Parse slot if requested. */
+    if (slotptr != NULL) {
+        *slotptr = vk_atoi(slot, strlen(slot));
+    }
+
+    /* Get the node if already known. */
+    dictEntry *de = dictFind(cc->nodes, key);
+    if (de != NULL) {
+        sdsfree(key);
+        sdsfree(endpoint);
+        return dictGetVal(de);
+    }
+
+    /* Add this node since it was unknown */
+    node = createValkeyClusterNode();
+    if (node == NULL) {
+        goto oom;
+    }
+    node->role = VALKEY_ROLE_PRIMARY;
+    node->host = endpoint;
+    node->port = port;
+    node->addr = sdsdup(key);
+    if (node->addr == NULL) {
+        goto oom;
+    }
+
+    if (dictAdd(cc->nodes, key, node) != DICT_OK) {
+        goto oom;
+    }
+    if (createdptr != NULL) {
+        *createdptr = 1;
+    }
+    return node;
+
+oom:
+    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+    sdsfree(key);
+    sdsfree(endpoint);
+    if (node != NULL) {
+        sdsfree(node->addr);
+        vk_free(node);
+    }
+    return NULL;
+}
+
+/* Updates the slot mapping entry for a slot given by a MOVED redirect.
+ * Returns 1 when a full slotmap update is needed, i.e. when incremental updates
+ * are not enabled, when the redirect pointed to a previously unknown node, or
+ * when the limits for applied deltas are reached. Otherwise 0 is returned. */
+static int clusterApplyMovedRedirect(valkeyClusterContext *cc, int slot,
+                                     valkeyClusterNode *node, int node_created) {
+    if (slot >= 0 && slot < VALKEYCLUSTER_SLOTS) {
+        cc->table[slot] = node;
+    }
+
+    if (!(cc->flags & VALKEY_FLAG_INCREMENTAL_SLOTMAP) || node_created)
+        return 1;
+
+    int64_t now = vk_usec_now();
+    if (cc->slotmap_deltas++ == 0)
+        cc->slotmap_delta_start = now;
+
+    return cc->slotmap_deltas >= cc->max_slotmap_deltas ||
+           now - cc->slotmap_delta_start >= cc->slotmap_delta_interval_usec;
+}
+
+static void *valkey_cluster_command_execute(valkeyClusterContext *cc,
+                                            struct cmd *command) {
+    void *reply = NULL;
+    valkeyClusterNode *node;
+    valkeyContext *c = NULL;
+    valkeyContext *c_updating_route = NULL;
+    int64_t sent_usec;
+
+    clusterAdoptSharedSlotmap(cc);
+
+retry:
+
+    node = node_get_by_table(cc, (uint32_t)command->slot_num);
+    if (node == NULL) {
+        /* Update the slotmap since the slot is not served. */
+        if (valkeyClusterUpdateSlotmap(cc) != VALKEY_OK) {
+            goto error;
+        }
+        node = node_get_by_table(cc, (uint32_t)command->slot_num);
+        if (node == NULL) {
+            /* Return error since the slot is still not served. */
+            goto error;
+        }
+    }
+
+    c = valkeyClusterGetValkeyContext(cc, node);
+    if (c == NULL || c->err) {
+        /* Failed to connect. Maybe there was a failover and this node is gone.
+         * Update slotmap to find out. */
+        if (valkeyClusterUpdateSlotmap(cc) != VALKEY_OK) {
+            goto error;
+        }
+
+        node = node_get_by_table(cc, (uint32_t)command->slot_num);
+        if (node == NULL) {
+            goto error;
+        }
+        c = valkeyClusterGetValkeyContext(cc, node);
+        if (c == NULL) {
+            goto error;
+        } else if (c->err) {
+            valkeyClusterSetError(cc, c->err, c->errstr);
+            goto error;
+        }
+    }
+
+moved_retry:
+ask_retry:
+
+    sent_usec = vk_usec_now();
+    if (valkeyAppendFormattedCommand(c, command->cmd, command->clen) !=
+        VALKEY_OK) {
+        clusterSetAppendError(cc, c);
+        goto error;
+    }
+
+    /* If update slotmap has been scheduled, do that in the same pipeline. */
+    if (cc->need_update_route && c_updating_route == NULL) {
+        if (clusterUpdateRouteSendCommand(cc, c) == VALKEY_OK) {
+            c_updating_route = c;
+        }
+    }
+
+    if (valkeyGetReply(c, &reply) != VALKEY_OK) {
+        valkeyClusterSetError(cc, c->err, c->errstr);
+        clusterNodeRecordReply(node, NULL, 0);
+        /* We may need to update the slotmap if this node is removed from the
+         * cluster, but the current request may have already timed out so we
+         * schedule it for later. */
+        if (c->err != VALKEY_ERR_OOM)
+            cc->need_update_route = 1;
+        goto error;
+    }
+    clusterNodeRecordReply(node, reply, vk_usec_now() - sent_usec);
+
+    replyErrorType error_type = getReplyErrorType(reply);
+    if (error_type > CLUSTER_NO_ERROR && error_type < CLUSTER_ERR_OTHER) {
+        cc->retry_count++;
+        if (cc->retry_count > cc->max_retry_count) {
+            valkeyClusterSetError(cc, VALKEY_ERR_CLUSTER_TOO_MANY_RETRIES,
+                                  "too many cluster retries");
+            goto error;
+        }
+
+        int slot = -1;
+        int node_created = 0;
+        switch (error_type) {
+        case CLUSTER_ERR_MOVED:
+            node = getNodeFromRedirectReply(cc, c, reply, &slot, &node_created);
+            freeReplyObject(reply);
+            reply = NULL;
+
+            if (node == NULL) {
+                /* Failed to parse redirect. Specific error already set. */
+                goto error;
+            }
+
+            /* Update the slot mapping entry for this slot, and the
+             * full slotmap when required. */
+            if (clusterApplyMovedRedirect(cc, slot, node, node_created) &&
+                c_updating_route == NULL) {
+                if (clusterUpdateRouteSendCommand(cc, c) == VALKEY_OK) {
+                    /* Deferred update route using the node that sent the
+                     * redirect. */
+                    c_updating_route = c;
+                } else if (clusterUpdateSlotmap(cc, 1) == VALKEY_OK) {
+                    /* Synchronous update route successful using new connection. */
+                    valkeyClusterClearError(cc);
+                } else {
+                    /* Failed to update route. Specific error already set. */
+                    goto error;
+                }
+            }
+
+            c = valkeyClusterGetValkeyContext(cc, node);
+            if (c == NULL) {
+                goto error;
+            } else if (c->err) {
+                valkeyClusterSetError(cc, c->err, c->errstr);
+                goto error;
+            }
+
+            goto moved_retry;
+        case CLUSTER_ERR_ASK:
+            node = getNodeFromRedirectReply(cc, c, reply, NULL, NULL);
+            if (node == NULL) {
+                goto error;
+            }
+
+            freeReplyObject(reply);
+            reply = NULL;
+
+            c = valkeyClusterGetValkeyContext(cc, node);
+            if (c == NULL) {
+                goto error;
+            } else if (c->err) {
+                valkeyClusterSetError(cc, c->err, c->errstr);
+                goto error;
+            }
+
+            reply = valkeyCommand(c, VALKEY_COMMAND_ASKING);
+            if (reply == NULL) {
+                clusterSetAppendError(cc, c);
+                goto error;
+            }
+
+            freeReplyObject(reply);
+            reply = NULL;
+
+            goto ask_retry;
+        case CLUSTER_ERR_TRYAGAIN:
+        case CLUSTER_ERR_CLUSTERDOWN:
+            freeReplyObject(reply);
+            reply = NULL;
+            goto retry;
+
+        default:
+
+            break;
+        }
+    }
+
+    goto done;
+
+error:
+    if (reply) {
+        freeReplyObject(reply);
+        reply = NULL;
+    }
+
+done:
+    if (c_updating_route) {
+        /* Deferred CLUSTER SLOTS or CLUSTER NODES in progress. Wait for the
+         * reply and handle it. */
+        if (clusterUpdateRouteHandleReply(cc, c_updating_route) != VALKEY_OK) {
+            /* Clear error and update synchronously using another node. */
+            valkeyClusterClearError(cc);
+            if (clusterUpdateSlotmap(cc, 1) != VALKEY_OK) {
+                /* Clear the reply to indicate failure. */
+                freeReplyObject(reply);
+                reply = NULL;
+            }
+        }
+    }
+
+    return reply;
+}
+
+/* Prepare command by parsing the string to find the key and to get the slot. */
+static int prepareCommand(valkeyClusterContext *cc, struct cmd *command) {
+    if (command->cmd == NULL || command->clen <= 0) {
+        return VALKEY_ERR;
+    }
+
+    valkey_parse_cmd(command);
+    if (command->result == CMD_PARSE_ENOMEM) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+        return VALKEY_ERR;
+    }
+    if (command->result != CMD_PARSE_OK) {
+        valkeyClusterSetError(cc, VALKEY_ERR_PROTOCOL, command->errstr);
+        return VALKEY_ERR;
+    }
+    if (command->key.len == 0) {
+        valkeyClusterSetError(
+            cc, VALKEY_ERR_OTHER,
+            "No keys in command(must have keys for valkey cluster mode)");
+        return VALKEY_ERR;
+    }
+    command->slot_num = keyHashSlot(command->key.start, command->key.len);
+    return VALKEY_OK;
+}
+
+void *valkeyClusterFormattedCommand(valkeyClusterContext *cc, char *cmd,
+                                    int len) {
+    valkeyReply *reply = NULL;
+    struct cmd *command = NULL;
+
+    if (cc == NULL) {
+        return NULL;
+    }
+
+    valkeyClusterClearError(cc);
+
+    command = command_get();
+    if (command == NULL) {
+        goto oom;
+    }
+    command->cmd = cmd;
+    command->clen = len;
+
+    if (prepareCommand(cc, command) != VALKEY_OK) {
+        goto error;
+    }
+
+    reply = valkey_cluster_command_execute(cc, command);
+    command->cmd = NULL;
+    command_destroy(command);
+    cc->retry_count = 0;
+    return reply;
+
+oom:
+    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+    // passthrough
+
+error:
+    if (command != NULL) {
+        command->cmd = NULL;
+        command_destroy(command);
+    }
+    cc->retry_count = 0;
+    return NULL;
+}
+
+void *valkeyClustervCommand(valkeyClusterContext *cc, const char *format,
+                            va_list ap) {
+    valkeyReply *reply;
+    char *cmd;
+    int len;
+
+    if (cc == NULL) {
+        return NULL;
+    }
+
+    len = valkeyvFormatCommand(&cmd, format, ap);
+
+    if (len == -1) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+        return NULL;
+    } else if (len == -2) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid format string");
+        return NULL;
+    }
+
+    reply = valkeyClusterFormattedCommand(cc, cmd, len);
+
+    vk_free(cmd);
+
+    return reply;
+}
+
+void *valkeyClusterCommand(valkeyClusterContext *cc, const char *format, ...) {
+    va_list ap;
+    valkeyReply *reply = NULL;
+
+    va_start(ap, format);
+    reply = valkeyClustervCommand(cc, format, ap);
+    va_end(ap);
+
+    return reply;
+}
+
+void *valkeyClustervCommandToNode(valkeyClusterContext *cc,
+                                  valkeyClusterNode *node, const char *format,
+                                  va_list ap) {
+    valkeyContext *c;
+    int ret;
+    void *reply;
+    int updating_slotmap = 0;
+
+    c = valkeyClusterGetValkeyContext(cc, node);
+    if (c == NULL) {
+        return NULL;
+    } else if (c->err) {
+        valkeyClusterSetError(cc, c->err, c->errstr);
+        return NULL;
+    }
+
+    valkeyClusterClearError(cc);
+
+    int64_t sent_usec = vk_usec_now();
+    ret = valkeyvAppendCommand(c, format, ap);
+
+    if (ret != VALKEY_OK) {
+        valkeyClusterSetError(cc, c->err, c->errstr);
+        return NULL;
+    }
+
+    if (cc->need_update_route) {
+        /* Pipeline slotmap update on the same connection. */
+        if (clusterUpdateRouteSendCommand(cc, c) == VALKEY_OK) {
+            updating_slotmap = 1;
+        }
+    }
+
+    if (valkeyGetReply(c, &reply) != VALKEY_OK) {
+        valkeyClusterSetError(cc, c->err, c->errstr);
+        clusterNodeRecordReply(node, NULL, 0);
+        if (c->err != VALKEY_ERR_OOM)
+            cc->need_update_route = 1;
+        return NULL;
+    }
+    clusterNodeRecordReply(node, reply, vk_usec_now() - sent_usec);
+
+    if (updating_slotmap) {
+        /* Handle reply from pipelined CLUSTER SLOTS or CLUSTER NODES. */
+        if (clusterUpdateRouteHandleReply(cc, c) != VALKEY_OK) {
+            /* Ignore error. Update will be triggered on the next command. */
+            valkeyClusterClearError(cc);
+        }
+    }
+
+    return reply;
+}
+
+void *valkeyClusterCommandToNode(valkeyClusterContext *cc,
+                                 valkeyClusterNode *node, const char *format,
+                                 ...) {
+    va_list ap;
+    valkeyReply *reply = NULL;
+
+    va_start(ap, format);
+    reply = valkeyClustervCommandToNode(cc, node, format, ap);
+    va_end(ap);
+
+    return reply;
+}
+
+/* Collect the nodes used by the ..ToAllNodes() API, i.e. all known primaries
+ * followed by their replicas when requested. */
+static valkeyClusterNode **clusterGetAllNodes(valkeyClusterContext *cc,
+                                              int flags, size_t *count) {
+    valkeyClusterNode **nodes;
+    size_t n = 0, max = dictSize(cc->nodes);
+    dictIterator di;
+    dictEntry *de;
+
+    if (flags & VALKEYCLUSTER_INCLUDE_REPLICAS) {
+        dictInitIterator(&di, cc->nodes);
+        while ((de = dictNext(&di)) != NULL) {
+            valkeyClusterNode *node = dictGetVal(de);
+            if (node->replicas != NULL)
+                max += listLength(node->replicas);
+        }
+    }
+    if (max == 0) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "no nodes known");
+        return NULL;
+    }
+
+    nodes = vk_malloc(max * sizeof(*nodes));
+    if (nodes == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+        return NULL;
+    }
+
+    dictInitIterator(&di, cc->nodes);
+    while ((de = dictNext(&di)) != NULL) {
+        valkeyClusterNode *node = dictGetVal(de);
+        nodes[n++] = node;
+
+        if ((flags & VALKEYCLUSTER_INCLUDE_REPLICAS) && node->replicas != NULL) {
+            listIter li;
+            listNode *ln;
+            listRewind(node->replicas, &li);
+            while ((ln = listNext(&li)) != NULL) {
+                nodes[n++] = listNodeValue(ln);
+            }
+        }
+    }
+    *count = n;
+    return nodes;
+}
+
+void *valkeyClustervCommandToAllNodes(valkeyClusterContext *cc, int flags,
+                                      valkeyClusterReducerFn *reducer,
+                                      const char *format, va_list ap) {
+    valkeyClusterNode **nodes = NULL;
+    valkeyContext **cons = NULL;
+    valkeyReply **replies = NULL;
+    valkeyReply *reply = NULL;
+    char *cmd = NULL;
+    size_t count = 0, sent = 0;
+    int len;
+
+    if (cc == NULL || reducer == NULL) {
+        return NULL;
+    }
+
+    valkeyClusterClearError(cc);
+
+    len = valkeyvFormatCommand(&cmd, format, ap);
+    if (len == -1) {
+        goto oom;
+    } else if (len == -2) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid format string");
+        return NULL;
+    }
+
+    nodes = clusterGetAllNodes(cc, flags, &count);
+    if (nodes == NULL) {
+        goto error;
+    }
+    cons = vk_calloc(count, sizeof(*cons));
+    replies = vk_calloc(count, sizeof(*replies));
+    if (cons == NULL || replies == NULL) {
+        goto oom;
+    }
+
+    /* Make sure all nodes are connected before sending anything. */
+    for (size_t i = 0; i < count; i++) {
+        cons[i] = valkeyClusterGetValkeyContext(cc, nodes[i]);
+        if (cons[i] == NULL) {
+            if (cc->err == 0)
+                valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                                      "node host or port is error");
+            goto error;
+        } else if (cons[i]->err) {
+            valkeyClusterSetError(cc, cons[i]->err, cons[i]->errstr);
+            goto error;
+        }
+    }
+
+    /* Write the command to all nodes before reading any reply, so that the
+     * nodes handle the command concurrently. A failed write is detected when
+     * reading the reply. */
+    for (; sent < count; sent++) {
+        valkeyContext *c = cons[sent];
+        if (valkeyAppendFormattedCommand(c, cmd, len) != VALKEY_OK) {
+            clusterSetAppendError(cc, c);
+            break;
+        }
+        int done = 0;
+        while (!done && valkeyBufferWrite(c, &done) == VALKEY_OK)
+            ;
+    }
+
+    /* Read replies from all nodes that the command was sent to. */
+    for (size_t i = 0; i < sent; i++) {
+        if (valkeyGetReply(cons[i], (void **)&replies[i]) != VALKEY_OK) {
+            if (cc->err == 0)
+                valkeyClusterSetError(cc, cons[i]->err, cons[i]->errstr);
+            if (cons[i]->err != VALKEY_ERR_OOM)
+                cc->need_update_route = 1;
+        }
+    }
+    if (cc->err) {
+        goto error;
+    }
+
+    reply = reducer(replies, count);
+    sent = 0; /* Ownership of the replies moved to the reducer. */
+    if (reply == NULL) {
+        goto oom;
+    }
+
+    vk_free(replies);
+    vk_free(cons);
+    vk_free(nodes);
+    vk_free(cmd);
+    return reply;
+
+oom:
+    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+    // passthrough
+
+error:
+    for (size_t i = 0; i < sent; i++)
+        freeReplyObject(replies[i]);
+    vk_free(replies);
+    vk_free(cons);
+    vk_free(nodes);
+    vk_free(cmd);
+    return NULL;
+}
+
+void *valkeyClusterCommandToAllNodes(valkeyClusterContext *cc, int flags,
+                                     valkeyClusterReducerFn *reducer,
+                                     const char *format, ...) {
+    va_list ap;
+    valkeyReply *reply = NULL;
+
+    va_start(ap, format);
+    reply = valkeyClustervCommandToAllNodes(cc, flags, reducer, format, ap);
+    va_end(ap);
+
+    return reply;
+}
+
+/* State of a single node during a cluster-wide SCAN. */
+typedef struct scan_node {
+    valkeyClusterScan *scan;
+    sds addr; /* Node address, the key in cc->nodes. */
+    valkeyContext *con; /* Connection used while fetching a page (sync). */
+    unsigned long long cursor;
+    int done;    /* The node is fully scanned or removed. */
+    int pending; /* A SCAN command is outstanding. */
+    int restart; /* Restart from cursor 0 when the pending reply arrives. */
+    uint8_t slots[VALKEYCLUSTER_SLOTS / 8]; /* Slots owned during the scan. */
+} scan_node;
+
+struct valkeyClusterScan {
+    valkeyClusterContext *cc;
+    valkeyClusterAsyncContext *acc; /* Set when using the async API. */
+    uint64_t route_version; /* Slotmap seen when the nodes were updated. */
+    int slotmap_deltas;
+    char *match;
+    char *type;
+    long long count;
+    int max_concurrency;
+    hilist *nodes; /* List of scan_node. */
+    hilist *pages; /* Fetched pages not returned yet (sync). */
+    int pending;   /* Outstanding SCAN commands (async). */
+    int stopped;
+    int in_callback;
+    int err;
+    char errstr[128];
+    valkeyClusterScanCallbackFn *callback;
+    void *privdata;
+};
+
+static void scanNodeFree(void *ptr) {
+    scan_node *sn = ptr;
+    sdsfree(sn->addr);
+    vk_free(sn);
+}
+
+/* Keep the first error of the scan. */
+static void scanSetError(valkeyClusterScan *scan, int type, const char *str) {
+    if (scan->err)
+        return;
+    scan->err = type ? type : VALKEY_ERR_OTHER;
+    snprintf(scan->errstr, sizeof(scan->errstr), "%s", str ? str : "");
+}
+
+static scan_node *scanGetNode(valkeyClusterScan *scan, const char *addr) {
+    listIter li;
+    listNode *ln;
+    scan_node *sn;
+
+    listRewind(scan->nodes, &li);
+    while ((ln = listNext(&li)) != NULL) {
+        sn = listNodeValue(ln);
+        if (strcmp(sn->addr, addr) == 0)
+            return sn;
+    }
+
+    sn = vk_calloc(1, sizeof(*sn));
+    if (sn == NULL)
+        return NULL;
+    sn->scan = scan;
+    sn->addr = sdsnew(addr);
+    if (sn->addr == NULL || listAddNodeTail(scan->nodes, sn) == NULL) {
+        scanNodeFree(sn);
+        return NULL;
+    }
+    return sn;
+}
+
+/* Update the scanned nodes from the current slotmap. A node that gets slots
+ * it did not own earlier in the scan is scanned again from the start, which
+ * makes sure that keys migrated to it are not missed. Removed nodes are
+ * skipped since their slots are owned by other nodes now. */
+static int scanUpdateNodes(valkeyClusterScan *scan) {
+    valkeyClusterContext *cc = scan->cc;
+    scan_node *sn = NULL;
+    listIter li;
+    listNode *ln;
+
+    scan->route_version = cc->route_version;
+    scan->slotmap_deltas = cc->slotmap_deltas;
+
+    listRewind(scan->nodes, &li);
+    while ((ln = listNext(&li)) != NULL) {
+        sn = listNodeValue(ln);
+        if (cc->nodes == NULL || dictFind(cc->nodes, sn->addr) == NULL) {
+            sn->done = 1;
+            sn->restart = 0;
+        }
+    }
+
+    if (cc->table == NULL)
+        return VALKEY_OK;
+
+    sn = NULL;
+    for (uint32_t slot = 0; slot < VALKEYCLUSTER_SLOTS; slot++) {
+        valkeyClusterNode *node = cc->table[slot];
+        if (node == NULL || node->addr == NULL)
+            continue;
+        if (sn == NULL || strcmp(sn->addr, node->addr) != 0) {
+            if ((sn = scanGetNode(scan, node->addr)) == NULL) {
+                scanSetError(scan, VALKEY_ERR_OOM, "Out of memory");
+                return VALKEY_ERR;
+            }
+        }
+        if ((sn->slots[slot / 8] & (1 << (slot % 8))) == 0) {
+            sn->slots[slot / 8] |= 1 << (slot % 8);
+            sn->cursor = 0;
+            sn->done = 0;
+            sn->restart = sn->pending;
+        }
+    }
+    return VALKEY_OK;
+}
+
+static inline int scanNeedsUpdate(valkeyClusterScan *scan) {
+    return scan->route_version != scan->cc->route_version ||
+           scan->slotmap_deltas != scan->cc->slotmap_deltas;
+}
+
+static valkeyClusterScan *scanCreate(valkeyClusterContext *cc,
+                                     const valkeyClusterScanOptions *options) {
+    valkeyClusterScan *scan = vk_calloc(1, sizeof(*scan));
+    if (scan == NULL)
+        return NULL;
+    scan->cc = cc;
+    scan->nodes = listCreate();
+    scan->pages = listCreate();
+    if (scan->nodes == NULL || scan->pages == NULL)
+        goto oom;
+    listSetFreeMethod(scan->nodes, scanNodeFree);
+    listSetFreeMethod(scan->pages, freeReplyObject);
+
+    if (options != NULL) {
+        if (options->match != NULL &&
+            (scan->match = vk_strdup(options->match)) == NULL)
+            goto oom;
+        if (options->type != NULL &&
+            (scan->type = vk_strdup(options->type)) == NULL)
+            goto oom;
+        scan->count = options->count;
+        scan->max_concurrency = options->max_concurrency;
+    }
+
+    if (scanUpdateNodes(scan) != VALKEY_OK)
+        goto oom;
+    return scan;
+
+oom:
+    valkeyClusterScanFree(scan);
+    return NULL;
+}
+
+#define SCAN_MAX_ARGC 8
+
+/* Create the SCAN command arguments for a node, returns the argument count.
+ * The buffer `buf` is used for the numeric arguments. */
+static int scanCommandArgv(valkeyClusterScan *scan, scan_node *sn,
+                           const char **argv, size_t *argvlen,
+                           char buf[2][24]) {
+    int argc = 0;
+
+    snprintf(buf[0], sizeof(buf[0]), "%llu", sn->cursor);
+    argv[argc++] = "SCAN";
+    argv[argc++] = buf[0];
+    if (scan->match != NULL) {
+        argv[argc++] = "MATCH";
+        argv[argc++] = scan->match;
+    }
+    if (scan->count > 0) {
+        snprintf(buf[1], sizeof(buf[1]), "%lld", scan->count);
+        argv[argc++] = "COUNT";
+        argv[argc++] = buf[1];
+    }
+    if (scan->type != NULL) {
+        argv[argc++] = "TYPE";
+        argv[argc++] = scan->type;
+    }
+    for (int i = 0; i < argc; i++)
+        argvlen[i] = strlen(argv[i]);
+    return argc;
+}
+
+/* Update the cursor of the node from a SCAN reply and return the keys. */
+static valkeyReply *scanParseReply(valkeyClusterScan *scan, scan_node *sn,
+                                   valkeyReply *reply) {
+    if (reply->type == VALKEY_REPLY_ERROR) {
+        scanSetError(scan, VALKEY_ERR_OTHER, reply->str);
+        return NULL;
+    }
+    if (reply->type != VALKEY_REPLY_ARRAY || reply->elements != 2 ||
+        reply->element[0]->type != VALKEY_REPLY_STRING ||
+        reply->element[1]->type != VALKEY_REPLY_ARRAY) {
+        scanSetError(scan, VALKEY_ERR_PROTOCOL, "Unexpected SCAN reply");
+        return NULL;
+    }
+
+    if (sn->restart) {
+        sn->restart = 0; /* Keep cursor 0. */
+    } else if (!sn->done) {
+        sn->cursor = strtoull(reply->element[0]->str, NULL, 10);
+        sn->done = sn->cursor == 0;
+    }
+    return reply->element[1];
+}
+
+/* Fetch the next page from a number of nodes concurrently by sending all
+ * commands before reading the replies. Returns the number of pages fetched,
+ * where 0 means that all nodes are scanned or that an error occurred. */
+static int scanFetchPages(valkeyClusterScan *scan) {
+    valkeyClusterContext *cc = scan->cc;
+    const char *argv[SCAN_MAX_ARGC];
+    size_t argvlen[SCAN_MAX_ARGC];
+    char buf[2][24];
+    listIter li;
+    listNode *ln;
+    int sent = 0;
+
+    if (scanNeedsUpdate(scan) && scanUpdateNodes(scan) != VALKEY_OK)
+        return 0;
+
+    listRewind(scan->nodes, &li);
+    while ((ln = listNext(&li)) != NULL) {
+        scan_node *sn = listNodeValue(ln);
+        dictEntry *de;
+        valkeyContext *c;
+        int argc, done = 0;
+
+        if (scan->max_concurrency > 0 && sent >= scan->max_concurrency)
+            break;
+        if (sn->done)
+            continue;
+        if (cc->nodes == NULL ||
+            (de = dictFind(cc->nodes, sn->addr)) == NULL) {
+            sn->done = 1;
+            continue;
+        }
+
+        c = valkeyClusterGetValkeyContext(cc, dictGetVal(de));
+        if (c == NULL || c->err) {
+            if (c != NULL)
+                scanSetError(scan, c->err, c->errstr);
+            else
+                scanSetError(scan, cc->err, cc->err ? cc->errstr : "Failed to connect");
+            break;
+        }
+        argc = scanCommandArgv(scan, sn, argv, argvlen, buf);
+        if (valkeyAppendCommandArgv(c, argc, argv, argvlen) != VALKEY_OK) {
+            scanSetError(scan, c->err, c->errstr);
+            break;
+        }
+        while (!done) {
+            if (valkeyBufferWrite(c, &done) != VALKEY_OK) {
+                scanSetError(scan, c->err, c->errstr);
+                break;
+            }
+        }
+        sn->con = c;
+        sn->pending = 1;
+        sent++;
+    }
+
+    /* Read the replies, also when a send failed, to keep the connections in
+     * sync. */
+    listRewind(scan->nodes, &li);
+    while ((ln = listNext(&li)) != NULL) {
+        scan_node *sn = listNodeValue(ln);
+        valkeyReply *reply, *keys;
+
+        if (!sn->pending)
+            continue;
+        sn->pending = 0;
+        if (valkeyGetReply(sn->con, (void **)&reply) != VALKEY_OK) {
+            scanSetError(scan, sn->con->err, sn->con->errstr);
+            cc->need_update_route = 1;
+            continue;
+        }
+        keys = scanParseReply(scan, sn, reply);
+        if (keys != NULL && keys->elements > 0) {
+            reply->element[1] = NULL; /* Steal the keys. */
+            if (listAddNodeTail(scan->pages, keys) == NULL) {
+                freeReplyObject(keys);
+                scanSetError(scan, VALKEY_ERR_OOM, "Out of memory");
+            }
+        }
+        freeReplyObject(reply);
+    }
+    return scan->err ? 0 : sent;
+}
+
+valkeyClusterScan *valkeyClusterScanCreate(valkeyClusterContext *cc,
+                                           const valkeyClusterScanOptions *options) {
+    valkeyClusterScan *scan;
+
+    if (cc == NULL) {
+        return NULL;
+    }
+
+    scan = scanCreate(cc, options);
+    if (scan == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+    }
+    return scan;
+}
+
+valkeyReply *valkeyClusterScanNext(valkeyClusterScan *scan) {
+    valkeyReply *keys;
+    listNode *ln;
+
+    if (scan == NULL) {
+        return NULL;
+    }
+    valkeyClusterClearError(scan->cc);
+
+    while (listLength(scan->pages) == 0) {
+        if (scan->err) {
+            valkeyClusterSetError(scan->cc, scan->err, scan->errstr);
+            return NULL;
+        }
+        if (scanFetchPages(scan) == 0 && scan->err == 0) {
+            return NULL; /* All nodes are scanned. */
+        }
+    }
+
+    ln = listFirst(scan->pages);
+    keys = listNodeValue(ln);
+    ln->value = NULL; /* Keep the page when deleting the list node. */
+    listDelNode(scan->pages, ln);
+    return keys;
+}
+
+void valkeyClusterScanFree(valkeyClusterScan *scan) {
+    if (scan == NULL) {
+        return;
+    }
+    if (scan->nodes != NULL)
+        listRelease(scan->nodes);
+    if (scan->pages != NULL)
+        listRelease(scan->pages);
+    vk_free(scan->match);
+    vk_free(scan->type);
+    vk_free(scan);
+}
+
+/* A MULTI/EXEC transaction. The commands are kept formatted after MULTI, and
+ * EXEC is added when sent. */
+struct valkeyClusterTransaction {
+    sds block;    /* MULTI and the queued commands. */
+    size_t *lens; /* Length of each command in the block, MULTI included. */
+    int count;    /* Number of queued commands. */
+    int slot;     /* Slot of the keys, or -1 before the first key. */
+    int err;      /* First error while appending, or 0. */
+    char errstr[128];
+};
+
+static void clusterTransactionSetError(valkeyClusterTransaction *tx, int type,
+                                       const char *str) {
+    if (tx->err)
+        return; /* Keep the first error. */
+    tx->err = type;
+    snprintf(tx->errstr, sizeof(tx->errstr), "%s", str);
+}
+
+valkeyClusterTransaction *valkeyClusterTransactionCreate(void) {
+    static const char multi[] = "*1\r\n$5\r\nMULTI\r\n";
+    valkeyClusterTransaction *tx;
+
+    tx = vk_calloc(1, sizeof(*tx));
+    if (tx == NULL)
+        return NULL;
+    tx->block = sdsnewlen(multi, sizeof(multi) - 1);
+    tx->lens = vk_malloc(sizeof(*tx->lens));
+    if (tx->block == NULL || tx->lens == NULL) {
+        valkeyClusterTransactionFree(tx);
+        return NULL;
+    }
+    tx->lens[0] = sizeof(multi) - 1;
+    tx->slot = -1;
+    return tx;
+}
+
+void valkeyClusterTransactionFree(valkeyClusterTransaction *tx) {
+    if (tx == NULL)
+        return;
+    sdsfree(tx->block);
+    vk_free(tx->lens);
+    vk_free(tx);
+}
+
+/* Queue an encoded command after checking the slot of its key. */
+static int clusterTransactionAppendFormatted(valkeyClusterTransaction *tx,
+                                             char *cmd, int len) {
+    struct cmd *command;
+    size_t *lens;
+    sds block;
+    int slot;
+
+    command = command_get();
+    if (command == NULL)
+        goto oom;
+    command->cmd = cmd;
+    command->clen = len;
+    valkey_parse_cmd(command);
+    command->cmd = NULL; /* Not owned. */
+
+    if (command->result == CMD_PARSE_ENOMEM) {
+        command_destroy(command);
+        goto oom;
+    }
+    if (command->result != CMD_PARSE_OK) {
+        clusterTransactionSetError(tx, VALKEY_ERR_PROTOCOL, command->errstr);
+        command_destroy(command);
+        return VALKEY_ERR;
+    }
+    if (command->key.len > 0) {
+        slot = keyHashSlot(command->key.start, command->key.len);
+        if (tx->slot >= 0 && slot != tx->slot) {
+            clusterTransactionSetError(tx, VALKEY_ERR_OTHER,
+                                       "Keys of the transaction hash to different slots");
+            command_destroy(command);
+            return VALKEY_ERR;
+        }
+        tx->slot = slot;
+    }
+    command_destroy(command);
+
+    lens = vk_realloc(tx->lens, (tx->count + 2) * sizeof(*lens));
+    if (lens == NULL)
+        goto oom;
+    tx->lens = lens;
+    block = sdscatlen(tx->block, cmd, len);
+    if (block == NULL)
+        goto oom;
+    tx->block = block;
+    tx->lens[++tx->count] = len;
+    return VALKEY_OK;
+
+oom:
+    clusterTransactionSetError(tx, VALKEY_ERR_OOM, "Out of memory");
+    return VALKEY_ERR;
+}
+
+int valkeyClusterTransactionvAppend(valkeyClusterTransaction *tx,
+                                    const char *format, va_list ap) {
+    char *cmd;
+    int len, status;
+
+    if (tx == NULL)
+        return VALKEY_ERR;
+
+    len = valkeyvFormatCommand(&cmd, format, ap);
+    if (len == -1) {
+        clusterTransactionSetError(tx, VALKEY_ERR_OOM, "Out of memory");
+        return VALKEY_ERR;
+    } else if (len == -2) {
+        clusterTransactionSetError(tx, VALKEY_ERR_OTHER, "Invalid format string");
+        return VALKEY_ERR;
+    }
+
+    status = clusterTransactionAppendFormatted(tx, cmd, len);
+    vk_free(cmd);
+    return status;
+}
+
+int valkeyClusterTransactionAppend(valkeyClusterTransaction *tx,
+                                   const char *format, ...) {
+    int status;
+    va_list ap;
+
+    va_start(ap, format);
+    status = valkeyClusterTransactionvAppend(tx, format, ap);
+    va_end(ap);
+    return status;
+}
+
+int valkeyClusterTransactionAppendArgv(valkeyClusterTransaction *tx, int argc,
+                                       const char **argv,
+                                       const size_t *argvlen) {
+    char *cmd;
+    int len, status;
+
+    if (tx == NULL)
+        return VALKEY_ERR;
+
+    len = valkeyFormatCommandArgv(&cmd, argc, argv, argvlen);
+    if (len == -1) {
+        clusterTransactionSetError(tx, VALKEY_ERR_OOM, "Out of memory");
+        return VALKEY_ERR;
+    }
+
+    status = clusterTransactionAppendFormatted(tx, cmd, len);
+    vk_free(cmd);
+    return status;
+}
+
+/* Check that a transaction can be executed, and set the error otherwise. */
+static int clusterTransactionCheck(valkeyClusterContext *cc,
+                                   valkeyClusterTransaction *tx) {
+    if (tx->err) {
+        valkeyClusterSetError(cc, tx->err, tx->errstr);
+        return VALKEY_ERR;
+    }
+    if (tx->slot < 0) {
+        valkeyClusterSetError(
+            cc, VALKEY_ERR_OTHER,
+            "No keys in transaction(must have keys for valkey cluster mode)");
+        return VALKEY_ERR;
+    }
+    return VALKEY_OK;
+}
+
+/* Send the transaction using a single write and read all replies. The first
+ * MOVED or ASK given to a queued command is returned in `redirect`. */
+static valkeyReply *clusterTransactionSend(valkeyClusterContext *cc,
+                                           valkeyClusterNode *node,
+                                           valkeyContext *c,
+                                           valkeyClusterTransaction *tx,
+                                           int asking, valkeyReply **redirect) {
+    valkeyReply *reply = NULL;
+    int64_t sent_usec;
+    size_t total_len;
+    int replies;
+
+    *redirect = NULL;
+
+    /* Reject the whole transaction up front rather than appending a part of
+     * it, which would be sent with the next command. */
+    total_len = sdslen(tx->block) + strlen("*1\r\n$4\r\nEXEC\r\n");
+    if (asking)
+        total_len += strlen("*1\r\n$6\r\nASKING\r\n");
+    if (valkeyOutputLimitReached(c, total_len)) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OUTPUT_LIMIT, "Output buffer limit exceeded");
+        return NULL;
+    }
+
+    sent_usec = vk_usec_now();
+    if ((asking && valkeyAppendCommand(c, VALKEY_COMMAND_ASKING) != VALKEY_OK) ||
+        valkeyAppendFormattedCommand(c, tx->block, sdslen(tx->block)) != VALKEY_OK ||
+        valkeyAppendCommand(c, "EXEC") != VALKEY_OK) {
+        clusterSetAppendError(cc, c);
+        return NULL;
+    }
+
+    replies = asking + tx->count + 2;
+    for (int i = 0; i < replies; i++) {
+        if (valkeyGetReply(c, (void **)&reply) != VALKEY_OK) {
+            valkeyClusterSetError(cc, c->err, c->errstr);
+            clusterNodeRecordReply(node, NULL, 0);
+            if (c->err != VALKEY_ERR_OOM)
+                cc->need_update_route = 1;
+            freeReplyObject(*redirect);
+            *redirect = NULL;
+            return NULL;
+        }
+        if (i == replies - 1)
+            break; /* The reply of EXEC. */
+
+        replyErrorType error_type = getReplyErrorType(reply);
+        if (*redirect == NULL && (error_type == CLUSTER_ERR_MOVED ||
+                                  error_type == CLUSTER_ERR_ASK)) {
+            *redirect = reply;
+            continue;
+        }
+        freeReplyObject(reply);
+    }
+    clusterNodeRecordReply(node, reply, vk_usec_now() - sent_usec);
+    return reply;
+}
+
+void *valkeyClusterTransactionExec(valkeyClusterContext *cc,
+                                   valkeyClusterTransaction *tx) {
+    valkeyReply *reply = NULL, *redirect;
+    valkeyClusterNode *node;
+    valkeyContext *c;
+    int asking = 0;
+
+    if (cc == NULL || tx == NULL)
+        return NULL;
+
+    valkeyClusterClearError(cc);
+    if (clusterTransactionCheck(cc, tx) != VALKEY_OK)
+        return NULL;
+
+    clusterAdoptSharedSlotmap(cc);
+    node = node_get_by_table(cc, (uint32_t)tx->slot);
+    if (node == NULL) {
+        /* Update the slotmap since the slot is not served. */
+        if (valkeyClusterUpdateSlotmap(cc) != VALKEY_OK)
+            goto done;
+        node = node_get_by_table(cc, (uint32_t)tx->slot);
+        if (node == NULL)
+            goto done;
+    }
+
+    while (1) {
+        c = valkeyClusterGetValkeyContext(cc, node);
+        if (c == NULL) {
+            goto done;
+        } else if (c->err) {
+            valkeyClusterSetError(cc, c->err, c->errstr);
+            goto done;
+        }
+
+        reply = clusterTransactionSend(cc, node, c, tx, asking, &redirect);
+        if (reply == NULL || redirect == NULL)
+            goto done;
+
+        /* A queued command was redirected, which aborts the transaction.
+         * Retry the whole transaction on the node given by the redirect. */
+        freeReplyObject(reply);
+        reply = NULL;
+
+        cc->retry_count++;
+        if (cc->retry_count > cc->max_retry_count) {
+            valkeyClusterSetError(cc, VALKEY_ERR_CLUSTER_TOO_MANY_RETRIES,
+                                  "too many cluster retries");
+            freeReplyObject(redirect);
+            goto done;
+        }
+
+        if (getReplyErrorType(redirect) == CLUSTER_ERR_ASK) {
+            node = getNodeFromRedirectReply(cc, c, redirect, NULL, NULL);
+            freeReplyObject(redirect);
+            if (node == NULL)
+                goto done;
+            asking = 1;
+            continue;
+        }
+
+        int slot = -1;
+        int node_created = 0;
+        node = getNodeFromRedirectReply(cc, c, redirect, &slot, &node_created);
+        freeReplyObject(redirect);
+        if (node == NULL)
+            goto done;
+        if (clusterApplyMovedRedirect(cc, slot, node, node_created)) {
+            if (valkeyClusterUpdateSlotmap(cc) != VALKEY_OK)
+                goto done;
+            node = node_get_by_table(cc, (uint32_t)tx->slot);
+            if (node == NULL)
+                goto done;
+        }
+        asking = 0;
+    }
+
+done:
+    cc->retry_count = 0;
+    return reply;
+}
+
+void *valkeyClusterCommandArgv(valkeyClusterContext *cc, int argc,
+                               const char **argv, const size_t *argvlen) {
+    valkeyReply *reply = NULL;
+    char *cmd;
+    int len;
+
+    len = valkeyFormatCommandArgv(&cmd, argc, argv, argvlen);
+    if (len == -1) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+        return NULL;
+    }
+
+    reply = valkeyClusterFormattedCommand(cc, cmd, len);
+
+    vk_free(cmd);
+
+    return reply;
+}
+
+int valkeyClusterAppendFormattedCommand(valkeyClusterContext *cc, char *cmd,
+                                        int len) {
+    struct cmd *command = NULL;
+
+    command = command_get();
+    if (command == NULL) {
+        goto oom;
+    }
+    command->cmd = cmd;
+    command->clen = len;
+
+    if (prepareCommand(cc, command) != VALKEY_OK) {
+        goto error;
+    }
+
+    if (valkeyClusterAppendCommandInternal(cc, command) != VALKEY_OK) {
+        goto error;
+    }
+
+    command->cmd = NULL;
+
+    if (listAddNodeTail(cc->requests, command) == NULL) {
+        goto oom;
+    }
+    return VALKEY_OK;
+
+oom:
+    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+    // passthrough
+
+error:
+    if (command != NULL) {
+        command->cmd = NULL;
+        command_destroy(command);
+    }
+    return VALKEY_ERR;
+}
+
+int valkeyClustervAppendCommand(valkeyClusterContext *cc, const char *format,
+                                va_list ap) {
+    int ret;
+    char *cmd;
+    int len;
+
+    len = valkeyvFormatCommand(&cmd, format, ap);
+    if (len == -1) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+        return VALKEY_ERR;
+    } else if (len == -2) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid format string");
+        return VALKEY_ERR;
+    }
+
+    ret = valkeyClusterAppendFormattedCommand(cc, cmd, len);
+
+    vk_free(cmd);
+
+    return ret;
+}
+
+int valkeyClusterAppendCommand(valkeyClusterContext *cc, const char *format,
+                               ...) {
+
+    int ret;
+    va_list ap;
+
+    if (cc == NULL || format == NULL) {
+        return VALKEY_ERR;
+    }
+
+    va_start(ap, format);
+    ret = valkeyClustervAppendCommand(cc, format, ap);
+    va_end(ap);
+
+    return ret;
+}
+
+int valkeyClustervAppendCommandToNode(valkeyClusterContext *cc,
+                                      valkeyClusterNode *node,
+                                      const char *format, va_list ap) {
+    valkeyContext *c;
+    struct cmd *command = NULL;
+    char *cmd = NULL;
+    int len;
+
+    c = valkeyClusterGetValkeyContext(cc, node);
+    if (c == NULL) {
+        return VALKEY_ERR;
+    } else if (c->err) {
+        valkeyClusterSetError(cc, c->err, c->errstr);
+        return VALKEY_ERR;
+    }
+
+    len = valkeyvFormatCommand(&cmd, format, ap);
+
+    if (len == -1) {
+        goto oom;
+    } else if (len == -2) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid format string");
+        return VALKEY_ERR;
+    }
+
+    // Append the command to the outgoing valkey buffer
+    if (valkeyAppendFormattedCommand(c, cmd, len) != VALKEY_OK) {
+        clusterSetAppendError(cc, c);
+        vk_free(cmd);
+        return VALKEY_ERR;
+    }
+
+    // Keep the command in the outstanding request list
+    command = command_get();
+    if (command == NULL) {
+        vk_free(cmd);
         goto oom;
     }
+    command->cmd = cmd;
+    command->clen = len;
+    command->node_addr = sdsnew(node->addr);
+    if (command->node_addr == NULL)
+        goto oom;
 
-    if (dictAdd(cc->nodes, key, node) != DICT_OK) {
+    if (listAddNodeTail(cc->requests, command) == NULL)
         goto oom;
-    }
-    return node;
+
+    return VALKEY_OK;
 
 oom:
+    command_destroy(command);
     valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-    sdsfree(key);
-    sdsfree(endpoint);
-    if (node != NULL) {
-        sdsfree(node->addr);
-        vk_free(node);
+    return VALKEY_ERR;
+}
+
+int valkeyClusterAppendCommandToNode(valkeyClusterContext *cc,
+                                     valkeyClusterNode *node,
+                                     const char *format, ...) {
+    int ret;
+    va_list ap;
+
+    if (cc == NULL || node == NULL || format == NULL) {
+        return VALKEY_ERR;
     }
-    return NULL;
+
+    va_start(ap, format);
+    ret = valkeyClustervAppendCommandToNode(cc, node, format, ap);
+    va_end(ap);
+
+    return ret;
 }
 
-static void *valkey_cluster_command_execute(valkeyClusterContext *cc,
-                                            struct cmd *command) {
-    void *reply = NULL;
+int valkeyClusterAppendCommandArgv(valkeyClusterContext *cc, int argc,
+                                   const char **argv, const size_t *argvlen) {
+    int ret;
+    char *cmd;
+    int len;
+
+    len = valkeyFormatCommandArgv(&cmd, argc, argv, argvlen);
+    if (len == -1) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+        return VALKEY_ERR;
+    }
+
+    ret = valkeyClusterAppendFormattedCommand(cc, cmd, len);
+
+    vk_free(cmd);
+
+    return ret;
+}
+
+VALKEY_UNUSED
+static int valkeyClusterSendAll(valkeyClusterContext *cc) {
+    dictEntry *de;
     valkeyClusterNode *node;
     valkeyContext *c = NULL;
-    valkeyContext *c_updating_route = NULL;
-
-retry:
+    int wdone = 0;
 
-    node = node_get_by_table(cc, (uint32_t)command->slot_num);
-    if (node == NULL) {
-        /* Update the slotmap since the slot is not served. */
-        if (valkeyClusterUpdateSlotmap(cc) != VALKEY_OK) {
-            goto error;
-        }
-        node = node_get_by_table(cc, (uint32_t)command->slot_num);
-        if (node == NULL) {
-            /* Return error since the slot is still not served. */
-            goto error;
-        }
+    if (cc == NULL) {
+        return VALKEY_ERR;
     }
 
-    c = valkeyClusterGetValkeyContext(cc, node);
-    if (c == NULL || c->err) {
-        /* Failed to connect. Maybe there was a failover and this node is gone.
-         * Update slotmap to find out. */
-        if (valkeyClusterUpdateSlotmap(cc) != VALKEY_OK) {
-            goto error;
-        }
+    dictIterator di;
+    dictInitIterator(&di, cc->nodes);
 
-        node = node_get_by_table(cc, (uint32_t)command->slot_num);
+    while ((de = dictNext(&di)) != NULL) {
+        node = dictGetVal(de);
         if (node == NULL) {
-            goto error;
+            continue;
         }
+
         c = valkeyClusterGetValkeyContext(cc, node);
         if (c == NULL) {
-            goto error;
-        } else if (c->err) {
-            valkeyClusterSetError(cc, c->err, c->errstr);
-            goto error;
+            continue;
         }
-    }
 
-moved_retry:
-ask_retry:
-
-    if (valkeyAppendFormattedCommand(c, command->cmd, command->clen) !=
-        VALKEY_OK) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
-        goto error;
+        /* Write until done */
+        do {
+            if (valkeyBufferWrite(c, &wdone) == VALKEY_ERR) {
+                return VALKEY_ERR;
+            }
+        } while (!wdone);
     }
 
-    /* If update slotmap has been scheduled, do that in the same pipeline. */
-    if (cc->need_update_route && c_updating_route == NULL) {
-        if (clusterUpdateRouteSendCommand(cc, c) == VALKEY_OK) {
-            c_updating_route = c;
-        }
-    }
+    return VALKEY_OK;
+}
 
-    if (valkeyGetReply(c, &reply) != VALKEY_OK) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
-        /* We may need to update the slotmap if this node is removed from the
-         * cluster, but the current request may have already timed out so we
-         * schedule it for later. */
-        if (c->err != VALKEY_ERR_OOM)
-            cc->need_update_route = 1;
-        goto error;
+VALKEY_UNUSED
+static int valkeyClusterClearAll(valkeyClusterContext *cc) {
+    dictEntry *de;
+    valkeyClusterNode *node;
+    valkeyContext *c = NULL;
+
+    if (cc == NULL) {
+        return VALKEY_ERR;
     }
 
-    replyErrorType error_type = getReplyErrorType(reply);
-    if (error_type > CLUSTER_NO_ERROR && error_type < CLUSTER_ERR_OTHER) {
-        cc->retry_count++;
-        if (cc->retry_count > cc->max_retry_count) {
-            valkeyClusterSetError(cc, VALKEY_ERR_CLUSTER_TOO_MANY_RETRIES,
-                                  "too many cluster retries");
-            goto error;
-        }
+    valkeyClusterClearError(cc);
 
-        int slot = -1;
-        switch (error_type) {
-        case CLUSTER_ERR_MOVED:
-            node = getNodeFromRedirectReply(cc, c, reply, &slot);
-            freeReplyObject(reply);
-            reply = NULL;
+    dictIterator di;
+    dictInitIterator(&di, cc->nodes);
 
-            if (node == NULL) {
-                /* Failed to parse redirect. Specific error already set. */
-                goto error;
-            }
+    while ((de = dictNext(&di)) != NULL) {
+        node = dictGetVal(de);
+        if (node == NULL) {
+            continue;
+        }
 
-            /* Update the slot mapping entry for this slot. */
-            if (slot >= 0) {
-                cc->table[slot] = node;
-            }
+        c = node->con;
+        if (c == NULL) {
+            continue;
+        }
 
-            if (c_updating_route == NULL) {
-                if (clusterUpdateRouteSendCommand(cc, c) == VALKEY_OK) {
-                    /* Deferred update route using the node that sent the
-                     * redirect. */
-                    c_updating_route = c;
-                } else if (valkeyClusterUpdateSlotmap(cc) == VALKEY_OK) {
-                    /* Synchronous update route successful using new connection. */
-                    valkeyClusterClearError(cc);
-                } else {
-                    /* Failed to update route. Specific error already set. */
-                    goto error;
-                }
-            }
+        valkeyFree(c);
+        node->con = NULL;
+    }
 
-            c = valkeyClusterGetValkeyContext(cc, node);
-            if (c == NULL) {
-                goto error;
-            } else if (c->err) {
-                valkeyClusterSetError(cc, c->err, c->errstr);
-                goto error;
-            }
+    return VALKEY_OK;
+}
 
-            goto moved_retry;
-        case CLUSTER_ERR_ASK:
-            node = getNodeFromRedirectReply(cc, c, reply, NULL);
-            if (node == NULL) {
-                goto error;
-            }
+int valkeyClusterGetReply(valkeyClusterContext *cc, void **reply) {
+    struct cmd *command;
+    listNode *list_command;
+    int slot_num;
 
-            freeReplyObject(reply);
-            reply = NULL;
+    if (cc == NULL || reply == NULL)
+        return VALKEY_ERR;
 
-            c = valkeyClusterGetValkeyContext(cc, node);
-            if (c == NULL) {
-                goto error;
-            } else if (c->err) {
-                valkeyClusterSetError(cc, c->err, c->errstr);
-                goto error;
-            }
+    valkeyClusterClearError(cc);
+    *reply = NULL;
 
-            reply = valkeyCommand(c, VALKEY_COMMAND_ASKING);
-            if (reply == NULL) {
-                valkeyClusterSetError(cc, c->err, c->errstr);
-                goto error;
-            }
+    list_command = listFirst(cc->requests);
 
-            freeReplyObject(reply);
-            reply = NULL;
+    /* No queued requests. */
+    if (list_command == NULL) {
+        *reply = NULL;
+        return VALKEY_OK;
+    }
 
-            goto ask_retry;
-        case CLUSTER_ERR_TRYAGAIN:
-        case CLUSTER_ERR_CLUSTERDOWN:
-            freeReplyObject(reply);
-            reply = NULL;
-            goto retry;
+    command = list_command->value;
+    if (command == NULL) {
+        valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                              "command in the requests list is null");
+        goto error;
+    }
 
-        default:
+    /* Get reply when the command was sent via slot */
+    slot_num = command->slot_num;
+    if (slot_num >= 0) {
+        valkeyClusterNode *node;
+        if ((node = node_get_by_table(cc, (uint32_t)slot_num)) == NULL)
+            goto error;
 
-            break;
-        }
+        listDelNode(cc->requests, list_command);
+        return valkeyClusterGetReplyFromNode(cc, node, reply);
     }
+    /* Get reply when the command was sent to a given node */
+    if (command->node_addr != NULL) {
+        dictEntry *de = dictFind(cc->nodes, command->node_addr);
+        if (de == NULL) {
+            valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
+                                  "command was sent to a now unknown node");
+            goto error;
+        }
 
-    goto done;
+        listDelNode(cc->requests, list_command);
+        return valkeyClusterGetReplyFromNode(cc, dictGetVal(de), reply);
+    }
 
 error:
-    if (reply) {
-        freeReplyObject(reply);
-        reply = NULL;
+    listDelNode(cc->requests, list_command);
+    return VALKEY_ERR;
+}
+
+/**
+ * Resets cluster state after pipeline.
+ * Resets Valkey node connections if pipeline commands were not called beforehand.
+ */
+void valkeyClusterReset(valkeyClusterContext *cc) {
+    int status;
+    void *reply;
+
+    if (cc == NULL) {
+        return;
     }
 
-done:
-    if (c_updating_route) {
-        /* Deferred CLUSTER SLOTS or CLUSTER NODES in progress. Wait for the
-         * reply and handle it. */
-        if (clusterUpdateRouteHandleReply(cc, c_updating_route) != VALKEY_OK) {
-            /* Clear error and update synchronously using another node. */
-            valkeyClusterClearError(cc);
-            if (valkeyClusterUpdateSlotmap(cc) != VALKEY_OK) {
-                /* Clear the reply to indicate failure. */
+    if (cc->err) {
+        valkeyClusterClearAll(cc);
+    } else {
+        /* Write/flush each nodes output buffer to socket */
+        valkeyClusterSendAll(cc);
+
+        /* Expect a reply for each pipelined request */
+        do {
+            status = valkeyClusterGetReply(cc, &reply);
+            if (status == VALKEY_OK) {
                 freeReplyObject(reply);
-                reply = NULL;
+            } else {
+                valkeyClusterClearAll(cc);
+                break;
             }
-        }
+        } while (reply != NULL);
     }
 
-    return reply;
-}
-
-/* Prepare command by parsing the string to find the key and to get the slot. */
-static int prepareCommand(valkeyClusterContext *cc, struct cmd *command) {
-    if (command->cmd == NULL || command->clen <= 0) {
-        return VALKEY_ERR;
+    listIter li;
+    listRewind(cc->requests, &li);
+    listNode *ln;
+    while ((ln = listNext(&li))) {
+        listDelNode(cc->requests, ln);
     }
 
-    valkey_parse_cmd(command);
-    if (command->result == CMD_PARSE_ENOMEM) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-        return VALKEY_ERR;
-    }
-    if (command->result != CMD_PARSE_OK) {
-        valkeyClusterSetError(cc, VALKEY_ERR_PROTOCOL, command->errstr);
-        return VALKEY_ERR;
-    }
-    if (command->key.len == 0) {
-        valkeyClusterSetError(
-            cc, VALKEY_ERR_OTHER,
-            "No keys in command(must have keys for valkey cluster mode)");
-        return VALKEY_ERR;
+    if (cc->need_update_route) {
+        status = valkeyClusterUpdateSlotmap(cc);
+        if (status != VALKEY_OK) {
+            /* Specific error already set */
+            return;
+        }
+        cc->need_update_route = 0;
     }
-    command->slot_num = keyHashSlot(command->key.start, command->key.len);
-    return VALKEY_OK;
 }
 
-void *valkeyClusterFormattedCommand(valkeyClusterContext *cc, char *cmd,
-                                    int len) {
-    valkeyReply *reply = NULL;
-    struct cmd *command = NULL;
+/*############valkey cluster async############*/
 
-    if (cc == NULL) {
-        return NULL;
-    }
+static void valkeyClusterAsyncSetError(valkeyClusterAsyncContext *acc, int type,
+                                       const char *str) {
+    valkeyClusterSetError(&acc->cc, type, str); /* Keep error flags identical. */
+    acc->err = acc->cc.err;
+}
 
-    valkeyClusterClearError(cc);
+/* Set the error of a command of `len` bytes not accepted by a node
+ * connection, which is failing or has reached its output buffer limit. */
+static void clusterAsyncSetSendError(valkeyClusterAsyncContext *acc,
+                                     valkeyAsyncContext *ac, size_t len) {
+    if (ac->err == 0 && valkeyOutputLimitReached(&ac->c, len))
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OUTPUT_LIMIT, "Output buffer limit exceeded");
+    else
+        valkeyClusterAsyncSetError(acc, ac->err, ac->errstr);
+}
 
-    command = command_get();
-    if (command == NULL) {
-        goto oom;
-    }
-    command->cmd = cmd;
-    command->clen = len;
+static inline void valkeyClusterAsyncClearError(valkeyClusterAsyncContext *acc) {
+    valkeyClusterClearError(&acc->cc);
+    acc->err = acc->cc.err;
+}
 
-    if (prepareCommand(cc, command) != VALKEY_OK) {
-        goto error;
+static cluster_async_data *cluster_async_data_create(void) {
+    /* use calloc to guarantee all fields are zeroed */
+    return vk_calloc(1, sizeof(cluster_async_data));
+}
+
+static void cluster_async_data_free(cluster_async_data *cad) {
+    if (cad == NULL) {
+        return;
     }
 
-    reply = valkey_cluster_command_execute(cc, command);
-    command->cmd = NULL;
-    command_destroy(command);
-    cc->retry_count = 0;
-    return reply;
+    command_destroy(cad->command);
+    if (cad->cache_bypass)
+        cad->acc->cache_bypass--;
 
-oom:
-    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-    // passthrough
+    vk_free(cad);
+}
 
-error:
-    if (command != NULL) {
-        command->cmd = NULL;
-        command_destroy(command);
+/* Bypass the client-side cache while a command that isn't cacheable, and may
+ * modify a cached key, is pending. */
+static void clusterAsyncCacheBypass(valkeyClusterAsyncContext *acc,
+                                    cluster_async_data *cad, const char *cmd,
+                                    size_t len) {
+    if (acc->cc.cache != NULL && !valkeyCacheIsCacheable(acc->cc.cache, cmd, len)) {
+        cad->cache_bypass = 1;
+        acc->cache_bypass++;
     }
-    cc->retry_count = 0;
-    return NULL;
 }
 
-void *valkeyClustervCommand(valkeyClusterContext *cc, const char *format,
-                            va_list ap) {
-    valkeyReply *reply;
-    char *cmd;
-    int len;
+static void unlinkAsyncContextAndNode(void *data) {
+    valkeyClusterNode *node;
 
-    if (cc == NULL) {
-        return NULL;
+    if (data) {
+        node = (valkeyClusterNode *)(data);
+        node->acon = NULL;
     }
+}
 
-    len = valkeyvFormatCommand(&cmd, format, ap);
-
-    if (len == -1) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-        return NULL;
-    } else if (len == -2) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid format string");
-        return NULL;
+static void unlinkAsyncContextAndPoolConn(void *data) {
+    if (data) {
+        ((cluster_conn *)data)->acon = NULL;
     }
+}
 
-    reply = valkeyClusterFormattedCommand(cc, cmd, len);
+/* The pool connection of an async context, or NULL when it isn't a pool
+ * connection or when its node has been removed from the cluster. The pool
+ * is looked up using the context since the node, and its pool, can be freed
+ * while commands are outstanding on the connection. */
+static cluster_conn *clusterAsyncPoolConn(valkeyAsyncContext *ac) {
+    if (ac->dataCleanup == unlinkAsyncContextAndPoolConn)
+        return ac->data;
+    return NULL;
+}
 
-    vk_free(cmd);
+/* The node an async context is connected to, or NULL when the node has been
+ * removed from the cluster. */
+static valkeyClusterNode *clusterAsyncContextNode(valkeyAsyncContext *ac) {
+    if (ac->data != NULL && ac->dataCleanup == unlinkAsyncContextAndPoolConn)
+        return ((cluster_conn *)ac->data)->node;
+    return ac->data;
+}
 
-    return reply;
+/* Update the node statistics when a command has been sent. */
+static void clusterAsyncCommandSent(valkeyAsyncContext *ac,
+                                    cluster_async_data *cad) {
+    valkeyClusterNode *node = clusterAsyncContextNode(ac);
+    valkeyClusterNodeStats *stats;
+
+    cad->sent_usec = vk_usec_now();
+    if (node != NULL && (stats = clusterNodeStats(node)) != NULL)
+        stats->in_flight++;
 }
 
-void *valkeyClusterCommand(valkeyClusterContext *cc, const char *format, ...) {
-    va_list ap;
-    valkeyReply *reply = NULL;
+/* Update the node statistics when the reply of a command has been received,
+ * or when the command failed. */
+static void clusterAsyncCommandDone(valkeyAsyncContext *ac,
+                                    cluster_async_data *cad,
+                                    valkeyReply *reply) {
+    valkeyClusterNode *node = clusterAsyncContextNode(ac);
 
-    va_start(ap, format);
-    reply = valkeyClustervCommand(cc, format, ap);
-    va_end(ap);
+    if (cad->sent_usec == 0)
+        return;
+    if (node != NULL && node->stats != NULL && node->stats->in_flight > 0)
+        node->stats->in_flight--;
+    if (node != NULL)
+        clusterNodeRecordReply(node, reply, vk_usec_now() - cad->sent_usec);
+    cad->sent_usec = 0;
+}
 
-    return reply;
+/* Reply callback function for SELECT */
+void selectReplyCallback(valkeyAsyncContext *ac, void *r, void *privdata) {
+    valkeyReply *reply = (valkeyReply *)r;
+    valkeyClusterAsyncContext *acc = (valkeyClusterAsyncContext *)privdata;
+
+    if (reply == NULL || reply->type == VALKEY_REPLY_ERROR) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
+                                   "Failed to select logical database");
+        valkeyAsyncDisconnect(ac);
+    }
 }
 
-void *valkeyClustervCommandToNode(valkeyClusterContext *cc,
-                                  valkeyClusterNode *node, const char *format,
-                                  va_list ap) {
-    valkeyContext *c;
+/* Get the async connection to a node, or connect if needed. The connection is
+ * either the node's own connection, or the pool connection `conn`. */
+static valkeyAsyncContext *clusterGetAsyncContext(valkeyClusterAsyncContext *acc,
+                                                  valkeyClusterNode *node,
+                                                  cluster_conn *conn) {
+    valkeyAsyncContext *ac;
     int ret;
-    void *reply;
-    int updating_slotmap = 0;
 
-    c = valkeyClusterGetValkeyContext(cc, node);
-    if (c == NULL) {
-        return NULL;
-    } else if (c->err) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
+    ac = conn ? conn->acon : node->acon;
+    if (ac != NULL) {
+        if (ac->c.err == 0) {
+            return ac;
+        } else {
+            /* The cluster node has a valkey context with errors. Libvalkey
+             * will asynchronously destruct the context and unlink it from
+             * the cluster node object. Return an error until done.
+             * An example scenario is when sending a command from a command
+             * callback, which has a NULL reply due to a disconnect. */
+            valkeyClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
+            return NULL;
+        }
+    }
+
+    // No async context exists, perform a connect
+
+    if (node->host == NULL || node->port <= 0) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
+                                   "node host or port is error");
         return NULL;
     }
 
-    valkeyClusterClearError(cc);
+    valkeyOptions options = {0};
+    VALKEY_OPTIONS_SET_TCP(&options, node->host, node->port);
+    options.connect_timeout = acc->cc.connect_timeout;
+    options.command_timeout = acc->cc.command_timeout;
+    options.options = acc->cc.options;
+    options.allocator = acc->cc.allocator;
+    options.max_obuf_size = acc->cc.max_obuf_size;
 
-    ret = valkeyvAppendCommand(c, format, ap);
+    node->lastConnectionAttempt = vk_usec_now();
 
-    if (ret != VALKEY_OK) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
+    ac = valkeyAsyncConnectWithOptions(&options);
+    if (ac == NULL) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
         return NULL;
     }
 
-    if (cc->need_update_route) {
-        /* Pipeline slotmap update on the same connection. */
-        if (clusterUpdateRouteSendCommand(cc, c) == VALKEY_OK) {
-            updating_slotmap = 1;
+    if (ac->err) {
+        valkeyClusterAsyncSetError(acc, ac->err, ac->errstr);
+        valkeyAsyncFree(ac);
+        return NULL;
+    }
+
+    if (acc->cc.tls &&
+        acc->cc.tls_init_fn(&ac->c, acc->cc.tls) != VALKEY_OK) {
+        valkeyClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
+        valkeyAsyncFree(ac);
+        return NULL;
+    }
+
+    // Authenticate when needed
+    if (acc->cc.password != NULL) {
+        if (acc->cc.username != NULL) {
+            ret = valkeyAsyncCommand(ac, NULL, NULL, "AUTH %s %s",
+                                     acc->cc.username, acc->cc.password);
+        } else {
+            ret = valkeyAsyncCommand(ac, NULL, NULL, "AUTH %s",
+                                     acc->cc.password);
+        }
+
+        if (ret != VALKEY_OK) {
+            valkeyClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
+            valkeyAsyncFree(ac);
+            return NULL;
         }
     }
-
-    if (valkeyGetReply(c, &reply) != VALKEY_OK) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
-        if (c->err != VALKEY_ERR_OOM)
-            cc->need_update_route = 1;
-        return NULL;
+    // Select logical database when needed
+    if (acc->cc.select_db > 0) {
+        ret = valkeyAsyncCommand(ac, selectReplyCallback, acc, "SELECT %d", acc->cc.select_db);
+        if (ret != VALKEY_OK) {
+            valkeyClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
+            valkeyAsyncFree(ac);
+            return NULL;
+        }
+    }
+    // Track the keys read for the client-side cache, except on the
+    // sharded pub/sub connection which is not used for commands
+    if (acc->cc.cache != NULL && (conn == NULL || conn != node->pubsub)) {
+        if (valkeyAsyncEnableCache(ac, acc->cc.cache) != VALKEY_OK) {
+            valkeyClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
+            valkeyAsyncFree(ac);
+            return NULL;
+        }
+        ac->cache_db = acc->cc.select_db;
     }
 
-    if (updating_slotmap) {
-        /* Handle reply from pipelined CLUSTER SLOTS or CLUSTER NODES. */
-        if (clusterUpdateRouteHandleReply(cc, c) != VALKEY_OK) {
-            /* Ignore error. Update will be triggered on the next command. */
-            valkeyClusterClearError(cc);
+    if (acc->attach_fn) {
+        ret = acc->attach_fn(ac, acc->attach_data);
+        if (ret != VALKEY_OK) {
+            valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
+                                       "Failed to attach event adapter");
+            valkeyAsyncFree(ac);
+            return NULL;
         }
     }
 
-    return reply;
-}
+    if (acc->onConnect) {
+        valkeyAsyncSetConnectCallback(ac, acc->onConnect);
+    }
 
-void *valkeyClusterCommandToNode(valkeyClusterContext *cc,
-                                 valkeyClusterNode *node, const char *format,
-                                 ...) {
-    va_list ap;
-    valkeyReply *reply = NULL;
+    if (acc->onDisconnect) {
+        valkeyAsyncSetDisconnectCallback(ac, acc->onDisconnect);
+    }
 
-    va_start(ap, format);
-    reply = valkeyClustervCommandToNode(cc, node, format, ap);
-    va_end(ap);
+    if (conn != NULL) {
+        ac->data = conn;
+        ac->dataCleanup = unlinkAsyncContextAndPoolConn;
+        conn->acon = ac;
+    } else {
+        ac->data = node;
+        ac->dataCleanup = unlinkAsyncContextAndNode;
+        node->acon = ac;
+    }
 
-    return reply;
+    return ac;
 }
 
-void *valkeyClusterCommandArgv(valkeyClusterContext *cc, int argc,
-                               const char **argv, const size_t *argvlen) {
-    valkeyReply *reply = NULL;
-    char *cmd;
-    int len;
-
-    len = valkeyFormatCommandArgv(&cmd, argc, argv, argvlen);
-    if (len == -1) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
+valkeyAsyncContext *
+valkeyClusterGetValkeyAsyncContext(valkeyClusterAsyncContext *acc,
+                                   valkeyClusterNode *node) {
+    if (node == NULL) {
         return NULL;
     }
 
-    reply = valkeyClusterFormattedCommand(cc, cmd, len);
-
-    vk_free(cmd);
-
-    return reply;
+    return clusterGetAsyncContext(acc, node, NULL);
 }
 
-int valkeyClusterAppendFormattedCommand(valkeyClusterContext *cc, char *cmd,
-                                        int len) {
-    struct cmd *command = NULL;
+/* Start connecting to all primaries, so the first commands don't wait for the
+ * connections to be set up one by one. The connects complete asynchronously. */
+static void clusterAsyncPreconnect(valkeyClusterAsyncContext *acc) {
+    valkeyClusterContext *cc = &acc->cc;
+    dictIterator di;
+    dictEntry *de;
 
-    command = command_get();
-    if (command == NULL) {
-        goto oom;
+    dictInitIterator(&di, cc->nodes);
+    while ((de = dictNext(&di)) != NULL) {
+        valkeyClusterNode *node = dictGetVal(de);
+        if (node->slots == NULL || listLength(node->slots) == 0)
+            continue;
+        if (cc->connections_per_node <= 1) {
+            valkeyClusterGetValkeyAsyncContext(acc, node);
+            continue;
+        }
+        if (clusterNodeInitPool(cc, node) != VALKEY_OK)
+            continue;
+        for (int i = 0; i < node->pool_size; i++)
+            clusterGetAsyncContext(acc, node, &node->pool[i]);
     }
-    command->cmd = cmd;
-    command->clen = len;
+    /* A failed connect is handled when the node is used. */
+    valkeyClusterAsyncClearError(acc);
+}
 
-    if (prepareCommand(cc, command) != VALKEY_OK) {
-        goto error;
-    }
+/* Get a connection for a command routed using the slotmap. When using a
+ * connection pool the pool connection is returned in `connp`, and the other
+ * pool connections are tried if the selected connection fails. */
+static valkeyAsyncContext *clusterGetRoutedAsyncContext(valkeyClusterAsyncContext *acc,
+                                                        valkeyClusterNode *node,
+                                                        cluster_conn **connp) {
+    valkeyClusterContext *cc = &acc->cc;
+    valkeyAsyncContext *ac = NULL;
+    int start = 0;
 
-    if (valkeyClusterAppendCommandInternal(cc, command) != VALKEY_OK) {
-        goto error;
+    *connp = NULL;
+    if (cc->connections_per_node <= 1) {
+        return valkeyClusterGetValkeyAsyncContext(acc, node);
     }
-
-    command->cmd = NULL;
-
-    if (listAddNodeTail(cc->requests, command) == NULL) {
-        goto oom;
+    if (clusterNodeInitPool(cc, node) != VALKEY_OK) {
+        valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
+        return NULL;
     }
-    return VALKEY_OK;
 
-oom:
-    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-    // passthrough
+    if (cc->flags & VALKEY_FLAG_POOL_LEAST_PENDING) {
+        for (int i = 1; i < node->pool_size; i++) {
+            if (node->pool[i].pending < node->pool[start].pending)
+                start = i;
+        }
+    } else {
+        start = node->pool_next++ % node->pool_size;
+    }
 
-error:
-    if (command != NULL) {
-        command->cmd = NULL;
-        command_destroy(command);
+    for (int i = 0; i < node->pool_size; i++) {
+        cluster_conn *conn = &node->pool[(start + i) % node->pool_size];
+        if ((ac = clusterGetAsyncContext(acc, node, conn)) != NULL) {
+            valkeyClusterAsyncClearError(acc);
+            *connp = conn;
+            return ac;
+        }
     }
-    return VALKEY_ERR;
+    return NULL; /* Error of the last attempt already set. */
 }
 
-int valkeyClustervAppendCommand(valkeyClusterContext *cc, const char *format,
-                                va_list ap) {
-    int ret;
-    char *cmd;
-    int len;
+static int valkeyClusterAsyncContextInit(valkeyClusterAsyncContext *acc,
+                                         const valkeyClusterOptions *options) {
+    /* Setup errstr to point to common error string in valkeyClusterContext. */
+    acc->errstr = acc->cc.errstr;
 
-    len = valkeyvFormatCommand(&cmd, format, ap);
-    if (len == -1) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-        return VALKEY_ERR;
-    } else if (len == -2) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid format string");
+    if (valkeyClusterContextInit(&acc->cc, options) != VALKEY_OK) {
+        valkeyClusterAsyncSetError(acc, acc->cc.err, acc->cc.errstr);
         return VALKEY_ERR;
     }
 
-    ret = valkeyClusterAppendFormattedCommand(cc, cmd, len);
-
-    vk_free(cmd);
-
-    return ret;
-}
-
-int valkeyClusterAppendCommand(valkeyClusterContext *cc, const char *format,
-                               ...) {
-
-    int ret;
-    va_list ap;
-
-    if (cc == NULL || format == NULL) {
+    if (options->async_connect_callback != NULL) {
+        acc->onConnect = options->async_connect_callback;
+    }
+    if (options->async_disconnect_callback != NULL) {
+        acc->onDisconnect = options->async_disconnect_callback;
+    }
+    if (options->attach_fn == NULL) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
+                                   "No event library configured");
         return VALKEY_ERR;
     }
-
-    va_start(ap, format);
-    ret = valkeyClustervAppendCommand(cc, format, ap);
-    va_end(ap);
-
-    return ret;
+    if (options->options & VALKEY_OPT_PRECONNECT) {
+        acc->cc.flags |= VALKEY_FLAG_PRECONNECT;
+    }
+    acc->attach_fn = options->attach_fn;
+    acc->attach_data = options->attach_data;
+    if (options->timer_fn != NULL && options->timer_cancel_fn != NULL) {
+        acc->timer_fn = options->timer_fn;
+        acc->timer_cancel_fn = options->timer_cancel_fn;
+    }
+    if (options->retry_backoff != NULL) {
+        acc->retry_backoff_usec = options->retry_backoff->tv_sec * 1000000LL +
+                                  options->retry_backoff->tv_usec;
+    } else {
+        acc->retry_backoff_usec = CLUSTER_DEFAULT_RETRY_BACKOFF_USEC;
+    }
+    if (options->retry_backoff_max != NULL) {
+        acc->retry_backoff_max_usec = options->retry_backoff_max->tv_sec * 1000000LL +
+                                      options->retry_backoff_max->tv_usec;
+    } else {
+        acc->retry_backoff_max_usec = CLUSTER_DEFAULT_RETRY_BACKOFF_MAX_USEC;
+    }
+    if (options->topology_refresh_interval != NULL) {
+        acc->topology_refresh_usec =
+            options->topology_refresh_interval->tv_sec * 1000000LL +
+            options->topology_refresh_interval->tv_usec;
+        if (acc->topology_refresh_usec > 0 && acc->timer_fn == NULL) {
+            valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
+                                       "Topology refresh requires timer support");
+            return VALKEY_ERR;
+        }
+    }
+    if (acc->cc.flags & VALKEY_FLAG_AUTO_PIPELINE) {
+        if (acc->timer_fn == NULL) {
+            valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
+                                       "Auto-pipelining requires timer support");
+            return VALKEY_ERR;
+        }
+        acc->pipeline_max_batch = options->pipeline_max_batch > 0 ?
+                                      options->pipeline_max_batch :
+                                      CLUSTER_DEFAULT_PIPELINE_MAX_BATCH;
+        if (options->pipeline_max_delay != NULL) {
+            acc->pipeline_max_delay_usec =
+                options->pipeline_max_delay->tv_sec * 1000000LL +
+                options->pipeline_max_delay->tv_usec;
+        }
+    }
+    return VALKEY_OK;
 }
 
-int valkeyClustervAppendCommandToNode(valkeyClusterContext *cc,
-                                      valkeyClusterNode *node,
-                                      const char *format, va_list ap) {
-    valkeyContext *c;
-    struct cmd *command = NULL;
-    char *cmd = NULL;
-    int len;
-
-    c = valkeyClusterGetValkeyContext(cc, node);
-    if (c == NULL) {
-        return VALKEY_ERR;
-    } else if (c->err) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
-        return VALKEY_ERR;
-    }
+valkeyClusterAsyncContext *valkeyClusterAsyncConnectWithOptions(const valkeyClusterOptions *options) {
+    valkeyClusterAsyncContext *acc;
 
-    len = valkeyvFormatCommand(&cmd, format, ap);
+    acc = vk_calloc(1, sizeof(valkeyClusterAsyncContext));
+    if (acc == NULL)
+        return NULL;
 
-    if (len == -1) {
-        goto oom;
-    } else if (len == -2) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER, "Invalid format string");
-        return VALKEY_ERR;
+    if (valkeyClusterAsyncContextInit(acc, options) == VALKEY_OK) {
+        /* Only connect if options are ok. */
+        valkeyClusterAsyncConnect(acc);
+        clusterAsyncScheduleRefresh(acc);
     }
 
-    // Append the command to the outgoing valkey buffer
-    if (valkeyAppendFormattedCommand(c, cmd, len) != VALKEY_OK) {
-        valkeyClusterSetError(cc, c->err, c->errstr);
-        vk_free(cmd);
-        return VALKEY_ERR;
-    }
+    return acc;
+}
 
-    // Keep the command in the outstanding request list
-    command = command_get();
-    if (command == NULL) {
-        vk_free(cmd);
-        goto oom;
-    }
-    command->cmd = cmd;
-    command->clen = len;
-    command->node_addr = sdsnew(node->addr);
-    if (command->node_addr == NULL)
-        goto oom;
+static int valkeyClusterAsyncConnect(valkeyClusterAsyncContext *acc) {
+    /* Start routing using a saved slotmap when available. */
+    if (clusterLoadSlotmapFile(&acc->cc) == VALKEY_OK)
+        return VALKEY_OK;
 
-    if (listAddNodeTail(cc->requests, command) == NULL)
-        goto oom;
+    /* Use blocking initial slotmap update when configured. */
+    if (acc->cc.flags & VALKEY_FLAG_BLOCKING_INITIAL_UPDATE) {
+        if (valkeyClusterUpdateSlotmap(&acc->cc) != VALKEY_OK) {
+            valkeyClusterAsyncSetError(acc, acc->cc.err, acc->cc.errstr);
+            return VALKEY_ERR;
+        }
 
-    return VALKEY_OK;
+        /* Disconnect any non-async context used for the initial update. */
+        dictIterator di;
+        dictInitIterator(&di, acc->cc.nodes);
+        dictEntry *de;
+        while ((de = dictNext(&di)) != NULL) {
+            valkeyClusterNode *node = dictGetVal(de);
+            if (node->con) {
+                valkeyFree(node->con);
+                node->con = NULL;
+            }
+        }
 
-oom:
-    command_destroy(command);
-    valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-    return VALKEY_ERR;
+        return VALKEY_OK;
+    }
+    /* Use non-blocking initial slotmap update. */
+    return updateSlotMapAsync(acc, NULL /*any node*/);
 }
 
-int valkeyClusterAppendCommandToNode(valkeyClusterContext *cc,
-                                     valkeyClusterNode *node,
-                                     const char *format, ...) {
-    int ret;
-    va_list ap;
+/* Reply callback function for CLUSTER SLOTS */
+void clusterSlotsReplyCallback(valkeyAsyncContext *ac, void *r,
+                               void *privdata) {
+    valkeyReply *reply = (valkeyReply *)r;
+    valkeyClusterAsyncContext *acc = (valkeyClusterAsyncContext *)privdata;
+    int periodic = acc->topology_refresh_ongoing;
+    acc->lastSlotmapUpdateAttempt = vk_usec_now();
+    acc->topology_refresh_ongoing = 0;
 
-    if (cc == NULL || node == NULL || format == NULL) {
-        return VALKEY_ERR;
+    if (reply == NULL) {
+        /* Retry using available nodes */
+        updateSlotMapAsync(acc, NULL);
+        return;
     }
 
-    va_start(ap, format);
-    ret = valkeyClustervAppendCommandToNode(cc, node, format, ap);
-    va_end(ap);
-
-    return ret;
+    valkeyClusterContext *cc = &acc->cc;
+    dict *nodes = parse_cluster_slots(cc, &ac->c, reply);
+    if (updateTopology(cc, nodes, periodic) != VALKEY_OK) {
+        /* Retry using available nodes */
+        updateSlotMapAsync(acc, NULL);
+    }
 }
 
-int valkeyClusterAppendCommandArgv(valkeyClusterContext *cc, int argc,
-                                   const char **argv, const size_t *argvlen) {
-    int ret;
-    char *cmd;
-    int len;
+/* Reply callback function for CLUSTER NODES */
+void clusterNodesReplyCallback(valkeyAsyncContext *ac, void *r,
+                               void *privdata) {
+    valkeyReply *reply = (valkeyReply *)r;
+    valkeyClusterAsyncContext *acc = (valkeyClusterAsyncContext *)privdata;
+    int periodic = acc->topology_refresh_ongoing;
+    acc->lastSlotmapUpdateAttempt = vk_usec_now();
+    acc->topology_refresh_ongoing = 0;
 
-    len = valkeyFormatCommandArgv(&cmd, argc, argv, argvlen);
-    if (len == -1) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OOM, "Out of memory");
-        return VALKEY_ERR;
+    if (reply == NULL) {
+        /* Retry using available nodes */
+        updateSlotMapAsync(acc, NULL);
+        return;
     }
 
-    ret = valkeyClusterAppendFormattedCommand(cc, cmd, len);
-
-    vk_free(cmd);
-
-    return ret;
+    valkeyClusterContext *cc = &acc->cc;
+    dict *nodes = parse_cluster_nodes(cc, &ac->c, reply);
+    if (updateTopology(cc, nodes, periodic) != VALKEY_OK) {
+        /* Retry using available nodes */
+        updateSlotMapAsync(acc, NULL);
+    }
 }
 
-VALKEY_UNUSED
-static int valkeyClusterSendAll(valkeyClusterContext *cc) {
-    dictEntry *de;
-    valkeyClusterNode *node;
-    valkeyContext *c = NULL;
-    int wdone = 0;
-
-    if (cc == NULL) {
-        return VALKEY_ERR;
-    }
+#define nodeIsConnected(n)                       \
+    ((n)->acon != NULL && (n)->acon->err == 0 && \
+     (n)->acon->c.flags & VALKEY_CONNECTED)
 
+/* Select a node.
+ * Primarily selects a connected node found close to a randomly picked index of
+ * all known nodes. The random index should give a more even distribution of
+ * selected nodes. If no connected node is found while iterating to this index
+ * the remaining nodes are also checked until a connected node is found.
+ * If no connected node is found a node for which a connect has not been attempted
+ * within throttle-time, and is found near the picked index, is selected.
+ */
+static valkeyClusterNode *selectNode(dict *nodes) {
+    valkeyClusterNode *node, *selected = NULL;
     dictIterator di;
-    dictInitIterator(&di, cc->nodes);
+    dictInitIterator(&di, nodes);
+
+    int64_t throttleLimit = vk_usec_now() - SLOTMAP_UPDATE_THROTTLE_USEC;
+    unsigned long currentIndex = 0;
+    unsigned long checkIndex = random() % dictSize(nodes);
 
+    dictEntry *de;
     while ((de = dictNext(&di)) != NULL) {
         node = dictGetVal(de);
-        if (node == NULL) {
-            continue;
-        }
 
-        c = valkeyClusterGetValkeyContext(cc, node);
-        if (c == NULL) {
-            continue;
+        if (nodeIsConnected(node)) {
+            /* Keep any connected node */
+            selected = node;
+        } else if (node->lastConnectionAttempt < throttleLimit &&
+                   (selected == NULL || (currentIndex < checkIndex &&
+                                         !nodeIsConnected(selected)))) {
+            /* Keep an accepted node when none is yet found, or
+               any accepted node until the chosen index is reached */
+            selected = node;
         }
 
-        /* Write until done */
-        do {
-            if (valkeyBufferWrite(c, &wdone) == VALKEY_ERR) {
-                return VALKEY_ERR;
-            }
-        } while (!wdone);
+        /* Return a found connected node when chosen index is reached. */
+        if (currentIndex >= checkIndex && selected != NULL &&
+            nodeIsConnected(selected))
+            break;
+        currentIndex += 1;
     }
-
-    return VALKEY_OK;
+    return selected;
 }
 
-VALKEY_UNUSED
-static int valkeyClusterClearAll(valkeyClusterContext *cc) {
-    dictEntry *de;
-    valkeyClusterNode *node;
-    valkeyContext *c = NULL;
-
-    if (cc == NULL) {
+/* Update the slot map by querying a selected cluster node. If ac is NULL, an
+ * arbitrary connected node is selected and a newer shared slotmap is used
+ * instead when available. A given ac is the node that sent a redirect, which
+ * can be newer than the shared slotmap, so the slotmap is always fetched. */
+static int updateSlotMapAsync(valkeyClusterAsyncContext *acc,
+                              valkeyAsyncContext *ac) {
+    if (acc->lastSlotmapUpdateAttempt == SLOTMAP_UPDATE_ONGOING) {
+        /* Don't allow concurrent slot map updates. */
         return VALKEY_ERR;
     }
+    if (acc->cc.flags & VALKEY_FLAG_DISCONNECTING) {
+        /* No slot map updates during a cluster client disconnect. */
+        return VALKEY_ERR;
+    }
+    if (ac == NULL && clusterAdoptSharedSlotmap(&acc->cc)) {
+        /* Not throttled, since nothing was fetched. */
+        return VALKEY_OK;
+    }
 
-    valkeyClusterClearError(cc);
-
-    dictIterator di;
-    dictInitIterator(&di, cc->nodes);
-
-    while ((de = dictNext(&di)) != NULL) {
-        node = dictGetVal(de);
+    if (ac == NULL) {
+        valkeyClusterNode *node = selectNode(acc->cc.nodes);
         if (node == NULL) {
-            continue;
+            goto error;
         }
 
-        c = node->con;
-        if (c == NULL) {
-            continue;
-        }
+        /* Get libvalkey context, connect if needed */
+        ac = valkeyClusterGetValkeyAsyncContext(acc, node);
+    }
+    if (ac == NULL)
+        goto error; /* Specific error already set */
 
-        valkeyFree(c);
-        node->con = NULL;
+    /* Send a command depending of config */
+    int status;
+    if (acc->cc.flags & VALKEY_FLAG_USE_CLUSTER_NODES) {
+        status = valkeyAsyncCommand(ac, clusterNodesReplyCallback, acc,
+                                    VALKEY_COMMAND_CLUSTER_NODES);
+    } else {
+        status = valkeyAsyncCommand(ac, clusterSlotsReplyCallback, acc,
+                                    VALKEY_COMMAND_CLUSTER_SLOTS);
     }
 
-    return VALKEY_OK;
+    if (status == VALKEY_OK) {
+        acc->lastSlotmapUpdateAttempt = SLOTMAP_UPDATE_ONGOING;
+        return VALKEY_OK;
+    }
+
+error:
+    acc->lastSlotmapUpdateAttempt = vk_usec_now();
+    return VALKEY_ERR;
 }
 
-int valkeyClusterGetReply(valkeyClusterContext *cc, void **reply) {
-    struct cmd *command;
-    listNode *list_command;
-    int slot_num;
+/* Start a slotmap update if the throttling allows. */
+static void throttledUpdateSlotMapAsync(valkeyClusterAsyncContext *acc,
+                                        valkeyAsyncContext *ac) {
+    if (acc->lastSlotmapUpdateAttempt != SLOTMAP_UPDATE_ONGOING &&
+        (acc->lastSlotmapUpdateAttempt + SLOTMAP_UPDATE_THROTTLE_USEC) <
+            vk_usec_now()) {
+        updateSlotMapAsync(acc, ac);
+    }
+}
 
-    if (cc == NULL || reply == NULL)
-        return VALKEY_ERR;
+/* Called when the topology refresh interval has passed. A slotmap update is
+ * started unless one is already ongoing, and the next refresh is scheduled. */
+static void clusterAsyncRefreshTimer(void *timer, void *privdata) {
+    valkeyClusterAsyncContext *acc = privdata;
+    (void)timer;
 
-    valkeyClusterClearError(cc);
-    *reply = NULL;
+    acc->topology_refresh_timer = NULL;
+    if (acc->lastSlotmapUpdateAttempt != SLOTMAP_UPDATE_ONGOING) {
+        /* Only a sent command is a refresh, not an adopted shared slotmap. */
+        updateSlotMapAsync(acc, NULL);
+        acc->topology_refresh_ongoing =
+            acc->lastSlotmapUpdateAttempt == SLOTMAP_UPDATE_ONGOING;
+    }
+    clusterAsyncScheduleRefresh(acc);
+}
 
-    list_command = listFirst(cc->requests);
+static void clusterAsyncScheduleRefresh(valkeyClusterAsyncContext *acc) {
+    struct timeval tv;
 
-    /* No queued requests. */
-    if (list_command == NULL) {
-        *reply = NULL;
-        return VALKEY_OK;
-    }
+    if (acc->topology_refresh_usec <= 0 || acc->timer_fn == NULL ||
+        acc->topology_refresh_timer != NULL ||
+        (acc->cc.flags & VALKEY_FLAG_DISCONNECTING))
+        return;
 
-    command = list_command->value;
-    if (command == NULL) {
-        valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
-                              "command in the requests list is null");
-        goto error;
+    tv.tv_sec = acc->topology_refresh_usec / 1000000;
+    tv.tv_usec = acc->topology_refresh_usec % 1000000;
+    acc->topology_refresh_timer =
+        acc->timer_fn(acc->attach_data, tv, clusterAsyncRefreshTimer, acc);
+}
+
+static void clusterAsyncCancelRefresh(valkeyClusterAsyncContext *acc) {
+    if (acc->topology_refresh_timer != NULL) {
+        acc->timer_cancel_fn(acc->attach_data, acc->topology_refresh_timer);
+        acc->topology_refresh_timer = NULL;
     }
+}
 
-    /* Get reply when the command was sent via slot */
-    slot_num = command->slot_num;
-    if (slot_num >= 0) {
-        valkeyClusterNode *node;
-        if ((node = node_get_by_table(cc, (uint32_t)slot_num)) == NULL)
-            goto error;
+static void valkeyClusterAsyncCallback(valkeyAsyncContext *ac, void *r,
+                                       void *privdata);
 
-        listDelNode(cc->requests, list_command);
-        return valkeyClusterGetReplyFromNode(cc, node, reply);
-    }
-    /* Get reply when the command was sent to a given node */
-    if (command->node_addr != NULL) {
-        dictEntry *de = dictFind(cc->nodes, command->node_addr);
-        if (de == NULL) {
-            valkeyClusterSetError(cc, VALKEY_ERR_OTHER,
-                                  "command was sent to a now unknown node");
-            goto error;
-        }
+/* Send a command to the node that serves its slot in the current slotmap.
+ * Returns VALKEY_ERR, with the error set in acc, when no node serves the slot
+ * or when the command could not be sent. */
+static int clusterAsyncSendBySlot(valkeyClusterAsyncContext *acc,
+                                  cluster_async_data *cad) {
+    valkeyClusterNode *node;
+    valkeyAsyncContext *ac;
+    cluster_conn *conn;
 
-        listDelNode(cc->requests, list_command);
-        return valkeyClusterGetReplyFromNode(cc, dictGetVal(de), reply);
+    node = node_get_by_table(&acc->cc, (uint32_t)cad->command->slot_num);
+    if (node == NULL) {
+        valkeyClusterAsyncSetError(acc, acc->cc.err, acc->cc.errstr);
+        return VALKEY_ERR;
     }
-
-error:
-    listDelNode(cc->requests, list_command);
-    return VALKEY_ERR;
+    ac = clusterGetRoutedAsyncContext(acc, node, &conn);
+    if (ac == NULL) {
+        return VALKEY_ERR; /* Error already set. */
+    }
+    if (valkeyAsyncFormattedCommandNoCache(ac, valkeyClusterAsyncCallback, cad,
+                                           cad->command->cmd,
+                                           cad->command->clen) != VALKEY_OK) {
+        clusterAsyncSetSendError(acc, ac, cad->command->clen);
+        return VALKEY_ERR;
+    }
+    clusterAsyncCommandSent(ac, cad);
+    if (conn != NULL)
+        conn->pending++;
+    return VALKEY_OK;
 }
 
-/**
- * Resets cluster state after pipeline.
- * Resets Valkey node connections if pipeline commands were not called beforehand.
- */
-void valkeyClusterReset(valkeyClusterContext *cc) {
-    int status;
-    void *reply;
+/* Called when the delay of a retry has passed. The command is sent using the
+ * current slotmap since the node that replied might have been removed. */
+static void clusterAsyncRetryTimer(void *timer, void *privdata) {
+    cluster_async_data *cad = privdata;
+    valkeyClusterAsyncContext *acc = cad->acc;
+    (void)timer;
 
-    if (cc == NULL) {
-        return;
+    listDelNode(acc->retries, cad->retry_node);
+    cad->retry_node = NULL;
+    cad->timer = NULL;
+
+    if (clusterAsyncSendBySlot(acc, cad) != VALKEY_OK) {
+        cad->callback(acc, NULL, cad->privdata);
+        valkeyClusterAsyncClearError(acc);
+        cluster_async_data_free(cad);
     }
+}
 
-    if (cc->err) {
-        valkeyClusterClearAll(cc);
-    } else {
-        /* Write/flush each nodes output buffer to socket */
-        valkeyClusterSendAll(cc);
+/* Mark that user callbacks are being called, which defers a call to
+ * valkeyClusterAsyncFree() until clusterAsyncLeaveCallback(). Returns if the
+ * mark was already set by a caller. */
+static int clusterAsyncEnterCallback(valkeyClusterAsyncContext *acc) {
+    int nested = (acc->cc.flags & VALKEY_FLAG_IN_CALLBACK) != 0;
+    acc->cc.flags |= VALKEY_FLAG_IN_CALLBACK;
+    return nested;
+}
 
-        /* Expect a reply for each pipelined request */
-        do {
-            status = valkeyClusterGetReply(cc, &reply);
-            if (status == VALKEY_OK) {
-                freeReplyObject(reply);
-            } else {
-                valkeyClusterClearAll(cc);
-                break;
-            }
-        } while (reply != NULL);
+/* Clear the mark set by clusterAsyncEnterCallback() and make a deferred free.
+ * Returns VALKEY_ERR when the context has been freed, or will be freed by the
+ * caller that set the mark, and must no longer be used. */
+static int clusterAsyncLeaveCallback(valkeyClusterAsyncContext *acc,
+                                     int nested) {
+    if (nested)
+        return (acc->cc.flags & VALKEY_FLAG_FREEING) ? VALKEY_ERR : VALKEY_OK;
+    acc->cc.flags &= ~VALKEY_FLAG_IN_CALLBACK;
+    if (acc->cc.flags & VALKEY_FLAG_FREEING) {
+        clusterAsyncFree(acc);
+        return VALKEY_ERR;
     }
+    return VALKEY_OK;
+}
 
-    listIter li;
-    listRewind(cc->requests, &li);
+/* Submit a list of commands held back by auto-pipelining, in the order they
+ * were given, and release the list. The commands to a node connection are
+ * written together when the event loop signals that the connection is
+ * writable. A command that can't be sent, or that remains when the context is
+ * freed from a callback, is reported as failed to its callback. */
+static void clusterAsyncSendHeld(valkeyClusterAsyncContext *acc,
+                                 struct hilist *cmds) {
     listNode *ln;
-    while ((ln = listNext(&li))) {
-        listDelNode(cc->requests, ln);
-    }
 
-    if (cc->need_update_route) {
-        status = valkeyClusterUpdateSlotmap(cc);
-        if (status != VALKEY_OK) {
-            /* Specific error already set */
-            return;
+    while ((ln = listFirst(cmds)) != NULL) {
+        cluster_async_data *cad = listNodeValue(ln);
+        listDelNode(cmds, ln);
+        if (acc->cc.flags & VALKEY_FLAG_FREEING) {
+            valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "disconnecting");
+        } else if (clusterAsyncSendBySlot(acc, cad) == VALKEY_OK) {
+            continue;
         }
-        cc->need_update_route = 0;
+        cad->callback(acc, NULL, cad->privdata);
+        valkeyClusterAsyncClearError(acc);
+        cluster_async_data_free(cad);
     }
+    listRelease(cmds);
 }
 
-/*############valkey cluster async############*/
+/* Submit the commands held back for all nodes. The held commands are detached
+ * first since the callbacks of failed commands may hold back new commands.
+ * Returns VALKEY_ERR when the context was freed from a callback. */
+static int clusterAsyncFlushPipeline(valkeyClusterAsyncContext *acc) {
+    dict *pipeline = acc->pipeline;
+    dictIterator di;
+    dictEntry *de;
 
-static void valkeyClusterAsyncSetError(valkeyClusterAsyncContext *acc, int type,
-                                       const char *str) {
-    valkeyClusterSetError(&acc->cc, type, str); /* Keep error flags identical. */
-    acc->err = acc->cc.err;
+    if (acc->pipeline_timer != NULL) {
+        acc->timer_cancel_fn(acc->attach_data, acc->pipeline_timer);
+        acc->pipeline_timer = NULL;
+    }
+    acc->pipeline = NULL;
+    if (pipeline == NULL)
+        return VALKEY_OK;
+
+    int nested = clusterAsyncEnterCallback(acc);
+    dictInitIterator(&di, pipeline);
+    while ((de = dictNext(&di)) != NULL) {
+        if (dictGetVal(de) != NULL) {
+            clusterAsyncSendHeld(acc, dictGetVal(de));
+            dictSetVal(pipeline, de, NULL);
+        }
+    }
+    dictRelease(pipeline);
+    return clusterAsyncLeaveCallback(acc, nested);
 }
 
-static inline void valkeyClusterAsyncClearError(valkeyClusterAsyncContext *acc) {
-    valkeyClusterClearError(&acc->cc);
-    acc->err = acc->cc.err;
+static void clusterAsyncPipelineTimer(void *timer, void *privdata) {
+    valkeyClusterAsyncContext *acc = privdata;
+    (void)timer;
+
+    acc->pipeline_timer = NULL;
+    clusterAsyncFlushPipeline(acc);
 }
 
-static cluster_async_data *cluster_async_data_create(void) {
-    /* use calloc to guarantee all fields are zeroed */
-    return vk_calloc(1, sizeof(cluster_async_data));
+/* Hold back a command for the node serving its slot, until the batch of the
+ * node is full or the max delay has passed. A full batch is submitted
+ * directly, where a valkeyClusterAsyncFree() from the callback of a failed
+ * command is deferred until all commands of the batch have been handled. */
+static int clusterAsyncPipelineCommand(valkeyClusterAsyncContext *acc,
+                                       valkeyClusterNode *node,
+                                       cluster_async_data *cad) {
+    struct hilist *cmds;
+    dictEntry *de;
+
+    if (acc->pipeline == NULL &&
+        (acc->pipeline = dictCreate(&clusterPipelineDictType)) == NULL)
+        return VALKEY_ERR;
+    if ((de = dictFind(acc->pipeline, node->addr)) == NULL) {
+        sds key = sdsdup(node->addr);
+        if (key == NULL)
+            return VALKEY_ERR;
+        if (dictAdd(acc->pipeline, key, NULL) != DICT_OK) {
+            sdsfree(key);
+            return VALKEY_ERR;
+        }
+        de = dictFind(acc->pipeline, key);
+    }
+    if ((cmds = dictGetVal(de)) == NULL) {
+        if ((cmds = listCreate()) == NULL)
+            return VALKEY_ERR;
+        dictSetVal(acc->pipeline, de, cmds);
+    }
+    if (listAddNodeTail(cmds, cad) == NULL)
+        return VALKEY_ERR;
+
+    if ((int)listLength(cmds) >= acc->pipeline_max_batch) {
+        dictSetVal(acc->pipeline, de, NULL);
+        int nested = clusterAsyncEnterCallback(acc);
+        clusterAsyncSendHeld(acc, cmds);
+        clusterAsyncLeaveCallback(acc, nested);
+    } else if (acc->pipeline_timer == NULL) {
+        struct timeval tv;
+        tv.tv_sec = acc->pipeline_max_delay_usec / 1000000;
+        tv.tv_usec = acc->pipeline_max_delay_usec % 1000000;
+        acc->pipeline_timer = acc->timer_fn(acc->attach_data, tv,
+                                            clusterAsyncPipelineTimer, acc);
+        if (acc->pipeline_timer == NULL) {
+            listDelNode(cmds, listLast(cmds));
+            return VALKEY_ERR;
+        }
+    }
+    return VALKEY_OK;
 }
 
-static void cluster_async_data_free(cluster_async_data *cad) {
-    if (cad == NULL) {
-        return;
+/* Report the commands held back by auto-pipelining as failed. */
+static void clusterAsyncCancelPipeline(valkeyClusterAsyncContext *acc) {
+    dict *pipeline = acc->pipeline;
+    dictIterator di;
+    dictEntry *de;
+
+    if (acc->pipeline_timer != NULL) {
+        acc->timer_cancel_fn(acc->attach_data, acc->pipeline_timer);
+        acc->pipeline_timer = NULL;
     }
+    acc->pipeline = NULL;
+    if (pipeline == NULL)
+        return;
 
-    command_destroy(cad->command);
+    dictInitIterator(&di, pipeline);
+    while ((de = dictNext(&di)) != NULL) {
+        struct hilist *cmds = dictGetVal(de);
+        listNode *ln;
 
-    vk_free(cad);
+        if (cmds == NULL)
+            continue;
+        while ((ln = listFirst(cmds)) != NULL) {
+            cluster_async_data *cad = listNodeValue(ln);
+            listDelNode(cmds, ln);
+
+            valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "disconnecting");
+            cad->callback(acc, NULL, cad->privdata);
+            valkeyClusterAsyncClearError(acc);
+            cluster_async_data_free(cad);
+        }
+    }
+    dictRelease(pipeline);
 }
 
-static void unlinkAsyncContextAndNode(void *data) {
-    valkeyClusterNode *node;
+/* Schedule a retry of a command using exponential backoff. The delay is
+ * picked randomly between half and the full backoff to avoid that clients
+ * retry in lockstep. Returns VALKEY_ERR when the retry should be made
+ * without delay, i.e. when the event library adapter lacks timer support. */
+static int clusterAsyncScheduleRetry(valkeyClusterAsyncContext *acc,
+                                     cluster_async_data *cad) {
+    int64_t backoff = acc->retry_backoff_usec;
+    int64_t usec;
+    struct timeval tv;
+
+    if (acc->timer_fn == NULL || backoff <= 0)
+        return VALKEY_ERR;
 
-    if (data) {
-        node = (valkeyClusterNode *)(data);
-        node->acon = NULL;
+    for (int i = 1; i < cad->retry_count && backoff < acc->retry_backoff_max_usec; i++)
+        backoff *= 2;
+    if (backoff > acc->retry_backoff_max_usec)
+        backoff = acc->retry_backoff_max_usec;
+    usec = backoff / 2 + random() % (backoff / 2 + 1);
+    tv.tv_sec = usec / 1000000;
+    tv.tv_usec = usec % 1000000;
+
+    if (acc->retries == NULL && (acc->retries = listCreate()) == NULL)
+        return VALKEY_ERR;
+    if (listAddNodeTail(acc->retries, cad) == NULL)
+        return VALKEY_ERR;
+    cad->retry_node = listLast(acc->retries);
+
+    cad->timer = acc->timer_fn(acc->attach_data, tv, clusterAsyncRetryTimer, cad);
+    if (cad->timer == NULL) {
+        listDelNode(acc->retries, cad->retry_node);
+        cad->retry_node = NULL;
+        return VALKEY_ERR;
     }
+    return VALKEY_OK;
 }
 
-/* Reply callback function for SELECT */
-void selectReplyCallback(valkeyAsyncContext *ac, void *r, void *privdata) {
-    valkeyReply *reply = (valkeyReply *)r;
-    valkeyClusterAsyncContext *acc = (valkeyClusterAsyncContext *)privdata;
+/* Cancel the delayed retries and report the commands as failed. */
+static void clusterAsyncCancelRetries(valkeyClusterAsyncContext *acc) {
+    listNode *ln;
 
-    if (reply == NULL || reply->type == VALKEY_REPLY_ERROR) {
-        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
-                                   "Failed to select logical database");
-        valkeyAsyncDisconnect(ac);
+    if (acc->retries == NULL)
+        return;
+
+    while ((ln = listFirst(acc->retries)) != NULL) {
+        cluster_async_data *cad = listNodeValue(ln);
+        listDelNode(acc->retries, ln);
+        acc->timer_cancel_fn(acc->attach_data, cad->timer);
+
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "disconnecting");
+        cad->callback(acc, NULL, cad->privdata);
+        valkeyClusterAsyncClearError(acc);
+        cluster_async_data_free(cad);
     }
 }
 
-valkeyAsyncContext *
-valkeyClusterGetValkeyAsyncContext(valkeyClusterAsyncContext *acc,
-                                   valkeyClusterNode *node) {
-    valkeyAsyncContext *ac;
+/* Callback for async cluster commands. Handles redirects (MOVED/ASK),
+ * retries (TRYAGAIN/CLUSTERDOWN), and delivers the final reply to the user.
+ * On success or unrecoverable failure, the user callback is always invoked
+ * with the reply on success, or with NULL when an error occurred (check
+ * acc->err for details). */
+static void valkeyClusterAsyncCallback(valkeyAsyncContext *ac, void *r,
+                                       void *privdata) {
     int ret;
+    valkeyReply *reply = r;
+    cluster_async_data *cad = privdata;
+    valkeyClusterAsyncContext *acc;
+    valkeyClusterContext *cc;
+    valkeyAsyncContext *ac_retry = NULL;
+    cluster_conn *conn_retry;
+    valkeyClusterNode *node;
+    struct cmd *command;
 
-    if (node == NULL) {
-        return NULL;
+    assert(cad != NULL);
+    if (cad == NULL)
+        return;
+
+    acc = cad->acc;
+    assert(acc != NULL);
+    if (acc == NULL) {
+        cluster_async_data_free(cad);
+        return;
     }
 
-    ac = node->acon;
-    if (ac != NULL) {
-        if (ac->c.err == 0) {
-            return ac;
-        } else {
-            /* The cluster node has a valkey context with errors. Libvalkey
-             * will asynchronously destruct the context and unlink it from
-             * the cluster node object. Return an error until done.
-             * An example scenario is when sending a command from a command
-             * callback, which has a NULL reply due to a disconnect. */
-            valkeyClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
-            return NULL;
-        }
+    cc = &acc->cc;
+    command = cad->command;
+
+    clusterAsyncCommandDone(ac, cad, reply);
+
+    /* The command is no longer outstanding on its pool connection. */
+    conn_retry = clusterAsyncPoolConn(ac);
+    if (conn_retry != NULL)
+        conn_retry->pending--;
+
+    if (reply == NULL) {
+        /* Copy error from the underlying context. */
+        valkeyClusterAsyncSetError(acc, ac->err, ac->errstr);
+
+        if (ac->data == NULL)
+            goto done; /* Node already removed from topology */
+
+        /* Start a slotmap update when the throttling allows */
+        throttledUpdateSlotMapAsync(acc, NULL);
+        goto done;
     }
 
-    // No async context exists, perform a connect
+    /* Skip retry handling when not expected, or during a client disconnect.
+     * The command is only kept when it can be retried. */
+    if (cad->retry_count == NO_RETRY || cc->flags & VALKEY_FLAG_DISCONNECTING)
+        goto done;
+    assert(command != NULL);
 
-    if (node->host == NULL || node->port <= 0) {
-        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
-                                   "node host or port is error");
-        return NULL;
+    /* Handle cluster redirect and retry errors. */
+    replyErrorType error_type = getReplyErrorType(reply);
+    if (error_type > CLUSTER_NO_ERROR && error_type < CLUSTER_ERR_OTHER) {
+        cad->retry_count++;
+        if (cad->retry_count > cc->max_retry_count) {
+            cad->retry_count = 0;
+            valkeyClusterAsyncSetError(acc, VALKEY_ERR_CLUSTER_TOO_MANY_RETRIES,
+                                       "too many cluster retries");
+            goto done;
+        }
+
+        int slot = -1;
+        int node_created = 0;
+        switch (error_type) {
+        case CLUSTER_ERR_MOVED:
+            node = getNodeFromRedirectReply(cc, &ac->c, reply, &slot, &node_created);
+            if (node == NULL) {
+                /* Initiate slot mapping update using the node that sent MOVED. */
+                throttledUpdateSlotMapAsync(acc, ac);
+                valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
+                goto done;
+            }
+            /* Update the slot mapping entry for this slot, and initiate a
+             * slot mapping update using the node that sent MOVED if required. */
+            if (clusterApplyMovedRedirect(cc, slot, node, node_created)) {
+                throttledUpdateSlotMapAsync(acc, ac);
+            }
+
+            ac_retry = clusterGetRoutedAsyncContext(acc, node, &conn_retry);
+            if (ac_retry == NULL)
+                goto done;
+            break;
+
+        case CLUSTER_ERR_ASK:
+            node = getNodeFromRedirectReply(cc, &ac->c, reply, NULL, NULL);
+            if (node == NULL) {
+                valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
+                goto done;
+            }
+
+            ac_retry = clusterGetRoutedAsyncContext(acc, node, &conn_retry);
+            if (ac_retry == NULL)
+                goto done;
+
+            ret = valkeyAsyncCommand(ac_retry, NULL, NULL, VALKEY_COMMAND_ASKING);
+            if (ret != VALKEY_OK)
+                goto done;
+            break;
+
+        case CLUSTER_ERR_TRYAGAIN:
+        case CLUSTER_ERR_CLUSTERDOWN:
+            if (clusterAsyncScheduleRetry(acc, cad) == VALKEY_OK)
+                return; /* Ownership of cad transferred to the timer. */
+            ac_retry = ac; /* Retry without delay, on the same connection. */
+            break;
+
+        default:
+            goto done;
+        }
+
+        /* Retry the command on the selected connection. */
+        ret = valkeyAsyncFormattedCommandNoCache(ac_retry, valkeyClusterAsyncCallback,
+                                                 cad, command->cmd, command->clen);
+        if (ret == VALKEY_OK) {
+            clusterAsyncCommandSent(ac_retry, cad);
+            if (conn_retry != NULL)
+                conn_retry->pending++;
+            return; /* Ownership of cad transferred to retry callback. */
+        }
+        /* Retry failed, fall through to notify the user. */
     }
 
-    valkeyOptions options = {0};
-    VALKEY_OPTIONS_SET_TCP(&options, node->host, node->port);
-    options.connect_timeout = acc->cc.connect_timeout;
-    options.command_timeout = acc->cc.command_timeout;
-    options.options = acc->cc.options;
+done:
+    /* Deliver result to the user callback. */
+    cad->callback(acc, acc->err ? NULL : r, cad->privdata);
+    valkeyClusterAsyncClearError(acc);
+    cluster_async_data_free(cad);
+}
 
-    node->lastConnectionAttempt = vk_usec_now();
+/* Send an encoded command using the slotmap. The command is kept until the
+ * reply is received, to be able to retry it on redirects. When `owned` is set
+ * the ownership of the command buffer is moved to this function, which avoids
+ * an additional copy. The buffer must then be allocated using vk_malloc(). */
+static int clusterAsyncFormattedCommand(valkeyClusterAsyncContext *acc,
+                                        valkeyClusterCallbackFn *fn,
+                                        void *privdata, char *cmd, int len,
+                                        int owned) {
+    valkeyClusterContext *cc;
+    int status = VALKEY_OK;
+    valkeyClusterNode *node;
+    valkeyAsyncContext *ac;
+    struct cmd *command = NULL;
+    cluster_async_data *cad = NULL;
+    cluster_conn *conn;
 
-    ac = valkeyAsyncConnectWithOptions(&options);
-    if (ac == NULL) {
-        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
-        return NULL;
+    if (acc == NULL) {
+        if (owned)
+            vk_free(cmd);
+        return VALKEY_ERR;
+    }
+
+    cc = &acc->cc;
+
+    /* Don't accept new commands when the client is about to disconnect. */
+    if (cc->flags & VALKEY_FLAG_DISCONNECTING) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "disconnecting");
+        if (owned)
+            vk_free(cmd);
+        return VALKEY_ERR;
     }
 
-    if (ac->err) {
-        valkeyClusterAsyncSetError(acc, ac->err, ac->errstr);
-        valkeyAsyncFree(ac);
-        return NULL;
+    valkeyClusterAsyncClearError(acc);
+
+    /* Reply when the reply is in the client-side cache, unless a command that
+     * may modify the key is pending. Freeing the context from the callback is
+     * deferred until the callback returns, like for replies from a node. */
+    if (cc->cache != NULL && acc->cache_bypass == 0 &&
+        valkeyCacheIsCacheable(cc->cache, cmd, len)) {
+        valkeyCacheEntry *entry = valkeyCacheLookup(cc->cache, cc->select_db, cmd, len);
+        if (entry != NULL) {
+            if (owned)
+                vk_free(cmd);
+            if (fn != NULL) {
+                int nested = clusterAsyncEnterCallback(acc);
+                fn(acc, valkeyCacheEntryReply(entry), privdata);
+                valkeyCacheEntryRelease(entry);
+                clusterAsyncLeaveCallback(acc, nested);
+            } else {
+                valkeyCacheEntryRelease(entry);
+            }
+            return VALKEY_OK;
+        }
     }
 
-    if (acc->cc.tls &&
-        acc->cc.tls_init_fn(&ac->c, acc->cc.tls) != VALKEY_OK) {
-        valkeyClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
-        valkeyAsyncFree(ac);
-        return NULL;
+    command = command_get();
+    if (command == NULL) {
+        goto oom;
     }
 
-    // Authenticate when needed
-    if (acc->cc.password != NULL) {
-        if (acc->cc.username != NULL) {
-            ret = valkeyAsyncCommand(ac, NULL, NULL, "AUTH %s %s",
-                                     acc->cc.username, acc->cc.password);
-        } else {
-            ret = valkeyAsyncCommand(ac, NULL, NULL, "AUTH %s",
-                                     acc->cc.password);
+    if (owned) {
+        command->cmd = cmd;
+        owned = 0; /* Memory ownership moved. */
+    } else {
+        command->cmd = vk_malloc(len);
+        if (command->cmd == NULL) {
+            goto oom;
         }
+        memcpy(command->cmd, cmd, len);
+    }
+    command->clen = len;
 
-        if (ret != VALKEY_OK) {
-            valkeyClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
-            valkeyAsyncFree(ac);
-            return NULL;
-        }
+    if (prepareCommand(cc, command) != VALKEY_OK) {
+        valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
+        goto error;
     }
-    // Select logical database when needed
-    if (acc->cc.select_db > 0) {
-        ret = valkeyAsyncCommand(ac, selectReplyCallback, acc, "SELECT %d", acc->cc.select_db);
-        if (ret != VALKEY_OK) {
-            valkeyClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
-            valkeyAsyncFree(ac);
-            return NULL;
-        }
+
+    clusterAdoptSharedSlotmap(cc);
+    node = node_get_by_table(cc, (uint32_t)command->slot_num);
+    if (node == NULL) {
+        /* Initiate a slotmap update since the slot is not served. */
+        throttledUpdateSlotMapAsync(acc, NULL);
+
+        /* node_get_by_table() has set the error on cc. */
+        valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
+        goto error;
     }
 
-    if (acc->attach_fn) {
-        ret = acc->attach_fn(ac, acc->attach_data);
-        if (ret != VALKEY_OK) {
-            valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
-                                       "Failed to attach event adapter");
-            valkeyAsyncFree(ac);
-            return NULL;
-        }
+    cad = cluster_async_data_create();
+    if (cad == NULL) {
+        goto oom;
     }
 
-    if (acc->onConnect) {
-        valkeyAsyncSetConnectCallback(ac, acc->onConnect);
+    cad->acc = acc;
+    cad->command = command;
+    command = NULL; /* Memory ownership moved. */
+    cad->callback = fn;
+    cad->privdata = privdata;
+    clusterAsyncCacheBypass(acc, cad, cmd, len);
+
+    if ((cc->flags & VALKEY_FLAG_AUTO_PIPELINE) && acc->pipeline_max_delay_usec > 0) {
+        /* The node connection is selected when the command is flushed.
+         * Without a delay the commands given in the same event loop
+         * iteration are already written together, and are sent directly. */
+        if (clusterAsyncPipelineCommand(acc, node, cad) != VALKEY_OK)
+            goto oom;
+        return VALKEY_OK;
     }
 
-    if (acc->onDisconnect) {
-        valkeyAsyncSetDisconnectCallback(ac, acc->onDisconnect);
+    ac = clusterGetRoutedAsyncContext(acc, node, &conn);
+    if (ac == NULL) {
+        /* Specific error already set */
+        goto error;
     }
 
-    ac->data = node;
-    ac->dataCleanup = unlinkAsyncContextAndNode;
-    node->acon = ac;
+    status = valkeyAsyncFormattedCommandNoCache(ac, valkeyClusterAsyncCallback, cad,
+                                                cad->command->cmd, len);
+    if (status != VALKEY_OK) {
+        clusterAsyncSetSendError(acc, ac, len);
+        goto error;
+    }
+    clusterAsyncCommandSent(ac, cad);
+    if (conn != NULL)
+        conn->pending++;
+    return VALKEY_OK;
 
-    return ac;
+oom:
+    valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
+    // passthrough
+
+error:
+    if (owned)
+        vk_free(cmd);
+    cluster_async_data_free(cad);
+    command_destroy(command);
+    return VALKEY_ERR;
 }
 
-static int valkeyClusterAsyncContextInit(valkeyClusterAsyncContext *acc,
-                                         const valkeyClusterOptions *options) {
-    /* Setup errstr to point to common error string in valkeyClusterContext. */
-    acc->errstr = acc->cc.errstr;
+int valkeyClusterAsyncFormattedCommand(valkeyClusterAsyncContext *acc,
+                                       valkeyClusterCallbackFn *fn,
+                                       void *privdata, char *cmd, int len) {
+    return clusterAsyncFormattedCommand(acc, fn, privdata, cmd, len, 0);
+}
 
-    if (valkeyClusterContextInit(&acc->cc, options) != VALKEY_OK) {
-        valkeyClusterAsyncSetError(acc, acc->cc.err, acc->cc.errstr);
+int valkeyClusterAsyncFormattedCommandOwned(valkeyClusterAsyncContext *acc,
+                                            valkeyClusterCallbackFn *fn,
+                                            void *privdata, char *cmd, int len) {
+    return clusterAsyncFormattedCommand(acc, fn, privdata, cmd, len, 1);
+}
+
+int valkeyClusterAsyncFormattedCommandToNode(valkeyClusterAsyncContext *acc,
+                                             valkeyClusterNode *node,
+                                             valkeyClusterCallbackFn *fn,
+                                             void *privdata, char *cmd,
+                                             int len) {
+    valkeyClusterContext *cc = &acc->cc;
+    valkeyAsyncContext *ac;
+    int status;
+    cluster_async_data *cad = NULL;
+
+    /* Don't accept new commands when the client is about to disconnect. */
+    if (cc->flags & VALKEY_FLAG_DISCONNECTING) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "disconnecting");
         return VALKEY_ERR;
     }
 
-    if (options->async_connect_callback != NULL) {
-        acc->onConnect = options->async_connect_callback;
-    }
-    if (options->async_disconnect_callback != NULL) {
-        acc->onDisconnect = options->async_disconnect_callback;
-    }
-    if (options->attach_fn == NULL) {
-        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
-                                   "No event library configured");
+    ac = valkeyClusterGetValkeyAsyncContext(acc, node);
+    if (ac == NULL) {
+        /* Specific error already set */
         return VALKEY_ERR;
     }
-    acc->attach_fn = options->attach_fn;
-    acc->attach_data = options->attach_data;
-    return VALKEY_OK;
-}
 
-valkeyClusterAsyncContext *valkeyClusterAsyncConnectWithOptions(const valkeyClusterOptions *options) {
-    valkeyClusterAsyncContext *acc;
+    valkeyClusterAsyncClearError(acc);
 
-    acc = vk_calloc(1, sizeof(valkeyClusterAsyncContext));
-    if (acc == NULL)
-        return NULL;
+    /* The command is not kept since commands to a specific node are not
+     * retried, i.e. it's only copied to the output buffer. */
+    cad = cluster_async_data_create();
+    if (cad == NULL)
+        goto oom;
 
-    if (valkeyClusterAsyncContextInit(acc, options) == VALKEY_OK) {
-        /* Only connect if options are ok. */
-        valkeyClusterAsyncConnect(acc);
+    cad->acc = acc;
+    cad->callback = fn;
+    cad->privdata = privdata;
+    cad->retry_count = NO_RETRY;
+    clusterAsyncCacheBypass(acc, cad, cmd, len);
+
+    status = valkeyAsyncFormattedCommandNoCache(ac, valkeyClusterAsyncCallback, cad,
+                                                cmd, len);
+    if (status != VALKEY_OK) {
+        clusterAsyncSetSendError(acc, ac, len);
+        goto error;
     }
+    clusterAsyncCommandSent(ac, cad);
 
-    return acc;
+    return VALKEY_OK;
+
+oom:
+    valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "Out of memory");
+    // passthrough
+
+error:
+    cluster_async_data_free(cad);
+    return VALKEY_ERR;
 }
 
-static int valkeyClusterAsyncConnect(valkeyClusterAsyncContext *acc) {
-    /* Use blocking initial slotmap update when configured. */
-    if (acc->cc.flags & VALKEY_FLAG_BLOCKING_INITIAL_UPDATE) {
-        if (valkeyClusterUpdateSlotmap(&acc->cc) != VALKEY_OK) {
-            valkeyClusterAsyncSetError(acc, acc->cc.err, acc->cc.errstr);
-            return VALKEY_ERR;
-        }
+int valkeyClustervAsyncCommand(valkeyClusterAsyncContext *acc,
+                               valkeyClusterCallbackFn *fn, void *privdata,
+                               const char *format, va_list ap) {
+    char *cmd;
+    int len;
 
-        /* Disconnect any non-async context used for the initial update. */
-        dictIterator di;
-        dictInitIterator(&di, acc->cc.nodes);
-        dictEntry *de;
-        while ((de = dictNext(&di)) != NULL) {
-            valkeyClusterNode *node = dictGetVal(de);
-            if (node->con) {
-                valkeyFree(node->con);
-                node->con = NULL;
-            }
-        }
+    if (acc == NULL) {
+        return VALKEY_ERR;
+    }
 
-        return VALKEY_OK;
+    len = valkeyvFormatCommand(&cmd, format, ap);
+    if (len == -1) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
+        return VALKEY_ERR;
+    } else if (len == -2) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
+                                   "Invalid format string");
+        return VALKEY_ERR;
     }
-    /* Use non-blocking initial slotmap update. */
-    return updateSlotMapAsync(acc, NULL /*any node*/);
+
+    /* Ownership of the command buffer is moved to avoid a copy. */
+    return clusterAsyncFormattedCommand(acc, fn, privdata, cmd, len, 1);
 }
 
-/* Reply callback function for CLUSTER SLOTS */
-void clusterSlotsReplyCallback(valkeyAsyncContext *ac, void *r,
-                               void *privdata) {
-    valkeyReply *reply = (valkeyReply *)r;
-    valkeyClusterAsyncContext *acc = (valkeyClusterAsyncContext *)privdata;
-    acc->lastSlotmapUpdateAttempt = vk_usec_now();
+int valkeyClusterAsyncCommand(valkeyClusterAsyncContext *acc,
+                              valkeyClusterCallbackFn *fn, void *privdata,
+                              const char *format, ...) {
+    int ret;
+    va_list ap;
 
-    if (reply == NULL) {
-        /* Retry using available nodes */
-        updateSlotMapAsync(acc, NULL);
-        return;
-    }
+    va_start(ap, format);
+    ret = valkeyClustervAsyncCommand(acc, fn, privdata, format, ap);
+    va_end(ap);
 
-    valkeyClusterContext *cc = &acc->cc;
-    dict *nodes = parse_cluster_slots(cc, &ac->c, reply);
-    if (updateNodesAndSlotmap(cc, nodes) != VALKEY_OK) {
-        /* Retry using available nodes */
-        updateSlotMapAsync(acc, NULL);
-    }
+    return ret;
 }
 
-/* Reply callback function for CLUSTER NODES */
-void clusterNodesReplyCallback(valkeyAsyncContext *ac, void *r,
-                               void *privdata) {
-    valkeyReply *reply = (valkeyReply *)r;
-    valkeyClusterAsyncContext *acc = (valkeyClusterAsyncContext *)privdata;
-    acc->lastSlotmapUpdateAttempt = vk_usec_now();
+int valkeyClusterAsyncCommandToNode(valkeyClusterAsyncContext *acc,
+                                    valkeyClusterNode *node,
+                                    valkeyClusterCallbackFn *fn, void *privdata,
+                                    const char *format, ...) {
+    int ret;
+    va_list ap;
+    int len;
+    char *cmd = NULL;
 
-    if (reply == NULL) {
-        /* Retry using available nodes */
-        updateSlotMapAsync(acc, NULL);
-        return;
+    /* Allocate cmd and encode the variadic command */
+    va_start(ap, format);
+    len = valkeyvFormatCommand(&cmd, format, ap);
+    va_end(ap);
+
+    if (len == -1) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "Out of memory");
+        return VALKEY_ERR;
+    } else if (len == -2) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
+                                   "Invalid format string");
+        return VALKEY_ERR;
     }
 
-    valkeyClusterContext *cc = &acc->cc;
-    dict *nodes = parse_cluster_nodes(cc, &ac->c, reply);
-    if (updateNodesAndSlotmap(cc, nodes) != VALKEY_OK) {
-        /* Retry using available nodes */
-        updateSlotMapAsync(acc, NULL);
-    }
+    ret = valkeyClusterAsyncFormattedCommandToNode(acc, node, fn, privdata, cmd,
+                                                   len);
+    vk_free(cmd);
+    return ret;
 }
 
-#define nodeIsConnected(n)                       \
-    ((n)->acon != NULL && (n)->acon->err == 0 && \
-     (n)->acon->c.flags & VALKEY_CONNECTED)
-
-/* Select a node.
- * Primarily selects a connected node found close to a randomly picked index of
- * all known nodes. The random index should give a more even distribution of
- * selected nodes. If no connected node is found while iterating to this index
- * the remaining nodes are also checked until a connected node is found.
- * If no connected node is found a node for which a connect has not been attempted
- * within throttle-time, and is found near the picked index, is selected.
- */
-static valkeyClusterNode *selectNode(dict *nodes) {
-    valkeyClusterNode *node, *selected = NULL;
-    dictIterator di;
-    dictInitIterator(&di, nodes);
+int valkeyClusterAsyncCommandArgv(valkeyClusterAsyncContext *acc,
+                                  valkeyClusterCallbackFn *fn, void *privdata,
+                                  int argc, const char **argv,
+                                  const size_t *argvlen) {
+    char *cmd;
+    int len;
 
-    int64_t throttleLimit = vk_usec_now() - SLOTMAP_UPDATE_THROTTLE_USEC;
-    unsigned long currentIndex = 0;
-    unsigned long checkIndex = random() % dictSize(nodes);
+    len = valkeyFormatCommandArgv(&cmd, argc, argv, argvlen);
+    if (len == -1) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
+        return VALKEY_ERR;
+    }
 
-    dictEntry *de;
-    while ((de = dictNext(&di)) != NULL) {
-        node = dictGetVal(de);
+    /* Ownership of the command buffer is moved to avoid a copy. */
+    return clusterAsyncFormattedCommand(acc, fn, privdata, cmd, len, 1);
+}
 
-        if (nodeIsConnected(node)) {
-            /* Keep any connected node */
-            selected = node;
-        } else if (node->lastConnectionAttempt < throttleLimit &&
-                   (selected == NULL || (currentIndex < checkIndex &&
-                                         !nodeIsConnected(selected)))) {
-            /* Keep an accepted node when none is yet found, or
-               any accepted node until the chosen index is reached */
-            selected = node;
+/* A script call, kept to be retried using EVAL. */
+typedef struct cluster_script_call {
+    valkeyScript *script;
+    sds command; /* EVALSHA, or NULL when retried. */
+    valkeyClusterCallbackFn *callback;
+    void *privdata;
+} cluster_script_call;
+
+static void clusterScriptCallback(valkeyClusterAsyncContext *acc, void *r,
+                                  void *privdata) {
+    cluster_script_call *call = privdata;
+
+    if (r != NULL && call->command != NULL && valkeyScriptIsNoscript(r)) {
+        /* The script is not loaded on the node serving the key, e.g. after
+         * a failover. EVAL loads it, and is routed by the same key. */
+        sds eval = valkeyScriptFormatEval(call->script, call->command,
+                                          sdslen(call->command));
+        sdsfree(call->command);
+        call->command = NULL;
+        if (eval != NULL &&
+            clusterAsyncFormattedCommand(acc, clusterScriptCallback, call, eval,
+                                         sdslen(eval), 0) == VALKEY_OK) {
+            sdsfree(eval);
+            return;
         }
-
-        /* Return a found connected node when chosen index is reached. */
-        if (currentIndex >= checkIndex && selected != NULL &&
-            nodeIsConnected(selected))
-            break;
-        currentIndex += 1;
+        sdsfree(eval); /* Give the NOSCRIPT error to the callback. */
     }
-    return selected;
+
+    if (call->callback != NULL)
+        call->callback(acc, r, call->privdata);
+    valkeyScriptFree(call->script);
+    sdsfree(call->command);
+    vk_free(call);
 }
 
-/* Update the slot map by querying a selected cluster node. If ac is NULL, an
- * arbitrary connected node is selected. */
-static int updateSlotMapAsync(valkeyClusterAsyncContext *acc,
-                              valkeyAsyncContext *ac) {
-    if (acc->lastSlotmapUpdateAttempt == SLOTMAP_UPDATE_ONGOING) {
-        /* Don't allow concurrent slot map updates. */
+int valkeyClusterAsyncScriptCall(valkeyClusterAsyncContext *acc,
+                                 valkeyClusterCallbackFn *fn, void *privdata,
+                                 valkeyScript *script, int numkeys, int argc,
+                                 const char **argv, const size_t *argvlen) {
+    cluster_script_call *call;
+
+    if (script == NULL || numkeys < 1 || argc < numkeys) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
+                                   "A script call needs at least one key");
         return VALKEY_ERR;
     }
-    if (acc->cc.flags & VALKEY_FLAG_DISCONNECTING) {
-        /* No slot map updates during a cluster client disconnect. */
+
+    call = vk_calloc(1, sizeof(*call));
+    if (call == NULL)
+        goto oom;
+    call->command = valkeyScriptFormatCall(script, numkeys, argc, argv, argvlen);
+    if (call->command == NULL) {
+        vk_free(call);
+        goto oom;
+    }
+    call->script = script;
+    call->callback = fn;
+    call->privdata = privdata;
+
+    if (clusterAsyncFormattedCommand(acc, clusterScriptCallback, call,
+                                     call->command, sdslen(call->command),
+                                     0) != VALKEY_OK) {
+        sdsfree(call->command);
+        vk_free(call);
         return VALKEY_ERR;
     }
+    valkeyScriptRetain(script);
+    return VALKEY_OK;
 
-    if (ac == NULL) {
-        valkeyClusterNode *node = selectNode(acc->cc.nodes);
-        if (node == NULL) {
-            goto error;
-        }
+oom:
+    valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
+    return VALKEY_ERR;
+}
 
-        /* Get libvalkey context, connect if needed */
-        ac = valkeyClusterGetValkeyAsyncContext(acc, node);
-    }
+/* A transaction sent using the asynchronous API, with a copy of the commands
+ * to be able to retry it on redirects. */
+typedef struct cluster_async_tx {
+    valkeyClusterAsyncContext *acc;
+    sds block;
+    size_t *lens;
+    int count;
+    int pending;     /* Replies not yet received. */
+    int retry_count;
+    int failed;      /* A reply is missing or the block was partly sent. */
+    sds redirect;    /* First MOVED or ASK error given to a queued command. */
+    valkeyClusterCallbackFn *callback;
+    void *privdata;
+} cluster_async_tx;
+
+static void clusterAsyncTransactionFree(cluster_async_tx *atx) {
+    if (atx->acc != NULL && atx->acc->cc.cache != NULL)
+        atx->acc->cache_bypass--;
+    sdsfree(atx->block);
+    sdsfree(atx->redirect);
+    vk_free(atx->lens);
+    vk_free(atx);
+}
+
+static void clusterTransactionCallback(valkeyAsyncContext *ac, void *r,
+                                       void *privdata);
+
+/* Send the transaction to a node, each command with its own callback. Returns
+ * VALKEY_ERR when nothing was sent. When only a part was sent the connection
+ * is closed, which discards the transaction, and the callback of the last
+ * sent command gives the error. */
+static int clusterAsyncTransactionSend(valkeyClusterAsyncContext *acc,
+                                       cluster_async_tx *atx,
+                                       valkeyClusterNode *node, int asking) {
+    valkeyAsyncContext *ac;
+    const char *p = atx->block;
+    size_t total_len;
+
+    ac = valkeyClusterGetValkeyAsyncContext(acc, node);
     if (ac == NULL)
-        goto error; /* Specific error already set */
+        return VALKEY_ERR;
 
-    /* Send a command depending of config */
-    int status;
-    if (acc->cc.flags & VALKEY_FLAG_USE_CLUSTER_NODES) {
-        status = valkeyAsyncCommand(ac, clusterNodesReplyCallback, acc,
-                                    VALKEY_COMMAND_CLUSTER_NODES);
-    } else {
-        status = valkeyAsyncCommand(ac, clusterSlotsReplyCallback, acc,
-                                    VALKEY_COMMAND_CLUSTER_SLOTS);
+    /* Reject the whole transaction up front rather than sending a part of it,
+     * since a partly sent transaction can only be failed by disconnecting. */
+    total_len = sdslen(atx->block) + strlen("*1\r\n$4\r\nEXEC\r\n");
+    if (asking)
+        total_len += strlen("*1\r\n$6\r\nASKING\r\n");
+    if (valkeyOutputLimitReached(&ac->c, total_len)) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OUTPUT_LIMIT, "Output buffer limit exceeded");
+        return VALKEY_ERR;
     }
 
-    if (status == VALKEY_OK) {
-        acc->lastSlotmapUpdateAttempt = SLOTMAP_UPDATE_ONGOING;
-        return VALKEY_OK;
+    sdsfree(atx->redirect);
+    atx->redirect = NULL;
+    atx->pending = 0;
+
+    if (asking) {
+        if (valkeyAsyncCommand(ac, clusterTransactionCallback, atx,
+                               VALKEY_COMMAND_ASKING) != VALKEY_OK)
+            goto error;
+        atx->pending++;
+    }
+    for (int i = 0; i <= atx->count; i++) {
+        if (valkeyAsyncFormattedCommandNoCache(ac, clusterTransactionCallback, atx,
+                                               p, atx->lens[i]) != VALKEY_OK)
+            goto error;
+        atx->pending++;
+        p += atx->lens[i];
     }
+    if (valkeyAsyncCommand(ac, clusterTransactionCallback, atx, "EXEC") != VALKEY_OK)
+        goto error;
+    atx->pending++;
+    return VALKEY_OK;
 
 error:
-    acc->lastSlotmapUpdateAttempt = vk_usec_now();
-    return VALKEY_ERR;
+    valkeyClusterAsyncSetError(acc, ac->err ? ac->err : VALKEY_ERR_OTHER,
+                               ac->err ? ac->errstr : "Failed to send transaction");
+    if (atx->pending == 0)
+        return VALKEY_ERR;
+    atx->failed = 1;
+    valkeyAsyncDisconnect(ac);
+    return VALKEY_OK;
 }
 
-/* Start a slotmap update if the throttling allows. */
-static void throttledUpdateSlotMapAsync(valkeyClusterAsyncContext *acc,
-                                        valkeyAsyncContext *ac) {
-    if (acc->lastSlotmapUpdateAttempt != SLOTMAP_UPDATE_ONGOING &&
-        (acc->lastSlotmapUpdateAttempt + SLOTMAP_UPDATE_THROTTLE_USEC) <
-            vk_usec_now()) {
-        updateSlotMapAsync(acc, ac);
+/* Retry a transaction on the node given by a redirect. */
+static int clusterAsyncTransactionRetry(valkeyClusterAsyncContext *acc,
+                                        valkeyAsyncContext *ac,
+                                        cluster_async_tx *atx) {
+    valkeyClusterContext *cc = &acc->cc;
+    valkeyReply redirect = {0};
+    valkeyClusterNode *node;
+    int slot = -1;
+    int node_created = 0;
+    int asking;
+
+    if (++atx->retry_count > cc->max_retry_count) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_CLUSTER_TOO_MANY_RETRIES,
+                                   "too many cluster retries");
+        return VALKEY_ERR;
+    }
+
+    redirect.type = VALKEY_REPLY_ERROR;
+    redirect.str = atx->redirect;
+    redirect.len = sdslen(atx->redirect);
+    asking = getReplyErrorType(&redirect) == CLUSTER_ERR_ASK;
+
+    if (asking) {
+        node = getNodeFromRedirectReply(cc, &ac->c, &redirect, NULL, NULL);
+    } else {
+        node = getNodeFromRedirectReply(cc, &ac->c, &redirect, &slot, &node_created);
+    }
+    if (node == NULL) {
+        if (!asking)
+            throttledUpdateSlotMapAsync(acc, ac);
+        valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
+        return VALKEY_ERR;
     }
+    if (!asking && clusterApplyMovedRedirect(cc, slot, node, node_created))
+        throttledUpdateSlotMapAsync(acc, ac);
+
+    return clusterAsyncTransactionSend(acc, atx, node, asking);
 }
 
-/* Callback for async cluster commands. Handles redirects (MOVED/ASK),
- * retries (TRYAGAIN/CLUSTERDOWN), and delivers the final reply to the user.
- * On success or unrecoverable failure, the user callback is always invoked
- * with the reply on success, or with NULL when an error occurred (check
- * acc->err for details). */
-static void valkeyClusterAsyncCallback(valkeyAsyncContext *ac, void *r,
+static void clusterTransactionCallback(valkeyAsyncContext *ac, void *r,
                                        void *privdata) {
-    int ret;
+    cluster_async_tx *atx = privdata;
+    valkeyClusterAsyncContext *acc = atx->acc;
     valkeyReply *reply = r;
-    cluster_async_data *cad = privdata;
-    valkeyClusterAsyncContext *acc;
-    valkeyClusterContext *cc;
-    valkeyAsyncContext *ac_retry = NULL;
-    valkeyClusterNode *node;
-    struct cmd *command;
 
-    assert(cad != NULL);
-    if (cad == NULL)
-        return;
+    if (reply == NULL) {
+        if (!atx->failed) {
+            valkeyClusterAsyncSetError(acc, ac->err, ac->errstr);
+            /* Start a slotmap update when the throttling allows. */
+            if (ac->data != NULL)
+                throttledUpdateSlotMapAsync(acc, NULL);
+        }
+        atx->failed = 1;
+    } else if (atx->redirect == NULL &&
+               (getReplyErrorType(reply) == CLUSTER_ERR_MOVED ||
+                getReplyErrorType(reply) == CLUSTER_ERR_ASK)) {
+        atx->redirect = sdsnewlen(reply->str, reply->len);
+        if (atx->redirect == NULL) {
+            valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
+            atx->failed = 1;
+        }
+    }
 
-    acc = cad->acc;
-    assert(acc != NULL);
-    if (acc == NULL) {
-        cluster_async_data_free(cad);
+    if (--atx->pending > 0)
         return;
+
+    /* The reply of EXEC, which is aborted when a queued command was
+     * redirected. Retry the whole transaction on the redirect target. */
+    if (!atx->failed && atx->redirect != NULL && reply->type == VALKEY_REPLY_ERROR &&
+        !(acc->cc.flags & VALKEY_FLAG_DISCONNECTING)) {
+        valkeyClusterAsyncClearError(acc);
+        if (clusterAsyncTransactionRetry(acc, ac, atx) == VALKEY_OK)
+            return; /* Ownership of atx transferred to the retry callbacks. */
+        atx->failed = 1;
     }
 
-    cc = &acc->cc;
+    if (atx->callback != NULL)
+        atx->callback(acc, atx->failed ? NULL : r, atx->privdata);
+    valkeyClusterAsyncClearError(acc);
+    clusterAsyncTransactionFree(atx);
+}
 
-    command = cad->command;
-    assert(command != NULL);
-    if (command == NULL)
-        goto done;
+int valkeyClusterAsyncTransactionExec(valkeyClusterAsyncContext *acc,
+                                      valkeyClusterTransaction *tx,
+                                      valkeyClusterCallbackFn *fn,
+                                      void *privdata) {
+    valkeyClusterContext *cc;
+    valkeyClusterNode *node;
+    cluster_async_tx *atx;
 
-    if (reply == NULL) {
-        /* Copy error from the underlying context. */
-        valkeyClusterAsyncSetError(acc, ac->err, ac->errstr);
+    if (acc == NULL || tx == NULL)
+        return VALKEY_ERR;
 
-        node = (valkeyClusterNode *)ac->data;
-        if (node == NULL)
-            goto done; /* Node already removed from topology */
+    cc = &acc->cc;
+    if (cc->flags & VALKEY_FLAG_DISCONNECTING) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "disconnecting");
+        return VALKEY_ERR;
+    }
 
-        /* Start a slotmap update when the throttling allows */
+    valkeyClusterAsyncClearError(acc);
+    if (clusterTransactionCheck(cc, tx) != VALKEY_OK) {
+        valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
+        return VALKEY_ERR;
+    }
+
+    clusterAdoptSharedSlotmap(cc);
+    node = node_get_by_table(cc, (uint32_t)tx->slot);
+    if (node == NULL) {
+        /* Initiate a slotmap update since the slot is not served. */
         throttledUpdateSlotMapAsync(acc, NULL);
-        goto done;
+        valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
+        return VALKEY_ERR;
     }
 
-    /* Skip retry handling when not expected, or during a client disconnect. */
-    if (cad->retry_count == NO_RETRY || cc->flags & VALKEY_FLAG_DISCONNECTING)
-        goto done;
+    atx = vk_calloc(1, sizeof(*atx));
+    if (atx == NULL)
+        goto oom;
+    atx->block = sdsdup(tx->block);
+    atx->lens = vk_malloc((tx->count + 1) * sizeof(*atx->lens));
+    if (atx->block == NULL || atx->lens == NULL) {
+        clusterAsyncTransactionFree(atx);
+        goto oom;
+    }
+    memcpy(atx->lens, tx->lens, (tx->count + 1) * sizeof(*atx->lens));
+    atx->count = tx->count;
+    atx->acc = acc;
+    if (cc->cache != NULL)
+        acc->cache_bypass++; /* The transaction may modify cached keys. */
+    atx->callback = fn;
+    atx->privdata = privdata;
 
-    /* Handle cluster redirect and retry errors. */
-    replyErrorType error_type = getReplyErrorType(reply);
-    if (error_type > CLUSTER_NO_ERROR && error_type < CLUSTER_ERR_OTHER) {
-        cad->retry_count++;
-        if (cad->retry_count > cc->max_retry_count) {
-            cad->retry_count = 0;
-            valkeyClusterAsyncSetError(acc, VALKEY_ERR_CLUSTER_TOO_MANY_RETRIES,
-                                       "too many cluster retries");
-            goto done;
-        }
+    if (clusterAsyncTransactionSend(acc, atx, node, 0) != VALKEY_OK) {
+        clusterAsyncTransactionFree(atx);
+        return VALKEY_ERR;
+    }
+    return VALKEY_OK;
 
-        int slot = -1;
-        switch (error_type) {
-        case CLUSTER_ERR_MOVED:
-            /* Initiate slot mapping update using the node that sent MOVED. */
-            throttledUpdateSlotMapAsync(acc, ac);
+oom:
+    valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
+    return VALKEY_ERR;
+}
 
-            node = getNodeFromRedirectReply(cc, &ac->c, reply, &slot);
-            if (node == NULL) {
-                valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
-                goto done;
-            }
-            /* Update the slot mapping entry for this slot. */
-            if (slot >= 0) {
-                cc->table[slot] = node;
-            }
+int valkeyClusterAsyncCommandArgvToNode(valkeyClusterAsyncContext *acc,
+                                        valkeyClusterNode *node,
+                                        valkeyClusterCallbackFn *fn,
+                                        void *privdata, int argc,
+                                        const char **argv,
+                                        const size_t *argvlen) {
 
-            ac_retry = valkeyClusterGetValkeyAsyncContext(acc, node);
-            if (ac_retry == NULL)
-                goto done;
-            break;
+    int ret;
+    char *cmd;
+    int len;
 
-        case CLUSTER_ERR_ASK:
-            node = getNodeFromRedirectReply(cc, &ac->c, reply, NULL);
-            if (node == NULL) {
-                valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
-                goto done;
-            }
+    len = valkeyFormatCommandArgv(&cmd, argc, argv, argvlen);
+    if (len == -1) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
+        return VALKEY_ERR;
+    }
+
+    ret = valkeyClusterAsyncFormattedCommandToNode(acc, node, fn, privdata, cmd,
+                                                   len);
 
-            ac_retry = valkeyClusterGetValkeyAsyncContext(acc, node);
-            if (ac_retry == NULL)
-                goto done;
+    vk_free(cmd);
 
-            ret = valkeyAsyncCommand(ac_retry, NULL, NULL, VALKEY_COMMAND_ASKING);
-            if (ret != VALKEY_OK)
-                goto done;
-            break;
+    return ret;
+}
 
-        case CLUSTER_ERR_TRYAGAIN:
-        case CLUSTER_ERR_CLUSTERDOWN:
-            ac_retry = ac;
-            break;
+static void clusterGatherFinish(cluster_gather_data *gd) {
+    valkeyClusterAsyncContext *acc = gd->acc;
+    valkeyReply *reply = NULL;
 
-        default:
-            goto done;
+    if (gd->err == 0) {
+        reply = gd->reducer(gd->replies, gd->count);
+        if (reply == NULL) {
+            gd->err = VALKEY_ERR_OOM;
+            strcpy(gd->errstr, "Out of memory");
         }
-
-        /* Retry the command on the selected connection. */
-        ret = valkeyAsyncFormattedCommand(ac_retry, valkeyClusterAsyncCallback,
-                                          cad, command->cmd, command->clen);
-        if (ret == VALKEY_OK)
-            return; /* Ownership of cad transferred to retry callback. */
-        /* Retry failed, fall through to notify the user. */
+    } else {
+        for (size_t i = 0; i < gd->count; i++)
+            freeReplyObject(gd->replies[i]);
     }
 
-done:
-    /* Deliver result to the user callback. */
-    cad->callback(acc, acc->err ? NULL : r, cad->privdata);
+    if (gd->err)
+        valkeyClusterAsyncSetError(acc, gd->err, gd->errstr);
+    gd->callback(acc, reply, gd->privdata);
     valkeyClusterAsyncClearError(acc);
-    cluster_async_data_free(cad);
+
+    freeReplyObject(reply);
+    vk_free(gd->entries);
+    vk_free(gd->replies);
+    vk_free(gd);
 }
 
-int valkeyClusterAsyncFormattedCommand(valkeyClusterAsyncContext *acc,
-                                       valkeyClusterCallbackFn *fn,
-                                       void *privdata, char *cmd, int len) {
+/* Keep the first error of a command sent to all nodes. */
+static void clusterGatherSetError(cluster_gather_data *gd, int type,
+                                  const char *str) {
+    if (gd->err != 0)
+        return;
+    gd->err = type;
+    snprintf(gd->errstr, sizeof(gd->errstr), "%s", str);
+}
+
+/* Reply callback for each node of a command sent to all nodes. */
+static void clusterGatherCallback(valkeyClusterAsyncContext *acc, void *r,
+                                  void *privdata) {
+    cluster_gather_entry *entry = privdata;
+    cluster_gather_data *gd = entry->gd;
+
+    if (r == NULL) {
+        clusterGatherSetError(gd, acc->err, acc->errstr);
+    } else {
+        /* The reply is freed by the async layer when returning. */
+        gd->replies[entry->index] = clusterReplyDup(r);
+        if (gd->replies[entry->index] == NULL)
+            clusterGatherSetError(gd, VALKEY_ERR_OOM, "Out of memory");
+    }
+
+    if (--gd->pending == 0)
+        clusterGatherFinish(gd);
+}
 
+int valkeyClustervAsyncCommandToAllNodes(valkeyClusterAsyncContext *acc,
+                                         int flags,
+                                         valkeyClusterReducerFn *reducer,
+                                         valkeyClusterCallbackFn *fn,
+                                         void *privdata, const char *format,
+                                         va_list ap) {
     valkeyClusterContext *cc;
-    int status = VALKEY_OK;
-    valkeyClusterNode *node;
-    valkeyAsyncContext *ac;
-    struct cmd *command = NULL;
-    cluster_async_data *cad = NULL;
+    valkeyClusterNode **nodes = NULL;
+    cluster_gather_data *gd = NULL;
+    char *cmd = NULL;
+    size_t count, sent = 0;
+    int len;
 
-    if (acc == NULL) {
+    if (acc == NULL || reducer == NULL) {
         return VALKEY_ERR;
     }
-
     cc = &acc->cc;
 
-    /* Don't accept new commands when the client is about to disconnect. */
-    if (cc->flags & VALKEY_FLAG_DISCONNECTING) {
-        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "disconnecting");
+    len = valkeyvFormatCommand(&cmd, format, ap);
+    if (len == -1) {
+        goto oom;
+    } else if (len == -2) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
+                                   "Invalid format string");
         return VALKEY_ERR;
     }
 
-    valkeyClusterAsyncClearError(acc);
+    nodes = clusterGetAllNodes(cc, flags, &count);
+    if (nodes == NULL) {
+        valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
+        goto error;
+    }
 
-    command = command_get();
-    if (command == NULL) {
+    gd = vk_calloc(1, sizeof(*gd));
+    if (gd == NULL) {
         goto oom;
     }
-
-    command->cmd = vk_calloc(len, sizeof(*command->cmd));
-    if (command->cmd == NULL) {
+    gd->replies = vk_calloc(count, sizeof(*gd->replies));
+    gd->entries = vk_calloc(count, sizeof(*gd->entries));
+    if (gd->replies == NULL || gd->entries == NULL) {
         goto oom;
     }
-    memcpy(command->cmd, cmd, len);
-    command->clen = len;
+    gd->acc = acc;
+    gd->reducer = reducer;
+    gd->callback = fn;
+    gd->privdata = privdata;
+    gd->count = count;
+
+    for (size_t i = 0; i < count; i++) {
+        gd->entries[i].gd = gd;
+        gd->entries[i].index = i;
+        if (valkeyClusterAsyncFormattedCommandToNode(
+                acc, nodes[i], clusterGatherCallback, &gd->entries[i], cmd,
+                len) == VALKEY_OK) {
+            sent++;
+        } else {
+            /* Reported in the callback when the command was sent to
+             * other nodes. */
+            clusterGatherSetError(gd, acc->err, acc->errstr);
+        }
+    }
+    if (sent == 0) {
+        goto error; /* Error already set by the last failed send. */
+    }
+    gd->pending = sent;
 
-    if (prepareCommand(cc, command) != VALKEY_OK) {
-        valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
-        goto error;
+    valkeyClusterAsyncClearError(acc);
+    vk_free(nodes);
+    vk_free(cmd);
+    return VALKEY_OK;
+
+oom:
+    valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
+    // passthrough
+
+error:
+    if (gd != NULL) {
+        vk_free(gd->entries);
+        vk_free(gd->replies);
+        vk_free(gd);
     }
+    vk_free(nodes);
+    vk_free(cmd);
+    return VALKEY_ERR;
+}
 
-    node = node_get_by_table(cc, (uint32_t)command->slot_num);
-    if (node == NULL) {
-        /* Initiate a slotmap update since the slot is not served. */
-        throttledUpdateSlotMapAsync(acc, NULL);
+int valkeyClusterAsyncCommandToAllNodes(valkeyClusterAsyncContext *acc,
+                                        int flags,
+                                        valkeyClusterReducerFn *reducer,
+                                        valkeyClusterCallbackFn *fn,
+                                        void *privdata, const char *format,
+                                        ...) {
+    int ret;
+    va_list ap;
 
-        /* node_get_by_table() has set the error on cc. */
-        valkeyClusterAsyncSetError(acc, cc->err, cc->errstr);
-        goto error;
+    va_start(ap, format);
+    ret = valkeyClustervAsyncCommandToAllNodes(acc, flags, reducer, fn,
+                                               privdata, format, ap);
+    va_end(ap);
+
+    return ret;
+}
+
+/* Report the end of an async scan to the user. */
+static void scanAsyncFinish(valkeyClusterScan *scan) {
+    valkeyClusterAsyncContext *acc = scan->acc;
+
+    if (scan->err)
+        valkeyClusterAsyncSetError(acc, scan->err, scan->errstr);
+    scan->callback(acc, NULL, scan->privdata);
+    valkeyClusterAsyncClearError(acc);
+    valkeyClusterScanFree(scan);
+}
+
+static void scanAsyncCallback(valkeyClusterAsyncContext *acc, void *r,
+                              void *privdata);
+
+/* Request the next page from the nodes that are not waiting for a reply,
+ * limited by the max concurrency. */
+static void scanAsyncSendNext(valkeyClusterScan *scan) {
+    valkeyClusterAsyncContext *acc = scan->acc;
+    valkeyClusterContext *cc = scan->cc;
+    const char *argv[SCAN_MAX_ARGC];
+    size_t argvlen[SCAN_MAX_ARGC];
+    char buf[2][24];
+    listIter li;
+    listNode *ln;
+
+    if (scanNeedsUpdate(scan) && scanUpdateNodes(scan) != VALKEY_OK) {
+        scan->stopped = 1;
+        return;
     }
 
-    ac = valkeyClusterGetValkeyAsyncContext(acc, node);
-    if (ac == NULL) {
-        /* Specific error already set */
-        goto error;
+    listRewind(scan->nodes, &li);
+    while ((ln = listNext(&li)) != NULL) {
+        scan_node *sn = listNodeValue(ln);
+        dictEntry *de;
+        int argc;
+
+        if (scan->max_concurrency > 0 && scan->pending >= scan->max_concurrency)
+            break;
+        if (sn->done || sn->pending)
+            continue;
+        if (cc->nodes == NULL ||
+            (de = dictFind(cc->nodes, sn->addr)) == NULL) {
+            sn->done = 1;
+            continue;
+        }
+
+        argc = scanCommandArgv(scan, sn, argv, argvlen, buf);
+        if (valkeyClusterAsyncCommandArgvToNode(acc, dictGetVal(de),
+                                                scanAsyncCallback, sn, argc,
+                                                argv, argvlen) != VALKEY_OK) {
+            scanSetError(scan, acc->err, acc->errstr);
+            valkeyClusterAsyncClearError(acc);
+            scan->stopped = 1;
+            return;
+        }
+        sn->pending = 1;
+        scan->pending++;
     }
+}
 
-    cad = cluster_async_data_create();
-    if (cad == NULL) {
-        goto oom;
+static void scanAsyncCallback(valkeyClusterAsyncContext *acc, void *r,
+                              void *privdata) {
+    scan_node *sn = privdata;
+    valkeyClusterScan *scan = sn->scan;
+    const valkeyReply *keys = NULL;
+
+    sn->pending = 0;
+    scan->pending--;
+
+    if (r == NULL) {
+        scanSetError(scan, acc->err, acc->errstr);
+        scan->stopped = 1;
+    } else if (!scan->stopped) {
+        keys = scanParseReply(scan, sn, r);
+        if (keys == NULL)
+            scan->stopped = 1;
+        else
+            scanAsyncSendNext(scan); /* Prefetch while the page is handled. */
+    }
+
+    if (keys != NULL && keys->elements > 0) {
+        scan->in_callback = 1;
+        if (scan->callback(acc, keys, scan->privdata) != 0)
+            scan->stopped = 1;
+        scan->in_callback = 0;
+    }
+
+    /* Replies to failed commands can be delivered from within the user
+     * callback, i.e. when disconnecting, so finish from the outermost call. */
+    if (scan->pending == 0 && !scan->in_callback)
+        scanAsyncFinish(scan);
+}
+
+int valkeyClusterAsyncScan(valkeyClusterAsyncContext *acc,
+                           const valkeyClusterScanOptions *options,
+                           valkeyClusterScanCallbackFn *fn, void *privdata) {
+    valkeyClusterScan *scan;
+
+    if (acc == NULL || fn == NULL) {
+        return VALKEY_ERR;
     }
 
-    cad->acc = acc;
-    cad->command = command;
-    command = NULL; /* Memory ownership moved. */
-    cad->callback = fn;
-    cad->privdata = privdata;
+    scan = scanCreate(&acc->cc, options);
+    if (scan == NULL) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
+        return VALKEY_ERR;
+    }
+    scan->acc = acc;
+    scan->callback = fn;
+    scan->privdata = privdata;
 
-    status = valkeyAsyncFormattedCommand(ac, valkeyClusterAsyncCallback, cad,
-                                         cmd, len);
-    if (status != VALKEY_OK) {
-        valkeyClusterAsyncSetError(acc, ac->err, ac->errstr);
-        goto error;
+    scanAsyncSendNext(scan);
+    if (scan->pending == 0) {
+        /* Nothing was sent, so there is no callback to report to. */
+        if (scan->err)
+            valkeyClusterAsyncSetError(acc, scan->err, scan->errstr);
+        else
+            valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
+                                       "No nodes to scan");
+        valkeyClusterScanFree(scan);
+        return VALKEY_ERR;
     }
     return VALKEY_OK;
+}
 
-oom:
-    valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
-    // passthrough
+/* A sharded pub/sub channel, see valkeyClusterAsyncSsubscribe(). */
+typedef struct cluster_shard_channel {
+    sds name;
+    int slot;
+    valkeyClusterCallbackFn *fn;
+    void *privdata;
+    valkeyAsyncContext *ac; /* Connection subscribed on, NULL when lost. */
+    int subscribed;         /* The subscription is confirmed on `ac`. */
+    int confirmed;          /* The first reply has been given to `fn`. */
+    int failed;             /* The subscription was refused by the node. */
+} cluster_shard_channel;
+
+/* Sharded channel hash table
+ * maps a channel name to its cluster_shard_channel, which owns the key.
+ */
+static dictType clusterShardChannelsDictType = {
+    .hashFunction = dictSdsHash,
+    .keyCompare = dictSdsKeyCompare};
 
-error:
-    cluster_async_data_free(cad);
-    command_destroy(command);
-    return VALKEY_ERR;
+typedef struct shardChannelName {
+    const char *str;
+    size_t len;
+} shardChannelName;
+
+static int shardChannelNameMatch(const void *key, const void *privdata) {
+    const shardChannelName *name = privdata;
+    return sdslen((const sds)key) == name->len &&
+           memcmp(key, name->str, name->len) == 0;
 }
 
-int valkeyClusterAsyncFormattedCommandToNode(valkeyClusterAsyncContext *acc,
-                                             valkeyClusterNode *node,
-                                             valkeyClusterCallbackFn *fn,
-                                             void *privdata, char *cmd,
-                                             int len) {
-    valkeyClusterContext *cc = &acc->cc;
-    valkeyAsyncContext *ac;
-    int status;
-    cluster_async_data *cad = NULL;
-    struct cmd *command = NULL;
+/* Find a channel without creating an sds key. */
+static cluster_shard_channel *clusterShardFind(dict *channels, const char *str,
+                                               size_t len) {
+    shardChannelName name = {str, len};
+    uint64_t hash = dictGenHashFunction((const unsigned char *)str, (int)len);
+    dictEntry *de = dictFindByHash(channels, hash, shardChannelNameMatch, &name);
+    return de ? dictGetVal(de) : NULL;
+}
 
-    /* Don't accept new commands when the client is about to disconnect. */
-    if (cc->flags & VALKEY_FLAG_DISCONNECTING) {
-        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "disconnecting");
+static void clusterShardChannelFree(cluster_shard_channel *ch) {
+    sdsfree(ch->name);
+    vk_free(ch);
+}
+
+/* Order channels by slot, and by connection within a slot. */
+static int clusterShardChannelCmp(const void *a, const void *b) {
+    const cluster_shard_channel *ch_a = *(cluster_shard_channel *const *)a;
+    const cluster_shard_channel *ch_b = *(cluster_shard_channel *const *)b;
+    if (ch_a->slot != ch_b->slot)
+        return ch_a->slot < ch_b->slot ? -1 : 1;
+    if (ch_a->ac != ch_b->ac)
+        return (uintptr_t)ch_a->ac < (uintptr_t)ch_b->ac ? -1 : 1;
+    return 0;
+}
+
+static void clusterShardCallback(valkeyAsyncContext *ac, void *r,
+                                 void *privdata);
+
+/* Get the sharded pub/sub connection to a node, or connect if needed. The
+ * connection is only used for subscriptions since a RESP2 connection can't
+ * be used for other commands while subscribed. */
+static valkeyAsyncContext *clusterShardGetContext(valkeyClusterAsyncContext *acc,
+                                                  valkeyClusterNode *node) {
+    if (node->pubsub == NULL) {
+        node->pubsub = vk_calloc(1, sizeof(cluster_conn));
+        if (node->pubsub == NULL) {
+            valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
+            return NULL;
+        }
+        node->pubsub->node = node;
+    }
+    return clusterGetAsyncContext(acc, node, node->pubsub);
+}
+
+/* Send SSUBSCRIBE or SUNSUBSCRIBE for channels in the same slot, which is
+ * required by the node. */
+static int clusterShardSend(valkeyClusterAsyncContext *acc,
+                            valkeyAsyncContext *ac, const char *command,
+                            cluster_shard_channel **chs, int count) {
+    const char **argv;
+    size_t *argvlen;
+    char *cmd = NULL;
+    long long len = -1;
+    int ret;
+
+    argv = vk_malloc((count + 1) * sizeof(*argv));
+    argvlen = vk_malloc((count + 1) * sizeof(*argvlen));
+    if (argv != NULL && argvlen != NULL) {
+        argv[0] = command;
+        argvlen[0] = strlen(command);
+        for (int i = 0; i < count; i++) {
+            argv[i + 1] = chs[i]->name;
+            argvlen[i + 1] = sdslen(chs[i]->name);
+        }
+        len = valkeyFormatCommandArgv(&cmd, count + 1, argv, argvlen);
+    }
+    vk_free(argv);
+    vk_free(argvlen);
+    if (len < 0) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
         return VALKEY_ERR;
     }
 
-    ac = valkeyClusterGetValkeyAsyncContext(acc, node);
-    if (ac == NULL) {
-        /* Specific error already set */
+    ret = valkeyAsyncFormattedCommand(ac, clusterShardCallback, acc, cmd, len);
+    valkeyFreeCommand(cmd);
+    if (ret != VALKEY_OK) {
+        clusterAsyncSetSendError(acc, ac, len);
         return VALKEY_ERR;
     }
+    return VALKEY_OK;
+}
 
-    valkeyClusterAsyncClearError(acc);
+static int clusterShardHasLost(valkeyClusterAsyncContext *acc) {
+    dictIterator di;
+    dictEntry *de;
 
-    command = command_get();
-    if (command == NULL) {
-        goto oom;
+    if (acc->shard_channels == NULL)
+        return 0;
+    dictInitIterator(&di, acc->shard_channels);
+    while ((de = dictNext(&di)) != NULL) {
+        cluster_shard_channel *ch = dictGetVal(de);
+        if (ch->ac == NULL)
+            return 1;
     }
+    return 0;
+}
 
-    command->cmd = vk_calloc(len, sizeof(*command->cmd));
-    if (command->cmd == NULL) {
-        goto oom;
-    }
-    memcpy(command->cmd, cmd, len);
-    command->clen = len;
+static void clusterShardScheduleRetry(valkeyClusterAsyncContext *acc);
 
-    cad = cluster_async_data_create();
-    if (cad == NULL)
-        goto oom;
+/* Called when lost subscriptions are to be retried. A slotmap update is
+ * started when the throttling allows, and the channels are resubscribed to
+ * when it's done. Otherwise they are resubscribed to using the current
+ * slotmap. */
+static void clusterShardRetryTimer(void *timer, void *privdata) {
+    valkeyClusterAsyncContext *acc = privdata;
+    (void)timer;
 
-    cad->acc = acc;
-    cad->command = command;
-    command = NULL; /* Memory ownership moved. */
-    cad->callback = fn;
-    cad->privdata = privdata;
-    cad->retry_count = NO_RETRY;
+    acc->shard_timer = NULL;
+    if (!clusterShardHasLost(acc))
+        return;
+    throttledUpdateSlotMapAsync(acc, NULL);
+    if (acc->lastSlotmapUpdateAttempt == SLOTMAP_UPDATE_ONGOING)
+        clusterShardScheduleRetry(acc);
+    else
+        clusterShardResubscribe(acc);
+}
 
-    status = valkeyAsyncFormattedCommand(ac, valkeyClusterAsyncCallback, cad,
-                                         cmd, len);
-    if (status != VALKEY_OK) {
-        valkeyClusterAsyncSetError(acc, ac->err, ac->errstr);
-        goto error;
+static void clusterShardScheduleRetry(valkeyClusterAsyncContext *acc) {
+    struct timeval tv = {SLOTMAP_UPDATE_THROTTLE_USEC / 1000000,
+                         SLOTMAP_UPDATE_THROTTLE_USEC % 1000000};
+
+    if (acc->timer_fn == NULL || acc->shard_timer != NULL ||
+        (acc->cc.flags & VALKEY_FLAG_DISCONNECTING))
+        return;
+    acc->shard_timer =
+        acc->timer_fn(acc->attach_data, tv, clusterShardRetryTimer, acc);
+}
+
+/* Subscriptions were lost, i.e. a slot moved or a node failed. Get the new
+ * owners by updating the slotmap, which resubscribes when done. Without a new
+ * slotmap a retry is attempted later. */
+static void clusterShardLost(valkeyClusterAsyncContext *acc) {
+    throttledUpdateSlotMapAsync(acc, NULL);
+    clusterShardScheduleRetry(acc);
+}
+
+/* Subscribe to all channels whose subscription is lost, or not yet made. The
+ * channels are grouped by slot, giving one SSUBSCRIBE per slot. */
+static void clusterShardResubscribe(valkeyClusterAsyncContext *acc) {
+    cluster_shard_channel **lost;
+    dictIterator di;
+    dictEntry *de;
+    size_t count = 0;
+    int failed = 0;
+
+    if (acc->shard_channels == NULL || dictSize(acc->shard_channels) == 0 ||
+        (acc->cc.flags & VALKEY_FLAG_DISCONNECTING))
+        return;
+
+    lost = vk_malloc(dictSize(acc->shard_channels) * sizeof(*lost));
+    if (lost == NULL) {
+        clusterShardScheduleRetry(acc);
+        return;
+    }
+    dictInitIterator(&di, acc->shard_channels);
+    while ((de = dictNext(&di)) != NULL) {
+        cluster_shard_channel *ch = dictGetVal(de);
+        if (ch->ac == NULL)
+            lost[count++] = ch;
+    }
+    qsort(lost, count, sizeof(*lost), clusterShardChannelCmp);
+
+    size_t i, j;
+    for (i = 0; i < count; i = j) {
+        for (j = i + 1; j < count && lost[j]->slot == lost[i]->slot; j++)
+            ;
+
+        valkeyClusterNode *node = NULL;
+        valkeyAsyncContext *ac = NULL;
+        if (acc->cc.table != NULL)
+            node = acc->cc.table[lost[i]->slot];
+        if (node != NULL)
+            ac = clusterShardGetContext(acc, node);
+        if (ac == NULL ||
+            clusterShardSend(acc, ac, "SSUBSCRIBE", &lost[i], j - i) != VALKEY_OK) {
+            failed = 1;
+            continue;
+        }
+        for (size_t k = i; k < j; k++) {
+            lost[k]->ac = ac;
+            lost[k]->subscribed = 0;
+        }
     }
+    vk_free(lost);
 
-    return VALKEY_OK;
+    if (failed)
+        clusterShardScheduleRetry(acc);
+}
 
-oom:
-    valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "Out of memory");
-    // passthrough
+/* The connection was closed, and its subscriptions are lost. */
+static void clusterShardConnectionLost(valkeyClusterAsyncContext *acc,
+                                       valkeyAsyncContext *ac) {
+    dictIterator di;
+    dictEntry *de;
+    int lost = 0;
 
-error:
-    cluster_async_data_free(cad);
-    command_destroy(command);
-    return VALKEY_ERR;
+    dictInitIterator(&di, acc->shard_channels);
+    while ((de = dictNext(&di)) != NULL) {
+        cluster_shard_channel *ch = dictGetVal(de);
+        if (ch->ac == ac) {
+            ch->ac = NULL;
+            ch->subscribed = 0;
+            lost = 1;
+        }
+    }
+    if (lost)
+        clusterShardLost(acc);
 }
 
-int valkeyClustervAsyncCommand(valkeyClusterAsyncContext *acc,
-                               valkeyClusterCallbackFn *fn, void *privdata,
-                               const char *format, va_list ap) {
-    int ret;
-    char *cmd;
-    int len;
+/* A SSUBSCRIBE was replied with an error. The failed channels are the pending
+ * ones no longer known by the connection, see valkeySsubscribeCallback().
+ * Redirects and cluster state errors are retried, while other errors are
+ * given to the channel callbacks and the channels are dropped. */
+static void clusterShardSubscribeFailed(valkeyClusterAsyncContext *acc,
+                                        valkeyAsyncContext *ac,
+                                        valkeyReply *reply) {
+    int fatal = getReplyErrorType(reply) == CLUSTER_ERR_OTHER;
+    cluster_shard_channel *ch;
+    dictIterator di;
+    dictEntry *de;
+    int lost = 0;
 
-    if (acc == NULL) {
-        return VALKEY_ERR;
+    dictInitIterator(&di, acc->shard_channels);
+    while ((de = dictNext(&di)) != NULL) {
+        ch = dictGetVal(de);
+        if (ch->ac != ac || ch->subscribed ||
+            dictFind(ac->sub.schannels, ch->name) != NULL)
+            continue;
+        ch->ac = NULL;
+        ch->failed = fatal;
+        lost = 1;
     }
 
-    len = valkeyvFormatCommand(&cmd, format, ap);
-    if (len == -1) {
-        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
-        return VALKEY_ERR;
-    } else if (len == -2) {
-        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
-                                   "Invalid format string");
-        return VALKEY_ERR;
+    if (!fatal) {
+        if (lost)
+            clusterShardLost(acc);
+        return;
+    }
+
+    /* The callbacks may change the channels, so restart after each one. */
+    while (acc->shard_channels != NULL) {
+        ch = NULL;
+        dictInitIterator(&di, acc->shard_channels);
+        while ((de = dictNext(&di)) != NULL) {
+            if (((cluster_shard_channel *)dictGetVal(de))->failed) {
+                ch = dictGetVal(de);
+                break;
+            }
+        }
+        if (ch == NULL)
+            break;
+        dictDelete(acc->shard_channels, ch->name);
+        ch->fn(acc, reply, ch->privdata);
+        clusterShardChannelFree(ch);
     }
+}
 
-    ret = valkeyClusterAsyncFormattedCommand(acc, fn, privdata, cmd, len);
+/* Callback for all replies and messages on the sharded pub/sub connections. */
+static void clusterShardCallback(valkeyAsyncContext *ac, void *r,
+                                 void *privdata) {
+    valkeyClusterAsyncContext *acc = privdata;
+    valkeyReply *reply = r;
+    cluster_shard_channel *ch;
 
-    vk_free(cmd);
+    /* The channels are released before disconnecting. */
+    if (acc->shard_channels == NULL ||
+        (acc->cc.flags & VALKEY_FLAG_DISCONNECTING))
+        return;
 
-    return ret;
+    if (reply == NULL) {
+        clusterShardConnectionLost(acc, ac);
+        return;
+    }
+    if (reply->type == VALKEY_REPLY_ERROR) {
+        clusterShardSubscribeFailed(acc, ac, reply);
+        return;
+    }
+    if ((reply->type != VALKEY_REPLY_ARRAY && reply->type != VALKEY_REPLY_PUSH) ||
+        reply->elements < 2 ||
+        reply->element[0]->type != VALKEY_REPLY_STRING ||
+        reply->element[1]->type != VALKEY_REPLY_STRING)
+        return;
+
+    ch = clusterShardFind(acc->shard_channels, reply->element[1]->str,
+                          reply->element[1]->len);
+    if (ch == NULL || ch->ac != ac)
+        return; /* Unsubscribed by the user, or an outdated subscription. */
+
+    const char *kind = reply->element[0]->str;
+    if (strcasecmp(kind, "smessage") == 0) {
+        ch->fn(acc, reply, ch->privdata);
+    } else if (strcasecmp(kind, "ssubscribe") == 0) {
+        ch->subscribed = 1;
+        if (!ch->confirmed) {
+            ch->confirmed = 1;
+            ch->fn(acc, reply, ch->privdata);
+        }
+    } else if (strcasecmp(kind, "sunsubscribe") == 0) {
+        /* Not requested by the user, so the slot has moved. */
+        ch->ac = NULL;
+        ch->subscribed = 0;
+        clusterShardLost(acc);
+    }
 }
 
-int valkeyClusterAsyncCommand(valkeyClusterAsyncContext *acc,
-                              valkeyClusterCallbackFn *fn, void *privdata,
-                              const char *format, ...) {
-    int ret;
-    va_list ap;
+/* Release all channels, and let the callbacks know by a NULL reply. */
+static void clusterShardReleaseChannels(valkeyClusterAsyncContext *acc) {
+    dict *channels = acc->shard_channels;
+    dictIterator di;
+    dictEntry *de;
 
-    va_start(ap, format);
-    ret = valkeyClustervAsyncCommand(acc, fn, privdata, format, ap);
-    va_end(ap);
+    if (acc->shard_timer != NULL) {
+        acc->timer_cancel_fn(acc->attach_data, acc->shard_timer);
+        acc->shard_timer = NULL;
+    }
+    if (channels == NULL)
+        return;
 
-    return ret;
+    acc->shard_channels = NULL;
+    dictInitIterator(&di, channels);
+    while ((de = dictNext(&di)) != NULL) {
+        cluster_shard_channel *ch = dictGetVal(de);
+        ch->fn(acc, NULL, ch->privdata);
+        clusterShardChannelFree(ch);
+    }
+    dictRelease(channels);
 }
 
-int valkeyClusterAsyncCommandToNode(valkeyClusterAsyncContext *acc,
-                                    valkeyClusterNode *node,
-                                    valkeyClusterCallbackFn *fn, void *privdata,
-                                    const char *format, ...) {
-    int ret;
-    va_list ap;
-    int len;
-    char *cmd = NULL;
-
-    /* Allocate cmd and encode the variadic command */
-    va_start(ap, format);
-    len = valkeyvFormatCommand(&cmd, format, ap);
-    va_end(ap);
+int valkeyClusterAsyncSsubscribe(valkeyClusterAsyncContext *acc,
+                                 valkeyClusterCallbackFn *fn, void *privdata,
+                                 int count, const char **channels,
+                                 const size_t *channellen) {
+    cluster_shard_channel *ch;
 
-    if (len == -1) {
-        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "Out of memory");
+    if (acc == NULL || fn == NULL || count <= 0 || channels == NULL) {
         return VALKEY_ERR;
-    } else if (len == -2) {
-        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER,
-                                   "Invalid format string");
+    }
+    if (acc->cc.flags & VALKEY_FLAG_DISCONNECTING) {
+        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OTHER, "disconnecting");
         return VALKEY_ERR;
     }
 
-    ret = valkeyClusterAsyncFormattedCommandToNode(acc, node, fn, privdata, cmd,
-                                                   len);
-    vk_free(cmd);
-    return ret;
-}
+    if (acc->shard_channels == NULL) {
+        acc->shard_channels = dictCreate(&clusterShardChannelsDictType);
+        if (acc->shard_channels == NULL)
+            goto oom;
+    }
 
-int valkeyClusterAsyncCommandArgv(valkeyClusterAsyncContext *acc,
-                                  valkeyClusterCallbackFn *fn, void *privdata,
-                                  int argc, const char **argv,
-                                  const size_t *argvlen) {
-    int ret;
-    char *cmd;
-    int len;
+    for (int i = 0; i < count; i++) {
+        size_t len = channellen ? channellen[i] : strlen(channels[i]);
 
-    len = valkeyFormatCommandArgv(&cmd, argc, argv, argvlen);
-    if (len == -1) {
-        valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
-        return VALKEY_ERR;
-    }
+        ch = clusterShardFind(acc->shard_channels, channels[i], len);
+        if (ch != NULL) {
+            /* Already subscribed to, only replace the callback. */
+            ch->fn = fn;
+            ch->privdata = privdata;
+            continue;
+        }
 
-    ret = valkeyClusterAsyncFormattedCommand(acc, fn, privdata, cmd, len);
+        ch = vk_calloc(1, sizeof(*ch));
+        if (ch == NULL)
+            goto oom;
+        ch->name = sdsnewlen(channels[i], len);
+        if (ch->name == NULL) {
+            vk_free(ch);
+            goto oom;
+        }
+        ch->slot = keyHashSlot(ch->name, (int)len);
+        ch->fn = fn;
+        ch->privdata = privdata;
+        if (dictAdd(acc->shard_channels, ch->name, ch) != DICT_OK) {
+            clusterShardChannelFree(ch);
+            goto oom;
+        }
+    }
 
-    vk_free(cmd);
+    acc->cc.flags |= VALKEY_FLAG_SHARDED_PUBSUB;
+    clusterShardResubscribe(acc);
+    return VALKEY_OK;
 
-    return ret;
+oom:
+    /* Channels added before the failure are kept. */
+    valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
+    if (acc->shard_channels != NULL && dictSize(acc->shard_channels) > 0) {
+        acc->cc.flags |= VALKEY_FLAG_SHARDED_PUBSUB;
+        clusterShardResubscribe(acc);
+    }
+    return VALKEY_ERR;
 }
 
-int valkeyClusterAsyncCommandArgvToNode(valkeyClusterAsyncContext *acc,
-                                        valkeyClusterNode *node,
-                                        valkeyClusterCallbackFn *fn,
-                                        void *privdata, int argc,
-                                        const char **argv,
-                                        const size_t *argvlen) {
+int valkeyClusterAsyncSunsubscribe(valkeyClusterAsyncContext *acc, int count,
+                                   const char **channels,
+                                   const size_t *channellen) {
+    cluster_shard_channel **removed;
+    size_t n = 0;
 
-    int ret;
-    char *cmd;
-    int len;
+    if (acc == NULL || count <= 0 || channels == NULL) {
+        return VALKEY_ERR;
+    }
+    if (acc->shard_channels == NULL) {
+        return VALKEY_OK;
+    }
 
-    len = valkeyFormatCommandArgv(&cmd, argc, argv, argvlen);
-    if (len == -1) {
+    removed = vk_malloc(count * sizeof(*removed));
+    if (removed == NULL) {
         valkeyClusterAsyncSetError(acc, VALKEY_ERR_OOM, "Out of memory");
         return VALKEY_ERR;
     }
 
-    ret = valkeyClusterAsyncFormattedCommandToNode(acc, node, fn, privdata, cmd,
-                                                   len);
-
-    vk_free(cmd);
-
-    return ret;
+    /* The callbacks are not called for the channels from now on. */
+    for (int i = 0; i < count; i++) {
+        size_t len = channellen ? channellen[i] : strlen(channels[i]);
+        cluster_shard_channel *ch = clusterShardFind(acc->shard_channels,
+                                                     channels[i], len);
+        if (ch == NULL)
+            continue;
+        dictDelete(acc->shard_channels, ch->name);
+        removed[n++] = ch;
+    }
+
+    /* Unsubscribe on the connections the channels are subscribed on. Errors
+     * are ignored since a failed connection has no subscriptions left. */
+    qsort(removed, n, sizeof(*removed), clusterShardChannelCmp);
+    size_t i, j;
+    for (i = 0; i < n; i = j) {
+        for (j = i + 1; j < n && removed[j]->slot == removed[i]->slot &&
+                        removed[j]->ac == removed[i]->ac;
+             j++)
+            ;
+        if (removed[i]->ac != NULL)
+            clusterShardSend(acc, removed[i]->ac, "SUNSUBSCRIBE", &removed[i],
+                             j - i);
+    }
+
+    for (i = 0; i < n; i++)
+        clusterShardChannelFree(removed[i]);
+    vk_free(removed);
+    return VALKEY_OK;
 }
 
 void valkeyClusterAsyncDisconnect(valkeyClusterAsyncContext *acc) {
@@ -3312,7 +7084,13 @@ void valkeyClusterAsyncDisconnect(valkeyClusterAsyncContext *acc) {
     }
 
     cc = &acc->cc;
+    /* Submit held back commands, which are replied before the disconnect. */
+    if (clusterAsyncFlushPipeline(acc) != VALKEY_OK)
+        return; /* Freed from a callback. */
     cc->flags |= VALKEY_FLAG_DISCONNECTING;
+    clusterAsyncCancelRetries(acc);
+    clusterAsyncCancelRefresh(acc);
+    clusterShardReleaseChannels(acc);
 
     dictIterator di;
     dictInitIterator(&di, cc->nodes);
@@ -3320,6 +7098,13 @@ void valkeyClusterAsyncDisconnect(valkeyClusterAsyncContext *acc) {
     while ((de = dictNext(&di)) != NULL) {
         node = dictGetVal(de);
 
+        for (int i = 0; i < node->pool_size; i++) {
+            if (node->pool[i].acon != NULL)
+                valkeyAsyncDisconnect(node->pool[i].acon);
+        }
+        if (node->pubsub != NULL && node->pubsub->acon != NULL)
+            valkeyAsyncDisconnect(node->pubsub->acon);
+
         ac = node->acon;
 
         if (ac == NULL) {
@@ -3330,13 +7115,28 @@ void valkeyClusterAsyncDisconnect(valkeyClusterAsyncContext *acc) {
     }
 }
 
+static void clusterAsyncFree(valkeyClusterAsyncContext *acc) {
+    valkeyClusterContext *cc = &acc->cc;
+    cc->flags |= VALKEY_FLAG_DISCONNECTING;
+    clusterAsyncCancelRetries(acc);
+    clusterAsyncCancelRefresh(acc);
+    clusterAsyncCancelPipeline(acc);
+    clusterShardReleaseChannels(acc);
+    if (acc->retries != NULL)
+        listRelease(acc->retries);
+    valkeyClusterFree(cc);
+}
+
 void valkeyClusterAsyncFree(valkeyClusterAsyncContext *acc) {
     if (acc == NULL)
         return;
 
-    valkeyClusterContext *cc = &acc->cc;
-    cc->flags |= VALKEY_FLAG_DISCONNECTING;
-    valkeyClusterFree(cc);
+    /* Freed when the callbacks have returned. */
+    if (acc->cc.flags & VALKEY_FLAG_IN_CALLBACK) {
+        acc->cc.flags |= VALKEY_FLAG_FREEING | VALKEY_FLAG_DISCONNECTING;
+        return;
+    }
+    clusterAsyncFree(acc);
 }
 
 struct nodeIterator {
@@ -3382,13 +7182,316 @@ valkeyClusterNode *valkeyClusterNodeNext(valkeyClusterNodeIterator *iter) {
         return NULL;
 }
 
+/* Get a copy of the statistics of a node. The statistics are zero when no
+ * command has been sent to the node. */
+void valkeyClusterNodeGetStats(const valkeyClusterNode *node,
+                               valkeyClusterNodeStats *stats) {
+    if (node->stats != NULL)
+        *stats = *node->stats;
+    else
+        memset(stats, 0, sizeof(*stats));
+}
+
+static void addMemoryUsage(valkeyMemoryUsage *usage,
+                           const valkeyMemoryUsage *add) {
+    usage->obuf += add->obuf;
+    usage->reader += add->reader;
+    usage->callbacks += add->callbacks;
+    usage->subscriptions += add->subscriptions;
+    usage->total += add->total;
+}
+
+static void addConnMemoryUsage(valkeyMemoryUsage *usage, valkeyContext *c,
+                               valkeyAsyncContext *ac) {
+    valkeyMemoryUsage conn;
+
+    if (c != NULL) {
+        valkeyGetMemoryUsage(c, &conn);
+        addMemoryUsage(usage, &conn);
+    }
+    if (ac != NULL) {
+        valkeyAsyncGetMemoryUsage(ac, &conn);
+        addMemoryUsage(usage, &conn);
+    }
+}
+
+/* Get the memory held by the connections to a node. */
+void valkeyClusterNodeGetMemoryUsage(const valkeyClusterNode *node,
+                                     valkeyMemoryUsage *usage) {
+    memset(usage, 0, sizeof(*usage));
+    addConnMemoryUsage(usage, node->con, node->acon);
+    for (int i = 0; i < node->pool_size; i++)
+        addConnMemoryUsage(usage, node->pool[i].con, node->pool[i].acon);
+    if (node->pubsub != NULL)
+        addConnMemoryUsage(usage, NULL, node->pubsub->acon);
+}
+
+/* Get the memory held by the connections to all nodes. */
+void valkeyClusterGetMemoryUsage(valkeyClusterContext *cc,
+                                 valkeyMemoryUsage *usage) {
+    valkeyMemoryUsage node_usage;
+    dictIterator di;
+    dictEntry *de;
+
+    memset(usage, 0, sizeof(*usage));
+    if (cc->nodes != NULL) {
+        dictInitIterator(&di, cc->nodes);
+        while ((de = dictNext(&di)) != NULL) {
+            valkeyClusterNodeGetMemoryUsage(dictGetVal(de), &node_usage);
+            addMemoryUsage(usage, &node_usage);
+        }
+    }
+    /* Checked out connections of removed nodes. */
+    if (cc->checkouts != NULL) {
+        dictInitIterator(&di, cc->checkouts);
+        while ((de = dictNext(&di)) != NULL) {
+            cluster_checkout *checkout = dictGetVal(de);
+            if (checkout->conn == NULL)
+                addConnMemoryUsage(usage, checkout->con, NULL);
+        }
+    }
+}
+
+/* Size of the commands in a list of cluster_async_data. */
+static size_t heldCommandsSize(struct hilist *list) {
+    size_t size = 0;
+
+    if (list == NULL)
+        return 0;
+    for (listNode *ln = listFirst(list); ln != NULL; ln = listNextNode(ln)) {
+        cluster_async_data *cad = listNodeValue(ln);
+        size += cad->command->clen;
+    }
+    return size;
+}
+
+/* Get the memory held by the connections to all nodes, including commands
+ * held back by auto-pipelining or waiting for a delayed retry. */
+void valkeyClusterAsyncGetMemoryUsage(valkeyClusterAsyncContext *acc,
+                                      valkeyMemoryUsage *usage) {
+    size_t held;
+
+    valkeyClusterGetMemoryUsage(&acc->cc, usage);
+    held = heldCommandsSize(acc->retries);
+    if (acc->pipeline != NULL) {
+        dictIterator di;
+        dictEntry *de;
+        dictInitIterator(&di, acc->pipeline);
+        while ((de = dictNext(&di)) != NULL)
+            held += heldCommandsSize(dictGetVal(de));
+    }
+    usage->obuf += held;
+    usage->total += held;
+}
+
+/* Reset the statistics of a node, except for the number of commands in
+ * flight which are still to be accounted for. */
+void valkeyClusterNodeResetStats(valkeyClusterNode *node) {
+    if (node->stats == NULL)
+        return;
+    uint64_t in_flight = node->stats->in_flight;
+    memset(node->stats, 0, sizeof(*node->stats));
+    node->stats->in_flight = in_flight;
+}
+
+/* Get a latency percentile, between 0 and 100, from node statistics. The
+ * returned value is the upper bound of the histogram bucket containing the
+ * percentile, capped by the highest latency measured. */
+uint64_t valkeyClusterNodeStatsPercentile(const valkeyClusterNodeStats *stats,
+                                          double percentile) {
+    uint64_t total = 0, seen = 0, rank;
+
+    for (unsigned int i = 0; i < VALKEY_NODE_STATS_BUCKETS; i++)
+        total += stats->latency[i];
+    if (total == 0)
+        return 0;
+
+    if (percentile <= 0)
+        rank = 1;
+    else if (percentile >= 100)
+        rank = total;
+    else
+        rank = (uint64_t)(percentile / 100 * (double)total + 0.5);
+    if (rank == 0)
+        rank = 1;
+
+    for (unsigned int i = 0; i < VALKEY_NODE_STATS_BUCKETS; i++) {
+        seen += stats->latency[i];
+        if (seen >= rank) {
+            uint64_t max = latencyBucketMax(i);
+            return max < stats->latency_max_usec ? max : stats->latency_max_usec;
+        }
+    }
+    return stats->latency_max_usec;
+}
+
 /* Get hash slot for given key string, which can include hash tags */
 unsigned int valkeyClusterGetSlotByKey(char *key) {
     return keyHashSlot(key, strlen(key));
 }
 
+/* Get hash slots for a batch of keys, which can include hash tags. The slot of
+ * the key `keys[i]` with length `keylens[i]` is stored in `slots[i]`. */
+void valkeyClusterGetSlotsByKeys(const char **keys, const size_t *keylens,
+                                 size_t count, unsigned int *slots) {
+    for (size_t i = 0; i < count; i++)
+        slots[i] = keyHashSlot(keys[i], (int)keylens[i]);
+}
+
+/* Get the hash slot of the first key in a formatted command. Returns -1 when
+ * the command can't be parsed or has no keys. */
+int valkeyClusterGetSlotByCommand(const char *cmd, size_t len) {
+    struct cmd *command;
+    int slot = -1;
+
+    if (cmd == NULL || len == 0)
+        return -1;
+
+    command = command_get();
+    if (command == NULL)
+        return -1;
+    command->cmd = (char *)cmd;
+    command->clen = len;
+
+    valkey_parse_cmd(command);
+    if (command->result == CMD_PARSE_OK && command->key.len > 0)
+        slot = keyHashSlot(command->key.start, command->key.len);
+
+    command->cmd = NULL; /* Not owned. */
+    command_destroy(command);
+    return slot;
+}
+
 /* Get node that handles given key string, which can include hash tags */
 valkeyClusterNode *valkeyClusterGetNodeByKey(valkeyClusterContext *cc,
                                              char *key) {
     return node_get_by_table(cc, keyHashSlot(key, strlen(key)));
 }
+
+/* Create a reply object that is freeable using freeReplyObject(). */
+static valkeyReply *createClusterReply(int type) {
+    valkeyReply *r = vk_calloc(1, sizeof(*r));
+    if (r == NULL)
+        return NULL;
+    r->type = type;
+    return r;
+}
+
+static valkeyReply *createClusterErrorReply(const char *str) {
+    valkeyReply *r = createClusterReply(VALKEY_REPLY_ERROR);
+    if (r == NULL)
+        return NULL;
+    r->len = strlen(str);
+    r->str = vk_malloc(r->len + 1);
+    if (r->str == NULL) {
+        vk_free(r);
+        return NULL;
+    }
+    memcpy(r->str, str, r->len + 1);
+    return r;
+}
+
+/* Deep copy of a reply. */
+static valkeyReply *clusterReplyDup(const valkeyReply *r) {
+    valkeyReply *dup = createClusterReply(r->type);
+    if (dup == NULL)
+        return NULL;
+
+    dup->integer = r->integer;
+    dup->dval = r->dval;
+    if (r->type == VALKEY_REPLY_VERB)
+        memcpy(dup->vtype, r->vtype, sizeof(dup->vtype));
+    if (r->str != NULL) {
+        dup->str = vk_malloc(r->len + 1);
+        if (dup->str == NULL)
+            goto oom;
+        memcpy(dup->str, r->str, r->len + 1);
+        dup->len = r->len;
+    }
+    if (r->element != NULL) {
+        dup->element = vk_calloc(r->elements, sizeof(*dup->element));
+        if (dup->element == NULL)
+            goto oom;
+        dup->elements = r->elements;
+        for (size_t i = 0; i < r->elements; i++) {
+            if ((dup->element[i] = clusterReplyDup(r->element[i])) == NULL)
+                goto oom;
+        }
+    }
+    return dup;
+
+oom:
+    freeReplyObject(dup);
+    return NULL;
+}
+
+/* Free all replies except the one given by `keep`. */
+static void freeRepliesExcept(valkeyReply **replies, size_t count,
+                              const valkeyReply *keep) {
+    for (size_t i = 0; i < count; i++) {
+        if (replies[i] != keep)
+            freeReplyObject(replies[i]);
+    }
+}
+
+valkeyReply *valkeyClusterReduceSum(valkeyReply **replies, size_t count) {
+    valkeyReply *reply = NULL;
+    long long sum = 0;
+
+    for (size_t i = 0; i < count && reply == NULL; i++) {
+        if (replies[i]->type == VALKEY_REPLY_ERROR) {
+            reply = replies[i];
+        } else if (replies[i]->type == VALKEY_REPLY_INTEGER) {
+            sum += replies[i]->integer;
+        } else {
+            /* NULL is returned if the error reply can't be allocated. */
+            reply = createClusterErrorReply("ERR reply is not an integer");
+            freeRepliesExcept(replies, count, NULL);
+            return reply;
+        }
+    }
+    freeRepliesExcept(replies, count, reply);
+    if (reply != NULL)
+        return reply;
+
+    reply = createClusterReply(VALKEY_REPLY_INTEGER);
+    if (reply != NULL)
+        reply->integer = sum;
+    return reply;
+}
+
+valkeyReply *valkeyClusterReduceConcat(valkeyReply **replies, size_t count) {
+    valkeyReply *reply = createClusterReply(VALKEY_REPLY_ARRAY);
+    if (reply != NULL && count > 0) {
+        reply->element = vk_malloc(count * sizeof(*reply->element));
+        if (reply->element == NULL) {
+            vk_free(reply);
+            reply = NULL;
+        }
+    }
+    if (reply == NULL) {
+        freeRepliesExcept(replies, count, NULL);
+        return NULL;
+    }
+
+    memcpy(reply->element, replies, count * sizeof(*reply->element));
+    reply->elements = count;
+    return reply;
+}
+
+valkeyReply *valkeyClusterReduceFirstError(valkeyReply **replies,
+                                           size_t count) {
+    valkeyReply *reply = NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        if (replies[i]->type == VALKEY_REPLY_ERROR) {
+            reply = replies[i];
+            break;
+        }
+    }
+    if (reply == NULL) {
+        reply = count > 0 ? replies[0] : createClusterReply(VALKEY_REPLY_NIL);
+    }
+    freeRepliesExcept(replies, count, reply);
+    return reply;
+}
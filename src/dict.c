@@ -283,6 +283,24 @@ dictEntry *dictFind(dict *ht, const void *key) {
     return NULL;
 }
 
+/* Search using the hash of a key and a function matching the keys of the
+ * entries, which allows a lookup without creating a key object. */
+dictEntry *dictFindByHash(dict *ht, uint64_t hash,
+                          int (*match)(const void *key, const void *privdata),
+                          const void *privdata) {
+    dictEntry *he;
+
+    if (ht->size == 0)
+        return NULL;
+    he = ht->table[hash & ht->sizemask];
+    while (he) {
+        if (match(he->key, privdata))
+            return he;
+        he = he->next;
+    }
+    return NULL;
+}
+
 void dictSetKey(dict *d, dictEntry *de, void *key) {
     if (d->type->keyDup)
         de->key = d->type->keyDup(key);
@@ -303,6 +321,11 @@ void *dictGetVal(const dictEntry *de) {
     return de->val;
 }
 
+/* Memory used by the table and the entries, not including keys and values. */
+size_t dictMemUsage(const dict *ht) {
+    return ht->size * sizeof(dictEntry *) + ht->used * sizeof(dictEntry);
+}
+
 void dictInitIterator(dictIterator *iter, dict *ht) {
     iter->ht = ht;
     iter->index = -1;
@@ -36,6 +36,7 @@
 #ifndef __DICT_H
 #define __DICT_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define DICT_OK 0
@@ -96,10 +97,14 @@ int dictReplace(dict *ht, void *key, void *val);
 int dictDelete(dict *ht, const void *key);
 void dictRelease(dict *ht);
 dictEntry *dictFind(dict *ht, const void *key);
+dictEntry *dictFindByHash(dict *ht, uint64_t hash,
+                          int (*match)(const void *key, const void *privdata),
+                          const void *privdata);
 void dictSetKey(dict *d, dictEntry *de, void *key);
 void dictSetVal(dict *d, dictEntry *de, void *val);
 void *dictGetKey(const dictEntry *de);
 void *dictGetVal(const dictEntry *de);
+size_t dictMemUsage(const dict *ht);
 void dictInitIterator(dictIterator *iter, dict *ht);
 dictEntry *dictNext(dictIterator *iter);
 
@@ -590,6 +590,7 @@ static int processAggregateItem(valkeyReader *r) {
                 r->task[r->ridx]->obj = NULL;
                 r->task[r->ridx]->parent = cur;
                 r->task[r->ridx]->privdata = r->privdata;
+                r->task[r->ridx]->allocator = r->allocator;
             } else {
                 moveToNextTask(r);
             }
@@ -842,6 +843,7 @@ int valkeyReaderGetReply(valkeyReader *r, void **reply) {
         r->task[0]->obj = NULL;
         r->task[0]->parent = NULL;
         r->task[0]->privdata = r->privdata;
+        r->task[0]->allocator = r->allocator;
         r->ridx = 0;
     }
 
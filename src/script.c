@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2026, the libvalkey contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "fmacros.h"
+#include "win32.h"
+
+#include "script_private.h"
+
+#include "alloc.h"
+#include "valkey_private.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+struct valkeyScript {
+    sds body;
+    char sha[41];
+    int refcount; /* One for the handle and one per call in progress. */
+};
+
+/* SHA1 (FIPS 180-4), only used to name scripts. */
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1Transform(uint32_t state[5], const unsigned char block[64]) {
+    uint32_t w[80], a, b, c, d, e, f, k, t;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+    }
+    for (i = 16; i < 80; i++)
+        w[i] = ROL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    for (i = 0; i < 80; i++) {
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        t = ROL32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROL32(b, 30);
+        b = a;
+        a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+static void sha1Hex(const char *data, size_t len, char *hex) {
+    static const char digits[] = "0123456789abcdef";
+    uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    const unsigned char *p = (const unsigned char *)data;
+    unsigned char block[64];
+    uint64_t bits = (uint64_t)len * 8;
+    size_t rest;
+    int i;
+
+    for (; len >= 64; p += 64, len -= 64)
+        sha1Transform(state, p);
+
+    /* Pad with a one bit, zeros and the length in bits. */
+    rest = len;
+    memcpy(block, p, rest);
+    block[rest++] = 0x80;
+    if (rest > 56) {
+        memset(block + rest, 0, 64 - rest);
+        sha1Transform(state, block);
+        rest = 0;
+    }
+    memset(block + rest, 0, 56 - rest);
+    for (i = 0; i < 8; i++)
+        block[56 + i] = (unsigned char)(bits >> (56 - i * 8));
+    sha1Transform(state, block);
+
+    for (i = 0; i < 20; i++) {
+        unsigned char byte = (unsigned char)(state[i / 4] >> (24 - (i % 4) * 8));
+        hex[i * 2] = digits[byte >> 4];
+        hex[i * 2 + 1] = digits[byte & 0xf];
+    }
+    hex[40] = '\0';
+}
+
+valkeyScript *valkeyScriptCreate(const char *body, size_t len) {
+    valkeyScript *script;
+
+    if (body == NULL)
+        return NULL;
+
+    script = vk_calloc(1, sizeof(*script));
+    if (script == NULL)
+        return NULL;
+    script->body = sdsnewlen(body, len);
+    if (script->body == NULL) {
+        vk_free(script);
+        return NULL;
+    }
+    sha1Hex(body, len, script->sha);
+    script->refcount = 1;
+    return script;
+}
+
+void valkeyScriptRetain(valkeyScript *script) {
+    script->refcount++;
+}
+
+void valkeyScriptFree(valkeyScript *script) {
+    if (script == NULL || --script->refcount > 0)
+        return;
+    sdsfree(script->body);
+    vk_free(script);
+}
+
+const char *valkeyScriptGetSha(const valkeyScript *script) {
+    return script->sha;
+}
+
+sds valkeyScriptFormatCall(const valkeyScript *script, int numkeys, int argc,
+                           const char **argv, const size_t *argvlen) {
+    const char **cargv;
+    size_t *cargvlen;
+    char numkeysstr[16];
+    sds cmd = NULL;
+
+    if (numkeys < 0 || argc < numkeys)
+        return NULL;
+
+    cargv = vk_malloc((argc + 3) * sizeof(char *));
+    cargvlen = vk_malloc((argc + 3) * sizeof(size_t));
+    if (cargv == NULL || cargvlen == NULL)
+        goto done;
+
+    cargv[0] = "EVALSHA";
+    cargvlen[0] = 7;
+    cargv[1] = script->sha;
+    cargvlen[1] = 40;
+    cargvlen[2] = snprintf(numkeysstr, sizeof(numkeysstr), "%d", numkeys);
+    cargv[2] = numkeysstr;
+    for (int i = 0; i < argc; i++) {
+        cargv[i + 3] = argv[i];
+        cargvlen[i + 3] = argvlen ? argvlen[i] : strlen(argv[i]);
+    }
+
+    if (valkeyFormatSdsCommandArgv(&cmd, argc + 3, cargv, cargvlen) < 0)
+        cmd = NULL;
+
+done:
+    vk_free(cargv);
+    vk_free(cargvlen);
+    return cmd;
+}
+
+sds valkeyScriptFormatEval(const valkeyScript *script, const char *cmd,
+                           size_t len) {
+    /* The EVALSHA command and the digest are replaced, i.e. the bulk strings
+     * "$7\r\nEVALSHA\r\n$40\r\n<sha>\r\n" following the multibulk count. */
+    static const size_t shalen = 13 + 47;
+    const char *p = memchr(cmd, '\n', len);
+    sds eval;
+
+    if (p == NULL || (size_t)(cmd + len - (p + 1)) < shalen)
+        return NULL;
+    p++;
+
+    eval = sdsnewlen(cmd, p - cmd);
+    if (eval == NULL)
+        return NULL;
+    eval = sdscatfmt(eval, "$4\r\nEVAL\r\n$%U\r\n", (unsigned long long)sdslen(script->body));
+    if (eval != NULL)
+        eval = sdscatsds(eval, script->body);
+    if (eval != NULL)
+        eval = sdscatlen(eval, "\r\n", 2);
+    if (eval != NULL)
+        eval = sdscatlen(eval, p + shalen, cmd + len - (p + shalen));
+    return eval;
+}
+
+int valkeyScriptIsNoscript(const valkeyReply *reply) {
+    return reply->type == VALKEY_REPLY_ERROR && reply->len >= 8 &&
+           memcmp(reply->str, "NOSCRIPT", 8) == 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2026, the libvalkey contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VALKEY_SCRIPT_PRIVATE_H
+#define VALKEY_SCRIPT_PRIVATE_H
+
+#include "script.h"
+#include "valkey.h"
+
+#include <sds.h>
+
+/* Keep the script while a call is in progress, released by valkeyScriptFree(). */
+void valkeyScriptRetain(valkeyScript *script);
+
+/* Format EVALSHA for the script, where the first `numkeys` of the arguments
+ * are keys. Returns NULL when out of memory. */
+sds valkeyScriptFormatCall(const valkeyScript *script, int numkeys, int argc,
+                           const char **argv, const size_t *argvlen);
+
+/* Convert a formatted EVALSHA to EVAL with the script body. */
+sds valkeyScriptFormatEval(const valkeyScript *script, const char *cmd,
+                           size_t len);
+
+/* Returns 1 if the reply is a NOSCRIPT error. */
+int valkeyScriptIsNoscript(const valkeyReply *reply);
+
+#endif /* VALKEY_SCRIPT_PRIVATE_H */
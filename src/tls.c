@@ -66,12 +66,57 @@
 
 #define OPENSSL_1_1_0 0x10100000L
 
+#ifdef _WIN32
+typedef CRITICAL_SECTION sslLockType;
+static void sslLockInit(sslLockType *l) {
+    InitializeCriticalSection(l);
+}
+static void sslLockAcquire(sslLockType *l) {
+    EnterCriticalSection(l);
+}
+static void sslLockRelease(sslLockType *l) {
+    LeaveCriticalSection(l);
+}
+static void sslLockDestroy(sslLockType *l) {
+    DeleteCriticalSection(l);
+}
+#else
+typedef pthread_mutex_t sslLockType;
+static void sslLockInit(sslLockType *l) {
+    pthread_mutex_init(l, NULL);
+}
+static void sslLockAcquire(sslLockType *l) {
+    pthread_mutex_lock(l);
+}
+static void sslLockRelease(sslLockType *l) {
+    pthread_mutex_unlock(l);
+}
+static void sslLockDestroy(sslLockType *l) {
+    pthread_mutex_destroy(l);
+}
+#endif
+
+/* A session for resumption, cached per server endpoint. */
+typedef struct tlsCachedSession {
+    char *endpoint; /* "host:port" or the path of a unix socket */
+    SSL_SESSION *session;
+    uint64_t last_used; /* For evicting the least recently used */
+} tlsCachedSession;
+
 struct valkeyTLSContext {
     /* Associated OpenSSL SSL_CTX as created by valkeyCreateTLSContext() */
     SSL_CTX *ssl_ctx;
 
     /* Requested SNI, or NULL */
     char *server_name;
+
+    /* Session cache, see `session_cache_size`. The connections, possibly in
+     * multiple threads, hold the endpoint in the ex_data of their SSL. */
+    tlsCachedSession *sessions;
+    int sessions_size;
+    int sessions_used;
+    uint64_t sessions_clock;
+    sslLockType sessions_lock;
 };
 
 /* The TLS connection context is attached to TLS connections as a privdata. */
@@ -110,30 +155,6 @@ static valkeyContextFuncs valkeyContextTLSFuncs;
 #endif
 
 #ifdef VALKEY_USE_CRYPTO_LOCKS
-#ifdef _WIN32
-typedef CRITICAL_SECTION sslLockType;
-static void sslLockInit(sslLockType *l) {
-    InitializeCriticalSection(l);
-}
-static void sslLockAcquire(sslLockType *l) {
-    EnterCriticalSection(l);
-}
-static void sslLockRelease(sslLockType *l) {
-    LeaveCriticalSection(l);
-}
-#else
-typedef pthread_mutex_t sslLockType;
-static void sslLockInit(sslLockType *l) {
-    pthread_mutex_init(l, NULL);
-}
-static void sslLockAcquire(sslLockType *l) {
-    pthread_mutex_lock(l);
-}
-static void sslLockRelease(sslLockType *l) {
-    pthread_mutex_unlock(l);
-}
-#endif
-
 static sslLockType *ossl_locks;
 
 static void opensslDoLock(int mode, int lkid, const char *f, int line) {
@@ -214,13 +235,187 @@ void valkeyFreeTLSContext(valkeyTLSContext *ctx) {
     }
 
     if (ctx->ssl_ctx) {
+        /* Connections still using the SSL_CTX no longer cache sessions. */
+        SSL_CTX_set_app_data(ctx->ssl_ctx, NULL);
         SSL_CTX_free(ctx->ssl_ctx);
         ctx->ssl_ctx = NULL;
     }
 
+    if (ctx->sessions) {
+        for (int i = 0; i < ctx->sessions_used; i++) {
+            vk_free(ctx->sessions[i].endpoint);
+            SSL_SESSION_free(ctx->sessions[i].session);
+        }
+        vk_free(ctx->sessions);
+        sslLockDestroy(&ctx->sessions_lock);
+    }
+
     vk_free(ctx);
 }
 
+/**
+ * TLS session cache.
+ */
+
+static void tlsFreeEndpoint(void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+                            int idx, long argl, void *argp) {
+    (void)parent;
+    (void)ad;
+    (void)idx;
+    (void)argl;
+    (void)argp;
+    vk_free(ptr);
+}
+
+/* The ex_data index holding the endpoint of a connection. It's shared by all
+ * contexts and allocated once, since OpenSSL never releases an index. */
+static int sessionExIndex = -1;
+
+static void tlsAllocSessionExIndex(void) {
+    sessionExIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, tlsFreeEndpoint);
+}
+
+#ifdef _WIN32
+static INIT_ONCE sessionExIndexOnce = INIT_ONCE_STATIC_INIT;
+static BOOL CALLBACK tlsAllocSessionExIndexOnce(PINIT_ONCE once, PVOID param, PVOID *context) {
+    (void)once;
+    (void)param;
+    (void)context;
+    tlsAllocSessionExIndex();
+    return TRUE;
+}
+#else
+static pthread_once_t sessionExIndexOnce = PTHREAD_ONCE_INIT;
+#endif
+
+/* Returns the ex_data index for the endpoints, or -1 if it can't be
+ * allocated. */
+static int tlsGetSessionExIndex(void) {
+#ifdef _WIN32
+    InitOnceExecuteOnce(&sessionExIndexOnce, tlsAllocSessionExIndexOnce, NULL, NULL);
+#else
+    pthread_once(&sessionExIndexOnce, tlsAllocSessionExIndex);
+#endif
+    return sessionExIndex;
+}
+
+static int tlsSessionIsResumable(const SSL_SESSION *session) {
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    return SSL_SESSION_is_resumable(session);
+#else
+    (void)session;
+    return 1;
+#endif
+}
+
+/* Find the cached session of an endpoint. Called with the lock held. */
+static tlsCachedSession *tlsFindSession(valkeyTLSContext *ctx, const char *endpoint) {
+    for (int i = 0; i < ctx->sessions_used; i++) {
+        if (strcmp(ctx->sessions[i].endpoint, endpoint) == 0)
+            return &ctx->sessions[i];
+    }
+    return NULL;
+}
+
+/* Called by OpenSSL when a session is established, or when a TLS 1.3 ticket
+ * is received after the handshake. Returns 1 when the session is kept. */
+static int tlsNewSessionCallback(SSL *ssl, SSL_SESSION *session) {
+    valkeyTLSContext *ctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+    const char *endpoint;
+    tlsCachedSession *entry;
+    char *copy = NULL;
+
+    if (ctx == NULL || !tlsSessionIsResumable(session))
+        return 0;
+    endpoint = SSL_get_ex_data(ssl, sessionExIndex);
+    if (endpoint == NULL)
+        return 0;
+
+    sslLockAcquire(&ctx->sessions_lock);
+    entry = tlsFindSession(ctx, endpoint);
+    if (entry == NULL) {
+        if ((copy = vk_strdup(endpoint)) == NULL) {
+            sslLockRelease(&ctx->sessions_lock);
+            return 0;
+        }
+        if (ctx->sessions_used < ctx->sessions_size) {
+            entry = &ctx->sessions[ctx->sessions_used++];
+        } else {
+            /* Replace the least recently used endpoint. */
+            entry = &ctx->sessions[0];
+            for (int i = 1; i < ctx->sessions_used; i++) {
+                if (ctx->sessions[i].last_used < entry->last_used)
+                    entry = &ctx->sessions[i];
+            }
+            vk_free(entry->endpoint);
+            SSL_SESSION_free(entry->session);
+        }
+        entry->endpoint = copy;
+    } else {
+        SSL_SESSION_free(entry->session);
+    }
+    entry->session = session;
+    entry->last_used = ++ctx->sessions_clock;
+    sslLockRelease(&ctx->sessions_lock);
+    return 1;
+}
+
+/* Get the endpoint of a connection as the key of the session cache. */
+static char *tlsGetEndpoint(valkeyContext *c) {
+    char *endpoint;
+    size_t len;
+
+    if (c->connection_type == VALKEY_CONN_TCP && c->tcp.host != NULL) {
+        len = strlen(c->tcp.host) + 16;
+        if ((endpoint = vk_malloc(len)) != NULL)
+            snprintf(endpoint, len, "%s:%d", c->tcp.host, c->tcp.port);
+        return endpoint;
+    }
+    if (c->connection_type == VALKEY_CONN_UNIX && c->unix_sock.path != NULL)
+        return vk_strdup(c->unix_sock.path);
+    return NULL;
+}
+
+/* Resume a cached session of the endpoint of a connection, and register the
+ * endpoint for caching the new session. */
+static int tlsUseSessionCache(valkeyTLSContext *ctx, valkeyContext *c, SSL *ssl) {
+    tlsCachedSession *entry;
+    char *endpoint;
+
+    if ((endpoint = tlsGetEndpoint(c)) == NULL)
+        return VALKEY_OK; /* Unknown endpoint, e.g. a file descriptor. */
+    if (!SSL_set_ex_data(ssl, sessionExIndex, endpoint)) {
+        vk_free(endpoint);
+        return VALKEY_ERR;
+    }
+
+    sslLockAcquire(&ctx->sessions_lock);
+    entry = tlsFindSession(ctx, endpoint);
+    if (entry != NULL) {
+        /* The SSL holds its own reference to the session. */
+        SSL_set_session(ssl, entry->session);
+        entry->last_used = ++ctx->sessions_clock;
+    }
+    sslLockRelease(&ctx->sessions_lock);
+    return VALKEY_OK;
+}
+
+static int tlsInitSessionCache(valkeyTLSContext *ctx, int size) {
+    if (tlsGetSessionExIndex() < 0)
+        return VALKEY_ERR;
+    ctx->sessions = vk_calloc(size, sizeof(*ctx->sessions));
+    if (ctx->sessions == NULL)
+        return VALKEY_ERR;
+    ctx->sessions_size = size;
+    sslLockInit(&ctx->sessions_lock);
+
+    SSL_CTX_set_app_data(ctx->ssl_ctx, ctx);
+    SSL_CTX_set_session_cache_mode(ctx->ssl_ctx, SSL_SESS_CACHE_CLIENT |
+                                                     SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx->ssl_ctx, tlsNewSessionCallback);
+    return VALKEY_OK;
+}
+
 /**
  * valkeyTLSContext helper context initialization.
  */
@@ -278,6 +473,12 @@ valkeyTLSContext *valkeyCreateTLSContextWithOptions(valkeyTLSOptions *options, v
 
     SSL_CTX_set_verify(ctx->ssl_ctx, options->verify_mode, NULL);
 
+#ifdef SSL_OP_ENABLE_KTLS
+    /* OpenSSL falls back to user space when kTLS can't be used. */
+    if (options->enable_ktls)
+        SSL_CTX_set_options(ctx->ssl_ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
     if ((cert_filename != NULL && private_key_filename == NULL) ||
         (private_key_filename != NULL && cert_filename == NULL)) {
         if (error)
@@ -341,6 +542,13 @@ valkeyTLSContext *valkeyCreateTLSContextWithOptions(valkeyTLSOptions *options, v
     if (server_name)
         ctx->server_name = vk_strdup(server_name);
 
+    if (options->session_cache_size > 0 &&
+        tlsInitSessionCache(ctx, options->session_cache_size) != VALKEY_OK) {
+        if (error)
+            *error = VALKEY_TLS_CTX_CREATE_FAILED;
+        goto error;
+    }
+
     return ctx;
 
 error:
@@ -416,6 +624,28 @@ int valkeyInitiateTLS(valkeyContext *c, SSL *ssl) {
     return valkeyTLSConnect(c, ssl);
 }
 
+int valkeyTLSIsSessionReused(valkeyContext *c) {
+    if (c == NULL || c->funcs != &valkeyContextTLSFuncs)
+        return 0;
+    return SSL_session_reused(((valkeyTLS *)c->privctx)->ssl);
+}
+
+int valkeyTLSGetKTLS(valkeyContext *c) {
+    int ktls = 0;
+
+    if (c == NULL || c->funcs != &valkeyContextTLSFuncs)
+        return 0;
+
+#ifdef BIO_get_ktls_send
+    valkeyTLS *rssl = c->privctx;
+    if (BIO_get_ktls_send(SSL_get_wbio(rssl->ssl)))
+        ktls |= VALKEY_TLS_KTLS_SEND;
+    if (BIO_get_ktls_recv(SSL_get_rbio(rssl->ssl)))
+        ktls |= VALKEY_TLS_KTLS_RECV;
+#endif
+    return ktls;
+}
+
 /**
  * A wrapper around valkeyTLSConnect() for users who use valkeyTLSContext and don't
  * manage their own OpenSSL SSL objects.
@@ -444,6 +674,12 @@ int valkeyInitiateTLSWithContext(valkeyContext *c, valkeyTLSContext *valkey_tls_
         }
     }
 
+    if (valkey_tls_ctx->sessions != NULL &&
+        tlsUseSessionCache(valkey_tls_ctx, c, ssl) != VALKEY_OK) {
+        valkeySetError(c, VALKEY_ERR_OOM, "Out of memory");
+        goto error;
+    }
+
     if (valkeyTLSConnect(c, ssl) != VALKEY_OK) {
         goto error;
     }
@@ -482,6 +718,11 @@ static void valkeyTLSFree(void *privctx) {
     if (!rsc)
         return;
     if (rsc->ssl) {
+        /* OpenSSL makes the session of a connection closed without a
+         * close_notify unresumable. Keep it for the session cache, while a
+         * fatal alert still makes it unresumable. */
+        if (SSL_CTX_get_app_data(SSL_get_SSL_CTX(rsc->ssl)) != NULL)
+            SSL_set_shutdown(rsc->ssl, SSL_get_shutdown(rsc->ssl) | SSL_SENT_SHUTDOWN);
         SSL_free(rsc->ssl);
         rsc->ssl = NULL;
     }
@@ -44,10 +44,11 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-static valkeyReply *createReplyObject(int type);
+static valkeyReply *createReplyObject(const valkeyReadTask *task, int type);
 static void *createStringObject(const valkeyReadTask *task, char *str, size_t len);
 static void *createArrayObject(const valkeyReadTask *task, size_t elements);
 static void *createIntegerObject(const valkeyReadTask *task, long long value);
@@ -66,12 +67,200 @@ static valkeyReplyObjectFunctions defaultFunctions = {
     createBoolObject,
     freeReplyObject};
 
-/* Create a reply object */
-static valkeyReply *createReplyObject(int type) {
-    valkeyReply *r = vk_calloc(1, sizeof(*r));
+/* Header in front of a reply object allocated using a context allocator,
+ * which keeps the alignment of the reply. */
+typedef union replyHeader {
+    const valkeyAllocator *allocator;
+    long long ll;
+    double d;
+} replyHeader;
+
+/* Thread-local free lists of small reply allocations, one per size class.
+ * The small allocations of a pooled reply object, i.e. the object itself, a
+ * short string and a short element vector, are rounded up to a size class
+ * and returned to the lists when freed. The freed blocks are linked using
+ * their first bytes. */
+#define FREELIST_CLASSES 3
+#define FREELIST_MIN_SIZE 16
+#define FREELIST_MAX_SIZE (FREELIST_MIN_SIZE << (FREELIST_CLASSES - 1))
+
+typedef struct replyFreelist {
+    void *head[FREELIST_CLASSES];
+    size_t bytes;    /* Memory kept in the lists. */
+    int registered; /* Trimmed when the thread exits. */
+} replyFreelist;
+
+#if defined(_MSC_VER)
+static __declspec(thread) replyFreelist freelist;
+#else
+static __thread replyFreelist freelist;
+#endif
+
+/* Memory kept per thread, 0 when the free lists are disabled. It's set by
+ * any thread and read by all threads freeing replies, so it's accessed
+ * atomically. Only its value matters, hence the relaxed ordering. */
+static size_t freelistLimit = 0;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define freelistLimitGet() __atomic_load_n(&freelistLimit, __ATOMIC_RELAXED)
+#define freelistLimitSet(v) __atomic_store_n(&freelistLimit, (v), __ATOMIC_RELAXED)
+#else
+/* Aligned pointer-sized volatile accesses are atomic on MSVC. */
+#define freelistLimitGet() (*(volatile size_t *)&freelistLimit)
+#define freelistLimitSet(v) (*(volatile size_t *)&freelistLimit = (v))
+#endif
+
+#if defined(VALKEY_USE_THREADS) && !defined(_WIN32)
+#include <pthread.h>
+
+static pthread_key_t freelistKey;
+static pthread_once_t freelistKeyOnce = PTHREAD_ONCE_INIT;
+
+static void freelistThreadExit(void *unused) {
+    (void)unused;
+    valkeyTrimReplyFreelist();
+}
 
-    if (r == NULL)
+static void freelistCreateKey(void) {
+    pthread_key_create(&freelistKey, freelistThreadExit);
+}
+
+/* Trim the free lists of a thread when it exits. */
+static void freelistRegisterThread(void) {
+    pthread_once(&freelistKeyOnce, freelistCreateKey);
+    pthread_setspecific(freelistKey, &freelist);
+    freelist.registered = 1;
+}
+#else
+static void freelistRegisterThread(void) {
+    freelist.registered = 1;
+}
+#endif
+
+/* Index of the size class of an allocation, or -1 when it's not pooled. */
+static int freelistClass(size_t size) {
+    int idx = 0;
+
+    if (size > FREELIST_MAX_SIZE)
+        return -1;
+    while ((size_t)(FREELIST_MIN_SIZE << idx) < size)
+        idx++;
+    return idx;
+}
+
+static void *freelistAlloc(size_t size) {
+    int idx = freelistClass(size);
+    void *p;
+
+    if (idx < 0)
+        return vk_malloc(size);
+
+    p = freelist.head[idx];
+    if (p == NULL)
+        return vk_malloc(FREELIST_MIN_SIZE << idx);
+    freelist.head[idx] = *(void **)p;
+    freelist.bytes -= FREELIST_MIN_SIZE << idx;
+    return p;
+}
+
+static void freelistRelease(void *p, size_t size) {
+    int idx = freelistClass(size);
+
+    if (p == NULL)
+        return;
+    if (idx < 0 || freelist.bytes + (FREELIST_MIN_SIZE << idx) > freelistLimitGet()) {
+        vk_free(p);
+        return;
+    }
+    if (!freelist.registered)
+        freelistRegisterThread();
+
+    *(void **)p = freelist.head[idx];
+    freelist.head[idx] = p;
+    freelist.bytes += FREELIST_MIN_SIZE << idx;
+}
+
+void valkeySetReplyFreelistLimit(size_t bytes) {
+    freelistLimitSet(bytes);
+    /* Other threads' lists can't be trimmed from here, they only shrink when
+     * their threads allocate from them, trim them or exit. */
+    if (freelist.bytes > bytes)
+        valkeyTrimReplyFreelist();
+}
+
+void valkeyTrimReplyFreelist(void) {
+    for (int i = 0; i < FREELIST_CLASSES; i++) {
+        while (freelist.head[i] != NULL) {
+            void *p = freelist.head[i];
+            freelist.head[i] = *(void **)p;
+            vk_free(p);
+        }
+    }
+    freelist.bytes = 0;
+}
+
+/* Get the allocator of a reply object, or NULL for the global allocators. */
+static const valkeyAllocator *replyAllocator(const valkeyReply *r) {
+    if (valkeyReplyGetOwner(r) == VALKEY_REPLY_OWNER_ALLOCATOR)
+        return ((const replyHeader *)r - 1)->allocator;
+    return NULL;
+}
+
+static int replyIsPooled(const valkeyReply *r) {
+    return valkeyReplyGetOwner(r) == VALKEY_REPLY_OWNER_POOLED;
+}
+
+/* Allocate memory owned by a reply object, i.e. a string or an element
+ * vector, in the same way as the object itself. */
+static void *replyMalloc(const valkeyReply *r, size_t size) {
+    if (replyIsPooled(r))
+        return freelistAlloc(size);
+    return vk_ctx_malloc(replyAllocator(r), size);
+}
+
+static void *replyCalloc(const valkeyReply *r, size_t nmemb, size_t size) {
+    void *p;
+
+    if (!replyIsPooled(r))
+        return vk_ctx_calloc(replyAllocator(r), nmemb, size);
+    if (SIZE_MAX / size < nmemb)
         return NULL;
+    p = freelistAlloc(nmemb * size);
+    if (p != NULL)
+        memset(p, 0, nmemb * size);
+    return p;
+}
+
+static void replyFree(const valkeyReply *r, void *ptr, size_t size) {
+    if (replyIsPooled(r))
+        freelistRelease(ptr, size);
+    else
+        vk_ctx_free(replyAllocator(r), ptr);
+}
+
+/* Create a reply object */
+static valkeyReply *createReplyObject(const valkeyReadTask *task, int type) {
+    const valkeyAllocator *a = task->allocator;
+    valkeyReply *r;
+
+    if (type == VALKEY_REPLY_VERB || (a == NULL && freelistLimitGet() == 0)) {
+        r = vk_calloc(1, sizeof(*r));
+        if (r == NULL)
+            return NULL;
+    } else if (a == NULL) {
+        r = freelistAlloc(sizeof(*r));
+        if (r == NULL)
+            return NULL;
+        memset(r, 0, sizeof(*r));
+        valkeyReplySetOwner(r, VALKEY_REPLY_OWNER_POOLED);
+    } else {
+        replyHeader *h = a->callocFn(a->privdata, 1, sizeof(*h) + sizeof(*r));
+        if (h == NULL)
+            return NULL;
+        h->allocator = a;
+        r = (valkeyReply *)(h + 1);
+        valkeyReplySetOwner(r, VALKEY_REPLY_OWNER_ALLOCATOR);
+    }
 
     r->type = type;
     return r;
@@ -80,6 +269,7 @@ static valkeyReply *createReplyObject(int type) {
 /* Free a reply object */
 void freeReplyObject(void *reply) {
     valkeyReply *r = reply;
+    const valkeyAllocator *a;
     size_t j;
 
     if (r == NULL)
@@ -98,7 +288,7 @@ void freeReplyObject(void *reply) {
         if (r->element != NULL) {
             for (j = 0; j < r->elements; j++)
                 freeReplyObject(r->element[j]);
-            vk_free(r->element);
+            replyFree(r, r->element, r->elements * sizeof(valkeyReply *));
         }
         break;
     case VALKEY_REPLY_ERROR:
@@ -107,17 +297,26 @@ void freeReplyObject(void *reply) {
     case VALKEY_REPLY_DOUBLE:
     case VALKEY_REPLY_VERB:
     case VALKEY_REPLY_BIGNUM:
-        vk_free(r->str);
+        replyFree(r, r->str, r->len + 1);
         break;
     }
-    vk_free(r);
+
+    if (replyIsPooled(r)) {
+        freelistRelease(r, sizeof(*r));
+        return;
+    }
+    a = replyAllocator(r);
+    if (a != NULL)
+        vk_ctx_free(a, (replyHeader *)r - 1);
+    else
+        vk_free(r);
 }
 
 static void *createStringObject(const valkeyReadTask *task, char *str, size_t len) {
     valkeyReply *r, *parent;
     char *buf;
 
-    r = createReplyObject(task->type);
+    r = createReplyObject(task, task->type);
     if (r == NULL)
         return NULL;
 
@@ -139,7 +338,7 @@ static void *createStringObject(const valkeyReadTask *task, char *str, size_t le
         buf[len - 4] = '\0';
         r->len = len - 4;
     } else {
-        buf = vk_malloc(len + 1);
+        buf = replyMalloc(r, len + 1);
         if (buf == NULL)
             goto oom;
 
@@ -168,12 +367,12 @@ oom:
 static void *createArrayObject(const valkeyReadTask *task, size_t elements) {
     valkeyReply *r, *parent;
 
-    r = createReplyObject(task->type);
+    r = createReplyObject(task, task->type);
     if (r == NULL)
         return NULL;
 
     if (elements > 0) {
-        r->element = vk_calloc(elements, sizeof(valkeyReply *));
+        r->element = replyCalloc(r, elements, sizeof(valkeyReply *));
         if (r->element == NULL) {
             freeReplyObject(r);
             return NULL;
@@ -197,7 +396,7 @@ static void *createArrayObject(const valkeyReadTask *task, size_t elements) {
 static void *createIntegerObject(const valkeyReadTask *task, long long value) {
     valkeyReply *r, *parent;
 
-    r = createReplyObject(VALKEY_REPLY_INTEGER);
+    r = createReplyObject(task, VALKEY_REPLY_INTEGER);
     if (r == NULL)
         return NULL;
 
@@ -221,12 +420,12 @@ static void *createDoubleObject(const valkeyReadTask *task, double value, char *
     if (len == SIZE_MAX) // Prevents vk_malloc(0) if len equals SIZE_MAX
         return NULL;
 
-    r = createReplyObject(VALKEY_REPLY_DOUBLE);
+    r = createReplyObject(task, VALKEY_REPLY_DOUBLE);
     if (r == NULL)
         return NULL;
 
     r->dval = value;
-    r->str = vk_malloc(len + 1);
+    r->str = replyMalloc(r, len + 1);
     if (r->str == NULL) {
         freeReplyObject(r);
         return NULL;
@@ -256,7 +455,7 @@ static void *createDoubleObject(const valkeyReadTask *task, double value, char *
 static void *createNilObject(const valkeyReadTask *task) {
     valkeyReply *r, *parent;
 
-    r = createReplyObject(VALKEY_REPLY_NIL);
+    r = createReplyObject(task, VALKEY_REPLY_NIL);
     if (r == NULL)
         return NULL;
 
@@ -275,7 +474,7 @@ static void *createNilObject(const valkeyReadTask *task) {
 static void *createBoolObject(const valkeyReadTask *task, int bval) {
     valkeyReply *r, *parent;
 
-    r = createReplyObject(VALKEY_REPLY_BOOL);
+    r = createReplyObject(task, VALKEY_REPLY_BOOL);
     if (r == NULL)
         return NULL;
 
@@ -805,6 +1004,7 @@ int valkeyReconnect(valkeyContext *c) {
         valkeySetError(c, VALKEY_ERR_OOM, "Out of memory");
         return VALKEY_ERR;
     }
+    c->reader->allocator = c->allocator;
 
     switch (c->connection_type) {
     case VALKEY_CONN_TCP:
@@ -884,6 +1084,9 @@ valkeyContext *valkeyConnectWithOptions(const valkeyOptions *options) {
 
     c->privdata = options->privdata;
     c->free_privdata = options->free_privdata;
+    c->allocator = options->allocator;
+    c->reader->allocator = c->allocator;
+    c->max_obuf_size = options->max_obuf_size;
     c->connection_type = options->type;
     /* Make sure we set a valkeyContextFuncs before returning any context. */
     valkeyContextSetFuncs(c);
@@ -1014,6 +1217,7 @@ int valkeyBufferRead(valkeyContext *c) {
     ssize_t nread;
 
     /* Return early when the context has seen an error. */
+    valkeyClearOutputLimitError(c);
     if (c->err)
         return VALKEY_ERR;
 
@@ -1059,6 +1263,7 @@ int valkeyBufferRead(valkeyContext *c) {
 int valkeyBufferWrite(valkeyContext *c, int *done) {
 
     /* Return early when the context has seen an error. */
+    valkeyClearOutputLimitError(c);
     if (c->err)
         return VALKEY_ERR;
 
@@ -1089,6 +1294,25 @@ oom:
     return VALKEY_ERR;
 }
 
+/* Memory of a reader, including its read buffer and its task stack. */
+static size_t valkeyReaderMemoryUsage(const valkeyReader *r) {
+    size_t size = sizeof(*r);
+
+    if (r->buf != NULL)
+        size += sdsAllocSize(r->buf);
+    size += r->tasks * (sizeof(*r->task) + sizeof(**r->task));
+    return size;
+}
+
+void valkeyGetMemoryUsage(const valkeyContext *c, valkeyMemoryUsage *usage) {
+    memset(usage, 0, sizeof(*usage));
+    if (c->obuf != NULL)
+        usage->obuf = sdsAllocSize(c->obuf);
+    if (c->reader != NULL)
+        usage->reader = valkeyReaderMemoryUsage(c->reader);
+    usage->total = usage->obuf + usage->reader;
+}
+
 /* Internal helper that returns 1 if the reply was a RESP3 PUSH
  * message and we handled it with a user-provided callback. */
 static int valkeyHandledPushReply(valkeyContext *c, void *reply) {
@@ -1167,6 +1391,14 @@ int valkeyGetReply(valkeyContext *c, void **reply) {
 int valkeyAppendCmdLen(valkeyContext *c, const char *cmd, size_t len) {
     sds newbuf;
 
+    /* Reject commands exceeding the output buffer limit, with an error that
+     * doesn't prevent using the context. */
+    valkeyClearOutputLimitError(c);
+    if (valkeyOutputLimitReached(c, len)) {
+        valkeySetError(c, VALKEY_ERR_OUTPUT_LIMIT, "Output buffer limit exceeded");
+        return VALKEY_ERR;
+    }
+
     newbuf = sdscatlen(c->obuf, cmd, len);
     if (newbuf == NULL) {
         valkeySetError(c, VALKEY_ERR_OOM, "Out of memory");
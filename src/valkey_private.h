@@ -45,6 +45,60 @@ LIBVALKEY_API void valkeySetError(valkeyContext *c, int type, const char *str);
 LIBVALKEY_API void valkeySetErrorFromErrno(valkeyContext *c, int type, const char *prefix);
 void valkeyClearError(valkeyContext *c);
 
+/* Allocation using a context allocator, or the global allocators when NULL. */
+static inline void *vk_ctx_malloc(const valkeyAllocator *a, size_t size) {
+    return a == NULL ? vk_malloc(size) : a->mallocFn(a->privdata, size);
+}
+
+static inline void *vk_ctx_calloc(const valkeyAllocator *a, size_t nmemb, size_t size) {
+    if (a == NULL)
+        return vk_calloc(nmemb, size);
+    if (SIZE_MAX / size < nmemb)
+        return NULL;
+    return a->callocFn(a->privdata, nmemb, size);
+}
+
+static inline void vk_ctx_free(const valkeyAllocator *a, void *ptr) {
+    if (a == NULL)
+        vk_free(ptr);
+    else if (ptr != NULL)
+        a->freeFn(a->privdata, ptr);
+}
+
+/* The owner of the memory of a reply object, kept in the last byte of its
+ * `vtype`. The `vtype` is otherwise only used by verbatim strings, for their
+ * type of 3 characters terminated by '\0', and they are always owned by the
+ * global allocators. Reply objects are zeroed when created, so a reply that
+ * isn't tagged is owned by the global allocators. */
+typedef enum valkeyReplyOwner {
+    VALKEY_REPLY_OWNER_GLOBAL = 0, /* The global allocators. */
+    VALKEY_REPLY_OWNER_ALLOCATOR,  /* A context allocator, kept in front of the object. */
+    VALKEY_REPLY_OWNER_POOLED,     /* The free lists of the thread, see valkey.c. */
+    VALKEY_REPLY_OWNER_REUSED,     /* A pub/sub reply reused by an async context. */
+} valkeyReplyOwner;
+
+static inline valkeyReplyOwner valkeyReplyGetOwner(const valkeyReply *r) {
+    if (r->type == VALKEY_REPLY_VERB)
+        return VALKEY_REPLY_OWNER_GLOBAL;
+    return (valkeyReplyOwner)r->vtype[3];
+}
+
+static inline void valkeyReplySetOwner(valkeyReply *r, valkeyReplyOwner owner) {
+    r->vtype[3] = (char)owner;
+}
+
+/* Check if appending `len` bytes exceeds the output buffer limit. */
+static inline int valkeyOutputLimitReached(const valkeyContext *c, size_t len) {
+    return c->max_obuf_size > 0 && sdslen(c->obuf) + len > c->max_obuf_size;
+}
+
+/* The error of a command rejected by the output buffer limit doesn't prevent
+ * using the context, and is cleared when using it again. */
+static inline void valkeyClearOutputLimitError(valkeyContext *c) {
+    if (c->err == VALKEY_ERR_OUTPUT_LIMIT)
+        valkeyClearError(c);
+}
+
 /* Helper function. Convert struct timeval to millisecond. */
 static inline int valkeyContextTimeoutMsec(const struct timeval *timeout, long *result) {
     long max_msec = (LONG_MAX - 999) / 1000;
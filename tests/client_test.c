@@ -1574,6 +1574,40 @@ static void test_invalid_timeout_errors(struct config config) {
     valkeyFree(c);
 }
 
+#ifdef VALKEY_TEST_TLS
+/* Commands work with kTLS enabled, whether it's used or not. */
+static void test_tls_ktls(struct config config) {
+    valkeyContext *c = do_connect(config);
+    int ktls = valkeyTLSGetKTLS(c);
+
+    printf("\t(kTLS send: %s, receive: %s)\n",
+           (ktls & VALKEY_TLS_KTLS_SEND) ? "yes" : "no",
+           (ktls & VALKEY_TLS_KTLS_RECV) ? "yes" : "no");
+    test("Commands work with kTLS enabled: ");
+    valkeyReply *reply = valkeyCommand(c, "PING");
+    test_cond(reply != NULL && reply->type == VALKEY_REPLY_STATUS &&
+              strcmp(reply->str, "PONG") == 0);
+    freeReplyObject(reply);
+
+    disconnect(c, 0);
+}
+
+/* A reconnect resumes the session cached when the first connection received
+ * it, which for TLS 1.3 is after the handshake. */
+static void test_tls_session_cache(struct config config) {
+    valkeyContext *c = do_connect(config);
+    valkeyReply *reply = valkeyCommand(c, "PING");
+    assert(reply != NULL);
+    freeReplyObject(reply);
+    disconnect(c, 0);
+
+    c = do_connect(config);
+    test("TLS session is resumed on reconnect: ");
+    test_cond(valkeyTLSIsSessionReused(c));
+    disconnect(c, 0);
+}
+#endif
+
 static void test_throughput(struct config config) {
     valkeyContext *c = do_connect(config);
     valkeyReply **replies;
@@ -2136,6 +2170,50 @@ static void test_pubsub_handling_resp3(struct config config) {
     assert(state.checkpoint == 6);
 }
 
+/* Same as test_pubsub_handling_resp3, with messages built in a reused reply. */
+static void test_pubsub_reused_replies(struct config config) {
+    test("Subscribe, handle published message and unsubscribe using reused replies: ");
+    /* Setup event dispatcher with a testcase timeout */
+    base = event_base_new();
+    struct event *timeout = evtimer_new(base, timeout_cb, NULL);
+    assert(timeout != NULL);
+
+    evtimer_assign(timeout, base, timeout_cb, NULL);
+    struct timeval timeout_tv = {.tv_sec = 10};
+    evtimer_add(timeout, &timeout_tv);
+
+    /* Connect */
+    valkeyOptions options = get_server_tcp_options(config);
+    options.options |= VALKEY_OPT_REUSE_PUBSUB_REPLIES;
+    valkeyAsyncContext *ac = valkeyAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+    valkeyLibeventAttach(ac, base);
+
+    /* Not expecting any push messages in this test */
+    valkeyAsyncSetPushCallback(ac, unexpected_push_cb);
+
+    /* Switch protocol */
+    valkeyAsyncCommand(ac, NULL, NULL, "HELLO 3");
+
+    /* Start subscribe */
+    TestState state = {.options = &options, .resp3 = 1};
+    valkeyAsyncCommand(ac, subscribe_cb, &state, "subscribe mychannel");
+
+    /* An array with 3 elements is still a regular reply */
+    valkeyAsyncCommand(ac, integer_cb, &state, "LPUSH mylist foo");
+    valkeyAsyncCommand(ac, integer_cb, &state, "LPUSH mylist foo");
+    valkeyAsyncCommand(ac, integer_cb, &state, "LPUSH mylist foo");
+    valkeyAsyncCommand(ac, array_cb, &state, "LRANGE mylist 0 2");
+
+    /* Start event dispatching loop */
+    test_cond(event_base_dispatch(base) == 0);
+    event_free(timeout);
+    event_base_free(base);
+
+    /* Verify test checkpoints */
+    assert(state.checkpoint == 6);
+}
+
 static void test_sharded_pubsub_handling_resp3(struct config config) {
     test("Sharded subscribe, handle published message and unsubscribe using RESP3: ");
     /* Setup event dispatcher with a testcase timeout */
@@ -2967,6 +3045,41 @@ int main(int argc, char **argv) {
 
         valkeyFreeTLSContext(_tls_ctx);
         _tls_ctx = NULL;
+
+        /* The session cache in user space TLS. */
+        valkeyTLSOptions tls_options = {0};
+        tls_options.cacert_filename = cfg.tls.ca_cert;
+        tls_options.cert_filename = cfg.tls.cert;
+        tls_options.private_key_filename = cfg.tls.key;
+        tls_options.verify_mode = VALKEY_TLS_VERIFY_PEER;
+        tls_options.session_cache_size = 16;
+        _tls_ctx = valkeyCreateTLSContextWithOptions(&tls_options, NULL);
+        assert(_tls_ctx != NULL);
+
+        printf("\nTesting against TLS connection with a session cache (%s:%d):\n",
+               cfg.tls.host, cfg.tls.port);
+
+        test_tls_session_cache(cfg);
+
+        valkeyFreeTLSContext(_tls_ctx);
+        _tls_ctx = NULL;
+
+        /* Compare the throughput when the encryption is offloaded to the
+         * kernel, or falls back to user space when not supported. */
+        tls_options.enable_ktls = 1;
+        _tls_ctx = valkeyCreateTLSContextWithOptions(&tls_options, NULL);
+        assert(_tls_ctx != NULL);
+
+        printf("\nTesting against TLS connection with kTLS and a session cache (%s:%d):\n",
+               cfg.tls.host, cfg.tls.port);
+
+        test_tls_ktls(cfg);
+        test_tls_session_cache(cfg);
+        if (throughput)
+            test_throughput(cfg);
+
+        valkeyFreeTLSContext(_tls_ctx);
+        _tls_ctx = NULL;
     }
 #endif
 
@@ -3002,6 +3115,7 @@ int main(int argc, char **argv) {
     test_monitor(cfg);
     if (major >= 6) {
         test_pubsub_handling_resp3(cfg);
+        test_pubsub_reused_replies(cfg);
         test_command_timeout_during_pubsub(cfg);
     }
     test_command_timeout_not_fired_on_reply(cfg);
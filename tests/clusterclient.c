@@ -8,6 +8,10 @@
  *           Will send following commands using the `..ToNode()` API and a
  *           cluster node iterator to send each command to all known nodes.
  *
+ * !checkout KEY - Check out a pooled connection to the node of KEY.
+ * !checkedout CMD - Send CMD using the checked out connection.
+ * !checkin - Check in the connection.
+ *
  * Exit statuses this program can return:
  *   0 - Successful execution of program.
  *   1 - Bad arguments.
@@ -74,8 +78,10 @@ int main(int argc, char **argv) {
     int show_events = 0;
     int use_cluster_nodes = 0;
     int send_to_all = 0;
+    valkeyContext *checked_out = NULL;
     int show_connection_events = 0;
     int select_db = 0;
+    const char *slotmap_file = NULL;
 
     int argindex;
     for (argindex = 1; argindex < argc && argv[argindex][0] == '-';
@@ -93,6 +99,13 @@ int main(int argc, char **argv) {
                 fprintf(stderr, "Missing or faulty argument for --select-db\n");
                 exit(1);
             }
+        } else if (strcmp(argv[argindex], "--slotmap-file") == 0) {
+            if (++argindex < argc) /* Need an additional argument */
+                slotmap_file = argv[argindex];
+            if (slotmap_file == NULL) {
+                fprintf(stderr, "Missing argument for --slotmap-file\n");
+                exit(1);
+            }
         } else {
             fprintf(stderr, "Unknown argument: '%s'\n", argv[argindex]);
             exit(1);
@@ -101,7 +114,8 @@ int main(int argc, char **argv) {
 
     if (argindex >= argc) {
         fprintf(stderr, "Usage: clusterclient [--events] [--connection-events] "
-                        "[--use-cluster-nodes] [--select-db NUM] HOST:PORT\n");
+                        "[--use-cluster-nodes] [--select-db NUM] "
+                        "[--slotmap-file PATH] HOST:PORT\n");
         exit(1);
     }
     const char *initnode = argv[argindex];
@@ -123,6 +137,7 @@ int main(int argc, char **argv) {
     if (select_db > 0) {
         options.select_db = select_db;
     }
+    options.slotmap_file = slotmap_file;
 
     valkeyClusterContext *cc = valkeyClusterConnectWithOptions(&options);
     if (cc == NULL || cc->err) {
@@ -141,8 +156,26 @@ int main(int argc, char **argv) {
         if (command[0] == '#') /* Skip comments */
             continue;
         if (command[0] == '!') {
-            if (strcmp(command, "!all") == 0) /* Enable send to all nodes */
+            if (strcmp(command, "!all") == 0) { /* Enable send to all nodes */
                 send_to_all = 1;
+            } else if (strncmp(command, "!checkout ", 10) == 0) {
+                valkeyClusterNode *node =
+                    valkeyClusterGetNodeByKey(cc, command + 10);
+                checked_out = node ? valkeyClusterCheckoutContext(cc, node) : NULL;
+                if (checked_out == NULL)
+                    printf("error: %s\n", cc->errstr);
+            } else if (strncmp(command, "!checkedout ", 12) == 0) {
+                valkeyReply *reply = valkeyCommand(checked_out, command + 12);
+                if (!reply) {
+                    printf("error: %s\n", checked_out->errstr);
+                } else {
+                    printReply(reply);
+                }
+                freeReplyObject(reply);
+            } else if (strcmp(command, "!checkin") == 0) {
+                valkeyClusterCheckinContext(cc, checked_out);
+                checked_out = NULL;
+            }
             continue;
         }
 
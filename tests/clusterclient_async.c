@@ -24,6 +24,16 @@
  *
  * !disconnect - Disconnect the client.
  *
+ * !ssubscribe CHANNEL   - Subscribe to a sharded channel, printing the
+ *                         subscription and messages as they arrive.
+ * !sunsubscribe CHANNEL - Unsubscribe from a sharded channel.
+ *
+ * !script BODY     - Register a script, replacing an earlier one.
+ * !scriptcall KEY  - Call the registered script with a single key.
+ *
+ * !multi           - Start collecting the following commands in a transaction.
+ * !exec            - Execute the collected transaction.
+ *
  * An example input of first sending 2 commands and waiting for their responses,
  * before sending a single command and waiting for its response:
  *
@@ -58,6 +68,8 @@ int resend_failed_cmd = 0;
 int send_to_all = 0;
 int show_events = 0;
 int blocking_initial_update = 0;
+valkeyScript *script = NULL;
+valkeyClusterTransaction *transaction = NULL;
 
 void sendNextCommand(evutil_socket_t, short, void *);
 
@@ -75,6 +87,10 @@ void printReply(const valkeyReply *reply) {
     case VALKEY_REPLY_INTEGER:
         printf("%lld\n", reply->integer);
         break;
+    case VALKEY_REPLY_ARRAY:
+        for (size_t i = 0; i < reply->elements; i++)
+            printReply(reply->element[i]);
+        break;
     default:
         printf("Unhandled reply type: %d\n", reply->type);
     }
@@ -110,6 +126,24 @@ void replyCallback(valkeyClusterAsyncContext *acc, void *r, void *privdata) {
     }
 }
 
+void shardCallback(valkeyClusterAsyncContext *acc, void *r, void *privdata) {
+    valkeyReply *reply = (valkeyReply *)r;
+    UNUSED(acc);
+    UNUSED(privdata);
+
+    if (reply == NULL) {
+        printf("sharded subscription ended\n");
+    } else if (reply->type == VALKEY_REPLY_ERROR) {
+        printReply(reply);
+    } else if (reply->elements == 3 &&
+               reply->element[2]->type == VALKEY_REPLY_STRING) {
+        printf("%s %s %s\n", reply->element[0]->str, reply->element[1]->str,
+               reply->element[2]->str);
+    } else {
+        printf("%s %s\n", reply->element[0]->str, reply->element[1]->str);
+    }
+}
+
 void sendNextCommand(evutil_socket_t fd, short kind, void *arg) {
     UNUSED(fd);
     UNUSED(kind);
@@ -126,6 +160,12 @@ void sendNextCommand(evutil_socket_t fd, short kind, void *arg) {
             continue;
         if (cmd[0] == '#') /* Skip comments */
             continue;
+        if (transaction != NULL && cmd[0] != '!') {
+            int status = valkeyClusterTransactionAppend(transaction, cmd);
+            if (status != VALKEY_OK)
+                printf("error: failed to append '%s'\n", cmd);
+            continue;
+        }
         if (cmd[0] == '!') {
             if (strcmp(cmd, "!sleep") == 0) {
                 ASSERT_MSG(async == 0, "!sleep in !async not supported");
@@ -149,6 +189,58 @@ void sendNextCommand(evutil_socket_t fd, short kind, void *arg) {
             }
             if (strcmp(cmd, "!disconnect") == 0)
                 valkeyClusterAsyncDisconnect(acc);
+            if (strncmp(cmd, "!ssubscribe ", 12) == 0) {
+                const char *channel = cmd + 12;
+                int status = valkeyClusterAsyncSsubscribe(
+                    acc, shardCallback, NULL, 1, &channel, NULL);
+                ASSERT_MSG(status == VALKEY_OK, acc->errstr);
+            }
+            if (strncmp(cmd, "!sunsubscribe ", 14) == 0) {
+                const char *channel = cmd + 14;
+                int status = valkeyClusterAsyncSunsubscribe(acc, 1, &channel,
+                                                            NULL);
+                ASSERT_MSG(status == VALKEY_OK, acc->errstr);
+            }
+            if (strncmp(cmd, "!script ", 8) == 0) {
+                valkeyScriptFree(script);
+                script = valkeyScriptCreate(cmd + 8, strlen(cmd + 8));
+                ASSERT_MSG(script != NULL, "Out of memory");
+            }
+            if (strncmp(cmd, "!scriptcall ", 12) == 0) {
+                const char *key = cmd + 12;
+                assert(num_running < HISTORY_DEPTH);
+                strcpy(cmd_history[num_running], cmd);
+                intptr_t cmd_id = num_running++;
+                int status = valkeyClusterAsyncScriptCall(
+                    acc, replyCallback, (void *)cmd_id, script, 1, 1, &key, NULL);
+                ASSERT_MSG(status == VALKEY_OK, acc->errstr);
+                if (async)
+                    continue;
+                return;
+            }
+            if (strcmp(cmd, "!multi") == 0) {
+                valkeyClusterTransactionFree(transaction);
+                transaction = valkeyClusterTransactionCreate();
+                ASSERT_MSG(transaction != NULL, "Out of memory");
+            }
+            if (strcmp(cmd, "!exec") == 0) {
+                ASSERT_MSG(transaction != NULL, "!exec without !multi");
+                assert(num_running < HISTORY_DEPTH);
+                strcpy(cmd_history[num_running], cmd);
+                intptr_t cmd_id = num_running++;
+                int status = valkeyClusterAsyncTransactionExec(
+                    acc, transaction, replyCallback, (void *)cmd_id);
+                valkeyClusterTransactionFree(transaction);
+                transaction = NULL;
+                if (status != VALKEY_OK) {
+                    num_running--;
+                    printf("error: %s\n", acc->errstr);
+                    continue;
+                }
+                if (async)
+                    continue;
+                return;
+            }
             continue; /* Skip line */
         }
 
@@ -169,11 +261,13 @@ void sendNextCommand(evutil_socket_t fd, short kind, void *arg) {
                 num_running++;
             }
         } else {
+            /* Counted before sending since a reply from the client-side
+             * cache is given to the callback directly. */
+            intptr_t cmd_id = num_running++;
             int status = valkeyClusterAsyncCommand(
-                acc, replyCallback, (void *)((intptr_t)num_running), cmd);
-            if (status == VALKEY_OK) {
-                num_running++;
-            } else {
+                acc, replyCallback, (void *)cmd_id, cmd);
+            if (status != VALKEY_OK) {
+                num_running--;
                 printf("error: %s\n", acc->errstr);
 
                 /* Schedule a read from stdin and handle next command. */
@@ -245,6 +339,13 @@ int main(int argc, char **argv) {
     int use_cluster_nodes = 0;
     int show_connection_events = 0;
     int select_db = 0;
+    int max_retry = 1;
+    int topology_refresh_ms = 0;
+    int preconnect = 0;
+    int use_cache = 0;
+    int connections_per_node = 0;
+    int pool_least_pending = 0;
+    int max_obuf_size = 0;
 
     int optind;
     for (optind = 1; optind < argc && argv[optind][0] == '-'; optind++) {
@@ -256,6 +357,12 @@ int main(int argc, char **argv) {
             show_connection_events = 1;
         } else if (strcmp(argv[optind], "--blocking-initial-update") == 0) {
             blocking_initial_update = 1;
+        } else if (strcmp(argv[optind], "--preconnect") == 0) {
+            preconnect = 1;
+        } else if (strcmp(argv[optind], "--cache") == 0) {
+            use_cache = 1;
+        } else if (strcmp(argv[optind], "--pool-least-pending") == 0) {
+            pool_least_pending = 1;
         } else if (strcmp(argv[optind], "--select-db") == 0) {
             if (++optind < argc) /* Need an additional argument */
                 select_db = atoi(argv[optind]);
@@ -263,6 +370,34 @@ int main(int argc, char **argv) {
                 fprintf(stderr, "Missing or faulty argument for --select-db\n");
                 exit(1);
             }
+        } else if (strcmp(argv[optind], "--max-retry") == 0) {
+            if (++optind < argc) /* Need an additional argument */
+                max_retry = atoi(argv[optind]);
+            if (max_retry == 0) {
+                fprintf(stderr, "Missing or faulty argument for --max-retry\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[optind], "--topology-refresh") == 0) {
+            if (++optind < argc) /* Need an additional argument */
+                topology_refresh_ms = atoi(argv[optind]);
+            if (topology_refresh_ms == 0) {
+                fprintf(stderr, "Missing or faulty argument for --topology-refresh\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[optind], "--connections-per-node") == 0) {
+            if (++optind < argc) /* Need an additional argument */
+                connections_per_node = atoi(argv[optind]);
+            if (connections_per_node == 0) {
+                fprintf(stderr, "Missing or faulty argument for --connections-per-node\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[optind], "--max-obuf-size") == 0) {
+            if (++optind < argc) /* Need an additional argument */
+                max_obuf_size = atoi(argv[optind]);
+            if (max_obuf_size == 0) {
+                fprintf(stderr, "Missing or faulty argument for --max-obuf-size\n");
+                exit(1);
+            }
         } else {
             fprintf(stderr, "Unknown argument: '%s'\n", argv[optind]);
         }
@@ -271,7 +406,10 @@ int main(int argc, char **argv) {
     if (optind >= argc) {
         fprintf(stderr,
                 "Usage: clusterclient_async [--events] [--connection-events] "
-                "[--use-cluster-nodes] [--select-db NUM] HOST:PORT\n");
+                "[--use-cluster-nodes] [--select-db NUM] [--max-retry NUM] "
+                "[--topology-refresh MSEC] [--preconnect] [--cache] "
+                "[--connections-per-node NUM] [--pool-least-pending] "
+                "[--max-obuf-size BYTES] HOST:PORT\n");
         exit(1);
     }
     const char *initnode = argv[optind];
@@ -283,13 +421,25 @@ int main(int argc, char **argv) {
     options.connect_timeout = &timeout;
     options.command_timeout = &timeout;
     options.event_callback = eventCallback;
-    options.max_retry = 1;
+    options.max_retry = max_retry;
+    struct timeval refresh_interval = {topology_refresh_ms / 1000,
+                                       (topology_refresh_ms % 1000) * 1000};
+    if (topology_refresh_ms > 0)
+        options.topology_refresh_interval = &refresh_interval;
     if (blocking_initial_update) {
         options.options = VALKEY_OPT_BLOCKING_INITIAL_UPDATE;
     }
     if (use_cluster_nodes) {
         options.options |= VALKEY_OPT_USE_CLUSTER_NODES;
     }
+    if (preconnect) {
+        options.options |= VALKEY_OPT_PRECONNECT;
+    }
+    if (pool_least_pending) {
+        options.options |= VALKEY_OPT_POOL_LEAST_PENDING;
+    }
+    options.connections_per_node = connections_per_node;
+    options.max_obuf_size = max_obuf_size;
     if (show_connection_events) {
         options.async_connect_callback = connectCallback;
         options.async_disconnect_callback = disconnectCallback;
@@ -297,6 +447,12 @@ int main(int argc, char **argv) {
     if (select_db > 0) {
         options.select_db = select_db;
     }
+    valkeyCache *cache = NULL;
+    if (use_cache) {
+        cache = valkeyCacheCreate(NULL);
+        ASSERT_MSG(cache != NULL, "Out of memory");
+        options.cache = cache;
+    }
     valkeyClusterOptionsUseLibevent(&options, base);
 
     valkeyClusterAsyncContext *acc = valkeyClusterAsyncConnectWithOptions(&options);
@@ -308,6 +464,8 @@ int main(int argc, char **argv) {
     event_base_dispatch(base);
 
     valkeyClusterAsyncFree(acc);
+    valkeyCacheFree(cache);
+    valkeyScriptFree(script);
     event_base_free(base);
     return 0;
 }
@@ -52,8 +52,12 @@ void eventCallback(const valkeyClusterContext *cc, int event, void *privdata) {
                                            "GET key12345");
         ASSERT_MSG(status == VALKEY_OK, acc->errstr);
 
-        status = valkeyClusterAsyncCommand(acc, setCallback, (char *)"ID",
-                                           "SET key23456 value2");
+        /* Hand over the encoded command instead of copying it. */
+        char *cmd;
+        int len = valkeyFormatCommand(&cmd, "SET key23456 value2");
+        assert(len > 0);
+        status = valkeyClusterAsyncFormattedCommandOwned(acc, setCallback,
+                                                         (char *)"ID", cmd, len);
         ASSERT_MSG(status == VALKEY_OK, acc->errstr);
 
         status = valkeyClusterAsyncCommand(acc, getCallback, (char *)"ID",
@@ -0,0 +1,136 @@
+#define _XOPEN_SOURCE 600 /* For usleep() and pthread */
+/* Tests of the multi-threaded executor in adapters/libevent_executor.h.
+ *
+ * Commands are submitted from several threads and are verified to be replied
+ * once each, also when submitted during the executor shutdown. */
+
+#include "adapters/libevent_executor.h"
+#include "cluster.h"
+#include "test_utils.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CLUSTER_NODE "127.0.0.1:7000"
+#define NUM_LOOP_THREADS 4
+#define NUM_PRODUCERS 4
+#define COMMANDS_PER_PRODUCER 1000
+
+static int replies;
+static int errors;
+static char values[NUM_PRODUCERS][32];
+
+typedef struct producer {
+    valkeyClusterExecutor *ex;
+    pthread_t thread;
+    int id;
+} producer;
+
+void setCallback(valkeyClusterAsyncContext *acc, void *r, void *privdata) {
+    UNUSED(privdata);
+    valkeyReply *reply = (valkeyReply *)r;
+    ASSERT_MSG(reply != NULL, acc->errstr);
+    assert(reply->type == VALKEY_REPLY_STATUS);
+    __atomic_fetch_add(&replies, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Verify that the value set by the same producer is read back. */
+void getCallback(valkeyClusterAsyncContext *acc, void *r, void *privdata) {
+    valkeyReply *reply = (valkeyReply *)r;
+    ASSERT_MSG(reply != NULL, acc->errstr);
+    assert(reply->type == VALKEY_REPLY_STRING);
+    assert(strcmp(reply->str, (char *)privdata) == 0);
+    __atomic_fetch_add(&replies, 1, __ATOMIC_SEQ_CST);
+}
+
+void errorCallback(valkeyClusterAsyncContext *acc, void *r, void *privdata) {
+    UNUSED(acc);
+    UNUSED(privdata);
+    if (r == NULL)
+        __atomic_fetch_add(&errors, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&replies, 1, __ATOMIC_SEQ_CST);
+}
+
+static void *produce(void *arg) {
+    producer *p = (producer *)arg;
+    char *value = values[p->id];
+    snprintf(value, sizeof(values[0]), "producer-%d", p->id);
+
+    for (int i = 0; i < COMMANDS_PER_PRODUCER; i++) {
+        int status = valkeyClusterExecutorCommand(p->ex, setCallback, NULL,
+                                                  "SET executor:%d:%d %s",
+                                                  p->id, i, value);
+        assert(status == VALKEY_OK);
+        status = valkeyClusterExecutorCommand(p->ex, getCallback, value,
+                                              "GET executor:%d:%d", p->id, i);
+        assert(status == VALKEY_OK);
+    }
+    return NULL;
+}
+
+static void wait_for_replies(int expected) {
+    while (__atomic_load_n(&replies, __ATOMIC_SEQ_CST) < expected)
+        usleep(1000);
+    assert(__atomic_load_n(&replies, __ATOMIC_SEQ_CST) == expected);
+}
+
+void test_commands_from_multiple_threads(void) {
+    valkeyClusterOptions options = {0};
+    options.initial_nodes = CLUSTER_NODE;
+
+    valkeyClusterExecutor *ex = valkeyClusterExecutorCreate(&options, NUM_LOOP_THREADS);
+    assert(ex);
+
+    replies = 0;
+    producer producers[NUM_PRODUCERS];
+    for (int i = 0; i < NUM_PRODUCERS; i++) {
+        producers[i].ex = ex;
+        producers[i].id = i;
+        assert(pthread_create(&producers[i].thread, NULL, produce, &producers[i]) == 0);
+    }
+    for (int i = 0; i < NUM_PRODUCERS; i++)
+        pthread_join(producers[i].thread, NULL);
+
+    wait_for_replies(NUM_PRODUCERS * COMMANDS_PER_PRODUCER * 2);
+    valkeyClusterExecutorFree(ex);
+}
+
+/* Commands without keys and commands pending at shutdown are replied to. */
+void test_errors_and_shutdown(void) {
+    valkeyClusterOptions options = {0};
+    options.initial_nodes = CLUSTER_NODE;
+
+    valkeyClusterExecutor *ex = valkeyClusterExecutorCreate(&options, NUM_LOOP_THREADS);
+    assert(ex);
+
+    replies = 0;
+    errors = 0;
+    assert(valkeyClusterExecutorCommand(ex, errorCallback, NULL, "PING") == VALKEY_OK);
+    wait_for_replies(1);
+    assert(errors == 1);
+
+    for (int i = 0; i < 100; i++) {
+        assert(valkeyClusterExecutorCommand(ex, errorCallback, NULL,
+                                            "SET executor:%d 1", i) == VALKEY_OK);
+    }
+    valkeyClusterExecutorFree(ex);
+    assert(replies == 101);
+    assert(errors == 1);
+}
+
+void test_create_failure(void) {
+    valkeyClusterOptions options = {0};
+    options.initial_nodes = "127.0.0.1:1"; /* No server */
+
+    assert(valkeyClusterExecutorCreate(&options, NUM_LOOP_THREADS) == NULL);
+    assert(valkeyClusterExecutorCreate(&options, 0) == NULL);
+}
+
+int main(void) {
+    test_commands_from_multiple_threads();
+    test_errors_and_shutdown();
+    test_create_failure();
+    return 0;
+}
@@ -262,6 +262,43 @@ void test_command_timeout_set_while_connected(void) {
     valkeyClusterFree(cc);
 }
 
+/* Check out connections from the connection pool of a node. */
+void test_connection_pool_checkout(void) {
+    valkeyClusterOptions options = {0};
+    options.initial_nodes = CLUSTER_NODE;
+    options.connections_per_node = 2;
+
+    valkeyClusterContext *cc = valkeyClusterConnectWithOptions(&options);
+    ASSERT_MSG(cc && cc->err == 0, cc ? cc->errstr : "OOM");
+
+    valkeyClusterNode *node = valkeyClusterGetNodeByKey(cc, (char *)"foo");
+    assert(node);
+
+    valkeyContext *c1 = valkeyClusterCheckoutContext(cc, node);
+    ASSERT_MSG(c1, cc->errstr);
+    valkeyContext *c2 = valkeyClusterCheckoutContext(cc, node);
+    ASSERT_MSG(c2, cc->errstr);
+    assert(c1 != c2);
+
+    /* All connections are in use. */
+    assert(valkeyClusterCheckoutContext(cc, node) == NULL);
+    assert(cc->err == VALKEY_ERR_OTHER);
+
+    valkeyReply *reply = valkeyCommand(c1, "SET foo pooled");
+    CHECK_REPLY_OK(cc, reply);
+    freeReplyObject(reply);
+
+    /* The regular API is not affected by checked out connections. */
+    reply = valkeyClusterCommand(cc, "GET foo");
+    CHECK_REPLY_STR(cc, reply, "pooled");
+    freeReplyObject(reply);
+
+    valkeyClusterCheckinContext(cc, c1);
+    assert(valkeyClusterCheckoutContext(cc, node) == c1);
+
+    valkeyClusterFree(cc);
+}
+
 //------------------------------------------------------------------------------
 // Async API
 //------------------------------------------------------------------------------
@@ -551,6 +588,43 @@ void test_async_command_timeout(void) {
     event_base_free(base);
 }
 
+int pool_connect_counter;
+void poolConnectCallback(valkeyAsyncContext *ac, int status) {
+    UNUSED(ac);
+    assert(status == VALKEY_OK);
+    pool_connect_counter++;
+}
+
+/* Commands to the same node are spread over the pooled connections. */
+void test_async_connection_pool(int options_flags) {
+    struct event_base *base = event_base_new();
+
+    valkeyClusterOptions options = {0};
+    options.initial_nodes = CLUSTER_NODE;
+    options.options = VALKEY_OPT_BLOCKING_INITIAL_UPDATE | options_flags;
+    options.connections_per_node = 3;
+    options.async_connect_callback = poolConnectCallback;
+    valkeyClusterOptionsUseLibevent(&options, base);
+
+    valkeyClusterAsyncContext *acc = valkeyClusterAsyncConnectWithOptions(&options);
+    ASSERT_MSG(acc && acc->err == 0, acc ? acc->errstr : "OOM");
+
+    pool_connect_counter = 0;
+    ExpectedResult r1 = {.type = VALKEY_REPLY_STATUS, .str = "OK"};
+    ExpectedResult r2 = {.type = VALKEY_REPLY_STATUS, .str = "OK", .disconnect = true};
+    for (int i = 0; i < 6; i++) {
+        int status = valkeyClusterAsyncCommand(acc, commandCallback,
+                                               i < 5 ? &r1 : &r2, "SET foo %d", i);
+        ASSERT_MSG(status == VALKEY_OK, acc->errstr);
+    }
+
+    event_base_dispatch(base);
+    assert(pool_connect_counter == 3);
+
+    valkeyClusterAsyncFree(acc);
+    event_base_free(base);
+}
+
 int main(void) {
 
     test_unsupported_option();
@@ -563,6 +637,7 @@ int main(void) {
     test_connect_timeout();
     test_command_timeout();
     test_command_timeout_set_while_connected();
+    test_connection_pool_checkout();
 
     test_async_password_ok();
     test_async_password_wrong();
@@ -571,6 +646,8 @@ int main(void) {
     test_async_multicluster();
     test_async_connect_timeout();
     test_async_command_timeout();
+    test_async_connection_pool(0);
+    test_async_connection_pool(VALKEY_OPT_POOL_LEAST_PENDING);
 
     return 0;
 }
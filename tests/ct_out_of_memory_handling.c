@@ -504,9 +504,9 @@ void test_alloc_failure_handling_async(void) {
         const char *cmd2 = "GET foo";
 
         for (int n = 0; n < 1000; ++n) {
-            /* Skip iteration 12, errstr not set by libvalkey when
+            /* Skip iteration 11, errstr not set by libvalkey when
              * valkeyFormatSdsCommandArgv() fails. */
-            if (n == 12)
+            if (n == 11)
                 continue;
             prepare_allocation_test_async(acc, n);
             result = valkeyClusterAsyncCommand(acc, commandCallback, &r2, cmd2);
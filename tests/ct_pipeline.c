@@ -91,12 +91,20 @@ void commandCallback(valkeyClusterAsyncContext *cc, void *r, void *privdata) {
 // In an asynchronous context, commands are automatically pipelined due to the
 // nature of an event loop. Therefore, unlike the synchronous API, there is only
 // a single way to send commands.
-void test_async_pipeline(void) {
+// With auto-pipelining the commands are held back and flushed in batches of
+// two, where the last command is flushed when the max delay has passed.
+void test_async_pipeline(bool auto_pipeline) {
     struct event_base *base = event_base_new();
+    struct timeval max_delay = {0, 10000};
 
     valkeyClusterOptions options = {0};
     options.initial_nodes = CLUSTER_NODE;
     options.options = VALKEY_OPT_BLOCKING_INITIAL_UPDATE;
+    if (auto_pipeline) {
+        options.options |= VALKEY_OPT_AUTO_PIPELINE;
+        options.pipeline_max_batch = 2;
+        options.pipeline_max_delay = &max_delay;
+    }
     options.async_connect_callback = connectCallback;
     options.async_disconnect_callback = disconnectCallback;
     valkeyClusterOptionsUseLibevent(&options, base);
@@ -136,11 +144,53 @@ void test_async_pipeline(void) {
     event_base_free(base);
 }
 
+int failed_commands = 0;
+void freeOnErrorCallback(valkeyClusterAsyncContext *acc, void *r,
+                         void *privdata) {
+    UNUSED(privdata);
+    assert(r == NULL);
+    if (failed_commands++ == 0)
+        valkeyClusterAsyncFree(acc);
+}
+
+// A full batch is submitted from the command call. A callback of a failed
+// command that frees the context is deferred until the batch is handled.
+void test_async_pipeline_free_from_callback(void) {
+    struct event_base *base = event_base_new();
+    struct timeval max_delay = {0, 10000};
+
+    valkeyClusterOptions options = {0};
+    options.initial_nodes = CLUSTER_NODE;
+    options.options = VALKEY_OPT_BLOCKING_INITIAL_UPDATE | VALKEY_OPT_AUTO_PIPELINE;
+    options.pipeline_max_batch = 2;
+    options.pipeline_max_delay = &max_delay;
+    options.max_obuf_size = 32; /* Fits CLUSTER SLOTS but not the commands. */
+    valkeyClusterOptionsUseLibevent(&options, base);
+
+    valkeyClusterAsyncContext *acc = valkeyClusterAsyncConnectWithOptions(&options);
+    ASSERT_MSG(acc && acc->err == 0, acc ? acc->errstr : "OOM");
+
+    int status;
+    status = valkeyClusterAsyncCommand(acc, freeOnErrorCallback, NULL,
+                                       "SET {foo}1 a-value-too-long");
+    ASSERT_MSG(status == VALKEY_OK, acc->errstr);
+    assert(failed_commands == 0);
+    status = valkeyClusterAsyncCommand(acc, freeOnErrorCallback, NULL,
+                                       "SET {foo}2 a-value-too-long");
+    assert(status == VALKEY_OK);
+    assert(failed_commands == 2); /* The context is freed. */
+
+    event_base_dispatch(base);
+    event_base_free(base);
+}
+
 int main(void) {
 
     test_pipeline();
 
-    test_async_pipeline();
+    test_async_pipeline(false);
+    test_async_pipeline(true);
+    test_async_pipeline_free_from_callback();
 
     return 0;
 }
@@ -41,6 +41,40 @@ void test_command_to_all_nodes(valkeyClusterContext *cc) {
     }
 }
 
+void test_command_to_all_nodes_reduced(valkeyClusterContext *cc) {
+    valkeyReply *reply;
+
+    /* Count the known nodes. */
+    size_t num_nodes = 0;
+    valkeyClusterNodeIterator ni;
+    valkeyClusterInitNodeIterator(&ni, cc);
+    while (valkeyClusterNodeNext(&ni) != NULL)
+        num_nodes++;
+
+    reply = valkeyClusterCommandToAllNodes(cc, 0, valkeyClusterReduceSum, "DBSIZE");
+    CHECK_REPLY(cc, reply);
+    CHECK_REPLY_TYPE(reply, VALKEY_REPLY_INTEGER);
+    freeReplyObject(reply);
+
+    reply = valkeyClusterCommandToAllNodes(cc, 0, valkeyClusterReduceConcat, "DBSIZE");
+    CHECK_REPLY(cc, reply);
+    CHECK_REPLY_TYPE(reply, VALKEY_REPLY_ARRAY);
+    assert(reply->elements == num_nodes);
+    for (size_t i = 0; i < reply->elements; i++)
+        CHECK_REPLY_TYPE(reply->element[i], VALKEY_REPLY_INTEGER);
+    freeReplyObject(reply);
+
+    reply = valkeyClusterCommandToAllNodes(cc, 0, valkeyClusterReduceFirstError, "PING");
+    CHECK_REPLY_STATUS(cc, reply, "PONG");
+    freeReplyObject(reply);
+
+    /* The first error is returned. */
+    reply = valkeyClusterCommandToAllNodes(cc, 0, valkeyClusterReduceFirstError,
+                                           "CONFIG SET nonexisting-config 1");
+    CHECK_REPLY_TYPE(reply, VALKEY_REPLY_ERROR);
+    freeReplyObject(reply);
+}
+
 void test_transaction(valkeyClusterContext *cc) {
 
     valkeyClusterNode *node = valkeyClusterGetNodeByKey(cc, (char *)"foo");
@@ -175,6 +209,38 @@ void test_streams(valkeyClusterContext *cc) {
     free(id);
 }
 
+void test_scan(valkeyClusterContext *cc) {
+    valkeyReply *reply;
+    char key[32];
+    int found[100] = {0};
+
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "scan:%d", i);
+        reply = valkeyClusterCommand(cc, "SET %s %d", key, i);
+        CHECK_REPLY_OK(cc, reply);
+        freeReplyObject(reply);
+    }
+
+    valkeyClusterScanOptions options = {.match = "scan:*", .count = 10};
+    valkeyClusterScan *scan = valkeyClusterScanCreate(cc, &options);
+    ASSERT_MSG(scan, cc->errstr);
+
+    valkeyReply *keys;
+    while ((keys = valkeyClusterScanNext(scan)) != NULL) {
+        CHECK_REPLY_TYPE(keys, VALKEY_REPLY_ARRAY);
+        for (size_t i = 0; i < keys->elements; i++) {
+            assert(strncmp(keys->element[i]->str, "scan:", 5) == 0);
+            found[atoi(keys->element[i]->str + 5)] = 1;
+        }
+        freeReplyObject(keys);
+    }
+    ASSERT_MSG(cc->err == 0, cc->errstr);
+    valkeyClusterScanFree(scan);
+
+    for (int i = 0; i < 100; i++)
+        assert(found[i]);
+}
+
 void test_pipeline_to_single_node(valkeyClusterContext *cc) {
     int status;
     valkeyReply *reply;
@@ -452,6 +518,38 @@ void test_async_to_all_nodes(void) {
     event_base_free(base);
 }
 
+void test_async_to_all_nodes_reduced(void) {
+    struct event_base *base = event_base_new();
+
+    valkeyClusterOptions options = {0};
+    options.initial_nodes = CLUSTER_NODE;
+    options.options = VALKEY_OPT_BLOCKING_INITIAL_UPDATE;
+    options.max_retry = 1;
+    options.async_connect_callback = connectCallback;
+    options.async_disconnect_callback = disconnectCallback;
+    valkeyClusterOptionsUseLibevent(&options, base);
+
+    valkeyClusterAsyncContext *acc = valkeyClusterAsyncConnectWithOptions(&options);
+    ASSERT_MSG(acc && acc->err == 0, acc ? acc->errstr : "OOM");
+
+    int status;
+    ExpectedResult r1 = {.type = VALKEY_REPLY_INTEGER};
+    status = valkeyClusterAsyncCommandToAllNodes(
+        acc, 0, valkeyClusterReduceSum, commandCallback, &r1, "DBSIZE");
+    ASSERT_MSG(status == VALKEY_OK, acc->errstr);
+
+    ExpectedResult r2 = {
+        .type = VALKEY_REPLY_STATUS, .str = "PONG", .disconnect = true};
+    status = valkeyClusterAsyncCommandToAllNodes(
+        acc, 0, valkeyClusterReduceFirstError, commandCallback, &r2, "PING");
+    ASSERT_MSG(status == VALKEY_OK, acc->errstr);
+
+    event_base_dispatch(base);
+
+    valkeyClusterAsyncFree(acc);
+    event_base_free(base);
+}
+
 void test_async_transaction(void) {
     struct event_base *base = event_base_new();
 
@@ -498,6 +596,59 @@ void test_async_transaction(void) {
     event_base_free(base);
 }
 
+typedef struct ScanResult {
+    int found[100];
+    bool done;
+} ScanResult;
+
+int scanCallback(valkeyClusterAsyncContext *acc, const valkeyReply *keys,
+                 void *privdata) {
+    ScanResult *result = privdata;
+    if (keys == NULL) {
+        ASSERT_MSG(acc->err == 0, acc->errstr);
+        result->done = true;
+        valkeyClusterAsyncDisconnect(acc);
+        return 0;
+    }
+    for (size_t i = 0; i < keys->elements; i++) {
+        assert(strncmp(keys->element[i]->str, "scan:", 5) == 0);
+        result->found[atoi(keys->element[i]->str + 5)] = 1;
+    }
+    return 0;
+}
+
+void test_async_scan(void) {
+    struct event_base *base = event_base_new();
+
+    valkeyClusterOptions options = {0};
+    options.initial_nodes = CLUSTER_NODE;
+    options.options = VALKEY_OPT_BLOCKING_INITIAL_UPDATE;
+    options.max_retry = 1;
+    options.async_connect_callback = connectCallback;
+    options.async_disconnect_callback = disconnectCallback;
+    valkeyClusterOptionsUseLibevent(&options, base);
+
+    valkeyClusterAsyncContext *acc = valkeyClusterAsyncConnectWithOptions(&options);
+    ASSERT_MSG(acc && acc->err == 0, acc ? acc->errstr : "OOM");
+
+    /* Uses the keys created by test_scan(). */
+    ScanResult result = {0};
+    valkeyClusterScanOptions scan_options = {
+        .match = "scan:*", .count = 10, .max_concurrency = 1};
+    int status = valkeyClusterAsyncScan(acc, &scan_options, scanCallback,
+                                        &result);
+    ASSERT_MSG(status == VALKEY_OK, acc->errstr);
+
+    event_base_dispatch(base);
+
+    assert(result.done);
+    for (int i = 0; i < 100; i++)
+        assert(result.found[i]);
+
+    valkeyClusterAsyncFree(acc);
+    event_base_free(base);
+}
+
 int main(void) {
     valkeyClusterOptions options = {0};
     options.initial_nodes = CLUSTER_NODE;
@@ -510,8 +661,10 @@ int main(void) {
     // Synchronous API
     test_command_to_single_node(cc);
     test_command_to_all_nodes(cc);
+    test_command_to_all_nodes_reduced(cc);
     test_transaction(cc);
     test_streams(cc);
+    test_scan(cc);
 
     // Pipeline API
     test_pipeline_to_single_node(cc);
@@ -525,7 +678,9 @@ int main(void) {
     test_async_formatted_to_single_node();
     test_async_command_argv_to_single_node();
     test_async_to_all_nodes();
+    test_async_to_all_nodes_reduced();
     test_async_transaction();
+    test_async_scan();
 
     return 0;
 }
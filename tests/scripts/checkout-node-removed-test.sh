@@ -0,0 +1,87 @@
+#!/bin/bash
+#
+# Verify that a checked out connection stays valid when a slotmap update
+# removes its node, and that it's closed when checked in.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=checkout-node-removed-test
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated node 1, which serves the checked out connection and the
+# connection used when following a redirect. The latter is closed when the
+# node is removed from the slotmap, while the checked out one stays open.
+timeout 5s ./simulated-valkey.pl -p 7401 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "one"
+EXPECT CONNECT
+EXPECT ["GET", "bar"]
+SEND "three"
+EXPECT CLOSE
+EXPECT ["GET", "foo"]
+SEND "two"
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated node 2, which redirects a command and replies with a
+# slotmap that doesn't contain node 1.
+timeout 5s ./simulated-valkey.pl -p 7402 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 12181, ["127.0.0.1", 7402, "nodeid7402"]], [12182, 12182, ["127.0.0.1", 7401, "nodeid7401"]], [12183, 16383, ["127.0.0.1", 7402, "nodeid7402"]]]
+EXPECT ["GET", "bar"]
+SEND -MOVED 5061 127.0.0.1:7401
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7402, "nodeid7402"]]]
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections.
+wait $syncpid1 $syncpid2;
+
+# Run client
+timeout 3s "$clientprog" 127.0.0.1:7402 > "$testname.out" <<'EOF'
+!checkout foo
+!checkedout GET foo
+GET bar
+!checkedout GET foo
+!checkin
+EOF
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+expected="one
+three
+two"
+
+echo "$expected" | diff -u - "$testname.out" || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# Verify that a cached reply is given without contacting the node, and that
+# an invalidation message removes it from the client-side cache. A command
+# sent while a write is pending is not replied from the cache.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient_async}
+testname=client-side-cache-test-async
+
+# Sync process just waiting for server to be ready to accept connection.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid=$!
+
+# Start simulated valkey node. The second GET is replied from the cache.
+timeout 5s ./simulated-valkey.pl -p 7407 -d --sigcont $syncpid <<'EOF' &
+EXPECT CONNECT
+EXPECT ["HELLO", "3"]
+SEND ["proto", 3]
+EXPECT ["CLIENT", "TRACKING", "ON"]
+SEND +OK
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7407, "nodeid7407"]]]
+EXPECT ["GET", "foo"]
+SEND "bar"
+EXPECT ["SET", "foo", "baz"]
+SEND +OK\r\n>2\r\n$10\r\ninvalidate\r\n*1\r\n$3\r\nfoo\r\n
+EXPECT ["GET", "foo"]
+SEND "baz"
+EXPECT ["SET", "foo", "qux"]
+EXPECT ["GET", "foo"]
+SEND +OK\r\n>2\r\n$10\r\ninvalidate\r\n*1\r\n$3\r\nfoo\r\n
+SEND "qux"
+EXPECT CLOSE
+EOF
+server=$!
+
+# Wait until server is ready to accept client connection
+wait $syncpid;
+
+# Run client
+timeout 4s "$clientprog" --cache 127.0.0.1:7407 > "$testname.out" <<'EOF'
+GET foo
+GET foo
+SET foo baz
+GET foo
+GET foo
+!async
+SET foo qux
+GET foo
+!sync
+EOF
+clientexit=$?
+
+# Wait for server to exit
+wait $server; serverexit=$?
+
+# Check exit statuses
+if [ $serverexit -ne 0 ]; then
+    echo "Simulated server exited with status $serverexit"
+    exit $serverexit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+expected="bar
+bar
+OK
+baz
+baz
+OK
+qux"
+
+echo "$expected" | diff -u - "$testname.out" || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,87 @@
+#!/bin/bash
+#
+# Verify that a node using a connection pool can be removed by a slotmap
+# update received on one of its pool connections, while another command is
+# outstanding on the same connection.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient_async}
+testname=pool-node-removed-test-async
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated server 1, which takes over all slots.
+timeout 5s ./simulated-valkey.pl -p 7401 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "one"
+EXPECT ["GET", "bar"]
+SEND "two"
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated server 2. The slotmap update is requested on the pool
+# connection that received the redirect, and is answered after the next
+# command is sent on that connection.
+timeout 5s ./simulated-valkey.pl -p 7402 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7402, "nodeid7402"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND -MOVED 12182 127.0.0.1:7401
+EXPECT ["CLUSTER", "SLOTS"]
+EXPECT ["GET", "bar"]
+SEND [[0, 16383, ["127.0.0.1", 7401, "nodeid7401"]]]
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both servers are ready to accept client connections.
+wait $syncpid1 $syncpid2;
+
+# Run client. The first GET bar fails when its connection is closed since
+# the node has been removed, and the second is sent to the new node.
+timeout 3s "$clientprog" --connections-per-node 2 --pool-least-pending \
+        --blocking-initial-update 127.0.0.1:7402 > "$testname.out" <<'EOF'
+GET foo
+GET bar
+GET bar
+EOF
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit status on servers.
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+# Check exit status on client.
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+expected="one
+unknown error
+two"
+
+echo "$expected" | diff -u - "$testname.out" || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# Verify that all primaries are connected to when the first slotmap is
+# received when using VALKEY_OPT_PRECONNECT, and not when first used.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient_async}
+testname=preconnect-test-async
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated valkey node #1
+timeout 5s ./simulated-valkey.pl -p 7403 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 8191, ["127.0.0.1", 7403, "nodeid7403"]], [8192, 16383, ["127.0.0.1", 7404, "nodeid7404"]]]
+EXPECT ["GET", "bar"]
+SEND "one"
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated valkey node #2
+timeout 5s ./simulated-valkey.pl -p 7404 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "two"
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client. The connection to the second node is made before the first
+# command is sent, although the node is only used by the second command.
+timeout 4s "$clientprog" --events --connection-events --preconnect 127.0.0.1:7403 > "$testname.out" <<'EOF'
+!sleep
+GET bar
+GET foo
+EOF
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+expected="Event: connect to 127.0.0.1:7403
+Event: slotmap-updated
+Event: ready
+Event: connect to 127.0.0.1:7404
+one
+two
+Event: disconnect from 127.0.0.1:7403
+Event: disconnect from 127.0.0.1:7404
+Event: free-context"
+
+echo "$expected" | diff -u - "$testname.out" || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# Verify that a script is called using EVALSHA, and that a NOSCRIPT error is
+# recovered from by retrying the call using EVAL.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient_async}
+testname=script-call-test-async
+
+# Sync process just waiting for server to be ready to accept connection.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid=$!
+
+# Start simulated valkey node. The SHA1 digest is of "return 1".
+timeout 5s ./simulated-valkey.pl -p 7408 -d --sigcont $syncpid <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7408, "nodeid7408"]]]
+EXPECT ["EVALSHA", "e0e1f9fabfc9d4800c877a703b823ac0578ff8db", "1", "foo"]
+SEND -NOSCRIPT No matching script.
+EXPECT ["EVAL", "return 1", "1", "foo"]
+SEND :1
+EXPECT ["EVALSHA", "e0e1f9fabfc9d4800c877a703b823ac0578ff8db", "1", "foo"]
+SEND :1
+EXPECT CLOSE
+EOF
+server=$!
+
+# Wait until server is ready to accept client connection
+wait $syncpid;
+
+# Run client
+timeout 4s "$clientprog" 127.0.0.1:7408 > "$testname.out" <<'EOF'
+!script return 1
+!scriptcall foo
+!scriptcall foo
+EOF
+clientexit=$?
+
+# Wait for server to exit
+wait $server; serverexit=$?
+
+# Check exit statuses
+if [ $serverexit -ne 0 ]; then
+    echo "Simulated server exited with status $serverexit"
+    exit $serverexit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+expected="1
+1"
+
+echo "$expected" | diff -u - "$testname.out" || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# Verify that a sharded pub/sub channel is resubscribed to on the new owner
+# when its slot is migrated and the node unsubscribes the client.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient_async}
+testname=sharded-pubsub-test-async
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated valkey node #1. The channel 'foo' hashes to slot 12182.
+timeout 6s ./simulated-valkey.pl -p 7405 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 8191, ["127.0.0.1", 7405, "nodeid7405"]], [8192, 16383, ["127.0.0.1", 7406, "nodeid7406"]]]
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7405, "nodeid7405"]]]
+EXPECT CONNECT
+EXPECT ["SSUBSCRIBE", "foo"]
+SEND ["ssubscribe", "foo", 1]
+SEND ["smessage", "foo", "two"]
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated valkey node #2, which migrates the slot of the channel.
+timeout 6s ./simulated-valkey.pl -p 7406 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["SSUBSCRIBE", "foo"]
+SEND ["ssubscribe", "foo", 1]
+SEND ["smessage", "foo", "one"]
+SEND ["sunsubscribe", "foo", 0]
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client. The channel is resubscribed to when the slotmap is updated,
+# which is throttled to once a second.
+timeout 5s "$clientprog" --events --connection-events 127.0.0.1:7405 > "$testname.out" <<'EOF'
+!ssubscribe foo
+!sleep
+!sleep
+EOF
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+expected="Event: connect to 127.0.0.1:7405
+Event: slotmap-updated
+Event: ready
+Event: connect to 127.0.0.1:7406
+ssubscribe foo
+smessage foo one
+Event: disconnect from 127.0.0.1:7406
+Event: slotmap-updated
+Event: connect to 127.0.0.1:7405
+smessage foo two
+sharded subscription ended
+Event: disconnect from 127.0.0.1:7405
+Event: disconnect from 127.0.0.1:7405
+Event: free-context"
+
+echo "$expected" | diff -u - "$testname.out" || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -120,7 +120,7 @@ while (<>) {
     print "(port $port) $_\n" if $debug;
     if (/^SEND (.*)/) {
         my $data = $1;
-        if ($data =~ /^[-+\$\*:]/) {
+        if ($data =~ /^[-+\$\*:>_]/) {
             # Valkey protocol with character escapes
             # e.g. '-ERR Unknown command: FOO\r\n'
             $data = unescape($data);
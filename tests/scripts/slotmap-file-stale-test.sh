@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# Verify that a client using a saved slotmap file where none of the nodes
+# exist anymore fetches a new slotmap from the seed node.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=slotmap-file-stale-test
+slotmapfile="$testname.slotmap"
+
+rm -f "$slotmapfile"
+
+# Sync process waiting for CONT signal.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+
+# Start simulated valkey node, which first replies with a slotmap containing a
+# node that doesn't exist, and then with a slotmap containing itself.
+timeout 5s ./simulated-valkey.pl -p 7403 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7499, "nodeid7499"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7403, "nodeid7403"]]]
+EXPECT ["GET", "foo"]
+SEND "bar"
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Wait until the node is ready to accept client connections
+wait $syncpid1;
+
+# Run client which saves the stale slotmap.
+timeout 3s "$clientprog" --slotmap-file "$slotmapfile" 127.0.0.1:7403 \
+        > "$testname.out" < /dev/null
+clientexit=$?
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Run client which uses the stale slotmap file.
+timeout 3s "$clientprog" --slotmap-file "$slotmapfile" 127.0.0.1:7403 \
+        >> "$testname.out" <<'EOF'
+GET foo
+EOF
+clientexit=$?
+
+# Wait for server to exit
+wait $server1; server1exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+expected="bar"
+
+echo "$expected" | diff -u - "$testname.out" || exit 99
+
+# Clean up
+rm "$testname.out" "$slotmapfile"
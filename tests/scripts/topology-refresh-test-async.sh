@@ -0,0 +1,78 @@
+#!/bin/bash
+#
+# Verify that the periodic topology refresh only updates the slotmap, and
+# sends the slotmap-updated event, when the topology has changed.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient_async}
+testname=topology-refresh-test-async
+
+# Sync process just waiting for server to be ready to accept connection.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid=$!
+
+# Start simulated server.
+# The first refresh replies with an unchanged topology, the second with a
+# topology where the node only serves some of the slots.
+timeout 5s ./simulated-valkey.pl -p 7401 -d --sigcont $syncpid <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7401, "nodeid7401"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "one"
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7401, "nodeid7401"]]]
+EXPECT ["GET", "foo"]
+SEND "two"
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 8000, ["127.0.0.1", 7401, "nodeid7401"]]]
+EXPECT ["GET", "bar"]
+SEND "three"
+EXPECT CLOSE
+EOF
+server=$!
+
+# Wait until server is ready to accept client connection
+wait $syncpid;
+
+# Run client. Refreshes are made at 750 ms and 1500 ms, while the commands
+# are sent at 0, 1000 and 2000 ms.
+timeout 4s "$clientprog" --events --blocking-initial-update --topology-refresh 750 127.0.0.1:7401 > "$testname.out" <<'EOF'
+GET foo
+!sleep
+GET foo
+!sleep
+GET bar
+EOF
+clientexit=$?
+
+# Wait for server to exit
+wait $server; serverexit=$?
+
+# Check exit status on server.
+if [ $serverexit -ne 0 ]; then
+    echo "Simulated server exited with status $serverexit"
+    exit $serverexit
+fi
+# Check exit status on client.
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+expected="Event: slotmap-updated
+Event: ready
+one
+two
+Event: slotmap-updated
+three
+Event: free-context"
+
+echo "$expected" | diff -u - "$testname.out" || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,59 @@
+#!/bin/sh
+#
+# Verify that a transaction exceeding the output buffer limit is rejected as
+# a whole, without sending a part of it, and that the connection is kept.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient_async}
+testname=transaction-obuf-limit-test-async
+
+# Sync process just waiting for server to be ready to accept connection.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid=$!
+
+# Start simulated valkey node.
+timeout 5s ./simulated-valkey.pl -p 7412 -d --sigcont $syncpid <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7412, "nodeid7412"]]]
+EXPECT ["GET", "foo"]
+SEND "bar"
+EXPECT CLOSE
+EOF
+server=$!
+
+# Wait until server is ready to accept client connection
+wait $syncpid;
+
+# Run client. The transaction doesn't fit in 64 bytes, but each command does.
+timeout 4s "$clientprog" --max-obuf-size 64 127.0.0.1:7412 > "$testname.out" <<'EOF'
+!multi
+SET foo 1
+INCR foo
+!exec
+GET foo
+EOF
+clientexit=$?
+
+# Wait for server to exit
+wait $server; serverexit=$?
+
+# Check exit statuses
+if [ $serverexit -ne 0 ]; then
+    echo "Simulated server exited with status $serverexit"
+    exit $serverexit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+expected="error: Output buffer limit exceeded
+bar"
+
+echo "$expected" | diff -u - "$testname.out" || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,111 @@
+#!/bin/sh
+#
+# Verify that a transaction is sent as MULTI..EXEC to the node serving its
+# slot, that it's retried as a whole when a queued command is redirected using
+# MOVED or ASK, and that keys in different slots are rejected.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient_async}
+testname=transaction-test-async
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated valkey node #1
+timeout 5s ./simulated-valkey.pl -p 7409 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7409, "nodeid7409"]]]
+EXPECT ["MULTI"]
+SEND +OK
+EXPECT ["SET", "foo", "1"]
+SEND -MOVED 12182 127.0.0.1:7410
+EXPECT ["INCR", "foo"]
+SEND -MOVED 12182 127.0.0.1:7410
+EXPECT ["EXEC"]
+SEND -EXECABORT Transaction discarded because of previous errors.
+EXPECT ["ASKING"]
+SEND +OK
+EXPECT ["MULTI"]
+SEND +OK
+EXPECT ["GET", "foo"]
+SEND +QUEUED
+EXPECT ["EXEC"]
+SEND *1\r\n$1\r\n2\r\n
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated valkey node #2
+timeout 5s ./simulated-valkey.pl -p 7410 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["MULTI"]
+SEND +OK
+EXPECT ["SET", "foo", "1"]
+SEND +QUEUED
+EXPECT ["INCR", "foo"]
+SEND +QUEUED
+EXPECT ["EXEC"]
+SEND *2\r\n+OK\r\n:2\r\n
+EXPECT ["MULTI"]
+SEND +OK
+EXPECT ["GET", "foo"]
+SEND -ASK 12182 127.0.0.1:7409
+EXPECT ["EXEC"]
+SEND -EXECABORT Transaction discarded because of previous errors.
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client
+timeout 4s "$clientprog" 127.0.0.1:7409 > "$testname.out" <<'EOF'
+!multi
+SET foo 1
+INCR foo
+!exec
+!multi
+GET foo
+!exec
+!multi
+GET foo
+GET bar
+!exec
+EOF
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+expected="OK
+2
+2
+error: failed to append 'GET bar'
+error: Keys of the transaction hash to different slots"
+
+echo "$expected" | diff -u - "$testname.out" || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,69 @@
+#!/bin/bash
+#
+# Verify that commands getting TRYAGAIN or CLUSTERDOWN are retried after a
+# delay using exponential backoff, until they succeed.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient_async}
+testname=tryagain-backoff-test-async
+
+# Sync process just waiting for server to be ready to accept connection.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid=$!
+
+# Start simulated server
+timeout 5s ./simulated-valkey.pl -p 7401 -d --sigcont $syncpid <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7401, "nodeid7401"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["SET", "foo", "bar"]
+SEND -TRYAGAIN Multiple keys request during rehashing of slot
+EXPECT ["SET", "foo", "bar"]
+SEND -CLUSTERDOWN The cluster is down
+EXPECT ["SET", "foo", "bar"]
+SEND +OK
+EXPECT ["GET", "foo"]
+SEND "bar"
+EXPECT CLOSE
+EOF
+server=$!
+
+# Wait until server is ready to accept client connection
+wait $syncpid;
+
+# Run client. The first retry is delayed 25-50 ms, and the second 50-100 ms.
+start=$(date +%s%N)
+timeout 3s "$clientprog" --blocking-initial-update --max-retry 2 127.0.0.1:7401 > "$testname.out" <<'EOF'
+SET foo bar
+GET foo
+EOF
+clientexit=$?
+elapsed_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+
+# Wait for server to exit
+wait $server; serverexit=$?
+
+# Check exit status on server.
+if [ $serverexit -ne 0 ]; then
+    echo "Simulated server exited with status $serverexit"
+    exit $serverexit
+fi
+# Check exit status on client.
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+printf 'OK\nbar\n' | cmp "$testname.out" - || exit 99
+
+if [ $elapsed_ms -lt 75 ]; then
+    echo "Retries were not delayed, finished in $elapsed_ms ms"
+    exit 98
+fi
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,93 @@
+/* Unit tests of the allocator for a single context: reply objects built by
+ * the reader are allocated using it and freed using freeReplyObject(). */
+
+#include "fmacros.h"
+
+#include "valkey.h"
+#include "valkey_private.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct counters {
+    int allocs;
+    int frees;
+} counters;
+
+static void *count_malloc(void *privdata, size_t size) {
+    ((counters *)privdata)->allocs++;
+    return malloc(size);
+}
+
+static void *count_calloc(void *privdata, size_t nmemb, size_t size) {
+    ((counters *)privdata)->allocs++;
+    return calloc(nmemb, size);
+}
+
+static void count_free(void *privdata, void *ptr) {
+    ((counters *)privdata)->frees++;
+    free(ptr);
+}
+
+static valkeyReply *read_reply(const valkeyAllocator *allocator, const char *resp) {
+    valkeyReader *reader = valkeyReaderCreate();
+    void *reply = NULL;
+
+    assert(reader != NULL);
+    reader->allocator = allocator;
+    assert(valkeyReaderFeed(reader, resp, strlen(resp)) == VALKEY_OK);
+    assert(valkeyReaderGetReply(reader, &reply) == VALKEY_OK);
+    assert(reply != NULL);
+    valkeyReaderFree(reader);
+    return reply;
+}
+
+void test_nested_reply(void) {
+    counters cnt = {0};
+    valkeyAllocator allocator = {count_malloc, count_calloc, count_free, &cnt};
+
+    valkeyReply *reply = read_reply(&allocator, "*4\r\n$3\r\nfoo\r\n:42\r\n"
+                                                "*2\r\n,3.14\r\n_\r\n#t\r\n");
+    assert(reply->type == VALKEY_REPLY_ARRAY);
+    assert(reply->elements == 4);
+    assert(strcmp(reply->element[0]->str, "foo") == 0);
+    assert(reply->element[1]->integer == 42);
+    assert(strcmp(reply->element[2]->element[0]->str, "3.14") == 0);
+    assert(reply->element[2]->element[1]->type == VALKEY_REPLY_NIL);
+    assert(reply->element[3]->integer == 1);
+
+    /* The arrays and strings allocate element lists and buffers. */
+    assert(cnt.allocs == 11);
+    assert(cnt.frees == 0);
+    freeReplyObject(reply);
+    assert(cnt.frees == cnt.allocs);
+}
+
+void test_verbatim_reply(void) {
+    counters cnt = {0};
+    valkeyAllocator allocator = {count_malloc, count_calloc, count_free, &cnt};
+
+    /* A verbatim string uses the global allocators. */
+    valkeyReply *reply = read_reply(&allocator, "*2\r\n=7\r\ntxt:foo\r\n+OK\r\n");
+    assert(strcmp(reply->element[0]->vtype, "txt") == 0);
+    assert(strcmp(reply->element[0]->str, "foo") == 0);
+    assert(strcmp(reply->element[1]->str, "OK") == 0);
+    assert(cnt.allocs == 4);
+    freeReplyObject(reply);
+    assert(cnt.frees == cnt.allocs);
+}
+
+void test_global_allocators(void) {
+    valkeyReply *reply = read_reply(NULL, "*1\r\n$3\r\nfoo\r\n");
+    assert(strcmp(reply->element[0]->str, "foo") == 0);
+    assert(valkeyReplyGetOwner(reply) == VALKEY_REPLY_OWNER_GLOBAL);
+    freeReplyObject(reply);
+}
+
+int main(void) {
+    test_nested_reply();
+    test_verbatim_reply();
+    test_global_allocators();
+    return 0;
+}
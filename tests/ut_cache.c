@@ -0,0 +1,292 @@
+/* Unit tests of the client-side cache: which commands are cached, the LRU
+ * eviction, the memory accounting and the handling of invalidation messages. */
+
+#include "fmacros.h"
+
+#include "cache_private.h"
+#include "sds.h"
+#include "valkey.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Parse a RESP encoded reply. */
+static valkeyReply *create_reply(const char *resp) {
+    valkeyReader *reader = valkeyReaderCreate();
+    void *reply = NULL;
+
+    assert(valkeyReaderFeed(reader, resp, strlen(resp)) == VALKEY_OK);
+    assert(valkeyReaderGetReply(reader, &reply) == VALKEY_OK);
+    assert(reply != NULL);
+    valkeyReaderFree(reader);
+    return reply;
+}
+
+static sds format_command(const char *cmd) {
+    char *buf;
+    int len = valkeyFormatCommand(&buf, cmd);
+    assert(len > 0);
+    sds s = sdsnewlen(buf, len);
+    valkeyFreeCommand(buf);
+    return s;
+}
+
+static int is_cacheable(valkeyCache *cache, const char *cmd) {
+    sds s = format_command(cmd);
+    int res = valkeyCacheIsCacheable(cache, s, sdslen(s));
+    sdsfree(s);
+    return res;
+}
+
+static int store_db(valkeyCache *cache, int db, const char *cmd, const char *resp) {
+    sds s = format_command(cmd);
+    valkeyReply *reply = create_reply(resp);
+    int res = valkeyCacheStore(cache, db, s, sdslen(s), reply);
+    freeReplyObject(reply);
+    sdsfree(s);
+    return res;
+}
+
+static int store(valkeyCache *cache, const char *cmd, const char *resp) {
+    return store_db(cache, 0, cmd, resp);
+}
+
+static valkeyCacheEntry *lookup_db(valkeyCache *cache, int db, const char *cmd) {
+    sds s = format_command(cmd);
+    valkeyCacheEntry *entry = valkeyCacheLookup(cache, db, s, sdslen(s));
+    sdsfree(s);
+    return entry;
+}
+
+static valkeyCacheEntry *lookup(valkeyCache *cache, const char *cmd) {
+    return lookup_db(cache, 0, cmd);
+}
+
+/* Returns 1 if the command has a cached reply, without counting it. */
+static int is_cached(valkeyCache *cache, const char *cmd) {
+    valkeyCacheStats before, after;
+    valkeyCacheGetStats(cache, &before);
+    valkeyCacheEntry *entry = lookup(cache, cmd);
+    if (entry != NULL)
+        valkeyCacheEntryRelease(entry);
+    valkeyCacheGetStats(cache, &after);
+    assert(after.hits + after.misses == before.hits + before.misses + 1);
+    return entry != NULL;
+}
+
+static void handle_push(valkeyCache *cache, const char *resp, int expected) {
+    valkeyReply *reply = create_reply(resp);
+    assert(valkeyCacheHandlePush(cache, reply) == expected);
+    freeReplyObject(reply);
+}
+
+void test_cacheable_commands(void) {
+    valkeyCache *cache = valkeyCacheCreate(NULL);
+    assert(cache);
+
+    assert(is_cacheable(cache, "GET foo"));
+    assert(is_cacheable(cache, "get foo"));
+    assert(is_cacheable(cache, "HGET foo field"));
+    assert(is_cacheable(cache, "HMGET foo a b c d e f g h i j"));
+    assert(is_cacheable(cache, "LRANGE foo 0 -1"));
+    assert(!is_cacheable(cache, "SET foo bar"));
+    assert(!is_cacheable(cache, "MGET foo bar"));
+    assert(!is_cacheable(cache, "GETDEL foo"));
+    assert(!is_cacheable(cache, "PING"));
+    assert(!is_cacheable(cache, "GET"));
+
+    valkeyCacheFree(cache);
+}
+
+void test_store_and_lookup(void) {
+    valkeyCacheStats stats;
+    valkeyCacheEntry *entry;
+    valkeyCache *cache = valkeyCacheCreate(NULL);
+    assert(cache);
+
+    assert(lookup(cache, "GET foo") == NULL);
+    assert(store(cache, "GET foo", "$3\r\nbar\r\n") == VALKEY_OK);
+    assert(store(cache, "HGET foo f", "-WRONGTYPE wrong kind\r\n") == VALKEY_ERR);
+    assert(store(cache, "SET foo bar", "+OK\r\n") == VALKEY_ERR);
+
+    entry = lookup(cache, "GET foo");
+    assert(entry != NULL);
+    valkeyReply *reply = valkeyCacheEntryReply(entry);
+    assert(reply->type == VALKEY_REPLY_STRING);
+    assert(strcmp(reply->str, "bar") == 0);
+    valkeyCacheEntryRelease(entry);
+
+    /* A stored reply replaces an earlier one. */
+    assert(store(cache, "GET foo", "$3\r\nbaz\r\n") == VALKEY_OK);
+    entry = lookup(cache, "GET foo");
+    assert(entry != NULL);
+    assert(strcmp(valkeyCacheEntryReply(entry)->str, "baz") == 0);
+    valkeyCacheEntryRelease(entry);
+
+    valkeyCacheGetStats(cache, &stats);
+    assert(stats.hits == 2);
+    assert(stats.misses == 1);
+    assert(stats.entries == 1);
+    assert(stats.used_memory > 0);
+
+    valkeyCacheFlush(cache);
+    valkeyCacheGetStats(cache, &stats);
+    assert(stats.entries == 0);
+    assert(stats.used_memory == 0);
+
+    valkeyCacheFree(cache);
+}
+
+void test_invalidation(void) {
+    valkeyCacheStats stats;
+    valkeyCache *cache = valkeyCacheCreate(NULL);
+    assert(cache);
+
+    assert(store(cache, "HGET foo a", "$1\r\n1\r\n") == VALKEY_OK);
+    assert(store(cache, "HGET foo b", "$1\r\n2\r\n") == VALKEY_OK);
+    assert(store(cache, "HLEN foo", ":2\r\n") == VALKEY_OK);
+    assert(store(cache, "GET bar", "$1\r\n3\r\n") == VALKEY_OK);
+
+    /* Other push messages are ignored. */
+    handle_push(cache, ">3\r\n$7\r\nmessage\r\n$2\r\nch\r\n$3\r\nmsg\r\n", 0);
+
+    handle_push(cache, ">2\r\n$10\r\ninvalidate\r\n*1\r\n$3\r\nfoo\r\n", 1);
+    assert(!is_cached(cache, "HGET foo a"));
+    assert(!is_cached(cache, "HGET foo b"));
+    assert(!is_cached(cache, "HLEN foo"));
+    assert(is_cached(cache, "GET bar"));
+
+    valkeyCacheGetStats(cache, &stats);
+    assert(stats.invalidations == 3);
+    assert(stats.entries == 1);
+
+    /* A pinned reply stays valid when invalidated. */
+    valkeyCacheEntry *entry = lookup(cache, "GET bar");
+    assert(entry != NULL);
+
+    /* Sent on FLUSHALL. */
+    handle_push(cache, ">2\r\n$10\r\ninvalidate\r\n_\r\n", 1);
+    assert(strcmp(valkeyCacheEntryReply(entry)->str, "3") == 0);
+    valkeyCacheEntryRelease(entry);
+
+    valkeyCacheGetStats(cache, &stats);
+    assert(stats.invalidations == 4);
+    assert(stats.entries == 0);
+    assert(stats.used_memory == 0);
+
+    valkeyCacheFree(cache);
+}
+
+/* The replies are cached per database, and invalidated in all databases. */
+void test_databases(void) {
+    valkeyCacheStats stats;
+    valkeyCacheEntry *entry;
+    valkeyCache *cache = valkeyCacheCreate(NULL);
+    assert(cache);
+
+    assert(store_db(cache, 0, "GET foo", "$1\r\n0\r\n") == VALKEY_OK);
+    assert(lookup_db(cache, 1, "GET foo") == NULL);
+    assert(store_db(cache, 1, "GET foo", "$1\r\n1\r\n") == VALKEY_OK);
+
+    entry = lookup_db(cache, 0, "GET foo");
+    assert(entry != NULL);
+    assert(strcmp(valkeyCacheEntryReply(entry)->str, "0") == 0);
+    valkeyCacheEntryRelease(entry);
+    entry = lookup_db(cache, 1, "GET foo");
+    assert(entry != NULL);
+    assert(strcmp(valkeyCacheEntryReply(entry)->str, "1") == 0);
+    valkeyCacheEntryRelease(entry);
+
+    valkeyCacheGetStats(cache, &stats);
+    assert(stats.entries == 2);
+
+    /* Invalidation messages don't name the database. */
+    handle_push(cache, ">2\r\n$10\r\ninvalidate\r\n*1\r\n$3\r\nfoo\r\n", 1);
+    valkeyCacheGetStats(cache, &stats);
+    assert(stats.invalidations == 2);
+    assert(stats.entries == 0);
+    assert(stats.used_memory == 0);
+
+    valkeyCacheFree(cache);
+}
+
+void test_lru_eviction(void) {
+    valkeyCacheStats stats;
+    char cmd[32];
+
+    /* Measure the memory used by a single reply. */
+    valkeyCache *cache = valkeyCacheCreate(NULL);
+    assert(store(cache, "GET key:0", "$10\r\n0123456789\r\n") == VALKEY_OK);
+    valkeyCacheGetStats(cache, &stats);
+    size_t size = stats.used_memory;
+    valkeyCacheFree(cache);
+
+    /* Room for three replies. */
+    valkeyCacheOptions options = {0};
+    options.max_memory = 3 * size + size / 2;
+    cache = valkeyCacheCreate(&options);
+    assert(cache);
+
+    for (int i = 0; i < 3; i++) {
+        sprintf(cmd, "GET key:%d", i);
+        assert(store(cache, cmd, "$10\r\n0123456789\r\n") == VALKEY_OK);
+    }
+    assert(is_cached(cache, "GET key:0")); /* Now the most recently used. */
+    assert(store(cache, "GET key:3", "$10\r\n0123456789\r\n") == VALKEY_OK);
+
+    assert(is_cached(cache, "GET key:0"));
+    assert(!is_cached(cache, "GET key:1"));
+    assert(is_cached(cache, "GET key:2"));
+    assert(is_cached(cache, "GET key:3"));
+
+    valkeyCacheGetStats(cache, &stats);
+    assert(stats.evictions == 1);
+    assert(stats.entries == 3);
+    assert(stats.used_memory == 3 * size);
+
+    /* A reply larger than the cache is not stored. */
+    char big[64 + 4096];
+    sprintf(big, "$4096\r\n%4096d\r\n", 0);
+    assert(store(cache, "GET big", big) == VALKEY_ERR);
+    valkeyCacheGetStats(cache, &stats);
+    assert(stats.entries == 3);
+
+    valkeyCacheFree(cache);
+}
+
+void test_bcast_prefixes(void) {
+    const char *prefixes[] = {"user:", "session:"};
+    valkeyCacheOptions options = {0};
+    options.bcast = 1;
+    options.prefixes = prefixes;
+    options.num_prefixes = 2;
+    valkeyCache *cache = valkeyCacheCreate(&options);
+    assert(cache);
+
+    assert(is_cacheable(cache, "GET user:1"));
+    assert(is_cacheable(cache, "HGETALL session:abc"));
+    assert(!is_cacheable(cache, "GET product:1"));
+    assert(store(cache, "GET product:1", "$1\r\n1\r\n") == VALKEY_ERR);
+
+    char *cmd;
+    long long len = valkeyCacheFormatTracking(cache, &cmd);
+    sds expected = format_command("CLIENT TRACKING ON BCAST PREFIX user: PREFIX session:");
+    assert(len == (long long)sdslen(expected));
+    assert(memcmp(cmd, expected, len) == 0);
+    valkeyFreeCommand(cmd);
+    sdsfree(expected);
+
+    valkeyCacheFree(cache);
+}
+
+int main(void) {
+    test_cacheable_commands();
+    test_store_and_lookup();
+    test_invalidation();
+    test_databases();
+    test_lru_eviction();
+    test_bcast_prefixes();
+    return 0;
+}
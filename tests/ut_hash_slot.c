@@ -0,0 +1,185 @@
+/* Unit tests of the CRC16 and hash slot calculations.
+ *
+ * The results are verified against a reference implementation using the
+ * bytewise table lookup. When started with the argument `--bench` the time
+ * used by the reference and the library implementations is also printed. */
+
+#include "fmacros.h"
+
+#include "cluster.h"
+#include "vkutil.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_KEYS 100000
+#define BENCH_ROUNDS 20
+
+static uint16_t ref_crc16tab[256];
+
+static void ref_crc16_init(void) {
+    for (int b = 0; b < 256; b++) {
+        uint16_t crc = b << 8;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        ref_crc16tab[b] = crc;
+    }
+}
+
+static uint16_t ref_crc16(const char *buf, int len) {
+    uint16_t crc = 0;
+    for (int i = 0; i < len; i++)
+        crc = (crc << 8) ^ ref_crc16tab[((crc >> 8) ^ buf[i]) & 0x00FF];
+    return crc;
+}
+
+static unsigned int ref_keyHashSlot(const char *key, int keylen) {
+    int s, e;
+
+    for (s = 0; s < keylen; s++)
+        if (key[s] == '{')
+            break;
+    if (s == keylen)
+        return ref_crc16(key, keylen) & 0x3FFF;
+
+    for (e = s + 1; e < keylen; e++)
+        if (key[e] == '}')
+            break;
+    if (e == keylen || e == s + 1)
+        return ref_crc16(key, keylen) & 0x3FFF;
+
+    return ref_crc16(key + s + 1, e - s - 1) & 0x3FFF;
+}
+
+/* Create random keys of varying length, some containing hash tags. */
+static char **create_keys(size_t *keylens, size_t count) {
+    static const char charset[] = "abcdefghijklmnopqrstuvwxyz0123456789:{}";
+    char **keys = malloc(count * sizeof(char *));
+    assert(keys);
+    for (size_t i = 0; i < count; i++) {
+        size_t len = rand() % 64;
+        keys[i] = malloc(len + 1);
+        assert(keys[i]);
+        for (size_t j = 0; j < len; j++)
+            keys[i][j] = charset[rand() % (sizeof(charset) - 1)];
+        keys[i][len] = '\0';
+        keylens[i] = len;
+    }
+    return keys;
+}
+
+void test_crc16(void) {
+    assert(crc16("123456789", 9) == 0x31C3);
+    assert(crc16("", 0) == 0);
+
+    char buf[256];
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = (char)(rand() & 0xff);
+
+    /* Verify all lengths and alignments, including bytes above 0x7f. */
+    for (int offset = 0; offset < 8; offset++) {
+        for (int len = 0; len <= (int)sizeof(buf) - offset; len++) {
+            assert(crc16(buf + offset, len) == ref_crc16(buf + offset, len));
+        }
+    }
+}
+
+/* Get the slot for a single key using the batch API. */
+static unsigned int get_slot(const char *key) {
+    size_t keylen = strlen(key);
+    unsigned int slot;
+    valkeyClusterGetSlotsByKeys(&key, &keylen, 1, &slot);
+    return slot;
+}
+
+void test_slot_by_key(void) {
+    assert(get_slot("foo") == 12182);
+    assert(get_slot("{user1000}.following") == get_slot("user1000"));
+    assert(get_slot("foo{}{bar}") == ref_keyHashSlot("foo{}{bar}", 10));
+    assert(get_slot("foo{{bar}}zap") == get_slot("{bar"));
+    assert(get_slot("foo{bar}{zap}") == get_slot("bar"));
+    assert(get_slot("{foo") == ref_keyHashSlot("{foo", 4));
+}
+
+void test_slots_by_keys(void) {
+    size_t keylens[1000];
+    char **keys = create_keys(keylens, 1000);
+    unsigned int slots[1000];
+
+    valkeyClusterGetSlotsByKeys((const char **)keys, keylens, 1000, slots);
+    for (size_t i = 0; i < 1000; i++) {
+        assert(slots[i] == ref_keyHashSlot(keys[i], keylens[i]));
+        free(keys[i]);
+    }
+    free(keys);
+}
+
+void test_slot_by_command(void) {
+    char *cmd;
+    int len;
+
+    len = valkeyFormatCommand(&cmd, "SET %s %s", "{user1000}.following", "v");
+    assert(valkeyClusterGetSlotByCommand(cmd, len) == (int)get_slot("user1000"));
+    valkeyFreeCommand(cmd);
+
+    len = valkeyFormatCommand(&cmd, "MGET foo bar");
+    assert(valkeyClusterGetSlotByCommand(cmd, len) == 12182);
+    valkeyFreeCommand(cmd);
+
+    /* No key or incomplete command. */
+    len = valkeyFormatCommand(&cmd, "PING");
+    assert(valkeyClusterGetSlotByCommand(cmd, len) == -1);
+    valkeyFreeCommand(cmd);
+    assert(valkeyClusterGetSlotByCommand("*2\r\n$3\r\nGET\r\n", 13) == -1);
+    assert(valkeyClusterGetSlotByCommand(NULL, 0) == -1);
+}
+
+/* Compare the time used by the reference and library implementations. */
+void bench_slots_by_keys(void) {
+    size_t *keylens = malloc(NUM_KEYS * sizeof(size_t));
+    unsigned int *slots = malloc(NUM_KEYS * sizeof(unsigned int));
+    assert(keylens && slots);
+    char **keys = create_keys(keylens, NUM_KEYS);
+    unsigned int sum = 0;
+
+    int64_t start = vk_usec_now();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (size_t i = 0; i < NUM_KEYS; i++)
+            sum += ref_keyHashSlot(keys[i], keylens[i]);
+    }
+    int64_t ref_usec = vk_usec_now() - start;
+
+    start = vk_usec_now();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        valkeyClusterGetSlotsByKeys((const char **)keys, keylens, NUM_KEYS,
+                                    slots);
+        sum += slots[r];
+    }
+    int64_t usec = vk_usec_now() - start;
+
+    printf("Keys: %d x %d\n", NUM_KEYS, BENCH_ROUNDS);
+    printf("Reference: %lld usec\n", (long long)ref_usec);
+    printf("valkeyClusterGetSlotsByKeys: %lld usec\n", (long long)usec);
+    printf("Checksum: %u\n", sum);
+
+    for (size_t i = 0; i < NUM_KEYS; i++)
+        free(keys[i]);
+    free(keys);
+    free(slots);
+    free(keylens);
+}
+
+int main(int argc, char **argv) {
+    ref_crc16_init();
+
+    test_crc16();
+    test_slot_by_key();
+    test_slots_by_keys();
+    test_slot_by_command();
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        bench_slots_by_keys();
+    return 0;
+}
@@ -0,0 +1,107 @@
+/* Unit tests of the memory usage of contexts and of the output buffer limit,
+ * using connections over a socket pair without a server. */
+
+#include "fmacros.h"
+
+#include "async.h"
+#include "valkey.h"
+
+#include <assert.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int peer_fd = -1;
+
+static void connect_options(valkeyOptions *options, size_t max_obuf_size) {
+    int fds[2];
+
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    peer_fd = fds[1];
+
+    memset(options, 0, sizeof(*options));
+    options->type = VALKEY_CONN_USERFD;
+    options->endpoint.fd = fds[0];
+    options->max_obuf_size = max_obuf_size;
+}
+
+void test_sync_limit(void) {
+    valkeyOptions options;
+    valkeyMemoryUsage usage;
+
+    connect_options(&options, 100);
+    valkeyContext *c = valkeyConnectWithOptions(&options);
+    assert(c != NULL && c->err == 0);
+
+    valkeyGetMemoryUsage(c, &usage);
+    assert(usage.reader > 0);
+    assert(usage.callbacks == 0 && usage.subscriptions == 0);
+    assert(usage.total == usage.obuf + usage.reader);
+
+    /* The pipelined commands are held in the output buffer. */
+    size_t obuf = usage.obuf;
+    assert(valkeyAppendCommand(c, "SET %s %s", "key", "value") == VALKEY_OK);
+    valkeyGetMemoryUsage(c, &usage);
+    assert(usage.obuf > obuf);
+
+    /* A command exceeding the limit is rejected with an error that doesn't
+     * prevent using the context. */
+    char value[100];
+    memset(value, 'x', sizeof(value));
+    assert(valkeyAppendCommand(c, "SET %s %b", "key", value, sizeof(value)) == VALKEY_ERR);
+    assert(c->err == VALKEY_ERR_OUTPUT_LIMIT);
+    assert(strcmp(c->errstr, "Output buffer limit exceeded") == 0);
+    assert(valkeyCommand(c, "SET %s %b", "key", value, sizeof(value)) == NULL);
+    assert(c->err == VALKEY_ERR_OUTPUT_LIMIT);
+
+    /* The reply to the pipelined command is still read. */
+    valkeyReply *reply;
+    assert(write(peer_fd, "+OK\r\n", 5) == 5);
+    assert(valkeyGetReply(c, (void **)&reply) == VALKEY_OK);
+    assert(c->err == 0);
+    assert(reply->type == VALKEY_REPLY_STATUS && strcmp(reply->str, "OK") == 0);
+    freeReplyObject(reply);
+    assert(valkeyAppendCommand(c, "GET %s", "key") == VALKEY_OK);
+
+    valkeyFree(c);
+    close(peer_fd);
+}
+
+void test_async_usage(void) {
+    valkeyOptions options;
+    valkeyMemoryUsage usage;
+
+    connect_options(&options, 200);
+    valkeyAsyncContext *ac = valkeyAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+
+    /* Each pending command has a callback. */
+    assert(valkeyAsyncCommand(ac, NULL, NULL, "GET foo") == VALKEY_OK);
+    assert(valkeyAsyncCommand(ac, NULL, NULL, "GET bar") == VALKEY_OK);
+    valkeyAsyncGetMemoryUsage(ac, &usage);
+    assert(usage.callbacks == 2 * sizeof(valkeyCallback));
+    assert(usage.subscriptions == 0);
+    assert(usage.obuf >= strlen("*2\r\n$3\r\nGET\r\n$3\r\nfoo\r\n") * 2);
+
+    assert(valkeyAsyncCommand(ac, NULL, NULL, "SUBSCRIBE a b") == VALKEY_OK);
+    valkeyAsyncGetMemoryUsage(ac, &usage);
+    assert(usage.subscriptions > 2 * sizeof(valkeyCallback));
+    assert(usage.total == usage.obuf + usage.reader + usage.callbacks +
+                              usage.subscriptions);
+
+    /* A command exceeding the limit is rejected, keeping the connection. */
+    char value[200];
+    memset(value, 'x', sizeof(value));
+    assert(valkeyAsyncCommand(ac, NULL, NULL, "PUBLISH a %b", value, sizeof(value)) == VALKEY_ERR);
+    assert(ac->err == 0);
+    assert(valkeyAsyncCommand(ac, NULL, NULL, "PING") == VALKEY_OK);
+
+    valkeyAsyncFree(ac);
+    close(peer_fd);
+}
+
+int main(void) {
+    test_sync_limit();
+    test_async_usage();
+    return 0;
+}
@@ -0,0 +1,197 @@
+/* Unit tests of the thread-local free lists of reply objects: small
+ * allocations of freed replies are reused by the next replies, up to the
+ * limit. When started with the argument `--bench` the number of allocations
+ * and the time used per reply are printed, with and without free lists. */
+
+#include "fmacros.h"
+
+#include "valkey.h"
+#include "valkey_private.h"
+#include "vkutil.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_ROUNDS 200000
+
+/* Nested reply with short strings and an element longer than 64 bytes. */
+#define REPLY "*4\r\n$3\r\nfoo\r\n:42\r\n*2\r\n+bar\r\n,3.14\r\n" \
+              "$70\r\n0123456789012345678901234567890123456789"    \
+              "012345678901234567890123456789\r\n"
+
+static long long allocs;
+static long long frees;
+
+static void *count_malloc(size_t size) {
+    allocs++;
+    return malloc(size);
+}
+
+static void *count_calloc(size_t nmemb, size_t size) {
+    allocs++;
+    return calloc(nmemb, size);
+}
+
+static void *count_realloc(void *ptr, size_t size) {
+    if (ptr == NULL)
+        allocs++;
+    return realloc(ptr, size);
+}
+
+static char *count_strdup(const char *str) {
+    allocs++;
+    return strdup(str);
+}
+
+static void count_free(void *ptr) {
+    if (ptr != NULL)
+        frees++;
+    free(ptr);
+}
+
+static void set_counting_allocators(void) {
+    valkeyAllocFuncs fns = {
+        .mallocFn = count_malloc,
+        .callocFn = count_calloc,
+        .reallocFn = count_realloc,
+        .strdupFn = count_strdup,
+        .freeFn = count_free,
+    };
+    valkeySetAllocators(&fns);
+    allocs = frees = 0;
+}
+
+static valkeyReply *read_reply(valkeyReader *reader) {
+    void *reply = NULL;
+
+    assert(valkeyReaderFeed(reader, REPLY, strlen(REPLY)) == VALKEY_OK);
+    assert(valkeyReaderGetReply(reader, &reply) == VALKEY_OK);
+    assert(reply != NULL);
+    return reply;
+}
+
+/* Number of allocations when reading and freeing a reply. */
+static long long count_reply_allocs(valkeyReader *reader) {
+    long long before = allocs;
+    freeReplyObject(read_reply(reader));
+    return allocs - before;
+}
+
+void test_reuse(void) {
+    set_counting_allocators();
+    valkeyReader *reader = valkeyReaderCreate();
+    assert(reader != NULL);
+
+    long long disabled = count_reply_allocs(reader);
+    assert(disabled == count_reply_allocs(reader));
+
+    /* Only the long string is allocated once the lists are filled. */
+    valkeySetReplyFreelistLimit(4096);
+    assert(count_reply_allocs(reader) == disabled);
+    assert(count_reply_allocs(reader) == 1);
+
+    valkeyReply *reply = read_reply(reader);
+    assert(reply->elements == 4);
+    assert(strcmp(reply->element[0]->str, "foo") == 0);
+    assert(reply->element[1]->integer == 42);
+    assert(strcmp(reply->element[2]->element[0]->str, "bar") == 0);
+    assert(reply->element[2]->element[1]->dval == 3.14);
+    assert(reply->element[3]->len == 70);
+    assert(valkeyReplyGetOwner(reply) == VALKEY_REPLY_OWNER_POOLED);
+    freeReplyObject(reply);
+
+    /* The lists are freed when trimmed. */
+    valkeyReaderFree(reader);
+    assert(frees < allocs);
+    valkeyTrimReplyFreelist();
+    assert(frees == allocs);
+
+    valkeySetReplyFreelistLimit(0);
+    valkeyResetAllocators();
+}
+
+void test_limit(void) {
+    set_counting_allocators();
+    valkeyReader *reader = valkeyReaderCreate();
+    assert(reader != NULL);
+
+    /* The strings "foo", "bar" and "3.14" and the inner element vector are
+     * freed first and fill the lists using 16 byte blocks. */
+    valkeySetReplyFreelistLimit(64);
+    long long disabled = count_reply_allocs(reader);
+    assert(count_reply_allocs(reader) == disabled - 4);
+
+    /* Lowering the limit trims the lists. */
+    valkeySetReplyFreelistLimit(0);
+    assert(count_reply_allocs(reader) == disabled);
+
+    valkeyReaderFree(reader);
+    assert(frees == allocs);
+    valkeyResetAllocators();
+}
+
+void test_verbatim(void) {
+    set_counting_allocators();
+    valkeyReader *reader = valkeyReaderCreate();
+    void *reply = NULL;
+    assert(reader != NULL);
+
+    /* Verbatim strings aren't pooled, the arrays holding them are. */
+    valkeySetReplyFreelistLimit(4096);
+    for (int i = 0; i < 2; i++) {
+        const char *resp = "*1\r\n=7\r\ntxt:foo\r\n";
+        assert(valkeyReaderFeed(reader, resp, strlen(resp)) == VALKEY_OK);
+        assert(valkeyReaderGetReply(reader, &reply) == VALKEY_OK);
+        valkeyReply *r = reply;
+        assert(strcmp(r->element[0]->vtype, "txt") == 0);
+        assert(strcmp(r->element[0]->str, "foo") == 0);
+        freeReplyObject(reply);
+    }
+
+    valkeyReaderFree(reader);
+    valkeyTrimReplyFreelist();
+    assert(frees == allocs);
+    valkeySetReplyFreelistLimit(0);
+    valkeyResetAllocators();
+}
+
+static void bench_rounds(valkeyReader *reader, const char *name) {
+    long long before = allocs;
+    int64_t start = vk_usec_now();
+
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+        freeReplyObject(read_reply(reader));
+
+    int64_t usec = vk_usec_now() - start;
+    printf("%s: %.2f allocations/reply, %lld usec\n", name,
+           (double)(allocs - before) / BENCH_ROUNDS, (long long)usec);
+}
+
+/* Compare reading replies with and without free lists. */
+void bench_read_replies(void) {
+    set_counting_allocators();
+    valkeyReader *reader = valkeyReaderCreate();
+    assert(reader != NULL);
+
+    printf("Replies: %d\n", BENCH_ROUNDS);
+    bench_rounds(reader, "Without free lists");
+    valkeySetReplyFreelistLimit(4096);
+    bench_rounds(reader, "With free lists");
+
+    valkeyReaderFree(reader);
+    valkeyTrimReplyFreelist();
+    valkeySetReplyFreelistLimit(0);
+    valkeyResetAllocators();
+}
+
+int main(int argc, char **argv) {
+    test_reuse();
+    test_limit();
+    test_verbatim();
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        bench_read_replies();
+    return 0;
+}
@@ -0,0 +1,171 @@
+/* Unit tests of the script registry: the SHA1 digests naming the scripts,
+ * the conversion of a call from EVALSHA to EVAL, and the script calls of an
+ * async context using a client-side cache, replied to without a server. */
+
+#include "fmacros.h"
+
+#include "async.h"
+#include "cache.h"
+#include "script_private.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void check_sha(const char *body, size_t len, const char *expected) {
+    valkeyScript *script = valkeyScriptCreate(body, len);
+    assert(script != NULL);
+    assert(strcmp(valkeyScriptGetSha(script), expected) == 0);
+    valkeyScriptFree(script);
+}
+
+void test_sha(void) {
+    char buf[200];
+
+    check_sha("", 0, "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    check_sha("return 1", 8, "e0e1f9fabfc9d4800c877a703b823ac0578ff8db");
+
+    /* Padding fitting the last block, or needing another block. */
+    memset(buf, 'y', 55);
+    check_sha(buf, 55, "f3c8b47e97bc2a23d9870c16d129390bf78225bb");
+    memset(buf, 'z', 56);
+    check_sha(buf, 56, "aaf29dd7fdb380d32791213ae5acf0f6cea0c5e3");
+
+    /* Multiple blocks. */
+    memset(buf, 'x', 200);
+    check_sha(buf, 200, "94218caae9904e93a3d7bf578bf4791926fc5e82");
+}
+
+void test_format_call(void) {
+    const char *argv[] = {"key", "arg"};
+    valkeyScript *script = valkeyScriptCreate("return 1", 8);
+    assert(script != NULL);
+
+    sds evalsha = valkeyScriptFormatCall(script, 1, 2, argv, NULL);
+    assert(evalsha != NULL);
+    assert(strcmp(evalsha, "*5\r\n$7\r\nEVALSHA\r\n"
+                           "$40\r\ne0e1f9fabfc9d4800c877a703b823ac0578ff8db\r\n"
+                           "$1\r\n1\r\n$3\r\nkey\r\n$3\r\narg\r\n") == 0);
+
+    sds eval = valkeyScriptFormatEval(script, evalsha, sdslen(evalsha));
+    assert(eval != NULL);
+    assert(strcmp(eval, "*5\r\n$4\r\nEVAL\r\n$8\r\nreturn 1\r\n"
+                        "$1\r\n1\r\n$3\r\nkey\r\n$3\r\narg\r\n") == 0);
+
+    /* More keys than arguments. */
+    assert(valkeyScriptFormatCall(script, 3, 2, argv, NULL) == NULL);
+
+    sdsfree(evalsha);
+    sdsfree(eval);
+    valkeyScriptFree(script);
+}
+
+static int is_noscript(int type, const char *str) {
+    char buf[64];
+    valkeyReply reply = {0};
+    reply.type = type;
+    reply.len = strlen(str);
+    reply.str = memcpy(buf, str, reply.len + 1);
+    return valkeyScriptIsNoscript(&reply);
+}
+
+void test_noscript(void) {
+    assert(is_noscript(VALKEY_REPLY_ERROR, "NOSCRIPT No matching script."));
+    assert(!is_noscript(VALKEY_REPLY_ERROR, "ERR unknown"));
+    assert(!is_noscript(VALKEY_REPLY_STRING, "NOSCRIPT"));
+}
+
+static char last_reply[16];
+
+static void store_reply(valkeyAsyncContext *ac, void *r, void *privdata) {
+    valkeyReply *reply = r;
+    (void)ac;
+    (void)privdata;
+    assert(reply != NULL);
+    snprintf(last_reply, sizeof(last_reply), "%s", reply->str ? reply->str : "");
+}
+
+/* Accept a connection of an async context on a local port, to reply to its
+ * commands without a server. */
+static valkeyAsyncContext *connect_local(int *peer) {
+    struct sockaddr_in sa = {0};
+    socklen_t len = sizeof(sa);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    assert(fd >= 0);
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0);
+    assert(listen(fd, 1) == 0);
+    assert(getsockname(fd, (struct sockaddr *)&sa, &len) == 0);
+
+    valkeyAsyncContext *ac = valkeyAsyncConnect("127.0.0.1", ntohs(sa.sin_port));
+    assert(ac != NULL && ac->err == 0);
+    *peer = accept(fd, NULL, NULL);
+    assert(*peer >= 0);
+    close(fd);
+    return ac;
+}
+
+/* Reply to the pending commands from the peer. */
+static void peer_reply(valkeyAsyncContext *ac, int fd, const char *resp) {
+    assert(write(fd, resp, strlen(resp)) == (ssize_t)strlen(resp));
+    valkeyAsyncHandleRead(ac);
+}
+
+/* A script may modify its keys, so a read sent while a script call is pending
+ * is neither replied from nor stored in the cache, including after the call
+ * is retried using EVAL. */
+void test_async_cache_bypass(void) {
+    const char *argv[] = {"k", "new"};
+    int peer;
+
+    valkeyAsyncContext *ac = connect_local(&peer);
+    valkeyCache *cache = valkeyCacheCreate(NULL);
+    assert(cache != NULL);
+    valkeyScript *script = valkeyScriptCreate("return 1", 8);
+    assert(script != NULL);
+
+    /* Replies to HELLO and CLIENT TRACKING. */
+    assert(valkeyAsyncEnableCache(ac, cache) == VALKEY_OK);
+    peer_reply(ac, peer, "+OK\r\n+OK\r\n");
+
+    assert(valkeyAsyncCommand(ac, store_reply, NULL, "GET k") == VALKEY_OK);
+    peer_reply(ac, peer, "$3\r\nold\r\n");
+    assert(strcmp(last_reply, "old") == 0);
+
+    /* Replied from the server, not from the cache. */
+    assert(valkeyAsyncScriptCall(ac, NULL, NULL, script, 1, 2, argv, NULL) == VALKEY_OK);
+    last_reply[0] = '\0';
+    assert(valkeyAsyncCommand(ac, store_reply, NULL, "GET k") == VALKEY_OK);
+    assert(last_reply[0] == '\0');
+    peer_reply(ac, peer, ":1\r\n$3\r\nnew\r\n");
+    assert(strcmp(last_reply, "new") == 0);
+
+    /* The same when the script isn't loaded and EVAL is sent instead. */
+    assert(valkeyAsyncScriptCall(ac, NULL, NULL, script, 1, 2, argv, NULL) == VALKEY_OK);
+    peer_reply(ac, peer, "-NOSCRIPT No matching script.\r\n");
+    last_reply[0] = '\0';
+    assert(valkeyAsyncCommand(ac, store_reply, NULL, "GET k") == VALKEY_OK);
+    assert(last_reply[0] == '\0');
+    peer_reply(ac, peer, ":1\r\n$5\r\nnewer\r\n");
+    assert(strcmp(last_reply, "newer") == 0);
+
+    valkeyScriptFree(script);
+    valkeyAsyncFree(ac);
+    valkeyCacheFree(cache);
+    close(peer);
+}
+
+int main(void) {
+    test_sha();
+    test_format_call();
+    test_noscript();
+    test_async_cache_bypass();
+    return 0;
+}
@@ -1,5 +1,6 @@
 /* Unit tests of internal functions that parses node and slot information
- * during slotmap updates. */
+ * during slotmap updates. When started with the argument `--bench` the time
+ * used to parse a CLUSTER NODES reply of a large cluster is also printed. */
 
 #ifndef __has_feature
 #define __has_feature(feature) 0
@@ -19,6 +20,9 @@ const char *__asan_default_options(void) {
 
 #include <stdbool.h>
 
+#define LARGE_NUM_PRIMARIES 500 /* Each with one replica, i.e. 1000 nodes. */
+#define BENCH_ROUNDS 200
+
 valkeyReply *create_reply(const char *buf, size_t len);
 char *resp_encode_array(char *p, sds *resp);
 
@@ -46,6 +50,29 @@ valkeyReply *create_cluster_nodes_reply_resp3(const char *str) {
     return create_reply(buf, len);
 }
 
+/* Helper to create a CLUSTER NODES reply of a large cluster where each slot
+ * is assigned to the primaries in turn, i.e. all 16384 slot ranges are
+ * fragmented. Each primary has a replica listed before the primary. */
+valkeyReply *create_large_cluster_nodes_reply(void) {
+    sds str = sdsempty();
+    for (int i = 0; i < LARGE_NUM_PRIMARIES; i++) {
+        str = sdscatprintf(str, "%040x 10.0.%d.%d:%d@%d slave %040x 0 1426238317239 %d connected\n",
+                           i + LARGE_NUM_PRIMARIES, i / 250, i % 250 + 1, 7001, 17001, i, i + 1);
+        str = sdscatprintf(str, "%040x 10.0.%d.%d:%d@%d master - 0 1426238316232 %d connected",
+                           i, i / 250, i % 250 + 1, 7000, 17000, i + 1);
+        for (int slot = i; slot < VALKEYCLUSTER_SLOTS; slot += LARGE_NUM_PRIMARIES)
+            str = sdscatprintf(str, " %d", slot);
+        str = sdscat(str, "\n");
+    }
+    sds resp = sdscatprintf(sdsempty(), "$%zu\r\n", sdslen(str));
+    resp = sdscatsds(resp, str);
+    resp = sdscat(resp, "\r\n");
+    valkeyReply *reply = create_reply(resp, sdslen(resp));
+    sdsfree(str);
+    sdsfree(resp);
+    return reply;
+}
+
 /* Helper to create a cluster slots response.
  * Parses the string using a rudimentary JSON like format which accepts:
  * - arrays   example: [elem1, elem2]
@@ -66,6 +93,14 @@ valkeyReply *create_cluster_slots_reply(const char *str) {
     return reply;
 }
 
+/* Helper to create a valkeyReply that contains an error. */
+valkeyReply *create_error_reply(const char *str) {
+    char buf[1024];
+    int len = sprintf(buf, "-%s\r\n", str);
+
+    return create_reply(buf, len);
+}
+
 /* Create a valkeyReply from a RESP encoded buffer. */
 valkeyReply *create_reply(const char *buf, size_t len) {
     valkeyReply *reply;
@@ -509,6 +544,71 @@ void test_parse_cluster_nodes_with_parse_error(void) {
     valkeyClusterFree(cc);
 }
 
+/* Parse a cluster nodes reply from a large cluster with fragmented slots. */
+void test_parse_cluster_nodes_with_large_topology(void) {
+    valkeyClusterOptions options = {0};
+    options.options |= VALKEY_OPT_USE_REPLICAS;
+    valkeyClusterContext *cc = createClusterContext(&options);
+    valkeyContext *c = valkeyContextInit();
+    valkeyReply *reply = create_large_cluster_nodes_reply();
+
+    dict *nodes = parse_cluster_nodes(cc, c, reply);
+    freeReplyObject(reply);
+
+    assert(nodes);
+    assert(dictSize(nodes) == LARGE_NUM_PRIMARIES);
+    sds key = sdsnew("10.0.1.1:7000");
+    dictEntry *de = dictFind(nodes, key);
+    sdsfree(key);
+    assert(de);
+    valkeyClusterNode *node = dictGetVal(de);
+    assert(node->name[39] == 'a'); /* Primary number 250 */
+    assert(listLength(node->slots) == 33);
+    cluster_slot *slot = listNodeValue(listLast(node->slots));
+    assert(slot->start == 16250 && slot->end == 16250);
+    assert(listLength(node->replicas) == 1);
+    node = listNodeValue(listFirst(node->replicas));
+    assert(strcmp(node->addr, "10.0.1.1:7001") == 0);
+
+    /* Verify that the nodes form a complete slotmap. */
+    assert(updateNodesAndSlotmap(cc, nodes) == VALKEY_OK);
+    for (int i = 0; i < VALKEYCLUSTER_SLOTS; i++)
+        assert(cc->table[i] != NULL);
+
+    valkeyFree(c);
+    valkeyClusterFree(cc);
+}
+
+/* Measure the time used to parse a cluster nodes reply from a large cluster,
+ * with and without the parsing of replicas. */
+void bench_parse_cluster_nodes(void) {
+    valkeyContext *c = valkeyContextInit();
+    valkeyReply *reply = create_large_cluster_nodes_reply();
+
+    for (int parse_replicas = 0; parse_replicas <= 1; parse_replicas++) {
+        valkeyClusterOptions options = {0};
+        if (parse_replicas)
+            options.options |= VALKEY_OPT_USE_REPLICAS;
+        valkeyClusterContext *cc = createClusterContext(&options);
+
+        int64_t start = vk_usec_now();
+        for (int r = 0; r < BENCH_ROUNDS; r++) {
+            dict *nodes = parse_cluster_nodes(cc, c, reply);
+            assert(nodes);
+            dictRelease(nodes);
+        }
+        int64_t usec = vk_usec_now() - start;
+
+        printf("parse_cluster_nodes (%d primaries, %s replicas, %d slot ranges): "
+               "%lld usec per reply\n",
+               LARGE_NUM_PRIMARIES, parse_replicas ? "with" : "without",
+               VALKEYCLUSTER_SLOTS, (long long)(usec / BENCH_ROUNDS));
+        valkeyClusterFree(cc);
+    }
+    freeReplyObject(reply);
+    valkeyFree(c);
+}
+
 /* Redis pre-v4.0 returned node addresses without the clusterbus port,
  * i.e. `ip:port` instead of `ip:port@cport` */
 void test_parse_cluster_nodes_with_legacy_format(void) {
@@ -872,7 +972,380 @@ void test_parse_cluster_slots_with_noncontiguous_slots(void) {
     valkeyClusterFree(cc);
 }
 
-int main(void) {
+/* Apply MOVED redirects to the slotmap and verify when a full update is needed. */
+void test_apply_moved_redirect(bool incremental) {
+    valkeyClusterOptions options = {0};
+    options.max_slotmap_deltas = 2;
+    if (incremental)
+        options.options |= VALKEY_OPT_INCREMENTAL_SLOTMAP;
+
+    valkeyClusterContext *cc = createClusterContext(&options);
+    valkeyContext *c = valkeyContextInit();
+    valkeyClusterNode *node;
+    int slot, created;
+
+    valkeyReply *reply = create_cluster_slots_reply(
+        "[[0, 8191, ['127.0.0.1', 30001, 'nodeid1']],"
+        " [8192, 16383, ['127.0.0.1', 30002, 'nodeid2']]]");
+    dict *nodes = parse_cluster_slots(cc, c, reply);
+    freeReplyObject(reply);
+    assert(nodes);
+    assert(updateNodesAndSlotmap(cc, nodes) == VALKEY_OK);
+
+    /* Redirect to a known node. */
+    reply = create_error_reply("MOVED 100 127.0.0.1:30002");
+    slot = -1;
+    created = 0;
+    node = getNodeFromRedirectReply(cc, c, reply, &slot, &created);
+    freeReplyObject(reply);
+    assert(node);
+    assert(strcmp(node->addr, "127.0.0.1:30002") == 0);
+    assert(slot == 100);
+    assert(created == 0);
+    assert(clusterApplyMovedRedirect(cc, slot, node, created) == !incremental);
+    assert(cc->table[100] == node);
+    assert(cc->table[101] != node);
+
+    /* The limit of applied deltas is reached. */
+    assert(clusterApplyMovedRedirect(cc, 101, node, 0) == 1);
+    assert(cc->table[101] == node);
+
+    /* Redirect to an unknown node. */
+    reply = create_error_reply("MOVED 200 127.0.0.1:30003");
+    created = 0;
+    node = getNodeFromRedirectReply(cc, c, reply, &slot, &created);
+    freeReplyObject(reply);
+    assert(node);
+    assert(strcmp(node->addr, "127.0.0.1:30003") == 0);
+    assert(created == 1);
+    assert(dictSize(cc->nodes) == 3);
+    assert(clusterApplyMovedRedirect(cc, slot, node, created) == 1);
+    assert(cc->table[200] == node);
+
+    valkeyFree(c);
+    valkeyClusterFree(cc);
+}
+
+static int slotmap_updated_events = 0;
+
+static void countSlotmapEvents(const valkeyClusterContext *cc, int event,
+                               void *privdata);
+
+static dict *create_slots_nodes(valkeyClusterContext *cc, valkeyContext *c,
+                                const char *str) {
+    valkeyReply *reply = create_cluster_slots_reply(str);
+    dict *nodes = parse_cluster_slots(cc, c, reply);
+    freeReplyObject(reply);
+    assert(nodes);
+    return nodes;
+}
+
+/* A changed topology from a periodic refresh is applied as a diff, keeping
+ * the nodes that remain, while an unchanged topology is skipped. */
+void test_topology_diff(void) {
+    valkeyClusterOptions options = {0};
+    options.options |= VALKEY_OPT_USE_REPLICAS;
+    options.event_callback = countSlotmapEvents;
+    valkeyClusterContext *cc = createClusterContext(&options);
+    valkeyContext *c = valkeyContextInit();
+
+    dict *nodes = create_slots_nodes(cc, c,
+                                     "[[0, 8191, ['127.0.0.1', 30001, 'nodeid1']],"
+                                     " [8192, 12287, ['127.0.0.1', 30002, 'nodeid2']],"
+                                     " [12288, 16383, ['127.0.0.1', 30003, 'nodeid3']]]");
+    assert(updateNodesAndSlotmap(cc, nodes) == VALKEY_OK);
+    valkeyClusterNode *node1 = cc->table[0];
+    valkeyClusterNode *node2 = cc->table[8192];
+    valkeyClusterNode **table = cc->table;
+    int events = slotmap_updated_events;
+
+    nodes = create_slots_nodes(cc, c,
+                               "[[0, 8191, ['127.0.0.1', 30001, 'nodeid1']],"
+                               " [8192, 12287, ['127.0.0.1', 30002, 'nodeid2']],"
+                               " [12288, 16383, ['127.0.0.1', 30003, 'nodeid3']]]");
+    assert(updateTopology(cc, nodes, 1) == VALKEY_OK);
+    assert(slotmap_updated_events == events);
+
+    /* Slots are moved to the second node, the third node is replaced by a
+     * fourth and the first node gets a replica. */
+    nodes = create_slots_nodes(cc, c,
+                               "[[0, 4095, ['127.0.0.1', 30001, 'nodeid1'], ['127.0.0.1', 30011, 'nodeid11']],"
+                               " [4096, 12287, ['127.0.0.1', 30002, 'nodeid2']],"
+                               " [12288, 16383, ['127.0.0.1', 30004, 'nodeid4']]]");
+    assert(updateTopology(cc, nodes, 1) == VALKEY_OK);
+    assert(slotmap_updated_events == events + 1);
+    assert(cc->table == table);
+    assert(dictSize(cc->nodes) == 3);
+    assert(cc->table[0] == node1 && cc->table[4095] == node1);
+    assert(cc->table[4096] == node2 && cc->table[12287] == node2);
+    assert(strcmp(cc->table[12288]->addr, "127.0.0.1:30004") == 0);
+    sds removed = sdsnew("127.0.0.1:30003");
+    assert(dictFind(cc->nodes, removed) == NULL);
+    sdsfree(removed);
+    assert(listLength(node1->slots) == 1 && listLength(node2->slots) == 1);
+    cluster_slot *slot = listNodeValue(listFirst(node1->slots));
+    assert(slot->node == node1 && slot->end == 4095);
+    assert(listLength(node1->replicas) == 1);
+
+    valkeyFree(c);
+    valkeyClusterFree(cc);
+    slotmap_updated_events = 0;
+}
+
+static void countSlotmapEvents(const valkeyClusterContext *cc, int event,
+                               void *privdata) {
+    (void)cc;
+    (void)privdata;
+    if (event == VALKEYCLUSTER_EVENT_SLOTMAP_UPDATED)
+        slotmap_updated_events++;
+}
+
+/* A slotmap fetched by one context is used by another context sharing it. */
+void test_shared_slotmap(void) {
+    valkeyClusterSharedSlotmap *ssm = valkeyClusterSharedSlotmapCreate();
+    assert(ssm);
+    valkeyClusterOptions options = {0};
+    options.options |= VALKEY_OPT_USE_REPLICAS;
+    options.shared_slotmap = ssm;
+    options.event_callback = countSlotmapEvents;
+    valkeyClusterContext *cc1 = createClusterContext(&options);
+    valkeyClusterContext *cc2 = createClusterContext(&options);
+    valkeyContext *c = valkeyContextInit();
+
+    /* Nothing published yet. */
+    assert(clusterAdoptSharedSlotmap(cc2) == 0);
+
+    valkeyReply *reply = create_cluster_slots_reply(
+        "[[0, 8191, ['127.0.0.1', 30001, 'nodeid1'], ['127.0.0.1', 30003, 'nodeid3']],"
+        " [8192, 16383, ['127.0.0.1', 30002, 'nodeid2']]]");
+    dict *nodes = parse_cluster_slots(cc1, c, reply);
+    freeReplyObject(reply);
+    assert(updateNodesAndSlotmap(cc1, nodes) == VALKEY_OK);
+    assert(slotmap_updated_events == 1);
+
+    /* The second context uses the published slotmap, with its own nodes. */
+    assert(valkeyClusterUpdateSlotmap(cc2) == VALKEY_OK);
+    assert(slotmap_updated_events == 2);
+    assert(dictSize(cc2->nodes) == 2);
+    assert(cc2->table[0] != cc1->table[0]);
+    assert(strcmp(cc2->table[0]->addr, "127.0.0.1:30001") == 0);
+    assert(strcmp(cc2->table[16383]->addr, "127.0.0.1:30002") == 0);
+    assert(listLength(cc2->table[0]->replicas) == 1);
+    assert(clusterAdoptSharedSlotmap(cc2) == 0); /* Already seen. */
+    assert(clusterAdoptSharedSlotmap(cc1) == 0); /* Published by itself. */
+
+    /* An update of the second context is used by the first. */
+    reply = create_cluster_slots_reply(
+        "[[0, 16383, ['127.0.0.1', 30002, 'nodeid2']]]");
+    nodes = parse_cluster_slots(cc2, c, reply);
+    freeReplyObject(reply);
+    assert(updateNodesAndSlotmap(cc2, nodes) == VALKEY_OK);
+    assert(clusterAdoptSharedSlotmap(cc1) == 1);
+    assert(dictSize(cc1->nodes) == 1);
+    assert(strcmp(cc1->table[0]->addr, "127.0.0.1:30002") == 0);
+    assert(slotmap_updated_events == 4);
+
+    valkeyFree(c);
+    valkeyClusterFree(cc1);
+    valkeyClusterFree(cc2);
+    valkeyClusterSharedSlotmapFree(ssm);
+}
+
+#if defined(VALKEY_USE_THREADS) && !defined(_WIN32)
+#define SHARED_SLOTMAP_ROUNDS 500
+
+typedef struct shared_slotmap_thread {
+    valkeyClusterContext *cc;
+    volatile int done;
+    int adopted;
+} shared_slotmap_thread;
+
+/* Publish slotmaps alternating between two topologies. */
+static void *publishSlotmaps(void *arg) {
+    shared_slotmap_thread *t = arg;
+    valkeyContext *c = valkeyContextInit();
+
+    for (int i = 0; i < SHARED_SLOTMAP_ROUNDS; i++) {
+        dict *nodes = create_slots_nodes(
+            t->cc, c, i % 2 ? "[[0, 16383, ['127.0.0.1', 30001, 'nodeid1']]]"
+                            : "[[0, 8191, ['127.0.0.1', 30001, 'nodeid1']],"
+                              " [8192, 16383, ['127.0.0.1', 30002, 'nodeid2']]]");
+        assert(updateNodesAndSlotmap(t->cc, nodes) == VALKEY_OK);
+    }
+    valkeyFree(c);
+    __atomic_store_n(&t->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Adopt published slotmaps until the publisher is done. */
+static void *adoptSlotmaps(void *arg) {
+    shared_slotmap_thread *t = arg;
+    int done;
+
+    do {
+        done = __atomic_load_n(&t->done, __ATOMIC_ACQUIRE);
+        if (clusterAdoptSharedSlotmap(t->cc)) {
+            t->adopted++;
+            assert(strcmp(t->cc->table[0]->addr, "127.0.0.1:30001") == 0);
+            assert(t->cc->table[16383] != NULL);
+        }
+    } while (!done);
+    return NULL;
+}
+
+/* Slotmaps are published and adopted concurrently by two threads. */
+void test_shared_slotmap_threads(void) {
+    valkeyClusterSharedSlotmap *ssm = valkeyClusterSharedSlotmapCreate();
+    assert(ssm);
+    valkeyClusterOptions options = {0};
+    options.shared_slotmap = ssm;
+    shared_slotmap_thread publisher = {0};
+    shared_slotmap_thread adopter = {0};
+    publisher.cc = createClusterContext(&options);
+    adopter.cc = createClusterContext(&options);
+    pthread_t threads[2];
+
+    assert(pthread_create(&threads[0], NULL, adoptSlotmaps, &adopter) == 0);
+    assert(pthread_create(&threads[1], NULL, publishSlotmaps, &publisher) == 0);
+    assert(pthread_join(threads[1], NULL) == 0);
+    __atomic_store_n(&adopter.done, 1, __ATOMIC_RELEASE);
+    assert(pthread_join(threads[0], NULL) == 0);
+
+    /* The last slotmap is adopted, if not already. */
+    clusterAdoptSharedSlotmap(adopter.cc);
+    assert(adopter.cc->shared_version == publisher.cc->shared_version);
+    assert(strcmp(adopter.cc->table[16383]->addr, "127.0.0.1:30001") == 0);
+
+    valkeyClusterFree(publisher.cc);
+    valkeyClusterFree(adopter.cc);
+    valkeyClusterSharedSlotmapFree(ssm);
+}
+#endif
+
+void test_slotmap_file(void) {
+    const char *path = "ut_slotmap_update.slotmap";
+    valkeyClusterOptions options = {0};
+    options.options |= VALKEY_OPT_USE_REPLICAS;
+    options.slotmap_file = path;
+    valkeyClusterContext *cc1 = createClusterContext(&options);
+    valkeyClusterContext *cc2 = createClusterContext(&options);
+    valkeyContext *c = valkeyContextInit();
+    FILE *fp;
+
+    remove(path);
+    assert(clusterLoadSlotmapFile(cc2) == VALKEY_ERR); /* No file. */
+
+    /* A fetched slotmap is saved. */
+    valkeyReply *reply = create_cluster_slots_reply(
+        "[[0, 5000, ['127.0.0.1', 30001, 'nodeid1'], ['127.0.0.1', 30003, 'nodeid3']],"
+        " [5001, 8191, ['127.0.0.1', 30001, 'nodeid1']],"
+        " [8192, 16383, ['::1', 30002, 'nodeid2']]]");
+    dict *nodes = parse_cluster_slots(cc1, c, reply);
+    freeReplyObject(reply);
+    assert(updateNodesAndSlotmap(cc1, nodes) == VALKEY_OK);
+
+    /* The saved slotmap is used by another context. */
+    assert(clusterLoadSlotmapFile(cc2) == VALKEY_OK);
+    assert(cc2->route_version == 1);
+    assert(dictSize(cc2->nodes) == 2);
+    for (int slot = 0; slot < VALKEYCLUSTER_SLOTS; slot++)
+        assert(strcmp(cc2->table[slot]->addr, cc1->table[slot]->addr) == 0);
+    valkeyClusterNode *node = cc2->table[0];
+    assert(sdsEqual(node->name, cc1->table[0]->name));
+    assert(strcmp(node->host, "127.0.0.1") == 0);
+    assert(node->port == 30001);
+    assert(listLength(node->slots) == 2);
+    assert(listLength(node->replicas) == 1);
+    valkeyClusterNode *replica = listNodeValue(listFirst(node->replicas));
+    assert(strcmp(replica->addr, "127.0.0.1:30003") == 0);
+    assert(replica->role == VALKEY_ROLE_REPLICA);
+    assert(strcmp(cc2->table[16383]->addr, "::1:30002") == 0);
+
+    /* A corrupt file is not used. */
+    fp = fopen(path, "r+b");
+    assert(fp);
+    assert(fseek(fp, -1, SEEK_END) == 0);
+    assert(fputc(0xff, fp) != EOF);
+    fclose(fp);
+    assert(clusterLoadSlotmapFile(cc2) == VALKEY_ERR);
+    assert(cc2->err == 0);
+    assert(cc2->route_version == 1);
+
+    remove(path);
+    valkeyFree(c);
+    valkeyClusterFree(cc1);
+    valkeyClusterFree(cc2);
+}
+
+void test_node_stats(void) {
+    valkeyClusterOptions options = {0};
+    valkeyClusterContext *cc = createClusterContext(&options);
+    valkeyContext *c = valkeyContextInit();
+    valkeyClusterNodeStats stats;
+
+    /* Histogram buckets are contiguous and increasing. */
+    for (uint64_t v = 0; v < 100000; v++) {
+        unsigned int i = latencyBucket(v);
+        assert(v <= latencyBucketMax(i));
+        assert(i == 0 || v > latencyBucketMax(i - 1));
+    }
+    assert(latencyBucket(UINT64_MAX) == VALKEY_NODE_STATS_BUCKETS - 1);
+
+    valkeyReply *reply = create_cluster_slots_reply(
+        "[[0, 8191, ['127.0.0.1', 30001, 'nodeid1']],"
+        " [8192, 16383, ['127.0.0.1', 30002, 'nodeid2']]]");
+    dict *nodes = parse_cluster_slots(cc, c, reply);
+    assert(updateNodesAndSlotmap(cc, nodes) == VALKEY_OK);
+    valkeyClusterNode *node = cc->table[0];
+
+    valkeyClusterNodeGetStats(node, &stats);
+    assert(stats.replies == 0 && stats.errors == 0);
+    assert(valkeyClusterNodeStatsPercentile(&stats, 50) == 0);
+
+    valkeyReply *ok = createClusterReply(VALKEY_REPLY_STATUS);
+    valkeyReply *moved = createClusterErrorReply("MOVED 1 127.0.0.1:30002");
+    valkeyReply *err = createClusterErrorReply("ERR wrong");
+    for (int i = 1; i <= 100; i++)
+        clusterNodeRecordReply(node, ok, i * 100);
+    clusterNodeRecordReply(node, moved, 50);
+    clusterNodeRecordReply(node, err, 50);
+    clusterNodeRecordReply(node, NULL, 0);
+
+    valkeyClusterNodeGetStats(node, &stats);
+    assert(stats.replies == 102);
+    assert(stats.redirects == 1);
+    assert(stats.errors == 2);
+    assert(stats.latency_max_usec == 10000);
+    assert(stats.latency_sum_usec == 505100);
+    /* Within the bucket precision of 12.5%. */
+    uint64_t p50 = valkeyClusterNodeStatsPercentile(&stats, 50);
+    assert(p50 >= 5000 && p50 <= 5000 * 9 / 8);
+    assert(valkeyClusterNodeStatsPercentile(&stats, 100) == 10000);
+    assert(valkeyClusterNodeStatsPercentile(&stats, 0) <= 50 * 9 / 8);
+
+    /* The statistics follow the node to a new slotmap. */
+    nodes = parse_cluster_slots(cc, c, reply);
+    assert(updateNodesAndSlotmap(cc, nodes) == VALKEY_OK);
+    assert(cc->table[0] != node);
+    node = cc->table[0];
+    valkeyClusterNodeGetStats(node, &stats);
+    assert(stats.replies == 102);
+
+    node->stats->in_flight = 3;
+    valkeyClusterNodeResetStats(node);
+    valkeyClusterNodeGetStats(node, &stats);
+    assert(stats.replies == 0 && stats.latency_max_usec == 0);
+    assert(stats.in_flight == 3);
+
+    freeReplyObject(ok);
+    freeReplyObject(moved);
+    freeReplyObject(err);
+    freeReplyObject(reply);
+    valkeyFree(c);
+    valkeyClusterFree(cc);
+}
+
+int main(int argc, char **argv) {
     test_parse_cluster_nodes(false /* replicas not parsed */);
     test_parse_cluster_nodes(true /* replicas parsed */);
     test_parse_cluster_nodes_during_failover();
@@ -883,6 +1356,7 @@ int main(void) {
     test_parse_cluster_nodes_with_parse_error();
     test_parse_cluster_nodes_with_legacy_format();
     test_parse_cluster_nodes_with_resp3();
+    test_parse_cluster_nodes_with_large_topology();
 
     test_parse_cluster_slots(false /* replicas not parsed */);
     test_parse_cluster_slots(true /* replicas parsed */);
@@ -891,5 +1365,18 @@ int main(void) {
     test_parse_cluster_slots_with_multiple_replicas();
     test_parse_cluster_slots_with_invalid_slot_range();
     test_parse_cluster_slots_with_noncontiguous_slots();
+
+    test_apply_moved_redirect(false /* full updates */);
+    test_apply_moved_redirect(true /* incremental updates */);
+    test_topology_diff();
+    test_shared_slotmap();
+#if defined(VALKEY_USE_THREADS) && !defined(_WIN32)
+    test_shared_slotmap_threads();
+#endif
+    test_slotmap_file();
+    test_node_stats();
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        bench_parse_cluster_nodes();
     return 0;
 }